@@ -19,21 +19,22 @@ struct ANIMATED_VERTEX {
     float boneWeights[4];
 };
 
+// Animated meshes are uploaded as PACKED_ANIMATED_VERTEX, see VertexCompression.h
 class AnimatedVertexLayoutCache {
 public:
     static const D3D12_INPUT_LAYOUT_DESC& getAnimatedLayout() {
         static const D3D12_INPUT_ELEMENT_DESC inputLayoutAnimated[] = {
-            { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
+            { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT,
             D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
+            { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT,
             D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            { "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
+            { "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT,
             D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
+            { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
             D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            { "BONEIDS", 0, DXGI_FORMAT_R32G32B32A32_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
+            { "BONEIDS", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
             D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            { "BONEWEIGHTS", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
+            { "BONEWEIGHTS", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT,
             D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
         };
         static const D3D12_INPUT_LAYOUT_DESC desc = { inputLayoutAnimated, 6 };
@@ -43,72 +44,49 @@ public:
 
 class AnimatedMesh {
 public:
-    ID3D12Resource* vertexBuffer;
-    ID3D12Resource* indexBuffer;
+    GpuBuffer vertexBuffer;
+    GpuBuffer indexBuffer;
     D3D12_VERTEX_BUFFER_VIEW vbView;
     D3D12_INDEX_BUFFER_VIEW ibView;
     D3D12_INPUT_LAYOUT_DESC inputLayoutDesc;
+    VertexDecode decode; // the box the packed positions are in
     unsigned int numMeshIndices;
+    unsigned long long sizeInBytes = 0;
 
     AnimatedMesh() {}
 
     void init(Core* core, void* vertices, int vertexSizeInBytes, int numVertices, unsigned int* indices, int numIndices) {
-        D3D12_HEAP_PROPERTIES heapprops = {};
-        heapprops.Type = D3D12_HEAP_TYPE_DEFAULT;
-        heapprops.CreationNodeMask = 1;
-        heapprops.VisibleNodeMask = 1;
-
-        D3D12_RESOURCE_DESC vbDesc = {};
-        vbDesc.Width = numVertices * vertexSizeInBytes;
-        vbDesc.Height = 1;
-        vbDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-        vbDesc.DepthOrArraySize = 1;
-        vbDesc.MipLevels = 1;
-        vbDesc.SampleDesc.Count = 1;
-        vbDesc.SampleDesc.Quality = 0;
-        vbDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-        core->device->CreateCommittedResource(&heapprops, D3D12_HEAP_FLAG_NONE, &vbDesc,
-            D3D12_RESOURCE_STATE_COMMON, NULL, IID_PPV_ARGS(&vertexBuffer));
-
-        core->uploadResource(vertexBuffer, vertices, numVertices * vertexSizeInBytes, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-
-        vbView.BufferLocation = vertexBuffer->GetGPUVirtualAddress(); // point where the buffer is located in GPU memory
+        sizeInBytes = ((unsigned long long)numVertices * vertexSizeInBytes) + (numIndices * sizeof(unsigned int));
+        if (!GpuMemory::createBuffer(core, vertices, (unsigned long long)numVertices * vertexSizeInBytes, vertexBuffer)) {
+            return;
+        }
+        vbView.BufferLocation = vertexBuffer.gpuAddress(); // point where the vertices are located in GPU memory
         vbView.StrideInBytes = vertexSizeInBytes; // size of each vertex. Everytime we step forward in the buffer, we move by this size
         vbView.SizeInBytes = numVertices * vertexSizeInBytes;
 
-        D3D12_RESOURCE_DESC ibDesc;
-        memset(&ibDesc, 0, sizeof(D3D12_RESOURCE_DESC));
-        ibDesc.Width = numIndices * sizeof(unsigned int);
-        ibDesc.Height = 1;
-        ibDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-        ibDesc.DepthOrArraySize = 1;
-        ibDesc.MipLevels = 1;
-        ibDesc.SampleDesc.Count = 1;
-        ibDesc.SampleDesc.Quality = 0;
-        ibDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-        HRESULT hr;
-        hr = core->device->CreateCommittedResource(&heapprops, D3D12_HEAP_FLAG_NONE, &ibDesc,
-            D3D12_RESOURCE_STATE_COMMON, NULL, IID_PPV_ARGS(&indexBuffer));
-        if (FAILED(hr)) {
-            MessageBoxA(NULL, "Failed to create index buffer", "Index Buffer Error", MB_OK | MB_ICONERROR);
+        if (!GpuMemory::createBuffer(core, indices, numIndices * sizeof(unsigned int), indexBuffer)) {
             return;
         }
-        core->uploadResource(indexBuffer, indices, numIndices * sizeof(unsigned int),
-            D3D12_RESOURCE_STATE_INDEX_BUFFER);
-
-        ibView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
+        ibView.BufferLocation = indexBuffer.gpuAddress();
         ibView.Format = DXGI_FORMAT_R32_UINT;
         ibView.SizeInBytes = numIndices * sizeof(unsigned int);
         numMeshIndices = numIndices;
-
     }
 
     void init(Core* core, std::vector<ANIMATED_VERTEX> vertices, std::vector<unsigned int> indices) {
-        init(core, &vertices[0], sizeof(ANIMATED_VERTEX), vertices.size(), &indices[0], indices.size());
+        std::vector<PACKED_ANIMATED_VERTEX> packed;
+        packAnimatedVertices(vertices, decode, packed);
+        init(core, packed.data(), sizeof(PACKED_ANIMATED_VERTEX), packed.size(), &indices[0], indices.size());
         inputLayoutDesc = AnimatedVertexLayoutCache::getAnimatedLayout();
     }
 
+    void release() {
+        GpuMemory::freeBuffer(vertexBuffer);
+        GpuMemory::freeBuffer(indexBuffer);
+    }
+
     void draw(Core* core) {
+        core->getCommandList()->SetGraphicsRoot32BitConstants(ROOT_MESH_DECODE, MESH_DECODE_COUNT, &decode, 0);
         core->getCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
         core->getCommandList()->IASetVertexBuffers(0, 1, &vbView);
         core->getCommandList()->IASetIndexBuffer(&ibView);
@@ -6,6 +6,16 @@
 #include "PSOManager.h"
 #include "Texture.h"
 
+// Sockets every model gets when its skeleton has the bone, by socket and bone name. The animals
+// and the duck share their rig's names
+#define SOCKET_HEAD "head"
+#define SOCKET_PELVIS "pelvis"
+
+const char* defaultSockets[][2] = {
+    { SOCKET_HEAD, "Head_M" },
+    { SOCKET_PELVIS, "Pelvis" },
+};
+
 class AnimatedModel {
 public:
     std::vector<AnimatedMesh*> meshes;
@@ -36,9 +46,7 @@ public:
             textureFilenames.push_back(texFilename);
 
             // Load the texture. Use the texture manager to avoid loading duplicates
-            Texture* texture = new Texture();
-            texture->load(core, texFilename);
-            textures.push_back(texture);
+            textures.push_back(TextureManager::acquire(core, texFilename));
 
             mesh->init(core, vertices, gemmeshes[i].indices);
             meshes.push_back(mesh);
@@ -54,6 +62,10 @@ public:
             bone.parentIndex = gemanimation.bones[i].parentIndex;
             animation.skeleton.bones.push_back(bone);
         }
+        animation.skeleton.findBindPoses();
+        for (const auto& socket : defaultSockets) {
+            animation.addSocket(socket[0], socket[1]);
+        }
 
         std::string allAnimationNames;
 
@@ -83,10 +95,34 @@ public:
         //MessageBoxA(NULL, allAnimationNames.c_str(), "Loaded Animations", MB_OK);
     }
 
+    unsigned long long sizeInBytes() {
+        unsigned long long size = 0;
+        for (AnimatedMesh* mesh : meshes) {
+            size += mesh->sizeInBytes;
+        }
+        for (Texture* texture : textures) {
+            size += texture->sizeInBytes;
+        }
+        return size;
+    }
+
+    void release() {
+        for (AnimatedMesh* mesh : meshes) {
+            mesh->release();
+            delete mesh;
+        }
+        meshes.clear();
+        for (const std::string& texFilename : textureFilenames) {
+            TextureManager::release(texFilename);
+        }
+        textureFilenames.clear();
+        textures.clear();
+    }
+
     void draw(ShaderManager* shaderManager) {
         for (int i = 0; i < meshes.size(); i++) {
             if (i < textures.size() && textures[i] != nullptr) {
-                shaderManager->updateTexturePS(core, name, textures[i]->heapOffset);
+                shaderManager->updateTexturePS(core, textures[i]->heapOffset);
             }
             meshes[i]->draw(core);
         }
@@ -7,6 +7,37 @@
 #include "Math.h"
 #include "Core.h"
 
+// How much of the view height a character covers, at or above which it animates at each rate.
+// Smaller than ANIMATION_LOD_QUARTER goes at 1/8
+#define ANIMATION_LOD_FULL 0.1f
+#define ANIMATION_LOD_HALF 0.05f
+#define ANIMATION_LOD_QUARTER 0.025f
+
+// How much of a pose to evaluate this frame
+struct AnimationLod {
+	int interval = 1; // frames per evaluation, the palette blends in between
+	int skipBones = 0; // bones with fewer than this many bones below them (finger tips, tail ends) keep their first frame pose
+	bool visible = true; // off screen only the time moves
+
+	static AnimationLod forScreenHeight(float screenHeight, bool visible) {
+		AnimationLod lod;
+		lod.visible = visible;
+		if (screenHeight >= ANIMATION_LOD_FULL) return lod;
+		if (screenHeight >= ANIMATION_LOD_HALF) {
+			lod.interval = 2;
+		}
+		else if (screenHeight >= ANIMATION_LOD_QUARTER) {
+			lod.interval = 4;
+			lod.skipBones = 1;
+		}
+		else {
+			lod.interval = 8;
+			lod.skipBones = 2;
+		}
+		return lod;
+	}
+};
+
 struct Bone {
 	std::string name;
 	Matrix offset;
@@ -16,8 +47,28 @@ struct Bone {
 struct Skeleton {
 	std::vector<Bone> bones;
 	Matrix globalInverse;
+	std::vector<int> heights; // by bone, the longest chain of bones below it, 0 for the tips
+	std::vector<Matrix> bindPoses; // by bone, the inverse of its offset: the palette times it is the bone's pose
+
+	// parents come before their children
+	void findHeights() {
+		heights.assign(bones.size(), 0);
+		for (int i = (int)bones.size() - 1; i >= 0; i--) {
+			int parent = bones[i].parentIndex;
+			if (parent > -1 && heights[i] + 1 > heights[parent]) {
+				heights[parent] = heights[i] + 1;
+			}
+		}
+	}
 
-	int findBone(std::string name) {
+	void findBindPoses() {
+		bindPoses.resize(bones.size());
+		for (int i = 0; i < (int)bones.size(); i++) {
+			bindPoses[i] = bones[i].offset.invert();
+		}
+	}
+
+	int findBone(const std::string& name) {
 		for (int i = 0; i < bones.size(); i++) {
 			if (bones[i].name == name) {
 				return i;
@@ -27,6 +78,14 @@ struct Skeleton {
 	}
 };
 
+// A named place on the skeleton props hang off (a hat on the head, an item in a hand), resolved
+// to its bone once when the model loads
+struct AnimationSocket {
+	std::string name;
+	int bone = -1;
+	Matrix local; // the bind pose of the bone times where the socket sits relative to the bone
+};
+
 struct AnimationFrame {
 	std::vector<Vec3> positions;
 	std::vector<Quaternion> rotations;
@@ -37,6 +96,14 @@ struct AnimationFrame {
 struct AnimationSequence {
 	std::vector<AnimationFrame> frames;
 	float ticksPerSecond;
+	std::vector<Matrix> firstFrameLocals; // by bone, the pose of the bones the LOD skips
+
+	void findFirstFrameLocals(int numBones) {
+		firstFrameLocals.resize(numBones);
+		for (int i = 0; i < numBones && !frames.empty(); i++) {
+			firstFrameLocals[i] = (Matrix::setTranslation(frames[0].positions[i]).mul(frames[0].rotations[i].toMatrix())).mul(Matrix::setScaling(frames[0].scales[i]));
+		}
+	}
 
 	Vec3 interpolate(Vec3 p1, Vec3 p2, float t) {
 		return ((p1 * (1.0f - t)) + (p2 * t));
@@ -86,6 +153,7 @@ class Animation {
 public:
 	std::map<std::string, AnimationSequence> animations;
 	Skeleton skeleton;
+	std::vector<AnimationSocket> sockets;
 
 	int bonesSize() {
 		return skeleton.bones.size();
@@ -99,10 +167,46 @@ public:
 		return animations[name].interpolateBoneToGlobal(matrices, baseFrame, interpolationFact, &skeleton, boneIndex);
 	}
 
+	// the bone heights and the poses the bone LOD holds, once per model
+	void prepareLod() {
+		if (skeleton.heights.size() == skeleton.bones.size()) return;
+		skeleton.findHeights();
+		for (auto& animation : animations) {
+			animation.second.findFirstFrameLocals(bonesSize());
+		}
+	}
+
+	// Returns the socket's index, what AnimationInstance::socketMatrix takes, or -1 without the bone.
+	// offset places the socket in the bone's space
+	int addSocket(const std::string& name, const std::string& boneName, const Matrix& offset = Matrix()) {
+		int bone = skeleton.findBone(boneName);
+		if (bone == -1) return -1;
+		if (skeleton.bindPoses.size() != skeleton.bones.size()) skeleton.findBindPoses();
+		AnimationSocket socket;
+		socket.name = name;
+		socket.bone = bone;
+		socket.local = skeleton.bindPoses[bone].mul(offset);
+		int index = findSocket(name);
+		if (index != -1) {
+			sockets[index] = socket;
+			return index;
+		}
+		sockets.push_back(socket);
+		return (int)sockets.size() - 1;
+	}
+
+	int findSocket(const std::string& name) const {
+		for (int i = 0; i < (int)sockets.size(); i++) {
+			if (sockets[i].name == name) return i;
+		}
+		return -1;
+	}
+
 	void calcTransforms(Matrix* matrices, Matrix coordTransform) {
+		Matrix root = coordTransform.mul(skeleton.globalInverse);
 		for (int i = 0; i < bonesSize(); i++) {
 			//matrices[i] = ((skeleton.bones[i].offset.mul(matrices[i])).mul(skeleton.globalInverse)).mul(coordTransform);
-			matrices[i] = ((coordTransform.mul(skeleton.globalInverse)).mul(matrices[i])).mul(skeleton.bones[i].offset);
+			matrices[i] = (root.mul(matrices[i])).mul(skeleton.bones[i].offset);
 		}
 	}
 
@@ -120,11 +224,16 @@ public:
 	std::string usingAnimation;
 	float t;
 	Matrix matrices[256]; // This is defined as 256 to match the maximum number in the shader
-	Matrix matricesPose[256]; // This is to store transforms needed for finding bone positions
 	Matrix coordTransform;
+	std::vector<Matrix> lodFrom; // at a reduced rate, the palette of the last evaluation
+	std::vector<Matrix> lodTo; // and of the one interval frames ahead it blends to
+	int lodInterval = 1;
+	int lodStep = 0; // frames since the last evaluation
+	bool stale = true; // matrices are not the pose at t, the next visible update evaluates at once
 
 	void init(Animation* _animation, int fromYZX) {
 		animation = _animation;
+		animation->prepareLod();
 		if (fromYZX == 1) {
 			memset(coordTransform.a, 0, 16 * sizeof(float));
 			coordTransform.a[0][0] = 1.0f;
@@ -135,30 +244,85 @@ public:
 	}
 
 	void update(std::string name, float dt) {
+		update(name, dt, AnimationLod());
+	}
+
+	// Off screen only the time moves. At a reduced rate the pose is evaluated every lod.interval
+	// frames, a step ahead, and the palette blends towards it in between
+	void update(std::string name, float dt, const AnimationLod& lod) {
 		if (name == usingAnimation) {
 			t += dt;
 		}
 		else {
 			usingAnimation = name;
 			t = 0;
+			stale = true;
 		}
 
 		if (animationFinished() == true) {
 			return;
 		}
 
+		if (!lod.visible) {
+			stale = true;
+			return;
+		}
+
+		if (lod.interval <= 1) {
+			evaluate(name, t, lod.skipBones, matrices);
+			lodInterval = 1;
+			stale = false;
+			return;
+		}
+
+		int numBones = animation->bonesSize();
+		if (stale || lod.interval != lodInterval || lodStep >= lodInterval) {
+			lodFrom.resize(numBones);
+			lodTo.resize(numBones);
+			if (stale || lod.interval != lodInterval) {
+				evaluate(name, t, lod.skipBones, lodFrom.data());
+			}
+			else {
+				std::swap(lodFrom, lodTo); // the last target is the pose now
+			}
+			evaluate(name, t + (dt * lod.interval), lod.skipBones, lodTo.data());
+			lodInterval = lod.interval;
+			lodStep = 0;
+			stale = false;
+		}
+
+		float blend = (float)lodStep / (float)lodInterval;
+		for (int i = 0; i < numBones; i++) {
+			for (int e = 0; e < 16; e++) {
+				matrices[i].m[e] = lodFrom[i].m[e] + ((lodTo[i].m[e] - lodFrom[i].m[e]) * blend);
+			}
+		}
+		lodStep++;
+	}
+
+	// The palette of name at time into out. Bones the LOD skips hang off their parent in their first frame pose
+	void evaluate(const std::string& name, float time, int skipBones, Matrix* out) {
+		AnimationSequence& sequence = animation->animations[name];
+		Skeleton& skeleton = animation->skeleton;
 		int frame = 0;
 		float interpolationFact = 0;
-		animation->calcFrame(name, t, frame, interpolationFact);
+		sequence.calcFrame(time, frame, interpolationFact);
 
 		for (int i = 0; i < animation->bonesSize(); i++) {
-			matrices[i] = animation->interpolateBoneToGlobal(name, matrices, frame, interpolationFact, i);
+			int parent = skeleton.bones[i].parentIndex;
+			if (parent > -1 && skeleton.heights[i] < skipBones) {
+				out[i] = out[parent].mul(sequence.firstFrameLocals[i]);
+			}
+			else {
+				out[i] = sequence.interpolateBoneToGlobal(out, frame, interpolationFact, &skeleton, i);
+			}
 		}
-		animation->calcTransforms(matrices, coordTransform);
+		animation->calcTransforms(out, coordTransform);
 	}
 
 	void resetAnimationTime() {
 		t = 0;
+		stale = true;
 	}
 
 	bool animationFinished() {
@@ -182,23 +346,18 @@ public:
 		return animation->animations[usingAnimation].duration();
 	}
 
-	Matrix findWorldMatrix(std::string boneName) {
-		int boneID = animation->skeleton.findBone(boneName);
-		std::vector<int> boneChain;
-		int ID = boneID;
-		while (ID != -1) {
-			boneChain.push_back(ID);
-			ID = animation->skeleton.bones[ID].parentIndex;
-		}
-
-		int frame = 0;
-		float interpolationFact = 0;
-		animation->calcFrame(usingAnimation, t, frame, interpolationFact);
-
-		for (int i = boneChain.size() - 1; i > -1; i = i - 1) {
-			matricesPose[boneChain[i]] = animation->interpolateBoneToGlobal(usingAnimation, matricesPose, frame, interpolationFact, boneChain[i]);
-		}
+	// Where a socket is in the model's space, from the palette the last update left, so what the
+	// model is drawn with. One multiply, safe to call from any thread once the updates are done
+	Matrix socketMatrix(int socket) const {
+		const AnimationSocket& s = animation->sockets[socket];
+		return matrices[s.bone].mul(s.local);
+	}
 
-		return (coordTransform.mul(matricesPose[boneID]));
+	// The pose of a bone by name, for code that looks one up now and then. Props that follow a bone
+	// every frame take a socket instead, this searches the bones by name
+	Matrix findWorldMatrix(const std::string& boneName) const {
+		int bone = animation->skeleton.findBone(boneName);
+		if (bone == -1) return Matrix();
+		return matrices[bone].mul(animation->skeleton.bindPoses[bone]);
 	}
 };
\ No newline at end of file
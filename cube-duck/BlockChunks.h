@@ -0,0 +1,365 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <string>
+#include <cfloat>
+#include <cmath>
+#include "Core.h"
+#include "Math.h"
+#include "Mesh.h"
+#include "GEMLoader.h"
+
+#define BLOCK_GRID_SIZE 2.0f // generateCubesPositions steps 1.95 inside one region and 2.0 between regions, both snap to 2.0
+#define CHUNK_SIZE 8 // a chunk is CHUNK_SIZE x 1 x CHUNK_SIZE cells, one layer tall so local heights survive the merge
+#define BLOCK_FACE_EPSILON 0.1f // triangles closer than this to a side of the model belong to that side
+#define BLOCK_COVER_EPSILON 0.25f // how much of a face a neighbour may leave uncovered (bevels, rotation offsets)
+
+enum BLOCK_FACE {
+    FACE_POS_X,
+    FACE_NEG_X,
+    FACE_POS_Y,
+    FACE_NEG_Y,
+    FACE_POS_Z,
+    FACE_NEG_Z,
+    FACE_COUNT
+};
+
+const int BlockFaceOffsets[FACE_COUNT][3] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+
+long long packBlockKey(int x, int y, int z) {
+    return ((long long)(x & 0xFFFFF) << 40) | ((long long)(y & 0xFFFFF) << 20) | (long long)(z & 0xFFFFF);
+}
+
+// The block model split into triangles, each one tagged with the sides of the cube it lies on.
+// A triangle with no side (faceMask == 0) is never culled
+class BlockMeshTemplate {
+public:
+    std::vector<STATIC_VERTEX> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<unsigned char> faceMasks; // one per triangle, bit i set = lies on BLOCK_FACE i
+    Vec3 boundsMin;
+    Vec3 boundsMax;
+
+    void load(const std::string& filename) {
+        GEMLoader::GEMModelLoader loader;
+        std::vector<GEMLoader::GEMMesh> gemmeshes;
+        loader.load(filename, gemmeshes);
+
+        boundsMin = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+        boundsMax = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (int i = 0; i < gemmeshes.size(); i++) {
+            unsigned int baseVertex = vertices.size();
+            for (int j = 0; j < gemmeshes[i].verticesStatic.size(); j++) {
+                STATIC_VERTEX v;
+                memcpy(&v, &gemmeshes[i].verticesStatic[j], sizeof(STATIC_VERTEX));
+                boundsMin = Min(boundsMin, v.pos);
+                boundsMax = Max(boundsMax, v.pos);
+                vertices.push_back(v);
+            }
+            for (int j = 0; j < gemmeshes[i].indices.size(); j++) {
+                indices.push_back(baseVertex + gemmeshes[i].indices[j]);
+            }
+        }
+
+        for (int t = 0; t < indices.size(); t += 3) {
+            Vec3 centroid = (vertices[indices[t]].pos + vertices[indices[t + 1]].pos + vertices[indices[t + 2]].pos) / 3.0f;
+            unsigned char mask = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                if (std::abs(centroid.v[axis] - boundsMax.v[axis]) < BLOCK_FACE_EPSILON) mask |= 1 << (axis * 2);
+                if (std::abs(centroid.v[axis] - boundsMin.v[axis]) < BLOCK_FACE_EPSILON) mask |= 1 << (axis * 2 + 1);
+            }
+            faceMasks.push_back(mask);
+        }
+    }
+};
+
+// Makes sure each block model is parsed only once
+class BlockTemplateCache {
+public:
+    static BlockMeshTemplate* get(const std::string& filename) {
+        static std::unordered_map<std::string, BlockMeshTemplate*> templates;
+        auto it = templates.find(filename);
+        if (it != templates.end()) {
+            return it->second;
+        }
+        BlockMeshTemplate* blockTemplate = new BlockMeshTemplate();
+        blockTemplate->load(filename);
+        templates.insert({ filename, blockTemplate });
+        return blockTemplate;
+    }
+};
+
+struct Block {
+    Matrix world;
+    int type;
+    int cell[3];
+    Vec3 boundsMin; // world space AABB of the rotated model
+    Vec3 boundsMax;
+    int facePermutation[FACE_COUNT]; // local face -> world face
+    bool loose; // not on the grid (odd rotation or cell already taken): drawn in full and never hides a neighbour
+    bool alive;
+};
+
+// Voxel view of the level blocks. Blocks are snapped to a BLOCK_GRID_SIZE grid so neighbours can be found,
+// but their geometry keeps the exact matrices from the layout generators
+class BlockWorld {
+public:
+    std::vector<Block> blocks;
+    std::unordered_map<long long, int> grid; // cell -> block index
+    std::unordered_map<long long, std::vector<int>> chunkBlocks; // chunk -> block indices
+    std::set<long long> dirtyChunks;
+    Vec3 modelMin;
+    Vec3 modelMax;
+
+    // all blocks share the same cube footprint, take it from the model
+    void init(const std::string& modelFilename) {
+        BlockMeshTemplate* blockTemplate = BlockTemplateCache::get(modelFilename);
+        modelMin = blockTemplate->boundsMin;
+        modelMax = blockTemplate->boundsMax;
+    }
+
+    // floors for negative cells too, so chunk -1 holds cells -CHUNK_SIZE..-1
+    static int chunkCoord(int cell) {
+        return (cell >= 0) ? (cell / CHUNK_SIZE) : (((cell + 1) / CHUNK_SIZE) - 1);
+    }
+
+    static long long chunkKeyForCell(const int cell[3]) {
+        return packBlockKey(chunkCoord(cell[0]), cell[1], chunkCoord(cell[2]));
+    }
+
+    void markDirtyAround(const Block& block) {
+        dirtyChunks.insert(chunkKeyForCell(block.cell));
+        for (int f = 0; f < FACE_COUNT; f++) {
+            int n[3] = { block.cell[0] + BlockFaceOffsets[f][0], block.cell[1] + BlockFaceOffsets[f][1], block.cell[2] + BlockFaceOffsets[f][2] };
+            dirtyChunks.insert(chunkKeyForCell(n));
+        }
+    }
+
+    int addBlock(const Matrix& world, int type) {
+        Block block;
+        block.world = world;
+        block.type = type;
+        block.alive = true;
+        block.loose = false;
+
+        block.cell[0] = (int)std::lround(world.m[3] / BLOCK_GRID_SIZE);
+        block.cell[1] = (int)std::lround(world.m[7] / BLOCK_GRID_SIZE);
+        block.cell[2] = (int)std::lround(world.m[11] / BLOCK_GRID_SIZE);
+
+        // where each side of the model ends up after the block rotation
+        for (int f = 0; f < FACE_COUNT; f++) {
+            float d[3] = { (float)BlockFaceOffsets[f][0], (float)BlockFaceOffsets[f][1], (float)BlockFaceOffsets[f][2] };
+            Vec3 rotated = world.mulVec(Vec3(d[0], d[1], d[2]));
+            block.facePermutation[f] = -1;
+            for (int axis = 0; axis < 3; axis++) {
+                if (rotated.v[axis] > 0.99f) block.facePermutation[f] = axis * 2;
+                if (rotated.v[axis] < -0.99f) block.facePermutation[f] = axis * 2 + 1;
+            }
+            if (block.facePermutation[f] == -1) {
+                block.loose = true;
+            }
+        }
+
+        block.boundsMin = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+        block.boundsMax = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (int i = 0; i < 8; i++) {
+            Vec3 corner((i & 1) ? modelMax.x : modelMin.x, (i & 2) ? modelMax.y : modelMin.y, (i & 4) ? modelMax.z : modelMin.z);
+            Vec3 p = world.mulVec(corner) + Vec3(world.m[3], world.m[7], world.m[11]);
+            block.boundsMin = Min(block.boundsMin, p);
+            block.boundsMax = Max(block.boundsMax, p);
+        }
+
+        int index = blocks.size();
+        long long cellKey = packBlockKey(block.cell[0], block.cell[1], block.cell[2]);
+        if (!block.loose && grid.find(cellKey) == grid.end()) {
+            grid.insert({ cellKey, index });
+        } else {
+            block.loose = true;
+        }
+
+        blocks.push_back(block);
+        chunkBlocks[chunkKeyForCell(block.cell)].push_back(index);
+        markDirtyAround(block);
+        return index;
+    }
+
+    void addBlocks(const std::vector<Matrix>& worldMatrices, int type) {
+        blocks.reserve(blocks.size() + worldMatrices.size());
+        grid.reserve(grid.size() + worldMatrices.size());
+        for (const Matrix& world : worldMatrices) {
+            addBlock(world, type);
+        }
+    }
+
+    void removeBlock(int index) {
+        Block& block = blocks[index];
+        if (!block.alive) return;
+        block.alive = false;
+
+        long long cellKey = packBlockKey(block.cell[0], block.cell[1], block.cell[2]);
+        auto it = grid.find(cellKey);
+        if (it != grid.end() && it->second == index) {
+            grid.erase(it);
+        }
+
+        std::vector<int>& inChunk = chunkBlocks[chunkKeyForCell(block.cell)];
+        inChunk.erase(std::remove(inChunk.begin(), inChunk.end(), index), inChunk.end());
+        markDirtyAround(block);
+    }
+
+    void positionsOfType(int type, std::vector<Matrix>& positions) {
+        positions.clear();
+        for (const Block& block : blocks) {
+            if (block.alive && block.type == type) {
+                positions.push_back(block.world);
+            }
+        }
+    }
+
+    // A world face is hidden only when the neighbour actually reaches it and covers it
+    bool isFaceHidden(const Block& block, int face) {
+        int n[3] = { block.cell[0] + BlockFaceOffsets[face][0], block.cell[1] + BlockFaceOffsets[face][1], block.cell[2] + BlockFaceOffsets[face][2] };
+        auto it = grid.find(packBlockKey(n[0], n[1], n[2]));
+        if (it == grid.end()) {
+            return false;
+        }
+        const Block& neighbour = blocks[it->second];
+
+        int axis = face / 2;
+        if (face % 2 == 0 && neighbour.boundsMin.v[axis] > block.boundsMax.v[axis]) return false;
+        if (face % 2 == 1 && neighbour.boundsMax.v[axis] < block.boundsMin.v[axis]) return false;
+
+        for (int other = 0; other < 3; other++) {
+            if (other == axis) continue;
+            if (neighbour.boundsMin.v[other] > block.boundsMin.v[other] + BLOCK_COVER_EPSILON) return false;
+            if (neighbour.boundsMax.v[other] < block.boundsMax.v[other] - BLOCK_COVER_EPSILON) return false;
+        }
+        return true;
+    }
+
+    // Bakes every block of one type inside a chunk into a single vertex/index list, dropping triangles on hidden sides.
+    // Vertices are relative to origin (the first block of the chunk) so LocalPos.y in the shaders is still the block height
+    void buildChunkGeometry(long long chunkKey, int type, BlockMeshTemplate* blockTemplate,
+        std::vector<STATIC_VERTEX>& vertices, std::vector<unsigned int>& indices, Vec3& origin) {
+        vertices.clear();
+        indices.clear();
+
+        auto chunkIt = chunkBlocks.find(chunkKey);
+        if (chunkIt == chunkBlocks.end()) {
+            return;
+        }
+
+        std::vector<int> remap(blockTemplate->vertices.size());
+        bool hasOrigin = false;
+        for (int blockIndex : chunkIt->second) {
+            Block& block = blocks[blockIndex];
+            if (!block.alive || block.type != type) continue;
+
+            if (!hasOrigin) {
+                origin = Vec3(block.world.m[3], block.world.m[7], block.world.m[11]);
+                hasOrigin = true;
+            }
+
+            unsigned char hiddenLocal = 0;
+            if (!block.loose) {
+                for (int f = 0; f < FACE_COUNT; f++) {
+                    if (isFaceHidden(block, block.facePermutation[f])) {
+                        hiddenLocal |= 1 << f;
+                    }
+                }
+            }
+
+            std::fill(remap.begin(), remap.end(), -1);
+            for (int t = 0; t < blockTemplate->faceMasks.size(); t++) {
+                unsigned char mask = blockTemplate->faceMasks[t];
+                if (mask != 0 && (mask & ~hiddenLocal) == 0) {
+                    continue; // every side this triangle lies on is covered
+                }
+                for (int k = 0; k < 3; k++) {
+                    unsigned int src = blockTemplate->indices[(t * 3) + k];
+                    if (remap[src] == -1) {
+                        STATIC_VERTEX v = blockTemplate->vertices[src];
+                        v.pos = block.world.mulPoint(v.pos) - origin;
+                        v.normal = block.world.mulVec(v.normal);
+                        v.tangent = block.world.mulVec(v.tangent);
+                        remap[src] = vertices.size();
+                        vertices.push_back(v);
+                    }
+                    indices.push_back(remap[src]);
+                }
+            }
+        }
+    }
+};
+
+// Draws all blocks of one type as one static mesh per chunk. Chunks are rebuilt only when a block in them
+// (or next to them) changes
+class ChunkedMesh {
+public:
+    Core* core;
+    BlockWorld* world;
+    BlockMeshTemplate* blockTemplate;
+    int blockType;
+    std::map<long long, Mesh*> chunks;
+    std::map<long long, unsigned int> chunkVertexCounts;
+
+    ChunkedMesh(Core* _core, BlockWorld* _world, int _blockType) : core(_core), world(_world), blockType(_blockType) {}
+
+    void rebuildChunk(long long chunkKey) {
+        std::vector<STATIC_VERTEX> vertices;
+        std::vector<unsigned int> indices;
+        Vec3 origin;
+        world->buildChunkGeometry(chunkKey, blockType, blockTemplate, vertices, indices, origin);
+
+        Mesh* mesh = nullptr;
+        if (indices.size() > 0) {
+            std::vector<Matrix> instance = { Matrix::setTranslation(origin) };
+            mesh = new Mesh();
+            mesh->initFromVec(core, vertices, indices, instance); // the upload waits for the queue, the old chunk is idle after this
+        }
+
+        auto it = chunks.find(chunkKey);
+        if (it != chunks.end()) {
+            it->second->release();
+            delete it->second;
+            chunks.erase(it);
+            chunkVertexCounts.erase(chunkKey);
+        }
+        if (mesh != nullptr) {
+            chunks.insert({ chunkKey, mesh });
+            chunkVertexCounts.insert({ chunkKey, (unsigned int)vertices.size() });
+        }
+    }
+
+    void load(const std::string& filename) {
+        blockTemplate = BlockTemplateCache::get(filename);
+        for (const auto& chunk : world->chunkBlocks) {
+            rebuildChunk(chunk.first);
+        }
+    }
+
+    // must run outside of frame recording: a chunk the frame already drew would be released under it
+    void rebuildDirty(const std::set<long long>& dirtyChunks) {
+        for (long long chunkKey : dirtyChunks) {
+            rebuildChunk(chunkKey);
+        }
+    }
+
+    unsigned int vertexCount() {
+        unsigned int total = 0;
+        for (const auto& count : chunkVertexCounts) {
+            total += count.second;
+        }
+        return total;
+    }
+
+    void draw() {
+        for (const auto& chunk : chunks) {
+            chunk.second->draw(core);
+        }
+    }
+};
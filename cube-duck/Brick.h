@@ -10,6 +10,8 @@
 #include "Texture.h"
 #include "Light.h"
 
+#define BRICKS_TEXTURE "models/textures/ColorPalette2.png"
+
 struct BrickVertexShaderCB {
     Matrix W;
     Matrix VP;
@@ -33,7 +35,7 @@ public:
 
         // load texture
         texture = new Texture();
-        texture->load(core, "models/textures/ColorPalette2.png");
+        texture->load(core, BRICKS_TEXTURE);
 
         // Build geometry
         staticMesh.load(filename, worldPositions);
@@ -77,7 +79,7 @@ public:
 
         updateConstantsVertexShader(core);
         updateConstantsPixelShader(core);
-        shaderManager->updateTexturePS(core, "Brick", texture->heapOffset);
+        shaderManager->updateTexturePS(core, texture->heapOffset);
         
         // 4. Draw
         staticMesh.draw();
@@ -85,7 +87,7 @@ public:
 
     static Brick* createBrick(ShaderManager* sm, Core* core, std::vector<Matrix> worldPositions, BRDFLightCB *light) {
 Brick* brick = new Brick(sm, core, "models/brick_2.gem");
-        brick->init(core, worldPositions, light);
+        brick->init(core, std::move(worldPositions), light);
         return brick;
     }
 };
\ No newline at end of file
@@ -115,4 +115,28 @@ class Camera {
         Vec3 right = (forward.cross(up)).normalize();
         return right;
     }
+
+    // whether a sphere is at least partly inside the view
+    bool isSphereVisible(const Vec3& center, float radius) {
+        Vec3 forward = getForwardVector();
+        Vec3 right = getRightVector();
+        Vec3 cameraUp = right.cross(forward);
+        Vec3 offset = center - from;
+        float z = offset.dot(forward);
+        if (z < ZNEAR - radius || z > ZFAR + radius) return false;
+
+        float tanY = tanf(FOV * 0.5f * 0.01745329251f);
+        float tanX = tanY * ((float)WINDOW_WIDTH / (float)WINDOW_HEIGHT);
+        // the sides lean out by the half angles, a sphere is outside one when it is more than radius past it
+        if (fabsf(offset.dot(right)) - (z * tanX) > radius * sqrtf(1.0f + (tanX * tanX))) return false;
+        if (fabsf(offset.dot(cameraUp)) - (z * tanY) > radius * sqrtf(1.0f + (tanY * tanY))) return false;
+        return true;
+    }
+
+    // how much of the view height a sphere covers, about
+    float screenHeight(const Vec3& center, float radius) {
+        float distanceToCenter = (center - from).length();
+        if (distanceToCenter <= radius) return 1.0f;
+        return radius / (distanceToCenter * tanf(FOV * 0.5f * 0.01745329251f));
+    }
 };
\ No newline at end of file
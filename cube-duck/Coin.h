@@ -1,4 +1,6 @@
 #pragma once
+#include <bit>
+#include <vector>
 
 #include "Core.h"
 #include "Math.h"
@@ -16,6 +18,7 @@
 
 #define COIN_TEXTURE "models/textures/Coin2_BaseColor.png"
 #define COIN_SIZE Vec3(1.5, 1.5, 1.5)
+#define COIN_ID_CHUNK_SHIFT 20 // coin ids are the chunk index above the coin's index in the chunk
 
 struct CoinVertexShaderCB {
     Matrix W;
@@ -51,8 +54,7 @@ public:
 
         // Load texture
         textureName = textureFilename;
-        texture = new Texture();
-        texture->load(core, textureName);
+        texture = TextureManager::acquire(core, textureName);
 
         Shader* vShader = shaderManager->getVertexShader(COIN_VERTEX_SHADER, vertexShaderCB);
         Shader* pShader = shaderManager->getPixelShader(COIN_PIXEL_SHADER, lightCB);
@@ -96,15 +98,115 @@ public:
         // 2. Update constant buffer values
         updateConstantsVertexShader(core);
         updateConstantsPixelShader(core);
-        shaderManager->updateTexturePS(core, textureName, texture->heapOffset);
+        shaderManager->updateTexturePS(core, texture->heapOffset);
 
         // 4. Draw
         staticMesh.draw();
     }
 
+    unsigned long long sizeInBytes() {
+        return staticMesh.sizeInBytes() + texture->sizeInBytes;
+    }
+
+    void release() {
+        releaseGeometry();
+        TextureManager::release(textureName);
+    }
+
     static Coin* createCoins(ShaderManager* sm, Core* core, std::vector<Matrix> worldPositions, BRDFLightCB *light) {
         Coin* coins = new Coin(sm, core);
         coins->init(core, worldPositions, light, COIN_TEXTURE);
         return coins;
     }
-};
\ No newline at end of file
+};
+
+// Every loaded coin of the level in one set: one mesh, one texture, one pipeline and a single
+// instanced draw. Which coins are still there is a bit per coin, the instance buffer holds the
+// visible ones and is rewritten from the bits between frames when they changed
+class CoinPickups {
+public:
+    Coin* coin = nullptr;
+    std::vector<Matrix> positions;
+    std::vector<long long> ids;
+    std::vector<uint64_t> visible; // bit i set while coin i has not been collected
+    std::vector<Matrix> instances; // the visible positions, what the instance buffer holds
+    bool dirty = false;
+
+    void init(ShaderManager* sm, Core* core, BRDFLightCB* light) {
+        coin = Coin::createCoins(sm, core, {}, light);
+    }
+
+    int size() const {
+        return (int)positions.size();
+    }
+
+    bool isVisible(int i) const {
+        return (visible[i >> 6] >> (i & 63)) & 1;
+    }
+
+    void setVisible(int i, bool isVisible) {
+        if (isVisible) visible[i >> 6] |= 1ull << (i & 63);
+        else visible[i >> 6] &= ~(1ull << (i & 63));
+        dirty = true;
+    }
+
+    // next visible coin from i on, -1 when there is none. Skips 64 collected coins at a time
+    int nextVisible(int i) const {
+        if (i >= size()) return -1;
+        int word = i >> 6;
+        uint64_t bits = visible[word] & (~0ull << (i & 63));
+        while (bits == 0) {
+            if (++word >= (int)visible.size()) return -1;
+            bits = visible[word];
+        }
+        int next = (word << 6) + std::countr_zero(bits);
+        return next < size() ? next : -1;
+    }
+
+    int visibleCount() const {
+        int count = 0;
+        for (uint64_t bits : visible) count += std::popcount(bits);
+        return count;
+    }
+
+    void add(long long id, const Matrix& position, bool isVisible) {
+        positions.push_back(position);
+        ids.push_back(id);
+        if (visible.size() * 64 < positions.size()) visible.push_back(0);
+        setVisible(size() - 1, isVisible);
+    }
+
+    // drops the coins of a chunk that streamed out, the rest keep their order
+    void removeChunk(int chunkIndex) {
+        int kept = 0;
+        for (int i = 0; i < size(); i++) {
+            if ((ids[i] >> COIN_ID_CHUNK_SHIFT) == chunkIndex) continue;
+            bool wasVisible = isVisible(i);
+            positions[kept] = positions[i];
+            ids[kept] = ids[i];
+            setVisible(kept, wasVisible);
+            kept++;
+        }
+        positions.resize(kept);
+        ids.resize(kept);
+        visible.resize((kept + 63) / 64);
+        if (kept & 63) visible.back() &= (1ull << (kept & 63)) - 1;
+        dirty = true;
+    }
+
+    void showAll() {
+        for (int i = 0; i < size(); i++) setVisible(i, true);
+    }
+
+    // The instances go into a new mapped buffer, nothing waits for the GPU
+    void upload(Core* core) {
+        if (!dirty || coin == nullptr) return;
+        instances.clear();
+        for (int i = nextVisible(0); i != -1; i = nextVisible(i + 1)) {
+            instances.push_back(positions[i]);
+        }
+        coin->staticMesh.updateInstances(instances);
+        coin->worldPositions = instances;
+        dirty = false;
+    }
+};
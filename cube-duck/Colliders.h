@@ -0,0 +1,156 @@
+#pragma once
+#include <vector>
+#include <math.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define COLLIDERS_AVX // 8 boxes per instruction, when the build targets AVX
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define COLLIDERS_SSE // two steps of 4 boxes
+#endif
+
+#define COLLIDERS_BATCH 8
+#define COLLIDERS_FAR 1e30f // padding boxes sit here and never overlap anything
+
+// Static boxes for the player's narrow phase, as packed arrays of centers and half extents
+// rather than world matrices, so a test reads 24 bytes per box and 8 boxes go through at once.
+// The arrays are padded to a multiple of COLLIDERS_BATCH with boxes far away
+struct StaticColliders {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> halfX, halfY, halfZ;
+    int count = 0;
+
+    void clear() {
+        centerX.clear();
+        centerY.clear();
+        centerZ.clear();
+        halfX.clear();
+        halfY.clear();
+        halfZ.clear();
+        count = 0;
+    }
+
+    // size is the full extent of the box, as GEMObject::size
+    void add(float x, float y, float z, float sizeX, float sizeY, float sizeZ) {
+        // drops the padding of an earlier pad()
+        centerX.resize(count);
+        centerY.resize(count);
+        centerZ.resize(count);
+        halfX.resize(count);
+        halfY.resize(count);
+        halfZ.resize(count);
+        centerX.push_back(x);
+        centerY.push_back(y);
+        centerZ.push_back(z);
+        halfX.push_back(sizeX / 2);
+        halfY.push_back(sizeY / 2);
+        halfZ.push_back(sizeZ / 2);
+        count++;
+    }
+
+    // call once the boxes are added, before testing
+    void pad() {
+        size_t padded = ((count + COLLIDERS_BATCH - 1) / COLLIDERS_BATCH) * COLLIDERS_BATCH;
+        centerX.resize(padded, COLLIDERS_FAR);
+        centerY.resize(padded, COLLIDERS_FAR);
+        centerZ.resize(padded, COLLIDERS_FAR);
+        halfX.resize(padded, 0.0f);
+        halfY.resize(padded, 0.0f);
+        halfZ.resize(padded, 0.0f);
+    }
+
+    int batches() const {
+        return (count + COLLIDERS_BATCH - 1) / COLLIDERS_BATCH;
+    }
+};
+
+// The player box moving from last to next. Each axis is tested on its own: the box moved along
+// that axis only, the other two where they were last frame
+struct ColliderQuery {
+    float lastX, lastY, lastZ;
+    float nextX, nextY, nextZ;
+    float halfX, halfY, halfZ;
+};
+
+// bit i is box first + i of the batch
+struct ColliderHits {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int z = 0;
+};
+
+// the boxes first .. first + 7, overlapping means |player - center| < player half + box half
+ColliderHits testColliderBatch(const StaticColliders& colliders, int first, const ColliderQuery& query) {
+    ColliderHits hits;
+#if defined(COLLIDERS_AVX)
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 cx = _mm256_loadu_ps(&colliders.centerX[first]);
+    __m256 cy = _mm256_loadu_ps(&colliders.centerY[first]);
+    __m256 cz = _mm256_loadu_ps(&colliders.centerZ[first]);
+    __m256 ex = _mm256_add_ps(_mm256_set1_ps(query.halfX), _mm256_loadu_ps(&colliders.halfX[first]));
+    __m256 ey = _mm256_add_ps(_mm256_set1_ps(query.halfY), _mm256_loadu_ps(&colliders.halfY[first]));
+    __m256 ez = _mm256_add_ps(_mm256_set1_ps(query.halfZ), _mm256_loadu_ps(&colliders.halfZ[first]));
+
+    __m256 lastX = _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(_mm256_set1_ps(query.lastX), cx), absMask), ex, _CMP_LT_OQ);
+    __m256 lastY = _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(_mm256_set1_ps(query.lastY), cy), absMask), ey, _CMP_LT_OQ);
+    __m256 lastZ = _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(_mm256_set1_ps(query.lastZ), cz), absMask), ez, _CMP_LT_OQ);
+    __m256 nextX = _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(_mm256_set1_ps(query.nextX), cx), absMask), ex, _CMP_LT_OQ);
+    __m256 nextY = _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(_mm256_set1_ps(query.nextY), cy), absMask), ey, _CMP_LT_OQ);
+    __m256 nextZ = _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(_mm256_set1_ps(query.nextZ), cz), absMask), ez, _CMP_LT_OQ);
+
+    hits.x = _mm256_movemask_ps(_mm256_and_ps(nextX, _mm256_and_ps(lastY, lastZ)));
+    hits.y = _mm256_movemask_ps(_mm256_and_ps(nextY, _mm256_and_ps(lastX, lastZ)));
+    hits.z = _mm256_movemask_ps(_mm256_and_ps(nextZ, _mm256_and_ps(lastX, lastY)));
+#elif defined(COLLIDERS_SSE)
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    for (int half = 0; half < 2; half++) {
+        int i = first + (half * 4);
+        __m128 cx = _mm_loadu_ps(&colliders.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&colliders.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&colliders.centerZ[i]);
+        __m128 ex = _mm_add_ps(_mm_set1_ps(query.halfX), _mm_loadu_ps(&colliders.halfX[i]));
+        __m128 ey = _mm_add_ps(_mm_set1_ps(query.halfY), _mm_loadu_ps(&colliders.halfY[i]));
+        __m128 ez = _mm_add_ps(_mm_set1_ps(query.halfZ), _mm_loadu_ps(&colliders.halfZ[i]));
+
+        __m128 lastX = _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(query.lastX), cx), absMask), ex);
+        __m128 lastY = _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(query.lastY), cy), absMask), ey);
+        __m128 lastZ = _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(query.lastZ), cz), absMask), ez);
+        __m128 nextX = _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(query.nextX), cx), absMask), ex);
+        __m128 nextY = _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(query.nextY), cy), absMask), ey);
+        __m128 nextZ = _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(query.nextZ), cz), absMask), ez);
+
+        hits.x |= _mm_movemask_ps(_mm_and_ps(nextX, _mm_and_ps(lastY, lastZ))) << (half * 4);
+        hits.y |= _mm_movemask_ps(_mm_and_ps(nextY, _mm_and_ps(lastX, lastZ))) << (half * 4);
+        hits.z |= _mm_movemask_ps(_mm_and_ps(nextZ, _mm_and_ps(lastX, lastY))) << (half * 4);
+    }
+#else
+    for (int b = 0; b < COLLIDERS_BATCH; b++) {
+        int i = first + b;
+        bool lastX = fabsf(query.lastX - colliders.centerX[i]) < (query.halfX + colliders.halfX[i]);
+        bool lastY = fabsf(query.lastY - colliders.centerY[i]) < (query.halfY + colliders.halfY[i]);
+        bool lastZ = fabsf(query.lastZ - colliders.centerZ[i]) < (query.halfZ + colliders.halfZ[i]);
+        bool nextX = fabsf(query.nextX - colliders.centerX[i]) < (query.halfX + colliders.halfX[i]);
+        bool nextY = fabsf(query.nextY - colliders.centerY[i]) < (query.halfY + colliders.halfY[i]);
+        bool nextZ = fabsf(query.nextZ - colliders.centerZ[i]) < (query.halfZ + colliders.halfZ[i]);
+        hits.x |= (unsigned int)(nextX && lastY && lastZ) << b;
+        hits.y |= (unsigned int)(nextY && lastX && lastZ) << b;
+        hits.z |= (unsigned int)(nextZ && lastX && lastY) << b;
+    }
+#endif
+    return hits;
+}
+
+// Whether any box blocks each axis. Stops early once all three are blocked
+ColliderHits testColliders(const StaticColliders& colliders, const ColliderQuery& query) {
+    ColliderHits any;
+    int batches = colliders.batches();
+    for (int b = 0; b < batches; b++) {
+        ColliderHits hits = testColliderBatch(colliders, b * COLLIDERS_BATCH, query);
+        any.x |= hits.x;
+        any.y |= hits.y;
+        any.z |= hits.z;
+        if (any.x && any.y && any.z) break;
+    }
+    return any;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include "Parallel.h"
+
+// Splitting a draw pass over several command lists. Kept free of D3D12 so the
+// partitioning and submission order can be checked with NullRecordBackend
+
+struct DrawRange {
+    int list;
+    int first;
+    int count;
+};
+
+// Splits draws [0, numDraws) into contiguous ranges of at least minDrawsPerList draws, at most
+// maxLists of them. Range i is recorded into list i and lists are submitted in list order,
+// so the GPU sees the draws in the same order as a serial recording
+std::vector<DrawRange> partitionDraws(int numDraws, int maxLists, int minDrawsPerList) {
+    std::vector<DrawRange> ranges;
+    if (numDraws <= 0) return ranges;
+
+    int numLists = numDraws / minDrawsPerList;
+    if (numLists > maxLists) numLists = maxLists;
+    if (numLists < 1) numLists = 1;
+
+    int base = numDraws / numLists;
+    int extra = numDraws % numLists; // the first lists take one more draw
+    int first = 0;
+    for (int i = 0; i < numLists; i++) {
+        int count = base + (i < extra ? 1 : 0);
+        ranges.push_back({i, first, count});
+        first += count;
+    }
+    return ranges;
+}
+
+// Records draws [0, numDraws) into up to maxLists lists across the pool, then submits them.
+// Backend needs beginList(list), draw(list, drawIndex), endList(list) and submit(numLists).
+// Each list is recorded start to end by one thread. Returns the number of lists used
+template <typename Backend>
+int recordParallel(JobPool& pool, Backend& backend, int numDraws, int maxLists, int minDrawsPerList) {
+    std::vector<DrawRange> ranges = partitionDraws(numDraws, maxLists, minDrawsPerList);
+    pool.run(ranges.size(), [&](int i) {
+        const DrawRange& range = ranges[i];
+        backend.beginList(range.list);
+        for (int d = range.first; d < range.first + range.count; d++) {
+            backend.draw(range.list, d);
+        }
+        backend.endList(range.list);
+    });
+    backend.submit(ranges.size());
+    return ranges.size();
+}
+
+// Backend that records nothing but a log: which thread recorded each list, the draws
+// in it and the order a queue would execute them in after submit
+class NullRecordBackend {
+public:
+    struct ListLog {
+        std::thread::id thread;
+        std::vector<int> draws;
+        bool open = false;
+        bool closed = false;
+    };
+
+    std::vector<ListLog> lists;
+    std::vector<int> executed;
+
+    NullRecordBackend(int maxLists) : lists(maxLists) {} // sized up front, lists are logged from several threads
+
+    void beginList(int list) {
+        lists[list].thread = std::this_thread::get_id();
+        lists[list].draws.clear();
+        lists[list].open = true;
+        lists[list].closed = false;
+    }
+
+    void draw(int list, int drawIndex) {
+        lists[list].draws.push_back(drawIndex);
+    }
+
+    void endList(int list) {
+        lists[list].open = false;
+        lists[list].closed = true;
+    }
+
+    void submit(int numLists) {
+        executed.clear();
+        for (int i = 0; i < numLists; i++) {
+            executed.insert(executed.end(), lists[i].draws.begin(), lists[i].draws.end());
+        }
+    }
+
+    // every draw executed exactly once, in the order a serial recording would have issued it
+    bool executedInOrder(int numDraws) const {
+        if ((int)executed.size() != numDraws) return false;
+        for (int i = 0; i < numDraws; i++) {
+            if (executed[i] != i) return false;
+        }
+        return true;
+    }
+};
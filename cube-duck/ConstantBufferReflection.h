@@ -2,7 +2,9 @@
 
 #include <string>
 #include <map>
+#include <atomic>
 #include "Core.h"
+#include "GpuMemory.h"
 #include "ShaderManager.h"
 
 struct ConstantBufferVariable {
@@ -15,58 +17,52 @@ public:
     std::string name;
     std::map<std::string, ConstantBufferVariable> constantBufferData;
 
-    ID3D12Resource* constantBuffer;
+    GpuBuffer constantBuffer; // part of a shared upload page
     unsigned char* buffer;
     unsigned int cbSizeInBytes;
-    unsigned int maxDrawCalls;
-    unsigned int offsetIndex;
+    unsigned int maxDrawCalls; // slots in the ring, shared by every recording thread
+    unsigned int currentSlot[RECORD_MAX_THREADS]; // the slot each recording thread writes to next
+    std::atomic<unsigned int> nextSlot;
 
+    // One ring for all threads, sized for the draws of the frames in flight as before recording
+    // went parallel. A thread takes its next slot with an atomic add, so only threads that draw
+    // with this shader use its slots
     void init(Core* core, unsigned int sizeInBytes, unsigned int _maxDrawCalls = 1024) {
         maxDrawCalls = _maxDrawCalls;
         cbSizeInBytes = (sizeInBytes + 255) & ~255;
         unsigned int cbSizeInBytesAligned = cbSizeInBytes * maxDrawCalls;
-        offsetIndex = 0;
-        HRESULT hr;
-        D3D12_HEAP_PROPERTIES heapprops = {};
-        heapprops.Type = D3D12_HEAP_TYPE_UPLOAD;
-        heapprops.CreationNodeMask = 1;
-        heapprops.VisibleNodeMask = 1;
-        D3D12_RESOURCE_DESC cbDesc = {};
-        cbDesc.Width = cbSizeInBytesAligned;
-        cbDesc.Height = 1;
-        cbDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-        cbDesc.DepthOrArraySize = 1;
-        cbDesc.MipLevels = 1;
-        cbDesc.SampleDesc.Count = 1;
-        cbDesc.SampleDesc.Quality = 0;
-        cbDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-        hr = core->device->CreateCommittedResource(&heapprops, D3D12_HEAP_FLAG_NONE, &cbDesc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL,
-            IID_PPV_ARGS(&constantBuffer));
-        if (FAILED(hr)) {
+        for (int i = 0; i < RECORD_MAX_THREADS; i++) {
+            currentSlot[i] = i;
+        }
+        nextSlot = RECORD_MAX_THREADS;
+        if (!GpuMemory::allocateBuffer(core, GPU_POOL_UPLOAD, cbSizeInBytesAligned, constantBuffer)) {
             MessageBoxA(NULL, "Failed to create constant buffer", "Constant Buffer Error", MB_OK | MB_ICONERROR);
             return;
         }
-        constantBuffer->Map(0, NULL, (void**)&buffer);
+        buffer = constantBuffer.mapped; // upload pages stay mapped
+    }
+
+    // slot the calling thread writes to next
+    unsigned int slot() const {
+        return currentSlot[recordThreadIndex];
     }
 
     D3D12_GPU_VIRTUAL_ADDRESS getGPUAddress() const {
-        return (constantBuffer->GetGPUVirtualAddress() + (offsetIndex * cbSizeInBytes));
+        return (constantBuffer.gpuAddress() + (slot() * cbSizeInBytes));
     }
 
     void update(std::string name, void* data) {
-        if (constantBufferData.find(name) == constantBufferData.end()) {
+        auto it = constantBufferData.find(name);
+        if (it == constantBufferData.end()) {
             MessageBoxA(NULL, ("Constant buffer variable not found: " + name).c_str(), "Error", MB_OK | MB_ICONERROR);
             return;
         }
-        ConstantBufferVariable cbVariable = constantBufferData[name];
-        unsigned int offset = offsetIndex * cbSizeInBytes;
+        ConstantBufferVariable cbVariable = it->second;
+        unsigned int offset = slot() * cbSizeInBytes;
         memcpy(&buffer[offset + cbVariable.offset], data, cbVariable.size);
     }
 
     void next() {
-        offsetIndex++;
-        if (offsetIndex >= maxDrawCalls) {
-            offsetIndex = 0;
-        }
+        currentSlot[recordThreadIndex] = nextSlot.fetch_add(1, std::memory_order_relaxed) % maxDrawCalls;
     }
 };
\ No newline at end of file
@@ -0,0 +1,176 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <stdint.h>
+#include "PipelineKey.h"
+
+// Textures cooked offline into the layout the GPU samples, so loading them is a file read
+// and a copy. A cooked file sits in a cache folder next to its source:
+//   models/textures/Grass.png -> models/textures/cache/Grass.ctex
+// and holds, little endian:
+//   header: magic, version, format, width, height, mip count, source size, source hash
+//   per mip: width, height, bytes per row, rows (of 4x4 blocks for BC formats)
+//   the mips' data, largest first
+// The source hash is of the image file, a changed source makes the cooked file stale
+
+#define COOKED_TEXTURE_MAGIC 0x58455443 // "CTEX"
+#define COOKED_TEXTURE_VERSION 1
+#define COOKED_TEXTURE_DIR "cache/"
+#define COOKED_TEXTURE_EXTENSION ".ctex"
+
+// DXGI_FORMAT values, the runtime hands them to D3D12 as they are
+#define COOKED_FORMAT_RGBA8 28
+#define COOKED_FORMAT_RGBA8_SRGB 29
+#define COOKED_FORMAT_BC1 71
+#define COOKED_FORMAT_BC1_SRGB 72
+#define COOKED_FORMAT_BC3 77
+#define COOKED_FORMAT_BC3_SRGB 78
+#define COOKED_FORMAT_BC5 83
+#define COOKED_FORMAT_BC7 98
+#define COOKED_FORMAT_BC7_SRGB 99
+
+enum TEXTURE_ROLE {
+    TEXTURE_ROLE_COLOUR, // sRGB
+    TEXTURE_ROLE_NORMAL, // tangent space xy, z is rebuilt in the shader
+    TEXTURE_ROLE_DATA // linear, e.g. roughness/metal masks
+};
+
+// what a texture holds, by the naming of the asset packs in models/textures
+int textureRoleFromFilename(const std::string& filename) {
+    std::string name = filename.substr(filename.find_last_of("/\\") + 1);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)tolower(c); });
+    if (name.find("_nh.") != std::string::npos || name.find("_n.") != std::string::npos || name.find("normal") != std::string::npos) {
+        return TEXTURE_ROLE_NORMAL;
+    }
+    if (name.find("_rmax.") != std::string::npos || name.find("_orm.") != std::string::npos || name.find("_mask.") != std::string::npos) {
+        return TEXTURE_ROLE_DATA;
+    }
+    return TEXTURE_ROLE_COLOUR;
+}
+
+bool cookedFormatIsBlockCompressed(uint32_t format) {
+    return format != COOKED_FORMAT_RGBA8 && format != COOKED_FORMAT_RGBA8_SRGB;
+}
+
+// bytes per 4x4 block, or per texel for uncompressed formats
+uint32_t cookedFormatBlockBytes(uint32_t format) {
+    switch (format) {
+    case COOKED_FORMAT_BC1:
+    case COOKED_FORMAT_BC1_SRGB:
+        return 8;
+    case COOKED_FORMAT_RGBA8:
+    case COOKED_FORMAT_RGBA8_SRGB:
+        return 4;
+    default:
+        return 16;
+    }
+}
+
+struct CookedMip {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t rowBytes = 0;
+    uint32_t rows = 0;
+    std::vector<unsigned char> data; // rows * rowBytes, tightly packed
+};
+
+struct CookedTexture {
+    uint32_t format = COOKED_FORMAT_RGBA8_SRGB;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t sourceSize = 0;
+    uint64_t sourceHash = 0;
+    std::vector<CookedMip> mips;
+
+    unsigned long long sizeInBytes() const {
+        unsigned long long size = 0;
+        for (const CookedMip& mip : mips) size += mip.data.size();
+        return size;
+    }
+};
+
+std::string cookedTexturePath(const std::string& source) {
+    size_t slash = source.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : source.substr(0, slash + 1);
+    std::string name = source.substr(slash == std::string::npos ? 0 : slash + 1);
+    return directory + COOKED_TEXTURE_DIR + name.substr(0, name.find_last_of('.')) + COOKED_TEXTURE_EXTENSION;
+}
+
+// size and hash of an image file, false if it cannot be read
+bool textureSourceHash(const std::string& filename, uint64_t& size, uint64_t& hash, std::vector<char>* contents = nullptr) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.good()) return false;
+    std::vector<char> data((size_t)file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    if (!file) return false;
+    size = data.size();
+    hash = hashBytes(data.data(), data.size(), hashBytes("ctex", 4) ^ COOKED_TEXTURE_VERSION);
+    if (contents != nullptr) contents->swap(data);
+    return true;
+}
+
+// false if the source image changed since it was cooked. A missing source is fine,
+// a build may ship the cooked files only
+bool cookedTextureIsCurrent(const std::string& source, const CookedTexture& texture) {
+    std::ifstream file(source, std::ios::binary | std::ios::ate);
+    if (!file.good()) return true;
+    if ((uint64_t)file.tellg() != texture.sourceSize) return false;
+    file.close();
+
+    uint64_t size = 0;
+    uint64_t hash = 0;
+    return textureSourceHash(source, size, hash) && hash == texture.sourceHash;
+}
+
+bool writeCookedTexture(const std::string& filename, const CookedTexture& texture) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.good()) return false;
+
+    uint32_t header[6] = { COOKED_TEXTURE_MAGIC, COOKED_TEXTURE_VERSION, texture.format, texture.width, texture.height, (uint32_t)texture.mips.size() };
+    uint64_t source[2] = { texture.sourceSize, texture.sourceHash };
+    file.write((const char*)header, sizeof(header));
+    file.write((const char*)source, sizeof(source));
+    for (const CookedMip& mip : texture.mips) {
+        uint32_t entry[4] = { mip.width, mip.height, mip.rowBytes, mip.rows };
+        file.write((const char*)entry, sizeof(entry));
+    }
+    for (const CookedMip& mip : texture.mips) {
+        file.write((const char*)mip.data.data(), mip.data.size());
+    }
+    return file.good();
+}
+
+bool readCookedTexture(const std::string& filename, CookedTexture& texture) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.good()) return false;
+
+    uint32_t header[6] = {};
+    uint64_t source[2] = {};
+    file.read((char*)header, sizeof(header));
+    file.read((char*)source, sizeof(source));
+    if (!file || header[0] != COOKED_TEXTURE_MAGIC || header[1] != COOKED_TEXTURE_VERSION || header[5] == 0 || header[5] > 16) return false;
+
+    texture.format = header[2];
+    texture.width = header[3];
+    texture.height = header[4];
+    texture.sourceSize = source[0];
+    texture.sourceHash = source[1];
+    texture.mips.resize(header[5]);
+    for (CookedMip& mip : texture.mips) {
+        uint32_t entry[4] = {};
+        file.read((char*)entry, sizeof(entry));
+        mip.width = entry[0];
+        mip.height = entry[1];
+        mip.rowBytes = entry[2];
+        mip.rows = entry[3];
+    }
+    for (CookedMip& mip : texture.mips) {
+        mip.data.resize((size_t)mip.rowBytes * mip.rows);
+        file.read((char*)mip.data.data(), mip.data.size());
+    }
+    return (bool)file;
+}
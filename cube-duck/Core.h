@@ -6,20 +6,56 @@
 #include <vector>
 #include "Fence.h"
 #include "Barrier.h"
+#include "DescriptorAllocator.h"
 
 #pragma comment(lib, "d3d12")
 #pragma comment(lib, "dxgi")
 #pragma comment(lib, "d3dcompiler.lib")
 
+#define SRV_HEAP_SIZE 16384
+#define SRV_TRANSIENT_SIZE 1024 // end of the SRV heap, for descriptors written every frame
+#define ROOT_TEXTURE_INDICES 2 // root constants: diffuse and normal map index into the SRV heap
+#define ROOT_BINDLESS_TEXTURES 3 // table over the whole SRV heap
+#define ROOT_MESH_DECODE 4 // root constants: the box a mesh's packed positions are quantised in
+#define TEXTURE_INDEX_COUNT 2
+#define MESH_DECODE_COUNT 8
+
+#define RECORD_MAX_THREADS 8 // threads that may record draws at once, the main thread included
+#define RECORD_MAX_LISTS 8 // worker command lists per frame in flight
+
+// Set while a thread records into a worker list, getCommandList() then returns that list
+// so draw code does not need to know which thread it runs on
+inline thread_local ID3D12GraphicsCommandList4* threadCommandList = nullptr;
+// 0 on the main thread, 1..RECORD_MAX_THREADS - 1 on recording workers. Picks the
+// constant buffer region a thread writes to
+inline thread_local int recordThreadIndex = 0;
+
+// What the list the calling thread records into has bound, so redundant binds can be skipped.
+// Cleared whenever that list is reset or the thread switches lists
+struct CommandListState {
+    ID3D12PipelineState* pipelineState = nullptr;
+    bool renderPassSet = false; // descriptor heap, viewport, scissor and root signature
+    unsigned int textureIndices[TEXTURE_INDEX_COUNT] = {};
+    bool textureIndicesSet = false;
+
+    void clear() {
+        pipelineState = nullptr;
+        renderPassSet = false;
+        textureIndicesSet = false;
+    }
+};
+inline thread_local CommandListState threadListState;
+
 class DescriptorHeap {
 public:
     ID3D12DescriptorHeap* heap;
-    D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle;
+    D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle; // heap start
     D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle;
     unsigned int incrementSize;
-    int used;
+    DescriptorFreeList persistent; // [0, num - transientCount)
+    DescriptorRing transient; // the rest, reclaimed per frame
 
-    void init(ID3D12Device5* device, int num) {
+    void init(ID3D12Device5* device, int num, int transientCount = 0) {
         D3D12_DESCRIPTOR_HEAP_DESC uavcbvHeapDesc = {};
         uavcbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
         uavcbvHeapDesc.NumDescriptors = num;
@@ -28,24 +64,56 @@ public:
         cpuHandle = heap->GetCPUDescriptorHandleForHeapStart();
         gpuHandle = heap->GetGPUDescriptorHandleForHeapStart();
         incrementSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-        used = 0;
+        persistent.init(0, num - transientCount);
+        transient.init(num - transientCount, transientCount);
     }
 
-    D3D12_CPU_DESCRIPTOR_HANDLE getNextCPUHandle() {
-        if (used > 0) {
-            cpuHandle.ptr += incrementSize;
+    // index of a descriptor that lives until free(), -1 if the heap is full
+    int allocate(int count = 1) {
+        int index = persistent.allocate(count);
+        if (index == -1) {
+            MessageBoxA(NULL, "Descriptor heap is full", "Error", MB_OK | MB_ICONERROR);
         }
-        used++;
-        return cpuHandle;
+        return index;
+    }
+
+    // the caller makes sure the GPU no longer reads the descriptor
+    void free(int index) {
+        persistent.free(index);
+    }
+
+    // index of descriptors that are only valid for the current frame, -1 if the ring is full.
+    // Nothing writes per frame descriptors yet, textures are bindless with persistent slots
+    int allocateTransient(int count = 1) {
+        return transient.allocate(count);
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE getCPUHandle(int index) {
+        D3D12_CPU_DESCRIPTOR_HANDLE handle = cpuHandle;
+        handle.ptr += (SIZE_T)index * incrementSize;
+        return handle;
+    }
+
+    D3D12_GPU_DESCRIPTOR_HANDLE getGPUHandle(int index) {
+        D3D12_GPU_DESCRIPTOR_HANDLE handle = gpuHandle;
+        handle.ptr += (UINT64)index * incrementSize;
+        return handle;
     }
 
-    // deallocate all descriptors in the future - destructor
     ~DescriptorHeap() {
         heap->Release();
     }
 
 };
 
+// A command list of copies out of upload heaps, reused once the upload fence passed its value
+struct UploadList {
+    ID3D12CommandAllocator* allocator;
+    ID3D12GraphicsCommandList4* list;
+    UINT64 fenceValue = 0;
+    std::vector<ID3D12Resource*> staging; // upload buffers the list copies from, released with the list
+};
+
 class Core {
 public:
     int wWidth, wHeight;
@@ -58,6 +126,16 @@ public:
     IDXGISwapChain3* swapchain;
     ID3D12CommandAllocator* graphicsCommandAllocator[2];
     ID3D12GraphicsCommandList4* graphicsCommandList[2];
+    ID3D12CommandAllocator* recordCommandAllocator[2][RECORD_MAX_LISTS];
+    ID3D12GraphicsCommandList4* recordCommandList[2][RECORD_MAX_LISTS];
+    ID3D12CommandAllocator* closeCommandAllocator[2];
+    ID3D12GraphicsCommandList4* closeCommandList[2]; // present barrier after the worker lists
+    std::vector<UploadList> uploadLists; // kept apart from the lists of the frames in flight, more are created while all are busy
+    int openUploadList = -1; // the batch between beginUploads and endUploads
+    int numRecordedLists = 0; // worker lists recorded this frame, submitted by finishFrame
+    uint64_t frameSerial = 0; // frames submitted so far
+    uint64_t frameSerials[2] = {}; // serial of the last frame submitted for each back buffer
+    uint64_t completedFrameSerial = 0; // the GPU finished every frame up to this one
     ID3D12DescriptorHeap* backbufferHeap;
     ID3D12Resource** backbuffers;
     ID3D12DescriptorHeap* dsvHeap;
@@ -69,6 +147,7 @@ public:
     ID3D12RootSignature* rootSignature;
 
     GPUFence graphicsQueueFence[2];
+    GPUFence uploadFence; // signalled after each upload list
 
     DescriptorHeap srvHeap;
 
@@ -141,6 +220,7 @@ public:
     // creates the 3 command queues: graphics, copy and compute
     // creates the swapchain
     // creates 2 command allocators and command lists
+    // creates the worker and closing command lists for each frame in flight
     // creates the backbuffer descriptor heap: 2 descriptors - one for each backbuffer
     // creates the render target views for each backbuffer
     // creates the fences for the graphics queue
@@ -166,10 +246,17 @@ public:
         selectAdapter(factory);
         createCommandQueues();
 
+        // tier 1 only allows 128 SRVs in a table, the bindless table spans the whole heap
+        D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+        device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options));
+        if (options.ResourceBindingTier < D3D12_RESOURCE_BINDING_TIER_2) {
+            MessageBoxA(NULL, "This GPU does not support resource binding tier 2, needed for bindless textures", "Error", MB_OK | MB_ICONERROR);
+        }
+
         DXGI_SWAP_CHAIN_DESC1 scDesc = {};
         initSwapChain(hwnd, factory, scDesc);
 
-        srvHeap.init(device, 16384);
+        srvHeap.init(device, SRV_HEAP_SIZE, SRV_TRANSIENT_SIZE);
 
         factory->Release();
 
@@ -183,6 +270,19 @@ public:
         device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE,
             IID_PPV_ARGS(&graphicsCommandList[1]));
 
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < RECORD_MAX_LISTS; j++) {
+                device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+                    IID_PPV_ARGS(&recordCommandAllocator[i][j]));
+                device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE,
+                    IID_PPV_ARGS(&recordCommandList[i][j]));
+            }
+            device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+                IID_PPV_ARGS(&closeCommandAllocator[i]));
+            device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE,
+                IID_PPV_ARGS(&closeCommandList[i]));
+        }
+
         D3D12_DESCRIPTOR_HEAP_DESC renderTargetViewHeapDesc = {};
         renderTargetViewHeapDesc.NumDescriptors = scDesc.BufferCount;
         renderTargetViewHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
@@ -200,6 +300,7 @@ public:
 
         graphicsQueueFence[0].create(device);
         graphicsQueueFence[1].create(device);
+        uploadFence.create(device);
 
         D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc;
         memset(&dsvHeapDesc, 0, sizeof(D3D12_DESCRIPTOR_HEAP_DESC));
@@ -270,32 +371,35 @@ public:
         rootParameterCBPS.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
         parameters.push_back(rootParameterCBPS);
 
+        D3D12_ROOT_PARAMETER rootParameterTextureIndices;
+        rootParameterTextureIndices.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+        rootParameterTextureIndices.Constants.ShaderRegister = 1; // Register(b1)
+        rootParameterTextureIndices.Constants.RegisterSpace = 0;
+        rootParameterTextureIndices.Constants.Num32BitValues = TEXTURE_INDEX_COUNT;
+        rootParameterTextureIndices.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+        parameters.push_back(rootParameterTextureIndices);
+
+        // bindless: shaders index the whole SRV heap with the indices above
         D3D12_DESCRIPTOR_RANGE srvRange = {};
         srvRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-        srvRange.NumDescriptors = 8; // number of SRVs (t0-t7)
-        srvRange.BaseShaderRegister = 0; // starting at t0
-        srvRange.RegisterSpace = 0;
-        srvRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
+        srvRange.NumDescriptors = SRV_HEAP_SIZE;
+        srvRange.BaseShaderRegister = 0; // Register(t0, space1)
+        srvRange.RegisterSpace = 1;
+        srvRange.OffsetInDescriptorsFromTableStart = 0;
         D3D12_ROOT_PARAMETER rootParameterTex;
         rootParameterTex.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
         rootParameterTex.DescriptorTable.NumDescriptorRanges = 1;
         rootParameterTex.DescriptorTable.pDescriptorRanges = &srvRange;
-        rootParameterTex.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+        rootParameterTex.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL; // vertex shaders read baked animations from it
         parameters.push_back(rootParameterTex);
 
-        D3D12_DESCRIPTOR_RANGE srvRange2 = {};
-        srvRange2.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-        srvRange2.NumDescriptors = 8;
-        srvRange2.BaseShaderRegister = 8;
-        srvRange2.RegisterSpace = 0;
-        srvRange2.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-
-        D3D12_ROOT_PARAMETER rootParameterTex2;
-        rootParameterTex2.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-        rootParameterTex2.DescriptorTable.NumDescriptorRanges = 1;
-        rootParameterTex2.DescriptorTable.pDescriptorRanges = &srvRange2;
-        rootParameterTex2.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
-        parameters.push_back(rootParameterTex2);
+        D3D12_ROOT_PARAMETER rootParameterMeshDecode;
+        rootParameterMeshDecode.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+        rootParameterMeshDecode.Constants.ShaderRegister = 2; // Register(b2)
+        rootParameterMeshDecode.Constants.RegisterSpace = 0;
+        rootParameterMeshDecode.Constants.Num32BitValues = MESH_DECODE_COUNT;
+        rootParameterMeshDecode.ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+        parameters.push_back(rootParameterMeshDecode);
 
         D3D12_STATIC_SAMPLER_DESC staticSampler = {};
         staticSampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
@@ -336,9 +440,13 @@ public:
         unsigned int frameIndex = swapchain->GetCurrentBackBufferIndex(); // 0 or 1 depending on which buffer is being used
         graphicsCommandAllocator[frameIndex]->Reset();
         graphicsCommandList[frameIndex]->Reset(graphicsCommandAllocator[frameIndex], NULL);
+        threadListState.clear();
     }
 
     ID3D12GraphicsCommandList4* getCommandList() {
+        if (threadCommandList != nullptr) {
+            return threadCommandList;
+        }
         unsigned int frameIndex = swapchain->GetCurrentBackBufferIndex();
         return graphicsCommandList[frameIndex];
     }
@@ -354,15 +462,85 @@ public:
             graphicsQueueFence[i].signal(graphicsQueue);
             graphicsQueueFence[i].wait();
         }
+        completedFrameSerial = frameSerial;
+        srvHeap.transient.reclaim(frameSerial);
     }
 
-    void beginFrame() {
-        unsigned int frameIndex = swapchain->GetCurrentBackBufferIndex();
-        graphicsQueueFence[frameIndex].wait();
+    // Starts a batch of uploads: the copy helpers record into one list until endUploads instead
+    // of running and waiting one copy at a time. A list is reused once the GPU ran it
+    void beginUploads() {
+        int index = -1;
+        for (int i = 0; i < (int)uploadLists.size(); i++) {
+            if (!uploadFence.completed(uploadLists[i].fenceValue)) continue;
+            for (ID3D12Resource* uploadBuffer : uploadLists[i].staging) {
+                uploadBuffer->Release();
+            }
+            uploadLists[i].staging.clear();
+            if (index == -1) index = i;
+        }
+        if (index == -1) {
+            UploadList upload;
+            device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+                IID_PPV_ARGS(&upload.allocator));
+            device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE,
+                IID_PPV_ARGS(&upload.list));
+            uploadLists.push_back(upload);
+            index = (int)uploadLists.size() - 1;
+        }
+        uploadLists[index].allocator->Reset();
+        uploadLists[index].list->Reset(uploadLists[index].allocator, NULL);
+        openUploadList = index;
+    }
+
+    // Submits the batch without waiting. Returns the upload fence value it is done at, the
+    // resources it copied into can be used once uploadsDone says so
+    UINT64 endUploads() {
+        UploadList& upload = uploadLists[openUploadList];
+        upload.list->Close();
+        ID3D12CommandList* lists[] = { upload.list };
+        graphicsQueue->ExecuteCommandLists(1, lists);
+        uploadFence.signal(graphicsQueue);
+        upload.fenceValue = uploadFence.value;
+        openUploadList = -1;
+        return upload.fenceValue;
+    }
+
+    bool uploadsDone(UINT64 fenceValue) {
+        return uploadFence.completed(fenceValue);
+    }
+
+    // The queue runs lists in order, so the frames submitted before the batch are finished too
+    void waitForUploads(UINT64 fenceValue) {
+        uploadFence.waitFor(fenceValue);
+    }
 
+    // list the copy helpers record into, a batch of its own when none is open
+    ID3D12GraphicsCommandList4* beginUpload(bool& batched) {
+        batched = openUploadList != -1;
+        if (!batched) beginUploads();
+        return uploadLists[openUploadList].list;
+    }
+
+    // outside a batch the copy runs now and is waited for, as callers releasing the resource it replaces expect
+    void endUpload(ID3D12Resource* uploadBuffer, bool batched) {
+        uploadLists[openUploadList].staging.push_back(uploadBuffer);
+        if (!batched) waitForUploads(endUploads());
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE backbufferHandle(unsigned int frameIndex) {
         D3D12_CPU_DESCRIPTOR_HANDLE renderTargetViewHandle = backbufferHeap->GetCPUDescriptorHandleForHeapStart();
         unsigned int renderTargetViewDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
         renderTargetViewHandle.ptr += frameIndex * renderTargetViewDescriptorSize;
+        return renderTargetViewHandle;
+    }
+
+    void beginFrame() {
+        unsigned int frameIndex = swapchain->GetCurrentBackBufferIndex();
+        graphicsQueueFence[frameIndex].wait();
+        completedFrameSerial = frameSerials[frameIndex]; // frames run in order, everything before it is done too
+        srvHeap.transient.reclaim(completedFrameSerial);
+
+        D3D12_CPU_DESCRIPTOR_HANDLE renderTargetViewHandle = backbufferHandle(frameIndex);
 
         resetCommandList();
 
@@ -379,17 +557,66 @@ public:
         getCommandList()->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, NULL);
     }
 
+    // Starts worker list `list` of this frame on the calling thread. State does not carry over
+    // between command lists, so render targets and the render pass state are set again
+    void beginRecordList(int list) {
+        unsigned int frameIndex = swapchain->GetCurrentBackBufferIndex();
+        recordCommandAllocator[frameIndex][list]->Reset();
+        recordCommandList[frameIndex][list]->Reset(recordCommandAllocator[frameIndex][list], NULL);
+        threadCommandList = recordCommandList[frameIndex][list];
+        threadListState.clear();
+
+        D3D12_CPU_DESCRIPTOR_HANDLE renderTargetViewHandle = backbufferHandle(frameIndex);
+        getCommandList()->OMSetRenderTargets(1, &renderTargetViewHandle, FALSE, &dsvHandle);
+        beginRenderPass();
+    }
+
+    void endRecordList(int list) {
+        threadCommandList->Close();
+        threadCommandList = nullptr;
+        threadListState.clear(); // back on the main list, whose state was not tracked meanwhile
+    }
+
+    // worker lists [0, count) are executed after the main list, in list order
+    void submitRecordedLists(int count) {
+        numRecordedLists = count;
+    }
+
     void finishFrame() {
         unsigned int frameIndex = swapchain->GetCurrentBackBufferIndex();
-        Barrier::add(backbuffers[frameIndex], D3D12_RESOURCE_STATE_RENDER_TARGET,
-            D3D12_RESOURCE_STATE_PRESENT, getCommandList());
-        runCommandList();
+        if (numRecordedLists == 0) {
+            Barrier::add(backbuffers[frameIndex], D3D12_RESOURCE_STATE_RENDER_TARGET,
+                D3D12_RESOURCE_STATE_PRESENT, getCommandList());
+            runCommandList();
+        }
+        else {
+            // main list, worker lists in order, then the present barrier, all in one submission
+            getCommandList()->Close();
+            closeCommandAllocator[frameIndex]->Reset();
+            closeCommandList[frameIndex]->Reset(closeCommandAllocator[frameIndex], NULL);
+            Barrier::add(backbuffers[frameIndex], D3D12_RESOURCE_STATE_RENDER_TARGET,
+                D3D12_RESOURCE_STATE_PRESENT, closeCommandList[frameIndex]);
+            closeCommandList[frameIndex]->Close();
+
+            ID3D12CommandList* lists[RECORD_MAX_LISTS + 2];
+            lists[0] = graphicsCommandList[frameIndex];
+            for (int i = 0; i < numRecordedLists; i++) {
+                lists[i + 1] = recordCommandList[frameIndex][i];
+            }
+            lists[numRecordedLists + 1] = closeCommandList[frameIndex];
+            graphicsQueue->ExecuteCommandLists(numRecordedLists + 2, lists);
+            numRecordedLists = 0;
+        }
         graphicsQueueFence[frameIndex].signal(graphicsQueue);
+        frameSerial++;
+        frameSerials[frameIndex] = frameSerial;
+        srvHeap.transient.endFrame(frameSerial);
         swapchain->Present(1, 0);
     }
 
-    // not so efficient. Better use copying queues, async work etc
-    void uploadResource(ID3D12Resource* dstResource, const void* data, unsigned int size, D3D12_RESOURCE_STATES targetState, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* texFootprint = NULL) {
+    // Upload heap buffer left mapped at *mapped, so the caller can write straight into it.
+    // The caller releases it once the copy ran
+    ID3D12Resource* createUploadBuffer(unsigned long long size, void** mapped) {
         ID3D12Resource* uploadBuffer;
         D3D12_HEAP_PROPERTIES heapProps = {};
         heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
@@ -404,42 +631,74 @@ public:
         device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc,
             D3D12_RESOURCE_STATE_GENERIC_READ, NULL, IID_PPV_ARGS(&uploadBuffer));
 
+        *mapped = NULL;
+        uploadBuffer->Map(0, NULL, mapped); // Map makes the buffer CPU accessible
+        return uploadBuffer;
+    }
+
+    // staging copy of data in an upload heap, the caller releases it once the copy ran
+    ID3D12Resource* createUploadBuffer(const void* data, unsigned long long size) {
         void* mappeddata = NULL;
-        uploadBuffer->Map(0, NULL, &mappeddata); // Map makes the buffer CPU accessible
+        ID3D12Resource* uploadBuffer = createUploadBuffer(size, &mappeddata);
         memcpy(mappeddata, data, size);
         uploadBuffer->Unmap(0, NULL); // unmap when we finish copying data - we finished with the CPU pointer
+        return uploadBuffer;
+    }
 
-        // Allocate commands to copy
-        resetCommandList(); // reset the command list to record copy commands
+    // Copies a filled upload buffer into dstResource and releases it once the copy ran. For textures
+    // there is one footprint per subresource (mip), all in the upload buffer at their offsets
+    void copyFromUploadBuffer(ID3D12Resource* dstResource, ID3D12Resource* uploadBuffer, unsigned long long size, D3D12_RESOURCE_STATES targetState, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* texFootprint = NULL, unsigned int numSubresources = 1) {
+        bool batched;
+        ID3D12GraphicsCommandList4* list = beginUpload(batched);
 
         if (texFootprint != NULL) {
-            D3D12_TEXTURE_COPY_LOCATION src = {};
-            src.pResource = uploadBuffer;
-            src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-            src.PlacedFootprint = *texFootprint;
-            D3D12_TEXTURE_COPY_LOCATION dst = {};
-            dst.pResource = dstResource;
-            dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-            dst.SubresourceIndex = 0;
-            getCommandList()->CopyTextureRegion(&dst, 0, 0, 0, &src, NULL);
+            for (unsigned int i = 0; i < numSubresources; i++) {
+                D3D12_TEXTURE_COPY_LOCATION src = {};
+                src.pResource = uploadBuffer;
+                src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+                src.PlacedFootprint = texFootprint[i];
+                D3D12_TEXTURE_COPY_LOCATION dst = {};
+                dst.pResource = dstResource;
+                dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+                dst.SubresourceIndex = i;
+                list->CopyTextureRegion(&dst, 0, 0, 0, &src, NULL);
+            }
         }
         else {
             // if it isn't a texture, just do a buffer copy
-            getCommandList()->CopyBufferRegion(dstResource, 0, uploadBuffer, 0, size);
+            list->CopyBufferRegion(dstResource, 0, uploadBuffer, 0, size);
         }
 
-        Barrier::add(dstResource, D3D12_RESOURCE_STATE_COPY_DEST, targetState, getCommandList()); // prevent resource to be used before copy is finished
+        Barrier::add(dstResource, D3D12_RESOURCE_STATE_COPY_DEST, targetState, list); // prevent resource to be used before copy is finished
+
+        endUpload(uploadBuffer, batched);
+    }
+
+    // not so efficient. Better use copying queues, async work etc
+    void uploadResource(ID3D12Resource* dstResource, const void* data, unsigned int size, D3D12_RESOURCE_STATES targetState, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* texFootprint = NULL, unsigned int numSubresources = 1) {
+        copyFromUploadBuffer(dstResource, createUploadBuffer(data, size), size, targetState, texFootprint, numSubresources);
+    }
 
-        runCommandList(); // execute the copy commands
-        flushGraphicsQueue(); // wait until copy is finished. This is inefficient. In practice use multiple command queues and async work
-        uploadBuffer->Release();
+    // Copies into part of a buffer that other data lives in too. The buffer stays in the common
+    // state: buffers are promoted to copy dest and read states on use and decay back after
+    // the list ran, so no barrier is needed and the rest of the buffer is not disturbed
+    void uploadBufferRegion(ID3D12Resource* dstResource, unsigned long long dstOffset, const void* data, unsigned long long size) {
+        ID3D12Resource* uploadBuffer = createUploadBuffer(data, size);
+        bool batched;
+        beginUpload(batched)->CopyBufferRegion(dstResource, dstOffset, uploadBuffer, 0, size);
+        endUpload(uploadBuffer, batched);
     }
 
     void beginRenderPass() {
+        if (threadListState.renderPassSet) {
+            return;
+        }
+        threadListState.renderPassSet = true;
         getCommandList()->SetDescriptorHeaps(1, &srvHeap.heap);
         getCommandList()->RSSetViewports(1, &viewport);
         getCommandList()->RSSetScissorRects(1, &scissorRect);
         getCommandList()->SetGraphicsRootSignature(rootSignature);
+        getCommandList()->SetGraphicsRootDescriptorTable(ROOT_BINDLESS_TEXTURES, srvHeap.gpuHandle);
     }
 
 };
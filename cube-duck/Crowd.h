@@ -0,0 +1,233 @@
+#pragma once
+#include "VertexAnimation.h" // before Math.h, whose min and max macros break <filesystem>
+#include <vector>
+#include "Core.h"
+#include "Math.h"
+#include "GpuMemory.h"
+#include "PSOManager.h"
+#include "ShaderManager.h"
+#include "Texture.h"
+#include "Camera.h"
+
+#define CROWD_VERTEX_SHADER "shaders/vertex/VertexShaderVAT.hlsl"
+#define CROWD_PIXEL_SHADER "shaders/pixel/PixelShaderTexture.hlsl"
+
+// An animated model drawn as many characters at once from its baked vertex animation: the
+// vertex shader reads each vertex's position for the frame of its instance, so drawing the
+// crowd costs one instanced draw per mesh and no bones on the CPU. The characters play their
+// own clip from their own point in it, but cannot blend clips or react to anything
+
+// all a vertex keeps once its skinning is baked: where it samples its texture and which baked vertex it is
+struct CROWD_VERTEX {
+    float tu;
+    float tv;
+    unsigned int vertex;
+};
+
+struct CrowdInstance {
+    Matrix world;
+    unsigned int clip = 0;
+    float timeOffset = 0.0f; // seconds into the clip at time 0, so the crowd does not move in step
+    float rate = 1.0f;
+    float padding = 0.0f;
+};
+
+struct VertexShaderCBCrowd {
+    Matrix VP;
+    float boundsMin[4]; // w is the time
+    float boundsExtent[4];
+    unsigned int vat[4]; // texture index, width, rows per frame
+    float clips[VAT_MAX_CLIPS][4]; // first frame, frame count, frames per second
+};
+
+class CrowdVertexLayoutCache {
+public:
+    static const D3D12_INPUT_LAYOUT_DESC& getCrowdLayout() {
+        static const D3D12_INPUT_ELEMENT_DESC inputLayoutCrowd[] = {
+            { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
+            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "VAT_VERTEX", 0, DXGI_FORMAT_R32_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
+            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+            { "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+            { "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+            { "WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+            { "CLIP", 0, DXGI_FORMAT_R32_UINT, 1, 64, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+            { "PLAYBACK", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 68, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+        };
+        static const D3D12_INPUT_LAYOUT_DESC desc = { inputLayoutCrowd, 8 };
+        return desc;
+    }
+};
+
+class Crowd {
+public:
+    struct CrowdMesh {
+        GpuBuffer vertexBuffer;
+        GpuBuffer indexBuffer;
+        D3D12_VERTEX_BUFFER_VIEW vbView;
+        D3D12_INDEX_BUFFER_VIEW ibView;
+        unsigned int numIndices;
+        std::string textureFilename;
+        Texture* texture;
+    };
+
+    Core* core;
+    ShaderManager* shaderManager;
+    PSOManager psos;
+    std::string filename;
+    std::vector<CrowdMesh> meshes;
+    std::vector<VertexAnimationClip> clips;
+    Texture animationTexture;
+    VertexShaderCBCrowd vertexShaderCB = {};
+    GpuBuffer instanceBuffer;
+    D3D12_VERTEX_BUFFER_VIEW instBufferView = {};
+    int numInstances = 0;
+    unsigned long long sizeInBytes = 0;
+
+    Crowd(Core* core, ShaderManager* sm) : core(core), shaderManager(sm) {}
+
+    // The baked animation comes from models/cache, baked first if it is missing or out of date
+    bool load(const std::string& _filename) {
+        filename = _filename;
+        VertexAnimation baked;
+        std::string error;
+        if (!loadVertexAnimation(filename, baked, error)) {
+            MessageBoxA(NULL, error.c_str(), "Crowd Error", MB_OK | MB_ICONERROR);
+            return false;
+        }
+
+        GEMLoader::GEMModelLoader loader;
+        std::vector<GEMLoader::GEMMesh> gemmeshes;
+        GEMLoader::GEMAnimation gemanimation;
+        loader.load(filename, gemmeshes, gemanimation);
+
+        // vertices are numbered across the meshes in the order the baker numbered them
+        unsigned int vertex = 0;
+        for (int i = 0; i < gemmeshes.size(); i++) {
+            std::vector<CROWD_VERTEX> vertices(gemmeshes[i].verticesAnimated.size());
+            for (int j = 0; j < vertices.size(); j++) {
+                vertices[j].tu = gemmeshes[i].verticesAnimated[j].u;
+                vertices[j].tv = gemmeshes[i].verticesAnimated[j].v;
+                vertices[j].vertex = vertex++;
+            }
+            CrowdMesh mesh = {};
+            unsigned long long vertexBytes = vertices.size() * sizeof(CROWD_VERTEX);
+            unsigned long long indexBytes = gemmeshes[i].indices.size() * sizeof(unsigned int);
+            if (!GpuMemory::createBuffer(core, vertices.data(), vertexBytes, mesh.vertexBuffer) ||
+                !GpuMemory::createBuffer(core, gemmeshes[i].indices.data(), indexBytes, mesh.indexBuffer)) {
+                return false;
+            }
+            mesh.vbView.BufferLocation = mesh.vertexBuffer.gpuAddress();
+            mesh.vbView.StrideInBytes = sizeof(CROWD_VERTEX);
+            mesh.vbView.SizeInBytes = (UINT)vertexBytes;
+            mesh.ibView.BufferLocation = mesh.indexBuffer.gpuAddress();
+            mesh.ibView.Format = DXGI_FORMAT_R32_UINT;
+            mesh.ibView.SizeInBytes = (UINT)indexBytes;
+            mesh.numIndices = gemmeshes[i].indices.size();
+            mesh.textureFilename = gemmeshes[i].material.find("albedo").getValue();
+            mesh.texture = TextureManager::acquire(core, mesh.textureFilename);
+            meshes.push_back(mesh);
+            sizeInBytes += vertexBytes + indexBytes;
+        }
+        if (vertex != baked.numVertices) {
+            MessageBoxA(NULL, ("Baked animation of " + filename + " does not match the model").c_str(), "Crowd Error", MB_OK | MB_ICONERROR);
+            return false;
+        }
+
+        // read by the vertex shader, so not only a pixel shader resource
+        CookedTexture cooked;
+        baked.toCookedTexture(cooked);
+        animationTexture.uploadCooked(core, cooked, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        sizeInBytes += animationTexture.sizeInBytes;
+
+        clips = baked.clips;
+        for (int axis = 0; axis < 3; axis++) {
+            vertexShaderCB.boundsMin[axis] = baked.boundsMin[axis];
+            vertexShaderCB.boundsExtent[axis] = baked.boundsMax[axis] - baked.boundsMin[axis];
+        }
+        vertexShaderCB.vat[0] = animationTexture.heapOffset;
+        vertexShaderCB.vat[1] = baked.width;
+        vertexShaderCB.vat[2] = baked.rowsPerFrame;
+        for (int i = 0; i < clips.size(); i++) {
+            vertexShaderCB.clips[i][0] = (float)clips[i].firstFrame;
+            vertexShaderCB.clips[i][1] = (float)clips[i].frameCount;
+            vertexShaderCB.clips[i][2] = clips[i].framesPerSecond;
+        }
+
+        Shader* vertexShaderBlob = shaderManager->getVertexShader(CROWD_VERTEX_SHADER, &vertexShaderCB);
+        Shader* pixelShaderBlob = shaderManager->getShader(CROWD_PIXEL_SHADER, PIXEL_SHADER);
+        psos.createPSO(core, filename + CROWD_VERTEX_SHADER, vertexShaderBlob->shaderBlob, pixelShaderBlob->shaderBlob, CrowdVertexLayoutCache::getCrowdLayout());
+        return true;
+    }
+
+    // -1 when the model has no clip of that name
+    int clipIndex(const std::string& name) const {
+        for (int i = 0; i < clips.size(); i++) {
+            if (clips[i].name == name) return i;
+        }
+        return -1;
+    }
+
+    // Rewrites the characters into a new mapped upload heap buffer, the old one is freed once the
+    // frames in flight are done with it. Only needed when they move, the animation plays from the time alone
+    void updateInstances(const std::vector<CrowdInstance>& instances) {
+        unsigned long long size = instances.size() * sizeof(CrowdInstance);
+        GpuMemory::retireBuffer(core, instanceBuffer);
+        if (!GpuMemory::allocateBuffer(core, GPU_POOL_UPLOAD, size, instanceBuffer)) {
+            numInstances = 0;
+            return;
+        }
+        if (size > 0) {
+            memcpy(instanceBuffer.mapped, instances.data(), size);
+        }
+        instBufferView.BufferLocation = instanceBuffer.gpuAddress();
+        instBufferView.StrideInBytes = sizeof(CrowdInstance);
+        numInstances = instances.size();
+        instBufferView.SizeInBytes = (UINT)size;
+    }
+
+    // frees the buffers, textures and pipelines, only once the GPU no longer uses them
+    void release() {
+        for (CrowdMesh& mesh : meshes) {
+            GpuMemory::freeBuffer(mesh.vertexBuffer);
+            GpuMemory::freeBuffer(mesh.indexBuffer);
+            TextureManager::release(mesh.textureFilename);
+        }
+        meshes.clear();
+        GpuMemory::freeBuffer(instanceBuffer);
+        numInstances = 0;
+        animationTexture.release();
+        psos.release();
+    }
+
+    // time in seconds, the same clock for the whole crowd
+    void draw(Core* core, Camera* camera, float time) {
+        if (numInstances == 0) return;
+        core->beginRenderPass();
+        psos.bind(core, filename + CROWD_VERTEX_SHADER);
+
+        Matrix viewMatrix;
+        viewMatrix.setLookatMatrix(camera->from, camera->to, camera->up);
+        Matrix projectionMatrix;
+        projectionMatrix.setProjectionMatrix(ZFAR, ZNEAR, FOV, WINDOW_WIDTH, WINDOW_HEIGHT);
+        vertexShaderCB.VP = projectionMatrix.mul(viewMatrix);
+        vertexShaderCB.boundsMin[3] = time;
+
+        shaderManager->updateConstant(CROWD_VERTEX_SHADER, "VP", &vertexShaderCB.VP);
+        shaderManager->updateConstant(CROWD_VERTEX_SHADER, "boundsMin", vertexShaderCB.boundsMin);
+        shaderManager->updateConstant(CROWD_VERTEX_SHADER, "boundsExtent", vertexShaderCB.boundsExtent);
+        shaderManager->updateConstant(CROWD_VERTEX_SHADER, "vat", vertexShaderCB.vat);
+        shaderManager->updateConstant(CROWD_VERTEX_SHADER, "clips", vertexShaderCB.clips);
+        shaderManager->getVertexShader(CROWD_VERTEX_SHADER, &vertexShaderCB)->apply(core);
+
+        for (CrowdMesh& mesh : meshes) {
+            shaderManager->updateTexturePS(core, mesh.texture->heapOffset);
+            D3D12_VERTEX_BUFFER_VIEW bufferViews[2] = { mesh.vbView, instBufferView };
+            core->getCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            core->getCommandList()->IASetVertexBuffers(0, 2, bufferViews);
+            core->getCommandList()->IASetIndexBuffer(&mesh.ibView);
+            core->getCommandList()->DrawIndexedInstanced(mesh.numIndices, numInstances, 0, 0, 0);
+        }
+    }
+};
@@ -24,7 +24,7 @@ public:
     Cube(ShaderManager* sm, Core* core, const std::string& filename) : GEMObject(sm, core, filename) {}
 
     void init(Core* core, std::vector<Matrix> _worldPositions, Vec3 topColor = Vec3(0.2, 1.0, 0.2), Vec3 bottomColor = Vec3(0.45, 0.2, 0.05), VertexDefaultShaderCB* vertexShader = nullptr, CubePixelShaderCB* pixelShader = nullptr) {
-        worldPositions = _worldPositions;
+        worldPositions = std::move(_worldPositions);
 
         if (vertexShader == nullptr) {
             vertexShader = new VertexDefaultShaderCB();
@@ -44,7 +44,7 @@ public:
         pixelShaderCB = pixelShader;
 
         // Build geometry
-        staticMesh.load(filename, worldPositions);
+        loadGeometry(core);
 
         Shader* vertexShaderBlob = shaderManager->getVertexShader("shaders/vertex/VertexShader.hlsl", vertexShaderCB);
         Shader* pixelShaderBlob = shaderManager->getPixelShader("shaders/pixel/CubePixelShader.hlsl", pixelShaderCB);
@@ -72,30 +72,44 @@ public:
         updateConstantsPixelShader(core);
         
         // 4. Draw
-        staticMesh.draw();
+        drawGeometry();
     }
 
     static Cube* createGrassCube(ShaderManager* sm, Core* core, std::vector<Matrix> worldPositions) {
         Cube* cube = new Cube(sm, core, CUBE_MODEL);
-        cube->init(core, worldPositions, Vec3(0.1, 0.6, 0.1), Vec3(0.45, 0.2, 0.05)); // green to brown
+        cube->init(core, std::move(worldPositions), Vec3(0.1, 0.6, 0.1), Vec3(0.45, 0.2, 0.05)); // green to brown
+        return cube;
+    }
+
+    static Cube* createGrassCube(ShaderManager* sm, Core* core, BlockWorld* world, int blockType) {
+        Cube* cube = new Cube(sm, core, CUBE_MODEL);
+        cube->useBlockWorld(core, world, blockType);
+        cube->init(core, {}, Vec3(0.1, 0.6, 0.1), Vec3(0.45, 0.2, 0.05)); // green to brown
         return cube;
     }
 
     static Cube* createDarkDirtCube(ShaderManager* sm, Core* core, std::vector<Matrix> worldPositions) {
         Cube* cube = new Cube(sm, core, CUBE_MODEL);
-        cube->init(core, worldPositions, Vec3(0.45, 0.2, 0.05), Vec3(0.45, 0.2, 0.05)); // all dark brown
+        cube->init(core, std::move(worldPositions), Vec3(0.45, 0.2, 0.05), Vec3(0.45, 0.2, 0.05)); // all dark brown
+        return cube;
+    }
+
+    static Cube* createDarkDirtCube(ShaderManager* sm, Core* core, BlockWorld* world, int blockType) {
+        Cube* cube = new Cube(sm, core, CUBE_MODEL);
+        cube->useBlockWorld(core, world, blockType);
+        cube->init(core, {}, Vec3(0.45, 0.2, 0.05), Vec3(0.45, 0.2, 0.05)); // all dark brown
         return cube;
     }
 
     static Cube* createLightDirtCube(ShaderManager* sm, Core* core, std::vector<Matrix> worldPositions) {
         Cube* cube = new Cube(sm, core, CUBE_MODEL);
-        cube->init(core, worldPositions, Vec3(0.65, 0.35, 0.15), Vec3(0.65, 0.35, 0.15)); // all light brown
+        cube->init(core, std::move(worldPositions), Vec3(0.65, 0.35, 0.15), Vec3(0.65, 0.35, 0.15)); // all light brown
         return cube;
     }
 
     static Cube* createIceCube(ShaderManager* sm, Core* core, std::vector<Matrix> worldPositions) {
         Cube* cube = new Cube(sm, core, CUBE_MODEL);
-        cube->init(core, worldPositions, Vec3(0.8, 0.9, 1.0), Vec3(0.5, 0.7, 0.9)); // light blue to darker blue
+        cube->init(core, std::move(worldPositions), Vec3(0.8, 0.9, 1.0), Vec3(0.5, 0.7, 0.9)); // light blue to darker blue
         return cube;
     }
 };
\ No newline at end of file
@@ -41,7 +41,7 @@ public:
         }
         
         vertexShaderFile = _vertexShaderFile;
-        worldPositions = _worldPositions;
+        worldPositions = std::move(_worldPositions);
 
         VertexDefaultShaderCB *vertexShader = new VertexDefaultShaderCB();
         vertexShader->W.setIdentity();
@@ -51,17 +51,15 @@ public:
         lightCB = light;
 
         // Build geometry
-        staticMesh.load(filename, worldPositions);
+        loadGeometry(core);
 
         // Load texture
         textureName = textureFilename;
-        texture = new Texture();
-        texture->load(core, textureName);
+        texture = TextureManager::acquire(core, textureName);
 
         if (normalMapFilename != "") {
             normalMapName = normalMapFilename;
-            normalMap = new Texture();
-            normalMap->load(core, normalMapFilename);
+            normalMap = TextureManager::acquire(core, normalMapFilename);
         }
 
         Shader* vShader = shaderManager->getVertexShader(vertexShaderFile, vertexShaderCB);
@@ -95,18 +93,37 @@ public:
         updateConstantsPixelShader(core);
 
         if (normalMapName != "") {
-            shaderManager->updateTexturesPSWithNormalMap(core, textureName, texture->heapOffset, normalMapName, normalMap->heapOffset);
+            shaderManager->updateTexturesPSWithNormalMap(core, texture->heapOffset, normalMap->heapOffset);
         } else {
-            shaderManager->updateTexturePS(core, textureName, texture->heapOffset);
+            shaderManager->updateTexturePS(core, texture->heapOffset);
         }
         
         // 4. Draw
-        staticMesh.draw();
+        drawGeometry();
+    }
+
+    unsigned long long sizeInBytes() {
+        return staticMesh.sizeInBytes() + texture->sizeInBytes + (normalMapName != "" ? normalMap->sizeInBytes : 0);
+    }
+
+    void release() {
+        releaseGeometry();
+        TextureManager::release(textureName);
+        if (normalMapName != "") {
+            TextureManager::release(normalMapName);
+        }
     }
 
     static CubeTextured* createBrickCubes(ShaderManager* sm, Core* core, std::vector<Matrix> worldPositions, BRDFLightCB *light) {
         CubeTextured* cubes = new CubeTextured(sm, core);
-        cubes->init(core, worldPositions, light, BRICK_TEXTURE);
+        cubes->init(core, std::move(worldPositions), light, BRICK_TEXTURE);
+        return cubes;
+    }
+
+    static CubeTextured* createBrickCubes(ShaderManager* sm, Core* core, BlockWorld* world, int blockType, BRDFLightCB *light) {
+        CubeTextured* cubes = new CubeTextured(sm, core);
+        cubes->useBlockWorld(core, world, blockType);
+        cubes->init(core, {}, light, BRICK_TEXTURE);
         return cubes;
     }
 };
\ No newline at end of file
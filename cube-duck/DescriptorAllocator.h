@@ -0,0 +1,173 @@
+#pragma once
+#include <map>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
+// Slot bookkeeping for descriptor heaps. Only indices are handed out, turning them into
+// handles is the heap's job, so this runs without a device
+
+struct DescriptorAllocatorStats {
+    int capacity = 0;
+    int used = 0;
+    int peak = 0;
+    int allocations = 0; // since init
+    int frees = 0;
+    int failed = 0; // allocations that did not fit
+    int badFrees = 0; // double frees or slots that were never allocated
+    int freeRanges = 0;
+    int largestFreeRange = 0;
+};
+
+// Long lived descriptors, e.g. a texture's SRV. Free ranges are merged with their neighbours
+// when slots come back, so streaming textures in and out does not fragment the heap
+class DescriptorFreeList {
+public:
+    int base = 0;
+    int capacity = 0;
+    std::map<int, int> freeRanges; // offset -> count
+    std::map<int, int> live; // offset -> count. Whatever is left here at shutdown leaked
+    DescriptorAllocatorStats stats;
+
+    void init(int _base, int _capacity) {
+        base = _base;
+        capacity = _capacity;
+        freeRanges.clear();
+        live.clear();
+        stats = DescriptorAllocatorStats();
+        stats.capacity = capacity;
+        if (capacity > 0) {
+            freeRanges[base] = capacity;
+        }
+    }
+
+    // first fit, lowest offset first. -1 when no free range is big enough
+    int allocate(int count = 1) {
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->second < count) continue;
+
+            int offset = it->first;
+            int remaining = it->second - count;
+            freeRanges.erase(it);
+            if (remaining > 0) {
+                freeRanges[offset + count] = remaining;
+            }
+            live[offset] = count;
+            stats.used += count;
+            stats.allocations++;
+            if (stats.used > stats.peak) stats.peak = stats.used;
+            return offset;
+        }
+        stats.failed++;
+        return -1;
+    }
+
+    bool free(int offset) {
+        auto it = live.find(offset);
+        if (it == live.end()) {
+            stats.badFrees++;
+            return false;
+        }
+        int count = it->second;
+        live.erase(it);
+        stats.used -= count;
+        stats.frees++;
+
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && next->first == offset + count) {
+            count += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += count;
+                return true;
+            }
+        }
+        freeRanges[offset] = count;
+        return true;
+    }
+
+    DescriptorAllocatorStats getStats() {
+        stats.freeRanges = freeRanges.size();
+        stats.largestFreeRange = 0;
+        for (auto& range : freeRanges) {
+            if (range.second > stats.largestFreeRange) stats.largestFreeRange = range.second;
+        }
+        return stats;
+    }
+
+    // allocations that were never freed, as offset and count
+    void leaks(std::vector<std::pair<int, int>>& out) {
+        out.assign(live.begin(), live.end());
+    }
+};
+
+// Descriptors that only live for one frame. Allocation is a pointer bump, the slots of a
+// frame come back once the fence value it ended with has completed
+class DescriptorRing {
+public:
+    struct FrameMark {
+        uint64_t fenceValue;
+        uint64_t end; // head when the frame ended
+    };
+
+    int base = 0;
+    int capacity = 0;
+    uint64_t head = 0; // total slots handed out, only grows
+    uint64_t tail = 0; // total slots reclaimed
+    std::deque<FrameMark> frames;
+    DescriptorAllocatorStats stats;
+
+    void init(int _base, int _capacity) {
+        base = _base;
+        capacity = _capacity;
+        head = 0;
+        tail = 0;
+        frames.clear();
+        stats = DescriptorAllocatorStats();
+        stats.capacity = capacity;
+    }
+
+    // count contiguous slots, -1 if the frames in flight hold too many
+    int allocate(int count = 1) {
+        if (count > capacity) {
+            stats.failed++;
+            return -1;
+        }
+        uint64_t start = head;
+        int position = start % capacity;
+        if (position + count > capacity) {
+            start += capacity - position; // a range never wraps, skip the end of the ring
+            position = 0;
+        }
+        if (start + count - tail > (uint64_t)capacity) {
+            stats.failed++;
+            return -1;
+        }
+        head = start + count;
+        stats.allocations++;
+        stats.used = head - tail;
+        if (stats.used > stats.peak) stats.peak = stats.used;
+        return base + position;
+    }
+
+    // everything allocated since the last endFrame is free once fenceValue completes
+    void endFrame(uint64_t fenceValue) {
+        frames.push_back({ fenceValue, head });
+    }
+
+    void reclaim(uint64_t completedFenceValue) {
+        while (!frames.empty() && frames.front().fenceValue <= completedFenceValue) {
+            tail = frames.front().end;
+            frames.pop_front();
+            stats.frees++;
+        }
+        stats.used = head - tail;
+    }
+
+    DescriptorAllocatorStats getStats() {
+        return stats;
+    }
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include "Core.h"
+#include "CommandRecording.h"
+
+#define RECORD_MIN_DRAWS_PER_LIST 16 // fewer draws than this do not pay for another list
+
+// Records into Core's worker lists of the current frame
+class D3D12RecordBackend {
+public:
+    Core* core;
+    const std::vector<std::function<void()>>* draws;
+
+    void beginList(int list) {
+        core->beginRecordList(list);
+    }
+
+    void draw(int list, int drawIndex) {
+        (*draws)[drawIndex]();
+    }
+
+    void endList(int list) {
+        core->endRecordList(list);
+    }
+
+    void submit(int numLists) {
+        core->submitRecordedLists(numLists);
+    }
+};
+
+// Records a pass of draws on several threads. Call between beginFrame and finishFrame after
+// everything that has to come first was recorded on the main list, finishFrame submits the
+// main list, the worker lists in draw order and the present barrier together
+class DrawRecorder {
+public:
+    Core* core;
+    JobPool pool;
+
+    void init(Core* _core) {
+        core = _core;
+        int numThreads = (int)std::thread::hardware_concurrency();
+        if (numThreads > RECORD_MAX_THREADS) numThreads = RECORD_MAX_THREADS;
+        if (numThreads < 1) numThreads = 1;
+        pool.start(numThreads - 1, [](int i) {
+            recordThreadIndex = i + 1; // 0 is the main thread
+        });
+    }
+
+    // Draw callbacks must only touch their own object. Constant buffers are safe, every
+    // recording thread takes its own slots
+    void record(const std::vector<std::function<void()>>& draws) {
+        D3D12RecordBackend backend;
+        backend.core = core;
+        backend.draws = &draws;
+        int maxLists = pool.numThreads() < RECORD_MAX_LISTS ? pool.numThreads() : RECORD_MAX_LISTS;
+        recordParallel(pool, backend, draws.size(), maxLists, RECORD_MIN_DRAWS_PER_LIST);
+    }
+};
@@ -6,12 +6,17 @@
 #include "GEMAnimatedObject.h"
 #include "Camera.h"
 #include "Window.h"
+#include "Colliders.h"
+#include "TransformHierarchy.h"
 
 #define DUCK_MODEL_FILE "models/Duck-white.gem"
 #define RUN_VELOCITY 0.04f
 #define WALK_VELOCITY 0.02f
 #define LOADING_FRAME 11
 #define DUCK_BOX_SIZE 1.5
+#define DUCK_HALF_X 0.5f // collision box
+#define DUCK_HALF_Y 1.0f
+#define DUCK_HALF_Z 0.5f
 #define JUMP_HEIGHT 4.5f
 #define JUMP_INCREMENT 0.13f
 #define GRAVITY_PULL 0.05f
@@ -44,9 +49,8 @@ public:
     VertexShaderCBAnimatedModel vsCBAnimatedModel;
     GEMAnimatedObject duckModel;
 
-    Matrix rotation;
-    Matrix scale;
-    Matrix translation;
+    TransformHierarchy *transforms;
+    TransformId transform; // the world matrix the duck draws with
 
     DUCK_ANIMATION currentAnimation;
     bool isJumping = false;
@@ -55,12 +59,13 @@ public:
 
     Vec3 startPosition;
 
-    Duck(ShaderManager *_sm, Core *_core, Vec3 _position, Camera *_camera): sm(_sm), core(_core), position(_position), camera(_camera), startPosition(_position), duckModel(sm, DUCK_MODEL_FILE) {
+    Duck(ShaderManager *_sm, Core *_core, Vec3 _position, Camera *_camera, TransformHierarchy *_transforms): sm(_sm), core(_core), position(_position), camera(_camera), startPosition(_position),
+        duckModel(sm, DUCK_MODEL_FILE), transforms(_transforms) {
         duckModel.init(core, &vsCBAnimatedModel);
         animatedInstance.init(&duckModel.animatedModel->animation, 0);
         memcpy(vsCBAnimatedModel.bones, animatedInstance.matrices, sizeof(vsCBAnimatedModel.bones));
 
-        scale.setScaling(0.02f, 0.02f, 0.02f);
+        transform = transforms->add(localTransform());
         currentAnimation = IDLE_VARIATION;
     }
 
@@ -156,12 +161,19 @@ public:
         }
     }
 
+    TransformLocal localTransform() {
+        return TransformLocal::fromRotationY(position, (float)rotationAngle, Vec3(0.02f, 0.02f, 0.02f));
+    }
+
+    // after the collisions, the hierarchy only computes the world matrix again when the duck moved or turned
+    void updateTransform() {
+        transforms->setLocal(transform, localTransform());
+    }
+
     void draw() {
         lastPosition = position;
 
-        rotation.setRotationY(rotationAngle);
-        translation = translation.setTranslation(position);
-        duckModel.vertexShaderCB->W = (translation.mul(rotation)).mul(scale);
+        duckModel.vertexShaderCB->W = transforms->world(transform);
         duckModel.draw(core, camera, &animatedInstance);
     }
 
@@ -184,9 +196,9 @@ public:
     }
 
     bool checkBoxCollision(Vec3 axisPosition, Vec3 point, Vec3 size) {
-        float duckHalfX = 0.5f;
-        float duckHalfY = 1.0f;
-        float duckHalfZ = 0.5f;
+        float duckHalfX = DUCK_HALF_X;
+        float duckHalfY = DUCK_HALF_Y;
+        float duckHalfZ = DUCK_HALF_Z;
         
         bool overlapX = std::abs(axisPosition.x - point.x) < (duckHalfX + size.x / 2);
         bool overlapY = std::abs(axisPosition.y - point.y) < (duckHalfY + size.y / 2);
@@ -194,6 +206,11 @@ public:
         return overlapX && overlapY && overlapZ;
     }
 
+    // the same three tests as checkCollisionX/Y/Z, for testing many static boxes at once
+    ColliderQuery colliderQuery() {
+        return ColliderQuery{ lastPosition.x, lastPosition.y, lastPosition.z, position.x, position.y, position.z, DUCK_HALF_X, DUCK_HALF_Y, DUCK_HALF_Z };
+    }
+
     bool checkCollisionX(Matrix *worldMatrix, Vec3 size) {
         Vec3 axisPosition = Vec3(position.x, lastPosition.y, lastPosition.z);
         Vec3 point = Vec3(worldMatrix->m[3], worldMatrix->m[7],worldMatrix->m[11]);
@@ -0,0 +1,363 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <math.h>
+#include "Parallel.h"
+#include "Colliders.h"
+#include "Patrol.h"
+#include "Navigation.h"
+
+// Gameplay entities as ids with their components in archetypes. An archetype holds every entity
+// with the same set of component types, one array per type, so a system walks contiguous arrays
+// of just the components it reads instead of chasing pointers to big objects. No D3D12 in here
+
+enum COMPONENT {
+    COMPONENT_TRANSFORM,
+    COMPONENT_PATROL,
+    COMPONENT_ANIMATION,
+    COMPONENT_COLLIDER,
+    COMPONENT_RENDERABLE,
+    COMPONENT_CHASE,
+    COMPONENT_COUNT
+};
+
+typedef uint32_t ComponentMask;
+#define COMPONENT_BIT(component) (1u << (component))
+
+#define ECS_INVALID_INDEX 0xFFFFFFFF
+#define ECS_BATCH 1024 // entities per job of a parallel system
+
+struct Entity {
+    uint32_t index = ECS_INVALID_INDEX;
+    uint32_t generation = 0; // bumped when the index is reused, old handles stop resolving
+
+    bool valid() const {
+        return index != ECS_INVALID_INDEX;
+    }
+};
+
+struct TransformComponent {
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+    float rotationY = 0.0f; // degrees
+    float scale = 1.0f;
+};
+
+class AnimationInstance; // Animation.h
+
+struct AnimationComponent {
+    AnimationInstance* instance = nullptr; // owned by whatever draws the entity
+    const char* clip = nullptr;
+};
+
+struct ColliderComponent {
+    float halfX = 0.0f, halfY = 0.0f, halfZ = 0.0f;
+};
+
+// what draws the entity, the owner of the world knows the type
+struct RenderableComponent {
+    void* object = nullptr;
+};
+
+// Follows the flow field of Navigation.h instead of patrolling
+struct ChaseComponent {
+    float speed = 0.0f; // world units per step
+    float height = 0.0f; // of the transform over the top it stands on
+    int node = NAV_NO_NODE; // looked up from the transform when the agent has none
+};
+
+struct Archetype {
+    ComponentMask mask = 0;
+    std::vector<Entity> entities;
+    std::vector<TransformComponent> transforms;
+    PatrolColumns patrols; // a field per array, see Patrol.h. Read and written through EntityWorld::getPatrol/setPatrol
+    std::vector<AnimationComponent> animations;
+    std::vector<ColliderComponent> colliders;
+    std::vector<RenderableComponent> renderables;
+    std::vector<ChaseComponent> chases;
+
+    int size() const {
+        return (int)entities.size();
+    }
+
+    bool has(int component) const {
+        return (mask & COMPONENT_BIT(component)) != 0;
+    }
+
+    std::vector<TransformComponent>& column(TransformComponent*) { return transforms; }
+    std::vector<AnimationComponent>& column(AnimationComponent*) { return animations; }
+    std::vector<ColliderComponent>& column(ColliderComponent*) { return colliders; }
+    std::vector<RenderableComponent>& column(RenderableComponent*) { return renderables; }
+    std::vector<ChaseComponent>& column(ChaseComponent*) { return chases; }
+
+    template <typename T>
+    std::vector<T>& get() {
+        return column((T*)nullptr);
+    }
+
+    // appends a row, taking the components from another archetype's row where both have them
+    void pushRow(Entity entity, Archetype* from = nullptr, int fromRow = 0) {
+        entities.push_back(entity);
+        pushComponent<TransformComponent>(COMPONENT_TRANSFORM, from, fromRow);
+        if (has(COMPONENT_PATROL)) {
+            patrols.push(from != nullptr && from->has(COMPONENT_PATROL) ? from->patrols.read(fromRow) : PatrolComponent());
+        }
+        pushComponent<AnimationComponent>(COMPONENT_ANIMATION, from, fromRow);
+        pushComponent<ColliderComponent>(COMPONENT_COLLIDER, from, fromRow);
+        pushComponent<RenderableComponent>(COMPONENT_RENDERABLE, from, fromRow);
+        pushComponent<ChaseComponent>(COMPONENT_CHASE, from, fromRow);
+    }
+
+    template <typename T>
+    void pushComponent(int component, Archetype* from, int fromRow) {
+        if (!has(component)) return;
+        if (from != nullptr && from->has(component)) get<T>().push_back(from->get<T>()[fromRow]);
+        else get<T>().push_back(T());
+    }
+
+    // the last row moves into row, returns the entity that moved there
+    Entity removeRow(int row) {
+        int last = size() - 1;
+        Entity moved = entities[last];
+        entities[row] = moved;
+        entities.pop_back();
+        removeComponent<TransformComponent>(COMPONENT_TRANSFORM, row, last);
+        if (has(COMPONENT_PATROL)) patrols.remove(row);
+        removeComponent<AnimationComponent>(COMPONENT_ANIMATION, row, last);
+        removeComponent<ColliderComponent>(COMPONENT_COLLIDER, row, last);
+        removeComponent<RenderableComponent>(COMPONENT_RENDERABLE, row, last);
+        removeComponent<ChaseComponent>(COMPONENT_CHASE, row, last);
+        return moved;
+    }
+
+    template <typename T>
+    void removeComponent(int component, int row, int last) {
+        if (!has(component)) return;
+        std::vector<T>& values = get<T>();
+        values[row] = values[last];
+        values.pop_back();
+    }
+};
+
+// a part of an archetype a job of a parallel system works on
+struct ArchetypeRange {
+    Archetype* archetype;
+    int first;
+    int last;
+};
+
+class EntityWorld {
+public:
+    struct Record {
+        int archetype = -1;
+        int row = 0;
+        uint32_t generation = 0;
+    };
+
+    std::vector<Archetype*> archetypes;
+    std::vector<Record> records; // by entity index
+    std::vector<uint32_t> freeIndices;
+    std::vector<ArchetypeRange> ranges; // kept to reuse its memory
+
+    ~EntityWorld() {
+        for (Archetype* archetype : archetypes) {
+            delete archetype;
+        }
+    }
+
+    int archetypeFor(ComponentMask mask) {
+        for (int i = 0; i < (int)archetypes.size(); i++) {
+            if (archetypes[i]->mask == mask) return i;
+        }
+        Archetype* archetype = new Archetype();
+        archetype->mask = mask;
+        archetypes.push_back(archetype);
+        return (int)archetypes.size() - 1;
+    }
+
+    Entity create(ComponentMask mask) {
+        Entity entity;
+        if (!freeIndices.empty()) {
+            entity.index = freeIndices.back();
+            freeIndices.pop_back();
+        }
+        else {
+            entity.index = (uint32_t)records.size();
+            records.push_back(Record());
+        }
+        Record& record = records[entity.index];
+        entity.generation = record.generation;
+        record.archetype = archetypeFor(mask);
+        record.row = archetypes[record.archetype]->size();
+        archetypes[record.archetype]->pushRow(entity);
+        return entity;
+    }
+
+    bool alive(Entity entity) const {
+        return entity.valid() && entity.index < records.size() && records[entity.index].archetype != -1 && records[entity.index].generation == entity.generation;
+    }
+
+    void destroy(Entity entity) {
+        if (!alive(entity)) return;
+        Record& record = records[entity.index];
+        Entity moved = archetypes[record.archetype]->removeRow(record.row);
+        if (moved.index != entity.index) records[moved.index].row = record.row;
+        record.archetype = -1;
+        record.generation++;
+        freeIndices.push_back(entity.index);
+    }
+
+    // Moves the entity to the archetype of mask. Components in both stay, new ones start default
+    void setComponents(Entity entity, ComponentMask mask) {
+        if (!alive(entity)) return;
+        Record& record = records[entity.index];
+        int to = archetypeFor(mask);
+        if (to == record.archetype) return;
+
+        Archetype* from = archetypes[record.archetype];
+        archetypes[to]->pushRow(entity, from, record.row);
+        Entity moved = from->removeRow(record.row);
+        if (moved.index != entity.index) records[moved.index].row = record.row;
+        record.archetype = to;
+        record.row = archetypes[to]->size() - 1;
+    }
+
+    template <typename T>
+    T& get(Entity entity) {
+        Record& record = records[entity.index];
+        return archetypes[record.archetype]->get<T>()[record.row];
+    }
+
+    PatrolComponent getPatrol(Entity entity) {
+        Record& record = records[entity.index];
+        return archetypes[record.archetype]->patrols.read(record.row);
+    }
+
+    void setPatrol(Entity entity, const PatrolComponent& patrol) {
+        Record& record = records[entity.index];
+        archetypes[record.archetype]->patrols.write(record.row, patrol);
+    }
+
+    int count(ComponentMask required) const {
+        int total = 0;
+        for (Archetype* archetype : archetypes) {
+            if ((archetype->mask & required) == required) total += archetype->size();
+        }
+        return total;
+    }
+
+    // func(archetype, first, last) over the rows of every archetype with the required components
+    template <typename F>
+    void each(ComponentMask required, F func) {
+        for (Archetype* archetype : archetypes) {
+            if ((archetype->mask & required) == required && archetype->size() > 0) func(*archetype, 0, archetype->size());
+        }
+    }
+
+    // The same split into batches on the pool. func must only write the rows it was given
+    template <typename F>
+    void parallelEach(JobPool* pool, ComponentMask required, int batch, F func) {
+        ranges.clear();
+        for (Archetype* archetype : archetypes) {
+            if ((archetype->mask & required) != required) continue;
+            for (int first = 0; first < archetype->size(); first += batch) {
+                int last = first + batch < archetype->size() ? first + batch : archetype->size();
+                ranges.push_back(ArchetypeRange{ archetype, first, last });
+            }
+        }
+        if (pool == nullptr) {
+            for (ArchetypeRange& range : ranges) func(*range.archetype, range.first, range.last);
+            return;
+        }
+        pool->run((int)ranges.size(), [this, &func](int i) {
+            func(*ranges[i].archetype, ranges[i].first, ranges[i].last);
+        });
+    }
+};
+
+// Steps every patrol, then moves the transforms along. The entities that turned around are
+// added to turnarounds, the layers that react to it (rotation, animation) take them from there
+void patrolSystem(EntityWorld& world, JobPool* pool, std::vector<Entity>* turnarounds = nullptr) {
+    ComponentMask required = COMPONENT_BIT(COMPONENT_TRANSFORM) | COMPONENT_BIT(COMPONENT_PATROL);
+    world.parallelEach(pool, required, ECS_BATCH, [](Archetype& archetype, int first, int last) {
+        PatrolColumns& patrols = archetype.patrols;
+        stepPatrols(patrols, first, last);
+        TransformComponent* transforms = archetype.transforms.data();
+        for (int i = first; i < last; i++) {
+            bool alongX = patrols.axis[i] == PATROL_ALONG_X;
+            transforms[i].x = alongX ? patrols.position[i] : transforms[i].x;
+            transforms[i].z = alongX ? transforms[i].z : patrols.position[i];
+        }
+    });
+
+    if (turnarounds == nullptr) return;
+    world.each(required, [turnarounds](Archetype& archetype, int first, int last) {
+        const std::vector<uint8_t>& turned = archetype.patrols.turned;
+        for (int byte = first >> 3; byte < ((last + 7) >> 3); byte++) {
+            int low = byte << 3;
+            uint8_t inRange = 0xFF; // the rows of the byte in [first, last)
+            if (low < first) inRange &= (uint8_t)(0xFF << (first - low));
+            if (low + 8 > last) inRange &= (uint8_t)(0xFF >> (low + 8 - last));
+            for (uint8_t bits = turned[byte] & inRange; bits != 0; bits &= bits - 1) {
+                int bit = 0;
+                while (!((bits >> bit) & 1)) bit++;
+                turnarounds->push_back(archetype.entities[(byte << 3) + bit]);
+            }
+        }
+    });
+}
+
+// the rotation layer: a patrol that turned around faces the other way
+void turnAround(EntityWorld& world, const std::vector<Entity>& turnarounds) {
+    for (Entity entity : turnarounds) {
+        TransformComponent& transform = world.get<TransformComponent>(entity);
+        transform.rotationY = fmodf(transform.rotationY + 180.0f, 360.0f);
+    }
+}
+
+// Steps every chasing entity along the field and turns it the way it walks. A step reads the
+// field at the node the agent stands on, so it costs the same however far the goal is
+void chaseSystem(EntityWorld& world, JobPool* pool, const NavGrid& grid, const FlowField& field) {
+    ComponentMask required = COMPONENT_BIT(COMPONENT_TRANSFORM) | COMPONENT_BIT(COMPONENT_CHASE);
+    world.parallelEach(pool, required, ECS_BATCH, [&grid, &field](Archetype& archetype, int first, int last) {
+        for (int i = first; i < last; i++) {
+            TransformComponent& transform = archetype.transforms[i];
+            ChaseComponent& chase = archetype.chases[i];
+            if (chase.node == NAV_NO_NODE) {
+                chase.node = grid.nodeAt(transform.x, transform.y, transform.z);
+                if (chase.node == NAV_NO_NODE) continue;
+                chase.height = transform.y - grid.worldY(chase.node);
+            }
+
+            float x = transform.x;
+            float z = transform.z;
+            chase.node = followField(grid, field, chase.node, chase.speed, x, z);
+            if (x != transform.x || z != transform.z) {
+                transform.rotationY = atan2f(x - transform.x, z - transform.z) * (180.0f / 3.14159265f);
+            }
+            transform.x = x;
+            transform.y = grid.worldY(chase.node) + chase.height;
+            transform.z = z;
+        }
+    });
+}
+
+// The first entity whose box blocks the player along any axis, as Duck::checkCollisionX/Y/Z
+Entity firstOverlap(EntityWorld& world, const ColliderQuery& query) {
+    Entity hit;
+    world.each(COMPONENT_BIT(COMPONENT_TRANSFORM) | COMPONENT_BIT(COMPONENT_COLLIDER), [&](Archetype& archetype, int first, int last) {
+        for (int i = first; i < last && !hit.valid(); i++) {
+            const TransformComponent& transform = archetype.transforms[i];
+            const ColliderComponent& collider = archetype.colliders[i];
+            bool lastX = fabsf(query.lastX - transform.x) < (query.halfX + collider.halfX);
+            bool lastY = fabsf(query.lastY - transform.y) < (query.halfY + collider.halfY);
+            bool lastZ = fabsf(query.lastZ - transform.z) < (query.halfZ + collider.halfZ);
+            bool nextX = fabsf(query.nextX - transform.x) < (query.halfX + collider.halfX);
+            bool nextY = fabsf(query.nextY - transform.y) < (query.halfY + collider.halfY);
+            bool nextZ = fabsf(query.nextZ - transform.z) < (query.halfZ + collider.halfZ);
+            if ((nextX && lastY && lastZ) || (lastX && nextY && lastZ) || (lastX && lastY && nextZ)) {
+                hit = archetype.entities[i];
+            }
+        }
+    });
+    return hit;
+}
@@ -6,6 +6,8 @@
 #include "GEMAnimatedObject.h"
 #include "Camera.h"
 #include "Window.h"
+#include "ECS.h"
+#include "TransformHierarchy.h"
 
 #define BULL_MODEL_FILE "models/Bull-white.gem"
 #define CAT_MODEL_FILE "models/Cat-Orange.gem"
@@ -16,6 +18,10 @@
 #define E_WALK_VELOCITY 0.09f
 #define E_LOADING_FRAME 3
 #define E_ENEMY_BOX_SIZE 2.0f
+#define E_ENEMY_COMPONENTS (COMPONENT_BIT(COMPONENT_TRANSFORM) | COMPONENT_BIT(COMPONENT_PATROL) | COMPONENT_BIT(COMPONENT_ANIMATION) | \
+    COMPONENT_BIT(COMPONENT_COLLIDER) | COMPONENT_BIT(COMPONENT_RENDERABLE))
+#define E_CHASER_COMPONENTS (COMPONENT_BIT(COMPONENT_TRANSFORM) | COMPONENT_BIT(COMPONENT_CHASE) | COMPONENT_BIT(COMPONENT_ANIMATION) | \
+    COMPONENT_BIT(COMPONENT_COLLIDER) | COMPONENT_BIT(COMPONENT_RENDERABLE))
 
 enum ENEMY_ANIMATION {
     E_IDLE_VARIATION,
@@ -32,125 +38,113 @@ enum ENEMY_ANIMATION {
 enum MOVE_KIND {
     ALONG_X,
     ALONG_Z,
+    CHASE, // follows the level's flow field to the duck, the end position is not used
 };
 
 const char *E_AnimationsMap[] = { "idle variation", "walk forward", "turn 90 l", "turn 90 r", "run forward", "walk backwards", "attack01", "hit reaction", "bird idle variation" };
 
+// The model and pose of an enemy. Where it is, how it patrols and its box are components of
+// its entity, which the systems of Level1 update together with every other entity
 class Enemy {
 public:
     ShaderManager *sm;
     Core *core;
+    EntityWorld *world;
+    Entity entity;
 
-    Vec3 position;
-    int rotationAngle = 0;
-    int loadingFrame = 0;
     AnimationInstance animatedInstance;
     VertexShaderCBAnimatedModel vsCBAnimatedModel;
     GEMAnimatedObject enemyModel;
 
-    Matrix rotation;
-    Matrix scale;
-    Matrix translation;
+    TransformHierarchy *transforms;
+    TransformId transform; // follows the entity's transform component
 
     ENEMY_ANIMATION currentAnimation;
 
-    Vec3 startPosition;
-    Vec3 endPosition;
-    MOVE_KIND moveKind;
-    float walkVelocity;
-
-    Vec3 size = {E_ENEMY_BOX_SIZE, E_ENEMY_BOX_SIZE, E_ENEMY_BOX_SIZE};
-
-    Enemy(ShaderManager *_sm, Core *_core, Vec3 _startPosition, Vec3 _endPosition, MOVE_KIND _moveKind, float _rotationAngle, std::string enemyFile, float _scale, ENEMY_ANIMATION animation, float _walkVelocity = E_WALK_VELOCITY): 
-        sm(_sm), core(_core), position(_startPosition), startPosition(_startPosition), 
-        endPosition(_endPosition), moveKind(_moveKind), rotationAngle(_rotationAngle), 
-        walkVelocity(_walkVelocity), enemyModel(sm, enemyFile)
+    // Loads the model. Its uploads may still be in flight, the enemy joins the systems with spawn
+    Enemy(ShaderManager *_sm, Core *_core, EntityWorld *_world, TransformHierarchy *_transforms, std::string enemyFile):
+        sm(_sm), core(_core), world(_world), enemyModel(sm, enemyFile), transforms(_transforms)
     {
         
         enemyModel.init(core, &vsCBAnimatedModel);
         animatedInstance.init(&enemyModel.animatedModel->animation, 0);
         memcpy(vsCBAnimatedModel.bones, animatedInstance.matrices, sizeof(vsCBAnimatedModel.bones));
+    }
 
-        scale.setScaling(_scale, _scale, _scale);
+    // Creates the entity, the systems move and draw the enemy from the next frame on
+    void spawn(Vec3 _startPosition, Vec3 _endPosition, MOVE_KIND _moveKind, float _rotationAngle, float _scale, ENEMY_ANIMATION animation, float _walkVelocity = E_WALK_VELOCITY) {
         currentAnimation = animation;
+
+        entity = world->create(_moveKind == CHASE ? E_CHASER_COMPONENTS : E_ENEMY_COMPONENTS);
+        TransformComponent &component = world->get<TransformComponent>(entity);
+        component.x = _startPosition.x;
+        component.y = _startPosition.y;
+        component.z = _startPosition.z;
+        component.rotationY = (float)(int)_rotationAngle; // whole degrees
+        component.scale = _scale;
+
+        if (_moveKind == CHASE) {
+            world->get<ChaseComponent>(entity).speed = _walkVelocity;
+        }
+        else {
+            PatrolComponent patrol;
+            bool alongX = _moveKind == ALONG_X;
+            patrol.axis = alongX ? PATROL_ALONG_X : PATROL_ALONG_Z;
+            patrol.position = alongX ? _startPosition.x : _startPosition.z;
+            patrol.start = patrol.position;
+            patrol.end = alongX ? _endPosition.x : _endPosition.z;
+            patrol.speed = _walkVelocity;
+            patrol.waitFrames = E_LOADING_FRAME;
+            world->setPatrol(entity, patrol);
+        }
+
+        AnimationComponent &anim = world->get<AnimationComponent>(entity);
+        anim.instance = &animatedInstance;
+        anim.clip = E_AnimationsMap[currentAnimation];
+
+        world->get<RenderableComponent>(entity).object = this;
+        transform = transforms->add(localTransform());
+        setSize(Vec3(E_ENEMY_BOX_SIZE, E_ENEMY_BOX_SIZE, E_ENEMY_BOX_SIZE));
     }
 
-    void resetPosition() {
-        position = startPosition;
+    Vec3 position() {
+        TransformComponent &transform = world->get<TransformComponent>(entity);
+        return Vec3(transform.x, transform.y, transform.z);
     }
 
     void setSize(Vec3 newSize) {
-        size = newSize;
+        ColliderComponent &collider = world->get<ColliderComponent>(entity);
+        collider.halfX = newSize.x / 2;
+        collider.halfY = newSize.y / 2;
+        collider.halfZ = newSize.z / 2;
     }
 
-    void move() {
-        if (loadingFrame < E_LOADING_FRAME) {
-            loadingFrame++;
-            return;
-        }
-        if (loadingFrame == E_LOADING_FRAME) {
-            loadingFrame = 0;
-        }
+    unsigned long long sizeInBytes() {
+        return enemyModel.animatedModel->sizeInBytes();
+    }
 
-        if (moveKind == ALONG_X && std::abs(position.x - endPosition.x) > 0.001) {
-            bool reached = false;
-            if (endPosition.x - position.x < 0) {
-                position.x -= walkVelocity;
-                if (position.x <= endPosition.x) {
-                    reached = true;
-                }
-            }
-            if (endPosition.x - position.x >= 0) {
-                position.x += walkVelocity;
-                if (position.x >= endPosition.x) {
-                    reached = true;
-                }
-            }
-
-            if (reached) { // reached goal
-                Vec3 aux = startPosition;
-                startPosition = endPosition;
-                endPosition = aux;
-                rotationAngle = (rotationAngle + 180) % 360;
-            }
-        }
+    TransformLocal localTransform() {
+        TransformComponent &component = world->get<TransformComponent>(entity);
+        return TransformLocal::fromRotationY(Vec3(component.x, component.y, component.z), component.rotationY, Vec3(component.scale, component.scale, component.scale));
+    }
 
-        if (moveKind == ALONG_Z && std::abs(position.z - endPosition.z) > 0.001) {
-            bool reached = false;
-            if (endPosition.z - position.z < 0) {
-                position.z -= walkVelocity;
-                if (position.z <= endPosition.z) {
-                    reached = true;
-                }
-            }
-            if (endPosition.z - position.z >= 0) {
-                position.z += walkVelocity;
-                if (position.z >= endPosition.z) {
-                    reached = true;
-                }
-            }
-
-            if (reached) { // reached goal
-                Vec3 aux = startPosition;
-                startPosition = endPosition;
-                endPosition = aux;
-                rotationAngle = (rotationAngle + 180) % 360;
-            }
-        }
+    // after the systems moved the entity. A waiting patrol leaves its world matrix as it is
+    void updateTransform() {
+        transforms->setLocal(transform, localTransform());
     }
 
-    void updateAnimation(Window *win, float dt) {
-        move();
-        animatedInstance.update(E_AnimationsMap[currentAnimation], dt);
-        if (animatedInstance.animationFinished()) {
-            animatedInstance.resetAnimationTime();
-        }
+    // takes the enemy out of the systems, the model stays until release
+    void despawn() {
+        world->destroy(entity);
+        transforms->remove(transform);
+    }
+
+    void release() {
+        enemyModel.release();
     }
 
     void draw(Camera *camera) {
-        rotation.setRotationY(rotationAngle);
-        translation = translation.setTranslation(position);
-        enemyModel.vertexShaderCB->W = (translation.mul(rotation)).mul(scale);
+        enemyModel.vertexShaderCB->W = transforms->world(transform);
         enemyModel.draw(core, camera, &animatedInstance);
     }
-};
\ No newline at end of file
+};
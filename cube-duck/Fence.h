@@ -17,13 +17,21 @@ public:
         queue->Signal(fence, ++value);
     }
 
-    void wait() {
-        if (fence->GetCompletedValue() < value) {
-            fence->SetEventOnCompletion(value, eventHandle);
+    bool completed(UINT64 waitValue) {
+        return fence->GetCompletedValue() >= waitValue;
+    }
+
+    void waitFor(UINT64 waitValue) {
+        if (fence->GetCompletedValue() < waitValue) {
+            fence->SetEventOnCompletion(waitValue, eventHandle);
             WaitForSingleObject(eventHandle, INFINITE); // wait until the fence has been processed - this is blocking
         }
     }
 
+    void wait() {
+        waitFor(value);
+    }
+
     ~GPUFence() {
         CloseHandle(eventHandle);
         fence->Release();
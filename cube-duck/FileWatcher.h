@@ -0,0 +1,179 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <Windows.h>
+#endif
+
+#define FILE_WATCH_INTERVAL_MS 250 // polling period, and how long the notification threads wait before checking for stop
+
+// Reports files under a directory that were written since the last poll(). Runs on its own
+// thread: inotify on Linux, ReadDirectoryChangesW on Windows, comparing modification times everywhere else
+class FileWatcher {
+public:
+    std::string directory;
+    std::string extension; // only files ending in this, empty for all
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::set<std::string> changed; // generic paths, e.g. shaders/pixel/PixelShaderWater.hlsl
+
+    bool matches(const std::filesystem::path& path) {
+        return extension.empty() || path.extension() == extension;
+    }
+
+    void push(const std::filesystem::path& path) {
+        if (!matches(path)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.insert(path.generic_string());
+    }
+
+    void start(const std::string& _directory, const std::string& _extension) {
+        directory = _directory;
+        extension = _extension;
+        running = true;
+        thread = std::thread([this]() { watch(); });
+    }
+
+    void stop() {
+        if (!running) return;
+        running = false;
+        thread.join();
+    }
+
+    // files changed since the last call, each once
+    void poll(std::vector<std::string>& files) {
+        std::lock_guard<std::mutex> lock(mutex);
+        files.insert(files.end(), changed.begin(), changed.end());
+        changed.clear();
+    }
+
+#ifdef __linux__
+    void watch() {
+        int fd = inotify_init1(IN_NONBLOCK);
+        if (fd < 0) {
+            watchPolling();
+            return;
+        }
+
+        // inotify is not recursive, every directory gets its own watch
+        std::map<int, std::filesystem::path> directories;
+        auto addWatch = [&](const std::filesystem::path& dir) {
+            int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (wd >= 0) directories[wd] = dir;
+        };
+        std::error_code error;
+        addWatch(directory);
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+            if (entry.is_directory()) addWatch(entry.path());
+        }
+
+        alignas(inotify_event) char buffer[4096];
+        while (running) {
+            pollfd descriptor = { fd, POLLIN, 0 };
+            if (::poll(&descriptor, 1, FILE_WATCH_INTERVAL_MS) <= 0) continue;
+
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            for (ssize_t offset = 0; offset < length;) {
+                inotify_event* event = (inotify_event*)(buffer + offset);
+                auto it = directories.find(event->wd);
+                if (it != directories.end() && event->len > 0) {
+                    push(it->second / event->name);
+                }
+                offset += sizeof(inotify_event) + event->len;
+            }
+        }
+        close(fd);
+    }
+#elif defined(_WIN32)
+    void watch() {
+        HANDLE dir = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+        if (dir == INVALID_HANDLE_VALUE) {
+            watchPolling();
+            return;
+        }
+
+        // overlapped, so the thread can wake up to check for stop
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        alignas(DWORD) char buffer[16384];
+        DWORD length = 0;
+        bool reading = false;
+        while (running) {
+            if (!reading) {
+                ResetEvent(overlapped.hEvent);
+                if (!ReadDirectoryChangesW(dir, buffer, sizeof(buffer), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME,
+                    NULL, &overlapped, NULL)) {
+                    break;
+                }
+                reading = true;
+            }
+            if (WaitForSingleObject(overlapped.hEvent, FILE_WATCH_INTERVAL_MS) != WAIT_OBJECT_0) continue;
+            reading = false;
+            if (!GetOverlappedResult(dir, &overlapped, &length, FALSE) || length == 0) continue; // 0: the buffer overflowed and the changes are lost
+
+            for (DWORD offset = 0;;) {
+                FILE_NOTIFY_INFORMATION* info = (FILE_NOTIFY_INFORMATION*)(buffer + offset);
+                if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+                    std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR)); // relative to directory
+                    push(std::filesystem::path(directory) / name);
+                }
+                if (info->NextEntryOffset == 0) break;
+                offset += info->NextEntryOffset;
+            }
+        }
+
+        if (reading) {
+            CancelIoEx(dir, &overlapped);
+            GetOverlappedResult(dir, &overlapped, &length, TRUE); // the read must be over before buffer goes away
+        }
+        CloseHandle(overlapped.hEvent);
+        CloseHandle(dir);
+    }
+#else
+    void watch() {
+        watchPolling();
+    }
+#endif
+
+    void watchPolling() {
+        std::map<std::string, std::filesystem::file_time_type> times;
+        bool first = true;
+        while (running) {
+            std::error_code error;
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+                if (!entry.is_regular_file(error) || !matches(entry.path())) continue;
+
+                std::string path = entry.path().generic_string();
+                std::filesystem::file_time_type time = entry.last_write_time(error);
+                auto it = times.find(path);
+                if (it == times.end()) {
+                    times[path] = time;
+                    if (!first) push(entry.path()); // new file
+                }
+                else if (it->second != time) {
+                    it->second = time;
+                    push(entry.path());
+                }
+            }
+            first = false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(FILE_WATCH_INTERVAL_MS));
+        }
+    }
+
+    ~FileWatcher() {
+        stop();
+    }
+};
@@ -46,6 +46,14 @@ public:
         vertexShaderCB->VP = projectionMatrix.mul(viewMatrix);
     }
 
+    // frees the model and pipelines, only once the GPU no longer uses them
+    void release() {
+        animatedModel->release();
+        delete animatedModel;
+        animatedModel = nullptr;
+        psos.release();
+    }
+
     void updateBones(AnimationInstance* animationInstance) {
         memcpy(vertexShaderCB->bones, animationInstance->matrices, sizeof(vertexShaderCB->bones));
     }
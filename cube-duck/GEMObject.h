@@ -5,6 +5,7 @@
 #include "PSOManager.h"
 #include "ShaderManager.h"
 #include "StaticMesh.h"
+#include "BlockChunks.h"
 #include "Camera.h"
 
 class GEMObject {
@@ -17,11 +18,12 @@ public:
     VertexDefaultShaderCB* vertexShaderCB;
     Vec3 size;
     std::vector<Matrix> worldPositions;
+    ChunkedMesh* chunkedMesh = nullptr; // set when the instances are blocks of a BlockWorld
 
     GEMObject(ShaderManager* sm, Core* core, const std::string& filename, Vec3 _size = Vec3(2,2,2)) : shaderManager(sm), staticMesh(core), filename(filename), size(_size)  {}
 
     void init(Core* core, std::vector<Matrix> _worldPositions, VertexDefaultShaderCB* vertexShader = nullptr) {
-        worldPositions = _worldPositions;
+        worldPositions = std::move(_worldPositions);
         if (vertexShader == nullptr) {
             vertexShader = new VertexDefaultShaderCB();
             vertexShader->W.setIdentity();
@@ -30,13 +32,47 @@ public:
         vertexShaderCB = vertexShader;
 
         // Build geometry
-        staticMesh.load(filename, worldPositions);
+        loadGeometry(core);
 
         Shader* vertexShaderBlob = shaderManager->getVertexShader("shaders/vertex/VertexShader.hlsl", vertexShaderCB);
         Shader* pixelShaderBlob = shaderManager->getShader("shaders/pixel/PixelShaderNormals.hlsl", PIXEL_SHADER);
         psos.createPSO(core, filename, vertexShaderBlob->shaderBlob, pixelShaderBlob->shaderBlob, vertexLayoutCache.getStaticLayout());
     }
 
+    // Draw the instances as merged chunks of world blocks instead of one instanced model
+    void useBlockWorld(Core* core, BlockWorld* world, int blockType) {
+        chunkedMesh = new ChunkedMesh(core, world, blockType);
+    }
+
+    void loadGeometry(Core* core) {
+        if (chunkedMesh != nullptr) {
+            chunkedMesh->load(filename);
+            chunkedMesh->world->positionsOfType(chunkedMesh->blockType, worldPositions); // collisions still test every block
+            return;
+        }
+        staticMesh.load(filename, worldPositions);
+    }
+
+    void rebuildDirtyChunks(const std::set<long long>& dirtyChunks) {
+        if (chunkedMesh == nullptr) return;
+        chunkedMesh->rebuildDirty(dirtyChunks);
+        chunkedMesh->world->positionsOfType(chunkedMesh->blockType, worldPositions);
+    }
+
+    // frees the GPU buffers and pipelines, only once the GPU no longer uses them
+    void releaseGeometry() {
+        staticMesh.release();
+        psos.release();
+    }
+
+    void drawGeometry() {
+        if (chunkedMesh != nullptr) {
+            chunkedMesh->draw();
+            return;
+        }
+        staticMesh.draw();
+    }
+
     void updateFromCamera(Core* core, Camera* camera) {
         Matrix viewMatrix;
         viewMatrix.setLookatMatrix(camera->from, camera->to, camera->up);
@@ -82,6 +118,6 @@ public:
         updateConstantsVertexShader(core);
         
         // 4. Draw
-        staticMesh.draw();
+        drawGeometry();
     }
 };
\ No newline at end of file
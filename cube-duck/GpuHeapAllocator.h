@@ -0,0 +1,209 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+// Placement policy for GPU heaps: decides at which offset of which heap a resource goes.
+// Creating the heaps and placing resources is GpuMemory's job, so this runs without a device
+
+#define GPU_INVALID_OFFSET 0xFFFFFFFFFFFFFFFFULL
+
+struct GpuAllocation {
+    int page = -1;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+
+    bool valid() const {
+        return page != -1;
+    }
+};
+
+// Shared by the pools that draw from the same memory, e.g. everything in video memory
+struct GpuMemoryBudget {
+    uint64_t budget = 0;
+    uint64_t reserved = 0; // bytes of all pages created against this budget
+};
+
+struct GpuMemoryStats {
+    uint64_t reserved = 0; // page bytes
+    uint64_t used = 0;
+    uint64_t peak = 0;
+    uint64_t freeBytes = 0;
+    uint64_t largestFree = 0;
+    int pages = 0;
+    int allocations = 0; // live
+    int failed = 0; // allocations that hit the budget
+
+    // 0 when all free memory is one range, close to 1 when it is scattered in small holes
+    float fragmentation() const {
+        return freeBytes == 0 ? 0.0f : 1.0f - ((float)largestFree / (float)freeBytes);
+    }
+};
+
+inline uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Ranges of one heap. Best fit on size, free neighbours are merged back together
+class HeapRangeAllocator {
+public:
+    uint64_t capacity = 0;
+    std::map<uint64_t, uint64_t> freeByOffset; // offset -> size
+    std::multimap<uint64_t, uint64_t> freeBySize; // size -> offset
+    std::map<uint64_t, uint64_t> live; // offset -> size
+
+    void init(uint64_t _capacity) {
+        capacity = _capacity;
+        freeByOffset.clear();
+        freeBySize.clear();
+        live.clear();
+        addFree(0, capacity);
+    }
+
+    void addFree(uint64_t offset, uint64_t size) {
+        freeByOffset[offset] = size;
+        freeBySize.insert({ size, offset });
+    }
+
+    void removeFree(std::map<uint64_t, uint64_t>::iterator it) {
+        auto range = freeBySize.equal_range(it->second);
+        for (auto s = range.first; s != range.second; ++s) {
+            if (s->second == it->first) {
+                freeBySize.erase(s);
+                break;
+            }
+        }
+        freeByOffset.erase(it);
+    }
+
+    // alignment is a power of two. GPU_INVALID_OFFSET when nothing fits
+    uint64_t allocate(uint64_t size, uint64_t alignment) {
+        for (auto s = freeBySize.lower_bound(size); s != freeBySize.end(); ++s) {
+            uint64_t start = s->second;
+            uint64_t end = start + s->first;
+            uint64_t aligned = alignUp(start, alignment);
+            if (aligned + size > end) continue; // the padding ate the range
+
+            removeFree(freeByOffset.find(start));
+            if (aligned > start) addFree(start, aligned - start);
+            if (aligned + size < end) addFree(aligned + size, end - (aligned + size));
+            live[aligned] = size;
+            return aligned;
+        }
+        return GPU_INVALID_OFFSET;
+    }
+
+    bool free(uint64_t offset) {
+        auto it = live.find(offset);
+        if (it == live.end()) return false;
+        uint64_t size = it->second;
+        live.erase(it);
+
+        auto next = freeByOffset.lower_bound(offset);
+        if (next != freeByOffset.end() && next->first == offset + size) {
+            size += next->second;
+            auto after = std::next(next);
+            removeFree(next);
+            next = after;
+        }
+        if (next != freeByOffset.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                offset = previous->first;
+                size += previous->second;
+                removeFree(previous);
+            }
+        }
+        addFree(offset, size);
+        return true;
+    }
+
+    uint64_t usedBytes() const {
+        uint64_t used = 0;
+        for (auto& range : live) used += range.second;
+        return used;
+    }
+
+    uint64_t largestFree() const {
+        return freeBySize.empty() ? 0 : freeBySize.rbegin()->first;
+    }
+};
+
+// Pages of one kind of heap. New pages are added while the budget allows, an allocation
+// bigger than a page gets a page of its own
+class GpuHeapAllocator {
+public:
+    uint64_t pageSize = 0;
+    uint64_t pageAlignment = 65536; // D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, heap sizes are multiples of it
+    GpuMemoryBudget* budget = nullptr;
+    std::vector<HeapRangeAllocator> pages;
+    uint64_t used = 0;
+    uint64_t peak = 0;
+    int failed = 0;
+
+    void init(uint64_t _pageSize, GpuMemoryBudget* _budget) {
+        pageSize = _pageSize;
+        budget = _budget;
+        pages.clear();
+        used = 0;
+        peak = 0;
+        failed = 0;
+    }
+
+    // Pages are tried in creation order so the first ones fill up and later ones stay empty.
+    // If the result is on a page that did not exist before the call, the caller creates its heap
+    GpuAllocation allocate(uint64_t size, uint64_t alignment) {
+        GpuAllocation allocation;
+        allocation.size = size;
+        for (int i = 0; i < (int)pages.size(); i++) {
+            uint64_t offset = pages[i].allocate(size, alignment);
+            if (offset != GPU_INVALID_OFFSET) {
+                allocation.page = i;
+                allocation.offset = offset;
+                onAllocated(size);
+                return allocation;
+            }
+        }
+
+        uint64_t capacity = size > pageSize ? alignUp(size, pageAlignment) : pageSize;
+        if (budget != nullptr && budget->reserved + capacity > budget->budget) {
+            failed++;
+            return allocation;
+        }
+        if (budget != nullptr) budget->reserved += capacity;
+        pages.emplace_back();
+        pages.back().init(capacity);
+        allocation.page = pages.size() - 1;
+        allocation.offset = pages.back().allocate(size, alignment); // page offsets are aligned, this is 0
+        onAllocated(size);
+        return allocation;
+    }
+
+    void onAllocated(uint64_t size) {
+        used += size;
+        if (used > peak) peak = used;
+    }
+
+    bool free(const GpuAllocation& allocation) {
+        if (!allocation.valid() || allocation.page >= (int)pages.size()) return false;
+        if (!pages[allocation.page].free(allocation.offset)) return false;
+        used -= allocation.size;
+        return true;
+    }
+
+    GpuMemoryStats getStats() const {
+        GpuMemoryStats stats;
+        stats.used = used;
+        stats.peak = peak;
+        stats.failed = failed;
+        stats.pages = pages.size();
+        for (const HeapRangeAllocator& page : pages) {
+            stats.reserved += page.capacity;
+            stats.allocations += page.live.size();
+            uint64_t largest = page.largestFree();
+            if (largest > stats.largestFree) stats.largestFree = largest;
+        }
+        stats.freeBytes = stats.reserved - stats.used;
+        return stats;
+    }
+};
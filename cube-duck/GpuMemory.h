@@ -0,0 +1,237 @@
+#pragma once
+#include <vector>
+#include <d3d12.h>
+#include "Core.h"
+#include "GpuHeapAllocator.h"
+
+#define GPU_BUFFER_PAGE_SIZE (32ull * 1024 * 1024)
+#define GPU_UPLOAD_PAGE_SIZE (16ull * 1024 * 1024)
+#define GPU_TEXTURE_PAGE_SIZE (64ull * 1024 * 1024)
+#define GPU_DEFAULT_BUDGET (1024ull * 1024 * 1024) // used when the adapter does not report one
+#define GPU_UPLOAD_BUDGET (256ull * 1024 * 1024)
+#define GPU_BUFFER_ALIGNMENT 256 // constant buffer views need it, vertex and index data is fine with it too
+
+enum GPU_POOL {
+    GPU_POOL_BUFFERS, // default heap: vertex, index and instance data
+    GPU_POOL_UPLOAD, // upload heap, mapped for good: constant buffers and instances rewritten while playing
+    GPU_POOL_TEXTURES, // default heap, textures that are not render targets
+    GPU_POOL_COUNT
+};
+
+// Part of one of the big buffers that cover a buffer page. Meshes share these, views
+// point at resource + offset
+struct GpuBuffer {
+    ID3D12Resource* resource = nullptr;
+    unsigned long long offset = 0;
+    unsigned long long size = 0;
+    unsigned char* mapped = nullptr; // upload pool only
+    int pool = GPU_POOL_BUFFERS;
+    GpuAllocation allocation;
+
+    D3D12_GPU_VIRTUAL_ADDRESS gpuAddress() const {
+        return resource->GetGPUVirtualAddress() + offset;
+    }
+};
+
+// Resources are placed in a few big heaps instead of being committed one by one, each of which
+// would cost a heap and at least 64 KB. Buffers are sub-allocated out of one buffer per page
+class GpuMemory {
+public:
+    struct Page {
+        ID3D12Heap* heap = nullptr;
+        ID3D12Resource* buffer = nullptr; // spans the page, buffer pools only
+        unsigned char* mapped = nullptr;
+    };
+
+    // Freed once the GPU finished the frame, it may still be read by the frames in flight
+    struct RetiredBuffer {
+        GpuBuffer buffer;
+        uint64_t frame;
+    };
+
+    struct State {
+        GpuMemoryBudget localBudget; // video memory, shared by buffers and textures
+        GpuMemoryBudget uploadBudget;
+        GpuHeapAllocator allocators[GPU_POOL_COUNT];
+        std::vector<Page> pages[GPU_POOL_COUNT];
+        std::vector<RetiredBuffer> retired;
+        bool opened = false;
+    };
+
+    static State& state() {
+        static State s;
+        return s;
+    }
+
+    static void open(Core* core) {
+        State& s = state();
+        if (s.opened) return;
+        s.opened = true;
+
+        s.localBudget.budget = GPU_DEFAULT_BUDGET;
+        IDXGIAdapter3* adapter3 = nullptr;
+        if (SUCCEEDED(core->adapter->QueryInterface(IID_PPV_ARGS(&adapter3)))) {
+            DXGI_QUERY_VIDEO_MEMORY_INFO info = {};
+            if (SUCCEEDED(adapter3->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info)) && info.Budget > 0) {
+                s.localBudget.budget = info.Budget;
+            }
+            adapter3->Release();
+        }
+        s.uploadBudget.budget = GPU_UPLOAD_BUDGET;
+
+        s.allocators[GPU_POOL_BUFFERS].init(GPU_BUFFER_PAGE_SIZE, &s.localBudget);
+        s.allocators[GPU_POOL_UPLOAD].init(GPU_UPLOAD_PAGE_SIZE, &s.uploadBudget);
+        s.allocators[GPU_POOL_TEXTURES].init(GPU_TEXTURE_PAGE_SIZE, &s.localBudget);
+    }
+
+    static bool createPage(Core* core, int pool, unsigned long long size) {
+        State& s = state();
+        Page page;
+        D3D12_HEAP_DESC heapDesc = {};
+        heapDesc.SizeInBytes = size;
+        heapDesc.Properties.Type = pool == GPU_POOL_UPLOAD ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT;
+        heapDesc.Properties.CreationNodeMask = 1;
+        heapDesc.Properties.VisibleNodeMask = 1;
+        heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        heapDesc.Flags = pool == GPU_POOL_TEXTURES ? D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES : D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+        HRESULT hr = core->device->CreateHeap(&heapDesc, IID_PPV_ARGS(&page.heap));
+        if (FAILED(hr)) {
+            MessageBoxA(NULL, "Failed to create GPU heap", "GPU Memory Error", MB_OK | MB_ICONERROR);
+            return false;
+        }
+
+        if (pool != GPU_POOL_TEXTURES) {
+            D3D12_RESOURCE_DESC bufferDesc = {};
+            bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+            bufferDesc.Width = size;
+            bufferDesc.Height = 1;
+            bufferDesc.DepthOrArraySize = 1;
+            bufferDesc.MipLevels = 1;
+            bufferDesc.SampleDesc.Count = 1;
+            bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+            D3D12_RESOURCE_STATES initialState = pool == GPU_POOL_UPLOAD ? D3D12_RESOURCE_STATE_GENERIC_READ : D3D12_RESOURCE_STATE_COMMON;
+            hr = core->device->CreatePlacedResource(page.heap, 0, &bufferDesc, initialState, NULL, IID_PPV_ARGS(&page.buffer));
+            if (FAILED(hr)) {
+                MessageBoxA(NULL, "Failed to create GPU page buffer", "GPU Memory Error", MB_OK | MB_ICONERROR);
+                page.heap->Release();
+                return false;
+            }
+            if (pool == GPU_POOL_UPLOAD) {
+                page.buffer->Map(0, NULL, (void**)&page.mapped);
+            }
+        }
+        s.pages[pool].push_back(page);
+        return true;
+    }
+
+    // Allocates from the pool and creates the heap of a page the allocator just added
+    static GpuAllocation allocate(Core* core, int pool, unsigned long long size, unsigned long long alignment) {
+        State& s = state();
+        open(core);
+        releaseRetired(core);
+        GpuHeapAllocator& allocator = s.allocators[pool];
+        GpuAllocation allocation = allocator.allocate(size, alignment);
+        if (!allocation.valid()) {
+            MessageBoxA(NULL, "GPU memory budget exceeded", "GPU Memory Error", MB_OK | MB_ICONERROR);
+            return allocation;
+        }
+        while (s.pages[pool].size() < allocator.pages.size()) {
+            if (!createPage(core, pool, allocator.pages[s.pages[pool].size()].capacity)) {
+                allocator.free(allocation);
+                allocation.page = -1;
+                return allocation;
+            }
+        }
+        return allocation;
+    }
+
+    static bool allocateBuffer(Core* core, int pool, unsigned long long size, GpuBuffer& buffer) {
+        GpuAllocation allocation = allocate(core, pool, alignUp(size > 0 ? size : 1, GPU_BUFFER_ALIGNMENT), GPU_BUFFER_ALIGNMENT);
+        if (!allocation.valid()) return false;
+
+        Page& page = state().pages[pool][allocation.page];
+        buffer.resource = page.buffer;
+        buffer.offset = allocation.offset;
+        buffer.size = size;
+        buffer.mapped = page.mapped != nullptr ? page.mapped + allocation.offset : nullptr;
+        buffer.pool = pool;
+        buffer.allocation = allocation;
+        return true;
+    }
+
+    // default heap buffer filled with data, readable as any kind of buffer once the copy ran
+    static bool createBuffer(Core* core, const void* data, unsigned long long size, GpuBuffer& buffer) {
+        if (!allocateBuffer(core, GPU_POOL_BUFFERS, size, buffer)) return false;
+        core->uploadBufferRegion(buffer.resource, buffer.offset, data, size);
+        return true;
+    }
+
+    static void freeBuffer(GpuBuffer& buffer) {
+        if (buffer.resource == nullptr) return;
+        state().allocators[buffer.pool].free(buffer.allocation);
+        buffer.resource = nullptr;
+        buffer.mapped = nullptr;
+    }
+
+    // For a buffer the frames in flight may still read, e.g. instances that were just replaced
+    static void retireBuffer(Core* core, GpuBuffer& buffer) {
+        if (buffer.resource == nullptr) return;
+        state().retired.push_back({ buffer, core->frameSerial + 1 }); // the frame being recorded may use it too
+        buffer.resource = nullptr;
+        buffer.mapped = nullptr;
+    }
+
+    static void releaseRetired(Core* core) {
+        std::vector<RetiredBuffer>& retired = state().retired;
+        for (auto it = retired.begin(); it != retired.end();) {
+            if (it->frame > core->completedFrameSerial) {
+                ++it;
+                continue;
+            }
+            freeBuffer(it->buffer);
+            it = retired.erase(it);
+        }
+    }
+
+    // Places a texture in a texture page. Textures that fit in 64 KB get the small alignment
+    static HRESULT createTexture(Core* core, D3D12_RESOURCE_DESC desc, D3D12_RESOURCE_STATES initialState, ID3D12Resource** texture, GpuAllocation& allocation) {
+        desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+        D3D12_RESOURCE_ALLOCATION_INFO info = core->device->GetResourceAllocationInfo(0, 1, &desc);
+        if (info.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT) {
+            desc.Alignment = 0;
+            info = core->device->GetResourceAllocationInfo(0, 1, &desc);
+        }
+
+        allocation = allocate(core, GPU_POOL_TEXTURES, info.SizeInBytes, info.Alignment);
+        if (!allocation.valid()) return E_OUTOFMEMORY;
+
+        Page& page = state().pages[GPU_POOL_TEXTURES][allocation.page];
+        HRESULT hr = core->device->CreatePlacedResource(page.heap, allocation.offset, &desc, initialState, NULL, IID_PPV_ARGS(texture));
+        if (FAILED(hr)) {
+            freeTexture(allocation);
+        }
+        return hr;
+    }
+
+    static void freeTexture(GpuAllocation& allocation) {
+        if (!allocation.valid()) return;
+        state().allocators[GPU_POOL_TEXTURES].free(allocation);
+        allocation.page = -1;
+    }
+
+    static GpuMemoryStats getStats(int pool) {
+        return state().allocators[pool].getStats();
+    }
+
+    // after the GPU is idle, at shutdown
+    static void release() {
+        State& s = state();
+        for (int pool = 0; pool < GPU_POOL_COUNT; pool++) {
+            for (Page& page : s.pages[pool]) {
+                if (page.buffer != nullptr) page.buffer->Release();
+                page.heap->Release();
+            }
+            s.pages[pool].clear();
+        }
+    }
+};
@@ -90,7 +90,7 @@ public:
         vertexShaderCB->PLAYER_POS = *playerPos;
         updateConstantsVertexShader(core);
 
-        shaderManager->updateTexturePS(core, "Grass", texture->heapOffset);
+        shaderManager->updateTexturePS(core, texture->heapOffset);
         
         // 4. Draw
         staticMesh.draw();
@@ -98,7 +98,7 @@ public:
 
     static Grass* createGrass(ShaderManager* sm, Core* core, std::vector<Matrix> worldPositions, Matrix *playerPos) {
         Grass* grass = new Grass(sm, core, "models/grass.gem");
-        grass->init(core, worldPositions, playerPos);
+        grass->init(core, std::move(worldPositions), playerPos);
         return grass;
     }
 };
\ No newline at end of file
@@ -88,7 +88,7 @@ public:
         updateConstantsVertexShader(core);
         updateConstantsPixelShader(core);
 
-        shaderManager->updateTexturePS(core, GRASS_MODEL, texture->heapOffset);
+        shaderManager->updateTexturePS(core, texture->heapOffset);
         
         // 4. Draw
         staticMesh.draw();
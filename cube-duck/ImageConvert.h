@@ -0,0 +1,71 @@
+#pragma once
+#include <stddef.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSSE3__)
+#include <tmmintrin.h>
+#define IMAGE_CONVERT_SSSE3 // every x64 CPU that runs D3D12 has SSSE3
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define IMAGE_CONVERT_NEON
+#endif
+
+// Pixel format conversion for texture uploads. Rows are converted straight into the mapped
+// upload buffer, so there is no intermediate RGBA copy of the image
+
+// RGB8 to RGBA8 with alpha 255
+void expandRGBToRGBA(const unsigned char* src, unsigned char* dst, size_t pixels) {
+    size_t i = 0;
+#if defined(IMAGE_CONVERT_SSSE3)
+    // 16 pixels per step: three 16 byte loads of RGB become four 16 byte stores of RGBA
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    for (; i + 16 <= pixels; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + (i * 3)));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + (i * 3) + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + (i * 3) + 32));
+        __m128i* out = (__m128i*)(dst + (i * 4));
+        _mm_storeu_si128(out, _mm_or_si128(_mm_shuffle_epi8(a, shuffle), alpha));
+        _mm_storeu_si128(out + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle), alpha));
+        _mm_storeu_si128(out + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle), alpha));
+        _mm_storeu_si128(out + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle), alpha));
+    }
+#elif defined(IMAGE_CONVERT_NEON)
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x3_t rgb = vld3q_u8(src + (i * 3));
+        uint8x16x4_t rgba;
+        rgba.val[0] = rgb.val[0];
+        rgba.val[1] = rgb.val[1];
+        rgba.val[2] = rgb.val[2];
+        rgba.val[3] = vdupq_n_u8(255);
+        vst4q_u8(dst + (i * 4), rgba);
+    }
+#endif
+    for (; i < pixels; i++) {
+        dst[(i * 4) + 0] = src[(i * 3) + 0];
+        dst[(i * 4) + 1] = src[(i * 3) + 1];
+        dst[(i * 4) + 2] = src[(i * 3) + 2];
+        dst[(i * 4) + 3] = 255;
+    }
+}
+
+// one row of 1 to 4 channel 8 bit pixels to RGBA8. Grey is copied to r, g and b
+void convertRowToRGBA(const unsigned char* src, int channels, unsigned char* dst, size_t pixels) {
+    switch (channels) {
+    case 4:
+        memcpy(dst, src, pixels * 4);
+        break;
+    case 3:
+        expandRGBToRGBA(src, dst, pixels);
+        break;
+    default:
+        for (size_t i = 0; i < pixels; i++) {
+            unsigned char grey = src[i * channels];
+            dst[(i * 4) + 0] = grey;
+            dst[(i * 4) + 1] = grey;
+            dst[(i * 4) + 2] = grey;
+            dst[(i * 4) + 3] = channels == 2 ? src[(i * 2) + 1] : 255;
+        }
+        break;
+    }
+}
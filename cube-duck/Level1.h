@@ -19,6 +19,16 @@
 #include "Random.h"
 #include "Wheel.h"
 #include "Brick.h"
+#include "BlockChunks.h"
+#include "Parallel.h"
+#include "LevelFile.h"
+#include "WorldStreaming.h"
+#include "DrawRecorder.h"
+#include "RenderQueue.h"
+#include "TransformHierarchy.h"
+#include "Crowd.h"
+#include <filesystem>
+#include <set>
 
 #define DEFAULT_LIGTH "default_light"
 #define WATER_LIGHT "water_light"
@@ -27,89 +37,208 @@
 #define LIGHT_WHEEL "light_wheel"
 #define LIGHT_BRICK "light_brick"
 
+#define LEVEL1_SEED 1337 // same seed, same layout
+#define LEVEL1_SCENE "levels/level1.json" // authored level, compiled to LEVEL1_FILE when that is missing or older
+#define LEVEL1_FILE "levels/level1.gemlevel"
+#define LEVEL1_STREAM_RADIUS 40.0f
+#define LEVEL1_UNLOAD_RADIUS 56.0f
+#define LEVEL1_STREAM_BUDGET (256ull * 1024 * 1024) // GPU bytes of the streamed chunks
+#define LEVEL1_CHUNK_COST_ESTIMATE (8ull * 1024 * 1024) // until a chunk reports what it really uses
+#define LEVEL1_ACTIVATIONS_PER_FRAME 1 // creating a chunk's objects reads and decodes their files, spread it over frames
+#define LEVEL1_RETIRE_FRAMES 3 // frames an unloaded chunk waits before its GPU objects are freed
+#define LEVEL1_ANIMATION_BATCH 8 // enemies per animation job, a pose costs far more than a patrol step
+#define LEVEL1_CROWD_MODEL "models/Duck-brown.gem" // ducklings resting on the water, drawn from their baked animation
+#define LEVEL1_CROWD_SIZE 12
+#define LEVEL1_CROWD_SCALE 0.012f // the player's duck is 0.02
+#define LEVEL1_CROWD_CLIP "idle variation"
+#define LEVEL1_CROWD_TIME_WRAP 3600.0f // seconds, the clips jump once an hour instead of losing precision
+#define LEVEL1_ANIMATION_MIN_RADIUS 1.0f // some colliders are much smaller than their model, the LOD sizes them at least this big
+
+enum LEVEL1_BLOCK {
+    BLOCK_GRASS,
+    BLOCK_DARK_DIRT,
+    BLOCK_LIGHT_DIRT
+};
+
 template <typename T>
 void append(std::vector<T> &target, std::vector<T> &source) {
-    target.insert(target.end(), source.begin(), source.end());
+    target.reserve(target.size() + source.size());
+    target.insert(target.end(), std::make_move_iterator(source.begin()), std::make_move_iterator(source.end()));
+    source.clear();
 }
 
-void generateCubesPositions(Vec3 startPos, int numCubesY, int numCubesX, int numCubesZ, std::vector<Matrix> &cubesPositions) {
-    for (int y = 0; y < numCubesY; y++ ) {
-        for (int x = 0; x < numCubesX; x++) {
-            for (int z = 0; z < numCubesZ; z++) {
-                Matrix world, translation, rotation;
-                float posX = startPos.x + (x * 1.95);
-                float posY = startPos.y + (y * 1.95);
-                float posZ = startPos.z + (z * 1.95);
-                translation = translation.setTranslation(Vec3(posX, posY - 0.15, posZ));
-
-                // SET RANDOM ROTAION BETWEEN 0, 90, 180, 270 DEGREES
-                float possibleRotations[4] = {0.0f, 90.0f, 180.0f, 270.0f};
-                int randomRotationIndex = static_cast<int>(generateRandomInt(0, 3));
-                float rotationAngle = possibleRotations[randomRotationIndex];
-                rotation.setRotationY(rotationAngle);
-                
-                world = translation.mul(rotation);
-                cubesPositions.push_back(world);
-            }
-        }
+// Each batch of generated items draws from its own random stream, so the layout only
+// depends on the seed and never on how many threads did the work
+#define LEVEL_GEN_BATCH 256
+#define LEVEL_GEN_STREAM(stream, batch) ((((uint64_t)(stream)) << 20) + (batch))
+
+enum LEVEL1_STREAM {
+    STREAM_DARK_DIRT,
+    STREAM_LIGHT_DIRT,
+    STREAM_LIGHT_DIRT_WITH_GRASS,
+    STREAM_GRASS_CUBES,
+    STREAM_GRASS,
+    STREAM_GRASS_ON_DIRT,
+    STREAM_BRICKS,
+    STREAM_CROWD
+};
+
+struct CubeRegion {
+    Vec3 startPos;
+    int numCubesY;
+    int numCubesX;
+    int numCubesZ;
+};
+
+void generateCubesPositions(const std::vector<CubeRegion> &regions, std::vector<Matrix> &cubesPositions, int stream) {
+    std::vector<int> regionOffsets(regions.size() + 1, 0);
+    for (int r = 0; r < regions.size(); r++) {
+        regionOffsets[r + 1] = regionOffsets[r] + (regions[r].numCubesY * regions[r].numCubesX * regions[r].numCubesZ);
     }
+
+    int offset = cubesPositions.size();
+    int numCubes = regionOffsets[regions.size()];
+    cubesPositions.resize(offset + numCubes);
+
+    int numBatches = (numCubes + LEVEL_GEN_BATCH - 1) / LEVEL_GEN_BATCH;
+    parallelFor(numBatches, [&](int batch) {
+        PCG32 rng = randomStream(LEVEL_GEN_STREAM(stream, batch));
+        int first = batch * LEVEL_GEN_BATCH;
+        int last = min(first + LEVEL_GEN_BATCH, numCubes);
+
+        int r = std::upper_bound(regionOffsets.begin(), regionOffsets.end(), first) - regionOffsets.begin() - 1;
+        for (int i = first; i < last; i++) {
+            while (i >= regionOffsets[r + 1]) r++;
+            const CubeRegion &region = regions[r];
+
+            // same order as walking y, x, z of the region
+            int local = i - regionOffsets[r];
+            int z = local % region.numCubesZ;
+            int x = (local / region.numCubesZ) % region.numCubesX;
+            int y = local / (region.numCubesZ * region.numCubesX);
+
+            Matrix translation, rotation;
+            float posX = region.startPos.x + (x * 1.95);
+            float posY = region.startPos.y + (y * 1.95);
+            float posZ = region.startPos.z + (z * 1.95);
+            translation = translation.setTranslation(Vec3(posX, posY - 0.15, posZ));
+
+            // SET RANDOM ROTAION BETWEEN 0, 90, 180, 270 DEGREES
+            float possibleRotations[4] = {0.0f, 90.0f, 180.0f, 270.0f};
+            rotation.setRotationY(possibleRotations[rng.nextInt(0, 3)]);
+
+            cubesPositions[offset + i] = translation.mul(rotation);
+        }
+    });
 }
 
-void generateGrassPositionsFromGrassCubes(std::vector<Matrix> &grassCubesPositions, std::vector<Matrix> &grassPositions, int factor) {
-    for (const Matrix &cubeWorld : grassCubesPositions) {
-        Matrix grassWorld;
-        float i = cubeWorld.m[3] / 2;
-        float y = cubeWorld.m[7] / 1.5f;
-        float j = cubeWorld.m[11] / 2;
+void generateGrassPositionsFromGrassCubes(const std::vector<Matrix> &grassCubesPositions, std::vector<Matrix> &grassPositions, int factor, int stream) {
+    int offset = grassPositions.size();
+    int numCubes = grassCubesPositions.size();
+    grassPositions.resize(offset + (numCubes * factor));
+
+    int numBatches = (numCubes + LEVEL_GEN_BATCH - 1) / LEVEL_GEN_BATCH;
+    parallelFor(numBatches, [&](int batch) {
+        PCG32 rng = randomStream(LEVEL_GEN_STREAM(stream, batch));
+        int last = min((batch + 1) * LEVEL_GEN_BATCH, numCubes);
 
-        for (int g = 0; g < factor; g++) {
-            float minX = (i*2) - 0.92;
-            float maxX = (i*2) + 0.92;
+        for (int c = batch * LEVEL_GEN_BATCH; c < last; c++) {
+            const Matrix &cubeWorld = grassCubesPositions[c];
+            Matrix grassWorld;
+            float i = cubeWorld.m[3] / 2;
+            float y = cubeWorld.m[7] / 1.5f;
+            float j = cubeWorld.m[11] / 2;
 
-            float minZ = (j*2) - 0.92;
-            float maxZ = (j*2) + 0.92;
+            for (int g = 0; g < factor; g++) {
+                float minX = (i*2) - 0.92;
+                float maxX = (i*2) + 0.92;
 
-            float x = generateRandomFloat(minX, maxX);
-            float z = generateRandomFloat(minZ, maxZ);
+                float minZ = (j*2) - 0.92;
+                float maxZ = (j*2) + 0.92;
 
-            grassWorld = grassWorld.setTranslation(Vec3(x, (y * 1.5) + 2.0f, z)).mul(grassWorld.setScaling(Vec3(0.9,0.9,0.9)));
-            grassPositions.push_back(grassWorld);
+                float x = rng.nextFloat(minX, maxX);
+                float z = rng.nextFloat(minZ, maxZ);
+
+                grassPositions[offset + (c * factor) + g] = grassWorld.setTranslation(Vec3(x, (y * 1.5) + 2.0f, z)).mul(grassWorld.setScaling(Vec3(0.9,0.9,0.9)));
+            }
         }
-    }
+    });
 }
 
-void generateBrickPositionsFromDirtCubes(std::vector<Matrix> &dirtCubesPositions, std::vector<Matrix> &bricksPositions, int factor) {
+void generateBrickPositionsFromDirtCubes(const std::vector<Matrix> &dirtCubesPositions, std::vector<Matrix> &bricksPositions, int factor, int stream) {
     float limit = 0.60f;
-    
-    for (const Matrix &cubeWorld : dirtCubesPositions) {
-        int shouldGen = generateRandomInt(0,1);
-        if (!shouldGen) {
-            continue;
+    int numCubes = dirtCubesPositions.size();
+    int numBatches = (numCubes + LEVEL_GEN_BATCH - 1) / LEVEL_GEN_BATCH;
+
+    // first pass decides which cubes get bricks so every batch knows where its output starts
+    std::vector<unsigned char> shouldGen(numCubes);
+    std::vector<PCG32> batchRng(numBatches);
+    std::vector<int> batchOffsets(numBatches + 1, 0);
+    parallelFor(numBatches, [&](int batch) {
+        batchRng[batch] = randomStream(LEVEL_GEN_STREAM(stream, batch));
+        int last = min((batch + 1) * LEVEL_GEN_BATCH, numCubes);
+        int count = 0;
+        for (int c = batch * LEVEL_GEN_BATCH; c < last; c++) {
+            shouldGen[c] = batchRng[batch].nextInt(0, 1);
+            count += shouldGen[c] * factor;
         }
-        Matrix brickWorld;
-        float i = cubeWorld.m[3] / 2;
-        float y = cubeWorld.m[7] / 1.5f;
-        float j = cubeWorld.m[11] / 2;
+        batchOffsets[batch + 1] = count;
+    });
+
+    int offset = bricksPositions.size();
+    for (int b = 0; b < numBatches; b++) {
+        batchOffsets[b + 1] += batchOffsets[b];
+    }
+    bricksPositions.resize(offset + batchOffsets[numBatches]);
+
+    parallelFor(numBatches, [&](int batch) {
+        PCG32 &rng = batchRng[batch];
+        int last = min((batch + 1) * LEVEL_GEN_BATCH, numCubes);
+        int out = offset + batchOffsets[batch];
+
+        for (int c = batch * LEVEL_GEN_BATCH; c < last; c++) {
+            if (!shouldGen[c]) {
+                continue;
+            }
+            const Matrix &cubeWorld = dirtCubesPositions[c];
+            Matrix brickWorld;
+            float i = cubeWorld.m[3] / 2;
+            float y = cubeWorld.m[7] / 1.5f;
+            float j = cubeWorld.m[11] / 2;
 
-        for (int g = 0; g < factor; g++) {
-            float minX = (i*2) - limit;
-            float maxX = (i*2) + limit;
+            for (int g = 0; g < factor; g++) {
+                float minX = (i*2) - limit;
+                float maxX = (i*2) + limit;
 
-            float minZ = (j*2) - limit;
-            float maxZ = (j*2) + limit;
+                float minZ = (j*2) - limit;
+                float maxZ = (j*2) + limit;
 
-            float x = generateRandomFloat(minX, maxX);
-            float z = generateRandomFloat(minZ, maxZ);
+                float x = rng.nextFloat(minX, maxX);
+                float z = rng.nextFloat(minZ, maxZ);
 
-            brickWorld = brickWorld.setTranslation(Vec3(x, (y * 1.5) + 1.7f, z)).mul(brickWorld.setScaling(Vec3(0.5,0.5,0.5)));
-            bricksPositions.push_back(brickWorld);
+                bricksPositions[out++] = brickWorld.setTranslation(Vec3(x, (y * 1.5) + 1.7f, z)).mul(brickWorld.setScaling(Vec3(0.5,0.5,0.5)));
+            }
         }
-    }
+    });
 }
 
-struct CoinVisible {
-    Coin* coin;
-    bool isVisible;
+// GPU objects created for one streamed level chunk
+struct StreamedChunk {
+    std::vector<CubeTextured*> objects;
+    std::vector<Enemy*> enemies;
+    unsigned long long sizeInBytes = 0;
+};
+
+// A chunk whose objects were created, put into the level once the GPU ran their copies
+struct PendingChunk {
+    LevelChunk *chunk;
+    StreamedChunk streamed;
+    uint64_t uploads; // upload fence value of the chunk's copies
+};
+
+struct RetiredChunk {
+    StreamedChunk chunk;
+    uint64_t frame;
 };
 
 class Level1 {
@@ -126,15 +255,43 @@ public:
     Duck *duck;
     Grass *grass;
     Brick *bricks;
+    BlockWorld blockWorld;
+    uint64_t seed = LEVEL1_SEED;
+    LevelStreamer levelStreamer;
+    ChunkResidency residency;
+    std::map<int, StreamedChunk> streamedChunks;
+    std::vector<LevelChunk*> readyChunks; // loaded, waiting to be activated
+    std::vector<PendingChunk> pendingChunks; // activated, waiting for their uploads, in upload order
+    std::vector<RetiredChunk> retiredChunks;
+    std::set<long long> collectedCoins;
+    StaticColliders staticColliders; // cubes, objects and wheels
+    bool collidersDirty = true;
+    int totalCoins = 0;
+    uint64_t frameCounter = 0;
     
     std::map<std::string, BRDFLightCB> lightsMap;
     Water *water;
-    std::vector<CoinVisible> coins;
-    std::vector<Enemy*> enemies;
+    CoinPickups coins; // ids are chunk and index in the chunk, collected coins stay collected across reloads
+    std::vector<Enemy*> enemies; // their models, the gameplay state is in entities
+    EntityWorld entities;
+    std::vector<Entity> turnarounds; // patrols that turned around this frame
+    NavGrid navGrid; // walkable block tops
+    FlowFieldWorker flowField; // towards the duck, shared by every chasing enemy
+    TransformHierarchy transforms; // world matrices of the duck, the enemies and the scenery
+    Crowd *crowd = nullptr; // nullptr when its model failed to load
+    std::vector<Matrix> crowdPositions;
+    float crowdTime = 0.0f;
 
     float timeAcc = 0.0f;
     bool isFirstFrame = true;
 
+    DrawRecorder recorder;
+    RenderQueue renderQueue; // rebuilt every frame, kept to reuse its memory
+#ifdef _DEBUG
+    RenderQueueStats reportedQueueStats;
+#endif
+    Matrix grassPlayerPos; // duck transform the grass bends around, copied before recording
+
     Level1(Window *_win, ShaderManager *_sm, Core *_core, Camera *_camera) : win(_win), sm(_sm), core(_core), camera(_camera) {};
 
     void createLights() {
@@ -176,59 +333,87 @@ public:
         std::vector<Matrix> grassCubesPositions = {};
         std::vector<Matrix> grassPositions = {};
         std::vector<Matrix> bricksPositions = {};
-        std::vector<Matrix> allCubesPositions = {};
-        
-        // base + right
-        generateCubesPositions(Vec3(-10, 0, -10), 1, 10, 10, darkDirtPositions);
-        generateCubesPositions(Vec3(-10, 2, -10), 1, 10, 10, lightDirtPositions);
-        generateCubesPositions(Vec3(4, 4, -10), 1, 3, 10, grassCubesPositions);
-        
-        // pilar
-        generateCubesPositions(Vec3(4, 6, -4), 3, 1, 2, lightDirtWithGrassPositions);
-        generateCubesPositions(Vec3(8, 6, -4), 3, 1, 2, lightDirtWithGrassPositions);
-        generateCubesPositions(Vec3(4, 12, -6), 1, 3, 4, lightDirtPositions);
-
-        // bridge
-        generateCubesPositions(Vec3(-10, 12, -4), 1, 7, 2, lightDirtPositions);
-
-        // left base
-        generateCubesPositions(Vec3(-10, 4, -10), 1, 4, 6, lightDirtPositions);
-        generateCubesPositions(Vec3(-10, 4, 6), 1, 4, 2, lightDirtPositions);
-        generateCubesPositions(Vec3(-10, 6, 8), 4, 4, 1, lightDirtPositions);
-        generateCubesPositions(Vec3(-10, 12, 0), 1, 4, 4, lightDirtPositions);
-
-        // left tunnel
-        generateCubesPositions(Vec3(-8, 6, -6), 2, 2, 6, lightDirtPositions);
-        generateCubesPositions(Vec3(-4, 6, -6), 3, 1, 4, lightDirtWithGrassPositions);
-        generateCubesPositions(Vec3(-4, 6, 6), 3, 1, 2, lightDirtWithGrassPositions);
-        generateCubesPositions(Vec3(-10, 6, -10), 4, 4, 1, lightDirtPositions); // Wall
-        //generateCubesPositions(Vec3(-10, 10, -8), 2, 1, 2, lightDirtPositions);
-        generateCubesPositions(Vec3(-4, 10, -8), 1, 1, 1, lightDirtPositions);
-        generateCubesPositions(Vec3(-8, 9, -8), 1, 2, 1, lightDirtPositions);
-        generateCubesPositions(Vec3(-4, 12, -8), 1, 1, 2, lightDirtPositions);
-
-        generateCubesPositions(Vec3(-10, 12, 10), 2, 4, 1, lightDirtPositions);
-        //generateCubesPositions(Vec3(-10, 12, 12), 3, 4, 1, lightDirtPositions);
 
-        generateCubesPositions(Vec3(-10, 4, 10), 1, 4, 1, grassCubesPositions);
-        generateCubesPositions(Vec3(-12, 4, 6), 1, 1, 3, grassCubesPositions);
-
-
-        // grass stand
-        generateCubesPositions(Vec3(0, 4, -10), 1, 1, 2, grassCubesPositions);
-
-        generateGrassPositionsFromGrassCubes(grassCubesPositions, grassPositions, 50);
-        generateGrassPositionsFromGrassCubes(lightDirtWithGrassPositions, grassPositions, 10);
+        std::vector<CubeRegion> darkDirtRegions = {
+            { Vec3(-10, 0, -10), 1, 10, 10 }, // base + right
+        };
+
+        std::vector<CubeRegion> lightDirtRegions = {
+            // base + right
+            { Vec3(-10, 2, -10), 1, 10, 10 },
+
+            // pilar
+            { Vec3(4, 12, -6), 1, 3, 4 },
+
+            // bridge
+            { Vec3(-10, 12, -4), 1, 7, 2 },
+
+            // left base
+            { Vec3(-10, 4, -10), 1, 4, 6 },
+            { Vec3(-10, 4, 6), 1, 4, 2 },
+            { Vec3(-10, 6, 8), 4, 4, 1 },
+            { Vec3(-10, 12, 0), 1, 4, 4 },
+
+            // left tunnel
+            { Vec3(-8, 6, -6), 2, 2, 6 },
+            { Vec3(-10, 6, -10), 4, 4, 1 }, // Wall
+            //{ Vec3(-10, 10, -8), 2, 1, 2 },
+            { Vec3(-4, 10, -8), 1, 1, 1 },
+            { Vec3(-8, 9, -8), 1, 2, 1 },
+            { Vec3(-4, 12, -8), 1, 1, 2 },
+
+            { Vec3(-10, 12, 10), 2, 4, 1 },
+            //{ Vec3(-10, 12, 12), 3, 4, 1 },
+        };
+
+        std::vector<CubeRegion> lightDirtWithGrassRegions = {
+            // pilar
+            { Vec3(4, 6, -4), 3, 1, 2 },
+            { Vec3(8, 6, -4), 3, 1, 2 },
+
+            // left tunnel
+            { Vec3(-4, 6, -6), 3, 1, 4 },
+            { Vec3(-4, 6, 6), 3, 1, 2 },
+        };
+
+        std::vector<CubeRegion> grassCubesRegions = {
+            // base + right
+            { Vec3(4, 4, -10), 1, 3, 10 },
+
+            // left base
+            { Vec3(-10, 4, 10), 1, 4, 1 },
+            { Vec3(-12, 4, 6), 1, 1, 3 },
+
+            // grass stand
+            { Vec3(0, 4, -10), 1, 1, 2 },
+        };
+
+        generateCubesPositions(darkDirtRegions, darkDirtPositions, STREAM_DARK_DIRT);
+        generateCubesPositions(lightDirtRegions, lightDirtPositions, STREAM_LIGHT_DIRT);
+        generateCubesPositions(lightDirtWithGrassRegions, lightDirtWithGrassPositions, STREAM_LIGHT_DIRT_WITH_GRASS);
+        generateCubesPositions(grassCubesRegions, grassCubesPositions, STREAM_GRASS_CUBES);
+
+        grassPositions.reserve((grassCubesPositions.size() * 50) + (lightDirtWithGrassPositions.size() * 10));
+        generateGrassPositionsFromGrassCubes(grassCubesPositions, grassPositions, 50, STREAM_GRASS);
+        generateGrassPositionsFromGrassCubes(lightDirtWithGrassPositions, grassPositions, 10, STREAM_GRASS_ON_DIRT);
 
         append(lightDirtPositions, lightDirtWithGrassPositions);
-        generateBrickPositionsFromDirtCubes(lightDirtPositions, bricksPositions, 1);
-
-        Cube* grassCubes = Cube::createGrassCube(sm, core, grassCubesPositions);
-        Cube* darkDirtCubes = Cube::createDarkDirtCube(sm, core, darkDirtPositions);
-        CubeTextured* lightDirtCubes = CubeTextured::createBrickCubes(sm, core, lightDirtPositions, &lightsMap[DEFAULT_LIGTH]);
+        generateBrickPositionsFromDirtCubes(lightDirtPositions, bricksPositions, 1, STREAM_BRICKS);
+
+        // all block kinds share one world so faces between different kinds are culled too
+        blockWorld.init(CUBE_MODEL);
+        blockWorld.addBlocks(grassCubesPositions, BLOCK_GRASS);
+        blockWorld.addBlocks(darkDirtPositions, BLOCK_DARK_DIRT);
+        blockWorld.addBlocks(lightDirtPositions, BLOCK_LIGHT_DIRT);
+
+        Cube* grassCubes = Cube::createGrassCube(sm, core, &blockWorld, BLOCK_GRASS);
+        Cube* darkDirtCubes = Cube::createDarkDirtCube(sm, core, &blockWorld, BLOCK_DARK_DIRT);
+        CubeTextured* lightDirtCubes = CubeTextured::createBrickCubes(sm, core, &blockWorld, BLOCK_LIGHT_DIRT, &lightsMap[DEFAULT_LIGTH]);
+        blockWorld.dirtyChunks.clear();
+        buildNavigation();
         
-        Grass* _grass = Grass::createGrass(sm, core, grassPositions, &duck->vsCBAnimatedModel.W);
-        Brick* _bricks = Brick::createBrick(sm, core, bricksPositions, &lightsMap[LIGHT_BRICK]);
+        Grass* _grass = Grass::createGrass(sm, core, std::move(grassPositions), &duck->vsCBAnimatedModel.W);
+        Brick* _bricks = Brick::createBrick(sm, core, std::move(bricksPositions), &lightsMap[LIGHT_BRICK]);
 
         cubes.push_back(grassCubes);
         cubes.push_back(darkDirtCubes);
@@ -238,96 +423,75 @@ public:
         bricks = _bricks;
     }
     
-    void createObjects() {
-        Matrix pilar1;
-        pilar1 = pilar1.setTranslation(Vec3(4.0f, 13.7f, -6.0f)).mul(pilar1.setScaling(Vec3(0.6,0.6,0.6)));
-        std::vector<Matrix> pilarPos = {pilar1};
-
-        Matrix pilarBrokenM;
-        pilarBrokenM = pilarBrokenM.setTranslation(Vec3(4.0f, 13.7f, 0.0f)).mul(pilarBrokenM.setScaling(Vec3(0.6,0.6,0.6)));
-        std::vector<Matrix> pilarBrokenPos = {pilarBrokenM};
-
-        Matrix palmTreeM, rotationM;
-        rotationM.setRotationY(180);
-        palmTreeM = palmTreeM.setTranslation(Vec3(2.0f, 5.7f, 7.5f)).mul(rotationM);
-        std::vector<Matrix> palmTreePos = {palmTreeM};
-
-        Matrix rail1, rail2, rail3, rail4;
-        rail1 = rail1.setTranslation(Vec3(-1.5f, 4.0f, 8.2f)).mul(rail1.setScaling(Vec3(1.0, 1.2, 1.5)));
-        rail2 = rail2.setTranslation(Vec3(1.5f, 4.0f, 8.2f)).mul(rail2.setScaling(Vec3(1.0, 1.2, 1.5)));
-        rail3 = rail3.setTranslation(Vec3(-1.5f, 4.0f, -10.65f)).mul(rail3.setScaling(Vec3(1.0, 1.2, 1.5)));
-        rail4 = rail4.setTranslation(Vec3(1.5f, 4.0f, -10.65f)).mul(rail4.setScaling(Vec3(1.0, 1.2, 1.5)));
-        std::vector<Matrix> railsPos = {rail1, rail2, rail3, rail4};
-
-        CubeTextured* pilar = new CubeTextured(sm, core, "models/pilar.gem");
-        pilar->init(core, pilarPos, &lightsMap[DEFAULT_LIGTH], "models/textures/metal_color.png");
-        pilar->setSize(Vec3(1.3, 5, 1.3));
-
-        CubeTextured* pilarBroken = new CubeTextured(sm, core, "models/pilar_broken.gem");
-        pilarBroken->init(core, pilarBrokenPos, &lightsMap[DEFAULT_LIGTH], "models/textures/metal_color.png");
-        pilarBroken->setSize(Vec3(1, 2.5, 1));
-
-        CubeTextured* palmTree = new CubeTextured(sm, core, "models/palm_tree.gem");
-        palmTree->init(core, palmTreePos, &lightsMap[DEFAULT_LIGTH], "models/textures/ColorPalette2.png");
-        palmTree->setSize(Vec3(4.7, 4, 1));
-
-        CubeTextured* rails = new CubeTextured(sm, core, "models/rail.gem");
-        rails->init(core, railsPos, &lightsMap[DEFAULT_LIGTH], "models/textures/ColorPalette2.png");
-        rails->setSize(Vec3(2,1.5,2));
-
-        Matrix plant1, rotation1X, rotationY1;
-        rotation1X.setRotationX(-25);
-        //rotationY1.setRotationY(-90);
-        plant1 = plant1.setTranslation(Vec3(-9.2f, 13.3f, -5.0f)).mul(rotation1X).mul(plant1.setScaling(Vec3(3, 3, 3)));
-        std::vector<Matrix> plantsPos = {plant1};
-
-        CubeTextured* plants = new CubeTextured(sm, core, "models/plant.gem");
-        plants->init(core, plantsPos, &lightsMap[DEFAULT_LIGTH], "models/textures/ColorPalette.png");
-        plants->setSize(Vec3(0.01,0.01,0.01));
-
-        Matrix spikes1, spikes2, spikes3, spikes4;
-        spikes1 = spikes1.setTranslation(Vec3(-1.5f, 14.0f, -1.3f)).mul(spikes1.setScaling(Vec3(0.5,0.3,1)));
-        spikes2 = spikes2.setTranslation(Vec3(1.5f, 14.0f, -1.3f)).mul(spikes2.setScaling(Vec3(0.5,0.3,1)));
-        spikes3 = spikes3.setTranslation(Vec3(-1.5f, 14.0f, -5.0f)).mul(spikes3.setScaling(Vec3(0.5,0.3,1)));
-        spikes4 = spikes4.setTranslation(Vec3(1.5f, 14.0f, -5.0f)).mul(spikes4.setScaling(Vec3(0.5,0.3,1)));
-        
-        std::vector<Matrix> spikesPos = {spikes1, spikes2, spikes3, spikes4};
-        
-        CubeTextured* spikes = new CubeTextured(sm, core, "models/spikes.gem");
-        spikes->init(core, spikesPos, &lightsMap[LIGHT_WHEEL], "models/textures/ColorPalette2.png");
-
-        Matrix treeM;
-        treeM = treeM.setTranslation(Vec3(8.0f, 6.0f, -10.0f)).mul(treeM.setScaling(Vec3(0.8,0.8,0.8)));
-        std::vector<Matrix> treePos = {treeM};
-
-        CubeTextured* tree = new CubeTextured(sm, core, "models/tree.gem");
-        tree->init(core, treePos, &lightsMap[DEFAULT_LIGTH], "models/textures/ColorPalette2.png");
-        tree->setSize(Vec3(2, 8, 2));
+    // The walkable tops of the blocks, stepping up one block and dropping two at most
+    void buildNavigation() {
+        NavBounds bounds;
+        bool first = true;
+        for (const Block &block : blockWorld.blocks) {
+            if (!block.alive) continue;
+            if (first || block.cell[0] < bounds.minX) bounds.minX = block.cell[0];
+            if (first || block.cell[1] < bounds.minY) bounds.minY = block.cell[1];
+            if (first || block.cell[2] < bounds.minZ) bounds.minZ = block.cell[2];
+            if (first || block.cell[0] > bounds.maxX) bounds.maxX = block.cell[0];
+            if (first || block.cell[1] > bounds.maxY) bounds.maxY = block.cell[1];
+            if (first || block.cell[2] > bounds.maxZ) bounds.maxZ = block.cell[2];
+            first = false;
+        }
+        navGrid.build(bounds, NavSettings(), BLOCK_GRID_SIZE, [this](int x, int y, int z) {
+            return blockWorld.grid.find(packBlockKey(x, y, z)) != blockWorld.grid.end();
+        });
+
+        // node numbers change with the grid, chasers look theirs up again
+        entities.each(COMPONENT_BIT(COMPONENT_CHASE), [](Archetype &archetype, int first, int last) {
+            for (int i = first; i < last; i++) {
+                archetype.chases[i].node = NAV_NO_NODE;
+            }
+        });
+    }
 
-        cubesTextured.push_back(pilar);
-        cubesTextured.push_back(pilarBroken);
-        cubesTextured.push_back(palmTree);
-        cubesTextured.push_back(rails);
-        cubesTextured.push_back(plants);
-        cubesTextured.push_back(tree);
-        //cubesTextured.push_back(spikes);
+    // Scenery that never moves gets its world matrix from the hierarchy once and is never marked again
+    Matrix placeStatic(const TransformLocal &local) {
+        TransformId node = transforms.add(local);
+        transforms.update();
+        return transforms.world(node);
     }
 
     void createWater() {
-        Matrix waterPlaneM;
-        waterPlaneM = waterPlaneM.setTranslation(Vec3(0.0f, 5.0f, -1.2f)).mul(waterPlaneM.setScaling(Vec3(1.0,1.0,0.85)));
-        std::vector<Matrix> waterPlanePos = {waterPlaneM};
+        TransformLocal waterPlane;
+        waterPlane.position = Vec3(0.0f, 5.0f, -1.2f);
+        waterPlane.scale = Vec3(1.0f, 1.0f, 0.85f);
+        std::vector<Matrix> waterPlanePos = {placeStatic(waterPlane)};
 
         Water *_water = Water::createWater(sm, core, waterPlanePos, &lightsMap[WATER_LIGHT]);
         water = _water;
     }
 
+    // On the water plane, which spans x -3.1 to 3.1 and z -10.5 to 8.1 at y 5
+    void createCrowd() {
+        Crowd *_crowd = new Crowd(core, sm);
+        if (!_crowd->load(LEVEL1_CROWD_MODEL)) {
+            _crowd->release();
+            delete _crowd;
+            return;
+        }
+        int clip = max(_crowd->clipIndex(LEVEL1_CROWD_CLIP), 0);
+
+        PCG32 rng = randomStream(LEVEL_GEN_STREAM(STREAM_CROWD, 0));
+        std::vector<CrowdInstance> instances(LEVEL1_CROWD_SIZE);
+        for (CrowdInstance &instance : instances) {
+            Vec3 position(rng.nextFloat(-2.5f, 2.5f), 5.0f, rng.nextFloat(-9.5f, 7.0f));
+            instance.world = placeStatic(TransformLocal::fromRotationY(position, rng.nextFloat(0.0f, 360.0f), Vec3(LEVEL1_CROWD_SCALE, LEVEL1_CROWD_SCALE, LEVEL1_CROWD_SCALE)));
+            instance.clip = clip;
+            instance.timeOffset = rng.nextFloat(0.0f, 10.0f);
+            instance.rate = rng.nextFloat(0.8f, 1.2f);
+            crowdPositions.push_back(instance.world);
+        }
+        _crowd->updateInstances(instances);
+        crowd = _crowd;
+    }
+
     void createWheel() {
-        Matrix waterWheelM1, rotationM1, scaleM1;
-        rotationM1.setRotationY(90);
-        scaleM1 = scaleM1.setScaling(Vec3(1.5,1.8,1.5));
-        waterWheelM1 = waterWheelM1.setTranslation(Vec3(-3.5f, 4.2f, 3.0f)).mul(rotationM1).mul(scaleM1);
-        std::vector<Matrix> waterWheelPos = {waterWheelM1};
+        std::vector<Matrix> waterWheelPos = {placeStatic(TransformLocal::fromRotationY(Vec3(-3.5f, 4.2f, 3.0f), 90.0f, Vec3(1.5f, 1.8f, 1.5f)))};
 
         Wheel *_wheel = Wheel::createWheel(sm, core, waterWheelPos,  &lightsMap[LIGHT_WHEEL]);
         _wheel->setSize(Vec3(6,8,4));
@@ -335,175 +499,364 @@ public:
     }
 
     void createBigWheel() {
-        Matrix waterWheelM1, rotationM1, scaleM1;
-        rotationM1.setRotationY(270);
-        scaleM1 = scaleM1.setScaling(Vec3(1.9,2.2,1.7));
-        waterWheelM1 = waterWheelM1.setTranslation(Vec3(-6.8f, 8.65f, -12.6f)).mul(rotationM1).mul(scaleM1);
-        std::vector<Matrix> waterWheelPos = {waterWheelM1};
+        std::vector<Matrix> waterWheelPos = {placeStatic(TransformLocal::fromRotationY(Vec3(-6.8f, 8.65f, -12.6f), 270.0f, Vec3(1.9f, 2.2f, 1.7f)))};
 
         Wheel *_wheel = Wheel::createWheel(sm, core, waterWheelPos,  &lightsMap[LIGHT_WHEEL]);
         _wheel->setSize(Vec3(6,8,4));
         bigWheel = _wheel;
     }
 
-    void createCoins() {        
-        Matrix coin1, coin2, coin3, coin4, coin5, coin6, coin7, coin8, coin9, coin10, coin11, coin12;
-        Matrix coin13, coin14, coin15, coin16, coin17, coin18, coin19, coin20, coin21, coin22, coin23, coin24;
-        coin1 = coin1.setTranslation(Vec3(8.0f, 6.5f, 7.5f)).mul(coin1.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin2 = coin2.setTranslation(Vec3(0, 14, -3)).mul(coin2.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin3 = coin3.setTranslation(Vec3(2, 14, -3)).mul(coin3.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin4 = coin4.setTranslation(Vec3(-2, 14, -3)).mul(coin4.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin5 = coin5.setTranslation(Vec3(-4, 14, 8)).mul(coin5.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin6 = coin6.setTranslation(Vec3(-6, 14, 8)).mul(coin6.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin7 = coin7.setTranslation(Vec3(-8, 14, 8)).mul(coin7.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin8 = coin8.setTranslation(Vec3(-10, 14, 8)).mul(coin8.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin9 = coin9.setTranslation(Vec3(-10, 16, 10)).mul(coin9.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin10 = coin10.setTranslation(Vec3(-8, 16, 10)).mul(coin10.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin11 = coin11.setTranslation(Vec3(-6, 16, 10)).mul(coin11.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin12 = coin12.setTranslation(Vec3(-4, 16, 10)).mul(coin12.setScaling(Vec3(0.015, 0.015, 0.015)));
-
-        coin13 = coin13.setTranslation(Vec3(-7, 18, 12)).mul(coin13.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin14 = coin14.setTranslation(Vec3(-8, 18, 12)).mul(coin14.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin15 = coin15.setTranslation(Vec3(-6, 18, 12)).mul(coin15.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin16 = coin16.setTranslation(Vec3(-4, 18, 12)).mul(coin16.setScaling(Vec3(0.015, 0.015, 0.015)));
-
-        coin17 = coin17.setTranslation(Vec3(-10, 6, -8)).mul(coin17.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin18 = coin18.setTranslation(Vec3(0, 6, -10)).mul(coin18.setScaling(Vec3(0.015, 0.015, 0.015)));
-        
-        coin19 = coin19.setTranslation(Vec3(-6, 6, 10)).mul(coin19.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin20 = coin20.setTranslation(Vec3(-4, 6, 10)).mul(coin20.setScaling(Vec3(0.015, 0.015, 0.015)));
+    bool loadLevelFile() {
+        std::error_code error;
+        bool sceneExists = std::filesystem::exists(LEVEL1_SCENE, error);
+        bool isStale = !std::filesystem::exists(LEVEL1_FILE, error) ||
+            (sceneExists && std::filesystem::last_write_time(LEVEL1_SCENE, error) > std::filesystem::last_write_time(LEVEL1_FILE, error));
+
+        if (isStale) {
+            LevelData levelData;
+            levelData.animationNames.assign(E_AnimationsMap, E_AnimationsMap + (sizeof(E_AnimationsMap) / sizeof(E_AnimationsMap[0])));
+            if (!levelData.compileScene(LEVEL1_SCENE) || !levelData.saveBinary(LEVEL1_FILE)) {
+                MessageBoxA(NULL, "Failed to compile level " LEVEL1_SCENE, "Error", MB_OK | MB_ICONERROR);
+                return false;
+            }
+        }
+
+        if (!levelStreamer.open(LEVEL1_FILE)) {
+            MessageBoxA(NULL, "Failed to open level " LEVEL1_FILE, "Error", MB_OK | MB_ICONERROR);
+            return false;
+        }
 
-        coin21 = coin21.setTranslation(Vec3(-10, 4, 2)).mul(coin21.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin22 = coin22.setTranslation(Vec3(-10, 4, 4)).mul(coin22.setScaling(Vec3(0.015, 0.015, 0.015)));
+        residency.settings.loadRadius = LEVEL1_STREAM_RADIUS;
+        residency.settings.unloadRadius = LEVEL1_UNLOAD_RADIUS;
+        residency.settings.memoryBudget = LEVEL1_STREAM_BUDGET;
+        for (const LevelChunkEntry &entry : levelStreamer.table) {
+            residency.addCell(entry.cx * LEVEL_CHUNK_WORLD_SIZE, entry.cz * LEVEL_CHUNK_WORLD_SIZE, LEVEL_CHUNK_WORLD_SIZE, LEVEL1_CHUNK_COST_ESTIMATE);
+            totalCoins += entry.numCoins;
+        }
+        return true;
+    }
+
+    // Creates the GPU objects of a chunk that finished streaming in. All their copies go into one
+    // upload list, the chunk waits in pendingChunks until the GPU ran it
+    void activateChunk(LevelChunk *chunk) {
+        PendingChunk pending;
+        pending.chunk = chunk;
+        StreamedChunk &streamed = pending.streamed;
+
+        core->beginUploads();
+        for (LevelInstanceGroup &group : chunk->groups) {
+            BRDFLightCB *light = &lightsMap[group.light == "" ? DEFAULT_LIGTH : group.light];
+
+            if (group.kind == LEVEL_OBJECT) {
+                CubeTextured* object = new CubeTextured(sm, core, group.meshFilename);
+                object->init(core, std::move(group.worldPositions), light, group.texture);
+                object->setSize(group.size);
+                streamed.objects.push_back(object);
+                streamed.sizeInBytes += object->sizeInBytes();
+            }
+            else if (group.kind == LEVEL_COIN) {
+                streamed.sizeInBytes += group.worldPositions.size() * sizeof(Matrix);
+            }
+            else if (group.kind == LEVEL_ENEMY) {
+                for (int i = 0; i < group.worldPositions.size(); i++) {
+                    Enemy *enemy = new Enemy(sm, core, &entities, &transforms, group.meshFilename);
+                    streamed.enemies.push_back(enemy);
+                    streamed.sizeInBytes += enemy->sizeInBytes();
+                }
+            }
+        }
+        pending.uploads = core->endUploads();
+        pendingChunks.push_back(std::move(pending));
+    }
 
-        coin23 = coin23.setTranslation(Vec3(-7, 10, -4)).mul(coin23.setScaling(Vec3(0.015, 0.015, 0.015)));
-        coin24 = coin24.setTranslation(Vec3(-7, 10, 2)).mul(coin24.setScaling(Vec3(0.015, 0.015, 0.015)));
+    // Puts a chunk's objects, coins and enemies into the level once its uploads are done
+    void publishChunk(PendingChunk &pending) {
+        LevelChunk *chunk = pending.chunk;
+        StreamedChunk &streamed = streamedChunks[chunk->index];
+        streamed = std::move(pending.streamed);
+        cubesTextured.insert(cubesTextured.end(), streamed.objects.begin(), streamed.objects.end());
+
+        int coinIndex = 0;
+        int enemyIndex = 0;
+        for (const LevelInstanceGroup &group : chunk->groups) {
+            if (group.kind == LEVEL_COIN) {
+                for (const Matrix &pos : group.worldPositions) {
+                    long long id = ((long long)chunk->index << COIN_ID_CHUNK_SHIFT) | coinIndex++;
+                    coins.add(id, pos, collectedCoins.count(id) == 0);
+                }
+            }
+            else if (group.kind == LEVEL_ENEMY) {
+                for (int i = 0; i < group.worldPositions.size(); i++) {
+                    const Matrix &start = group.worldPositions[i];
+                    const LevelEnemy &params = group.enemies[i];
+                    float walkVelocity = params.walkVelocity < 0.0f ? E_WALK_VELOCITY : params.walkVelocity;
+
+                    Enemy *enemy = streamed.enemies[enemyIndex++];
+                    enemy->spawn(Vec3(start.m[3], start.m[7], start.m[11]), params.endPosition, (MOVE_KIND)params.moveKind,
+                        params.rotationAngle, params.scale, (ENEMY_ANIMATION)params.animation, walkVelocity);
+                    enemy->setSize(group.size);
+                    enemies.push_back(enemy);
+                }
+            }
+        }
+        residency.onLoaded(chunk->index, streamed.sizeInBytes);
+        collidersDirty = true;
+        delete chunk;
+    }
 
-        std::vector<Matrix> coinsPos = {coin1, coin2, coin3, coin4, coin5, coin6, coin7, coin8, coin9, coin10, coin11, coin12, coin13, coin17, coin18, coin20, coin21, coin22, coin23, coin24};
-        for (Matrix pos : coinsPos) {
-            std::vector<Matrix> unary = {pos};
-            Coin* _coin = Coin::createCoins(sm, core, unary, &lightsMap[COIN_LIGHT]);
-            coins.push_back(CoinVisible{_coin, true});
+    // Batches finish in the order they were submitted, so this stops at the first one still running.
+    // wait blocks on the uploads instead
+    void publishUploadedChunks(bool wait) {
+        int published = 0;
+        for (PendingChunk &pending : pendingChunks) {
+            if (wait) {
+                core->waitForUploads(pending.uploads);
+            }
+            else if (!core->uploadsDone(pending.uploads)) {
+                break;
+            }
+            publishChunk(pending);
+            published++;
         }
+        pendingChunks.erase(pendingChunks.begin(), pendingChunks.begin() + published);
     }
 
-    void createEnemies() {
-        Enemy *bull = new Enemy(sm, core, Vec3(-10.0f, 14.0f, 6.0f), Vec3(-4.0f, 14.0f, 6.0f), ALONG_X, -90, BULL_MODEL_FILE, 0.015, E_WALK_FORWARD);
-        Enemy *bull2 = new Enemy(sm, core, Vec3(-4.0f, 14.0f, 1.0f), Vec3(-10.0f, 14.0f, 1.0f), ALONG_X, 90, BULL_MODEL_FILE, 0.015, E_WALK_FORWARD);
-        Enemy *cat1 = new Enemy(sm, core, Vec3(-10.0f, 6.0f, -2.0f), Vec3(-10.0f, 6.0f, -2.0f), ALONG_Z, 180, CAT_SIAMESE_MODEL_FILE, 0.05, E_ATTACK);
-        Enemy *cat2 = new Enemy(sm, core, Vec3(6.0f, 6.2f, 8.0f), Vec3(6.0f, 6.2f, 0.0f), ALONG_Z, 0, CAT_MODEL_FILE, 0.04, E_WALK_FORWARD, 0.15f);
-        Enemy *duck = new Enemy(sm, core, Vec3(4.0f, 17.2f, -6.0f), Vec3(4.0f, 17.1f, -6.0f), ALONG_Z, 90, DUCK_MIXED_MODEL_FILE, 0.02, E_BIRD_IDLE_VARIATION);
+    // Takes the chunk's objects out of the level. The GPU may still be drawing them,
+    // so they are freed LEVEL1_RETIRE_FRAMES later
+    void retireChunk(int index) {
+        auto it = streamedChunks.find(index);
+        if (it == streamedChunks.end()) return;
+        StreamedChunk &streamed = it->second;
 
-        bull->setSize(Vec3(2.0, 2.0, 2.0));
-        bull2->setSize(Vec3(2.0, 2.0, 2.0));
-        cat1->setSize(Vec3(1.0, 1.0, 2.0));
-        cat2->setSize(Vec3(1.0, 1.0, 2.0));
-        duck->setSize(Vec3(0.02f, 0.02f, 0.02f));
+        for (CubeTextured *object : streamed.objects) {
+            cubesTextured.erase(std::remove(cubesTextured.begin(), cubesTextured.end(), object), cubesTextured.end());
+        }
+        coins.removeChunk(index);
+        for (Enemy *enemy : streamed.enemies) {
+            enemies.erase(std::remove(enemies.begin(), enemies.end(), enemy), enemies.end());
+            enemy->despawn();
+        }
+
+        retiredChunks.push_back(RetiredChunk{std::move(streamed), frameCounter});
+        collidersDirty = true;
+        streamedChunks.erase(it);
+    }
 
-        enemies.push_back(bull);
-        enemies.push_back(bull2);
-        enemies.push_back(cat1);
-        enemies.push_back(cat2);
-        enemies.push_back(duck);
+    void releaseRetiredChunks() {
+        for (auto it = retiredChunks.begin(); it != retiredChunks.end();) {
+            if (frameCounter - it->frame < LEVEL1_RETIRE_FRAMES) {
+                ++it;
+                continue;
+            }
+            for (CubeTextured *object : it->chunk.objects) {
+                object->release();
+                delete object;
+            }
+            for (Enemy *enemy : it->chunk.enemies) {
+                enemy->release();
+                delete enemy;
+            }
+            it = retiredChunks.erase(it);
+        }
+    }
+
+    // Loads the level chunks around the duck on worker threads and unloads the ones far away
+    // or over the memory budget. wait blocks until the first chunks are in, used before the first frame
+    void streamLevel(bool wait = false) {
+        frameCounter++;
+        releaseRetiredChunks();
+
+        std::vector<int> toLoad;
+        do {
+            std::vector<int> toEvict;
+            toLoad.clear();
+            residency.update(duck->position, frameCounter, toLoad, toEvict);
+
+            for (int index : toEvict) {
+                retireChunk(index);
+            }
+            for (int index : toLoad) {
+                levelStreamer.request(index);
+            }
+
+            std::vector<int> failed;
+            levelStreamer.collect(readyChunks, failed, wait);
+            for (int index : failed) {
+                residency.onLoadFailed(index);
+            }
+
+            // the chunks activated below read their textures in parallel instead of one after another
+            std::vector<std::string> textures;
+            for (size_t i = 0; i < readyChunks.size() && (wait || (int)i < LEVEL1_ACTIVATIONS_PER_FRAME); i++) {
+                for (const LevelInstanceGroup &group : readyChunks[i]->groups) {
+                    if (group.kind == LEVEL_OBJECT) textures.push_back(group.texture);
+                }
+            }
+            TextureManager::prefetch(textures);
+
+            int activations = 0;
+            while (!readyChunks.empty() && (wait || activations < LEVEL1_ACTIVATIONS_PER_FRAME)) {
+                LevelChunk *chunk = readyChunks.front();
+                readyChunks.erase(readyChunks.begin());
+                activateChunk(chunk);
+                activations++;
+            }
+            publishUploadedChunks(wait);
+        } while (wait && !toLoad.empty()); // more than maxLoadsInFlight chunks around the start
+
+        coins.upload(core); // coins that streamed in or out, or were collected last frame
     }
 
     void createDuck() {
-        Duck *_duck = new Duck(sm, core, Vec3(8.0f, 16.0f, -3.0f), camera);
+        Duck *_duck = new Duck(sm, core, Vec3(8.0f, 16.0f, -3.0f), camera, &transforms);
         duck = _duck;
     }
 
+    // what init loads, main reads them on worker threads while the shaders and the sky load
+    static std::vector<std::string> startupTextures() {
+        return { BRICK_TEXTURE, COIN_TEXTURE, GRASS_TEXTURE, WATER_TEXTURE, WHEEL_TEXTURE, BRICKS_TEXTURE };
+    }
+
     void init() {
+        setRandomSeed(seed);
+        recorder.init(core);
         createLights();
+        coins.init(sm, core, &lightsMap[COIN_LIGHT]);
         createDuck();
         createBlocksLayout();
-        createObjects();
+        flowField.start(&navGrid);
         createWater();
+        createCrowd();
         createWheel();
         createBigWheel();
-        createCoins();
-        createEnemies();
+        if (loadLevelFile()) {
+            streamLevel(true);
+        }
     }
 
-    void checkRigidBodyCollision(GEMObject *object) {
-        for (Matrix objectWorldMatrix : object->worldPositions) {
-            bool isColidingX = duck->checkCollisionX(&objectWorldMatrix, object->size);
-            if (isColidingX) {
-                duck->blockMovementX();
-            }
-    
-            bool isColidingY = duck->checkCollisionY(&objectWorldMatrix, object->size);
-            if (isColidingY) {
-                duck->isJumping = false;
-                duck->jumpingCurrentHeight = 0.0f;
-                duck->blockMovementY();
-            }
-    
-            bool isColidingZ = duck->checkCollisionZ(&objectWorldMatrix, object->size);
-            if (isColidingZ) {
-                duck->blockMovementZ();
-            }
+    // Rebuilds only the chunks touched by block changes since the last call. Runs between frames
+    void rebuildDirtyChunks() {
+        if (blockWorld.dirtyChunks.empty()) return;
+
+        for (Cube *cube : cubes) {
+            cube->rebuildDirtyChunks(blockWorld.dirtyChunks);
+        }
+
+        for (CubeTextured *cubeTextured : cubesTextured) {
+            cubeTextured->rebuildDirtyChunks(blockWorld.dirtyChunks);
         }
+        blockWorld.dirtyChunks.clear();
+        collidersDirty = true;
+
+        flowField.reset(); // waits for a field being built over the old grid
+        buildNavigation();
     }
 
-    void checkCoinsCollision() {
-        int idxColiding = -1;
-        int idx = 0;
-        for (CoinVisible coinVisible : coins) {
-            if (!coinVisible.isVisible) {
-                idx++;
-                continue;
-            }
-            Matrix objectWorldMatrix = coinVisible.coin->worldPositions[0];
-            bool isColidingX = duck->checkCollisionX(&objectWorldMatrix, coinVisible.coin->size);    
-            bool isColidingY = duck->checkCollisionY(&objectWorldMatrix, coinVisible.coin->size);
-            bool isColidingZ = duck->checkCollisionZ(&objectWorldMatrix, coinVisible.coin->size);
-            if (isColidingX || isColidingY || isColidingZ) {
-                idxColiding = idx;
-                break;
-            }
-            idx++;
+    void addColliders(GEMObject *object) {
+        for (const Matrix &world : object->worldPositions) {
+            staticColliders.add(world.m[3], world.m[7], world.m[11], object->size.x, object->size.y, object->size.z);
         }
+    }
 
-        if (idxColiding != -1) {
-            coins[idxColiding].isVisible = false;
+    // Packs the boxes of everything that does not move, after the set of objects or blocks changed
+    void rebuildColliders() {
+        staticColliders.clear();
+        for (Cube *cube : cubes) {
+            addColliders(cube);
+        }
+        for (CubeTextured *cubeTextured : cubesTextured) {
+            addColliders(cubeTextured);
         }
+        addColliders(wheel);
+        addColliders(bigWheel);
+        staticColliders.pad();
+        collidersDirty = false;
     }
 
-    void checkEnemiesCollision() {
-        if (duck->isDead) return;
+    // A blocked axis goes back to where it was last frame. Blocking twice changes nothing, so
+    // knowing whether any box blocks an axis is enough and the boxes can be tested in batches
+    void checkStaticCollisions() {
+        if (collidersDirty) rebuildColliders();
+        ColliderHits hits = testColliders(staticColliders, duck->colliderQuery());
+        if (hits.x) {
+            duck->blockMovementX();
+        }
+        if (hits.y) {
+            duck->isJumping = false;
+            duck->jumpingCurrentHeight = 0.0f;
+            duck->blockMovementY();
+        }
+        if (hits.z) {
+            duck->blockMovementZ();
+        }
+    }
 
-        for (Enemy *enemy : enemies) {
-            Matrix objectWorldMatrix = enemy->enemyModel.vertexShaderCB->W;
-            bool isColidingX = duck->checkCollisionX(&objectWorldMatrix, enemy->size);    
-            bool isColidingY = duck->checkCollisionY(&objectWorldMatrix, enemy->size);
-            bool isColidingZ = duck->checkCollisionZ(&objectWorldMatrix, enemy->size);
+    void checkCoinsCollision() {
+        for (int i = coins.nextVisible(0); i != -1; i = coins.nextVisible(i + 1)) {
+            Matrix objectWorldMatrix = coins.positions[i];
+            bool isColidingX = duck->checkCollisionX(&objectWorldMatrix, COIN_SIZE);
+            bool isColidingY = duck->checkCollisionY(&objectWorldMatrix, COIN_SIZE);
+            bool isColidingZ = duck->checkCollisionZ(&objectWorldMatrix, COIN_SIZE);
             if (isColidingX || isColidingY || isColidingZ) {
-                duck->isDead = true;
+                coins.setVisible(i, false); // the instance buffer follows before the next frame
+                collectedCoins.insert(coins.ids[i]);
                 break;
             }
         }
     }
 
-    void checkCollisions() {
-        for (Cube *cube : cubes) {
-            checkRigidBodyCollision(cube);
+    // The systems over every entity, in batches on the recorder's threads, which idle until the draws
+    void updateEntities(float dt) {
+        turnarounds.clear();
+        patrolSystem(entities, &recorder.pool, &turnarounds);
+        turnAround(entities, turnarounds);
+
+        // a new field only when the duck moved to another cell, built on the flow field thread.
+        // Until it is in the chasers keep following the last one
+        if (entities.count(COMPONENT_BIT(COMPONENT_CHASE)) > 0) {
+            flowField.request(navGrid.nodeAt(duck->position.x, duck->position.y, duck->position.z));
+            chaseSystem(entities, &recorder.pool, navGrid, flowField.latest());
         }
 
-        for (CubeTextured *cubeTextured : cubesTextured) {
-            checkRigidBodyCollision(cubeTextured);
-        }
+        // each batch only writes the poses of its own entities. How often a pose is evaluated
+        // follows how big the entity is on screen, off screen only its time moves
+        entities.parallelEach(&recorder.pool, COMPONENT_BIT(COMPONENT_ANIMATION), LEVEL1_ANIMATION_BATCH, [this, dt](Archetype &archetype, int first, int last) {
+            bool sized = archetype.has(COMPONENT_TRANSFORM) && archetype.has(COMPONENT_COLLIDER);
+            for (int i = first; i < last; i++) {
+                AnimationComponent &animation = archetype.animations[i];
+                AnimationLod lod;
+                if (sized) {
+                    const TransformComponent &transform = archetype.transforms[i];
+                    const ColliderComponent &collider = archetype.colliders[i];
+                    Vec3 center(transform.x, transform.y + collider.halfY, transform.z);
+                    float radius = max(LEVEL1_ANIMATION_MIN_RADIUS, sqrtf((collider.halfX * collider.halfX) + (collider.halfY * collider.halfY) + (collider.halfZ * collider.halfZ)));
+                    lod = AnimationLod::forScreenHeight(camera->screenHeight(center, radius), camera->isSphereVisible(center, radius));
+                }
+                animation.instance->update(animation.clip, dt, lod);
+                if (animation.instance->animationFinished()) {
+                    animation.instance->resetAnimationTime();
+                }
+            }
+        });
+    }
 
-        checkRigidBodyCollision(wheel);
-        checkRigidBodyCollision(bigWheel);
+    void checkEnemiesCollision() {
+        if (duck->isDead) return;
+
+        if (firstOverlap(entities, duck->colliderQuery()).valid()) {
+            duck->isDead = true;
+        }
+    }
 
+    void checkCollisions() {
+        checkStaticCollisions();
         checkCoinsCollision();
         checkEnemiesCollision();
     }
 
     void resetCoins() {
-        for (CoinVisible &coinVisible : coins) {
-            coinVisible.isVisible = true;
-        }
+        coins.showAll();
+        collectedCoins.clear();
     }
 
     void reset() {
@@ -515,13 +868,8 @@ public:
     }
 
     void checkForWinning() {
-        bool allCollected = true;
-        for (CoinVisible &coinVisible : coins) {
-            if (coinVisible.isVisible) {
-                allCollected = false;
-                break;
-            }
-        }
+        // counts the coins of every chunk, not only the loaded ones
+        bool allCollected = totalCoins > 0 && collectedCoins.size() >= totalCoins;
 
         if (allCollected) {
             MessageBoxA(NULL, "You collected all the coins! You won!\nPress OK to restart.", "Victory", MB_OK | MB_ICONINFORMATION);
@@ -534,6 +882,7 @@ public:
 
         timeAcc += dt;
         timeAcc = fmodf(timeAcc, 2 * 3.1415f); // Avoid precision issues
+        crowdTime = fmodf(crowdTime + dt, LEVEL1_CROWD_TIME_WRAP);
 
         if (win->keys['R']) {
             reset();
@@ -546,39 +895,108 @@ public:
         }
 
         duck->updateAnimation(win, dt, [this]() { this->reset(); });
+        updateEntities(dt);
+
+        checkCollisions();
+    }
+
+    // Hands where the duck and the enemies ended up this frame to the hierarchy, which only
+    // computes the world matrices of the ones that moved
+    void updateTransforms() {
+        duck->updateTransform();
         for (Enemy *enemy : enemies) {
-            enemy->updateAnimation(win, dt);
+            enemy->updateTransform();
         }
+        transforms.update();
+    }
 
-        checkCollisions();
+    float viewDepth(const Vec3 &position) {
+        return (position - camera->from).length();
     }
 
-    void draw(float dt) {
+    // instanced objects sort by their first instance
+    float viewDepth(const std::vector<Matrix> &worldPositions) {
+        if (worldPositions.empty()) return 0.0f;
+        return viewDepth(Vec3(worldPositions[0].m[3], worldPositions[0].m[7], worldPositions[0].m[11]));
+    }
+
+    unsigned int animatedMaterial(GEMAnimatedObject &model) {
+        std::vector<Texture*> &textures = model.animatedModel->textures;
+        return (textures.empty() || textures[0] == nullptr) ? 0 : textures[0]->heapOffset;
+    }
+
+    // Every draw goes into the queue with its pipeline, first texture and distance to the camera
+    void collectDraws(float dt, RenderQueue &queue) {
         for (Cube *cube : cubes) {
-            cube->draw(core, camera);
+            queue.submit(RENDER_PASS_OPAQUE, cube->psos.handle(cube->filename), 0, viewDepth(cube->worldPositions),
+                [this, cube]() { cube->draw(core, camera); });
         }
 
         for (CubeTextured *cubeTextured : cubesTextured) {
-            cubeTextured->draw(core, camera);
+            queue.submit(RENDER_PASS_OPAQUE, cubeTextured->psos.handle(cubeTextured->filename), cubeTextured->texture->heapOffset,
+                viewDepth(cubeTextured->worldPositions), [this, cubeTextured]() { cubeTextured->draw(core, camera); });
         }
 
-        for (CoinVisible coinVisible : coins) {
-            if (coinVisible.isVisible) {
-                coinVisible.coin->draw(core, camera, timeAcc);
-            }
+        float time = timeAcc;
+        Coin *coin = coins.coin;
+        if (!coin->worldPositions.empty()) {
+            queue.submit(RENDER_PASS_OPAQUE, coin->psos.handle(coin->filename), coin->texture->heapOffset, viewDepth(coin->worldPositions),
+                [this, coin, time]() { coin->draw(core, camera, time); });
         }
-        
+
         for (Enemy *enemy : enemies) {
-            enemy->draw(camera);
+            queue.submit(RENDER_PASS_OPAQUE, enemy->enemyModel.psos.handle(enemy->enemyModel.filename), animatedMaterial(enemy->enemyModel),
+                viewDepth(enemy->position()), [this, enemy]() { enemy->draw(camera); });
+        }
+
+        if (crowd != nullptr) {
+            float clock = crowdTime;
+            queue.submit(RENDER_PASS_OPAQUE, crowd->psos.handle(crowd->filename + CROWD_VERTEX_SHADER), crowd->meshes[0].texture->heapOffset,
+                viewDepth(crowdPositions), [this, clock]() { crowd->draw(core, camera, clock); });
         }
 
-        bigWheel->draw(core, camera, dt);
-        wheel->draw(core, camera, dt);
-        grass->draw(core, camera, &duck->vsCBAnimatedModel.W);
-        bricks->draw(core, camera);
-        duck->draw();
+        // the grass bends around a copy, the duck's constant buffer is written while recording
+        grassPlayerPos = transforms.world(duck->transform);
+        Matrix *playerPos = &grassPlayerPos;
+
+        queue.submit(RENDER_PASS_OPAQUE, bigWheel->psos.handle(bigWheel->filename), bigWheel->texture->heapOffset, viewDepth(bigWheel->worldPositions),
+            [this, dt]() { bigWheel->draw(core, camera, dt); });
+        queue.submit(RENDER_PASS_OPAQUE, wheel->psos.handle(wheel->filename), wheel->texture->heapOffset, viewDepth(wheel->worldPositions),
+            [this, dt]() { wheel->draw(core, camera, dt); });
+        queue.submit(RENDER_PASS_OPAQUE, grass->psos.handle(grass->filename), grass->texture->heapOffset, viewDepth(grass->worldPositions),
+            [this, playerPos]() { grass->draw(core, camera, playerPos); });
+        queue.submit(RENDER_PASS_OPAQUE, bricks->psos.handle(bricks->filename), bricks->texture->heapOffset, viewDepth(bricks->worldPositions),
+            [this]() { bricks->draw(core, camera); });
+        queue.submit(RENDER_PASS_OPAQUE, duck->duckModel.psos.handle(duck->duckModel.filename), animatedMaterial(duck->duckModel),
+            viewDepth(duck->position), [this]() { duck->draw(); });
+
+        queue.submit(RENDER_PASS_TRANSPARENT, water->psos.handle(water->filename), water->texture->heapOffset, viewDepth(water->worldPositions),
+            [this, dt]() { water->draw(core, camera, dt); });
+    }
 
-        water->draw(core, camera, dt);
+#ifdef _DEBUG
+    // to the debugger whenever the binds of a frame change, e.g. when a chunk streams in
+    void reportQueueStats() {
+        RenderQueueStats sorted = renderQueue.sortedStats;
+        if (sorted.pipelineChanges == reportedQueueStats.pipelineChanges && sorted.materialChanges == reportedQueueStats.materialChanges) return;
+        reportedQueueStats = sorted;
+        char text[160];
+        snprintf(text, sizeof(text), "render queue: %d draws, %d pipeline and %d material binds, %d and %d unsorted\n",
+            (int)renderQueue.packets.size(), sorted.pipelineChanges, sorted.materialChanges,
+            renderQueue.unsortedStats.pipelineChanges, renderQueue.unsortedStats.materialChanges);
+        OutputDebugStringA(text);
+    }
+#endif
+
+    // records the level on the recorder's threads in key order, after the sky on the main list
+    void draw(float dt) {
+        updateTransforms();
+        renderQueue.clear();
+        collectDraws(dt, renderQueue);
+        recorder.record(renderQueue.sort());
+#ifdef _DEBUG
+        reportQueueStats();
+#endif
 
         if (isFirstFrame) {
             reset();
@@ -0,0 +1,314 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <fstream>
+#include <future>
+#include <cmath>
+#include <stdint.h>
+#include "Math.h"
+#include "GEMLoader.h"
+#include "Parallel.h"
+
+#define LEVEL_FILE_MAGIC 0x4C4D4547 // "GEML"
+#define LEVEL_FILE_VERSION 2
+#define LEVEL_CHUNK_WORLD_SIZE 16.0f // chunks cover this many world units on x and z
+
+enum LEVEL_INSTANCE_KIND {
+    LEVEL_OBJECT, // static textured model, collides as a box
+    LEVEL_COIN,
+    LEVEL_ENEMY
+};
+
+// per instance data that only enemies need, stored next to their world matrices
+struct LevelEnemy {
+    Vec3 endPosition;
+    int moveKind;
+    float rotationAngle;
+    float scale;
+    int animation;
+    float walkVelocity;
+};
+
+// All instances of one chunk sharing a model and material, ready to go into one object
+struct LevelInstanceGroup {
+    int kind = LEVEL_OBJECT;
+    std::string meshFilename;
+    std::string texture;
+    std::string light;
+    Vec3 size = Vec3(2, 2, 2);
+    std::vector<Matrix> worldPositions;
+    std::vector<LevelEnemy> enemies; // only for LEVEL_ENEMY, one per world matrix
+};
+
+struct LevelChunk {
+    int index = -1; // in the chunk table
+    int cx = 0;
+    int cz = 0;
+    std::vector<LevelInstanceGroup> groups;
+};
+
+// Chunk table entry of a binary level, lets a chunk be read without touching the rest of the file
+struct LevelChunkEntry {
+    int cx;
+    int cz;
+    int numCoins; // lets the game count coins of chunks that are not loaded
+    int reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+int levelChunkCoord(float v) {
+    return (int)floorf(v / LEVEL_CHUNK_WORLD_SIZE);
+}
+
+static void levelWriteString(std::ofstream& file, const std::string& s) {
+    uint32_t length = s.size();
+    file.write((const char*)&length, sizeof(length));
+    file.write(s.data(), length);
+}
+
+static bool levelReadString(std::ifstream& file, std::string& s) {
+    uint32_t length = 0;
+    file.read((char*)&length, sizeof(length));
+    if (!file) return false;
+    s.resize(length);
+    file.read(&s[0], length);
+    return (bool)file;
+}
+
+// Compiles a GEMScene json level into chunks of packed instance tables and reads/writes them
+// in the binary format. The json instances are "filename" + "world" with these properties:
+//   type: "object" (default), "coin" or "enemy"
+//   texture, light, size ("x y z")
+//   enemies: end ("x y z"), axis ("x", "z" or "chase"), rotation, scale, animation, speed
+class LevelData {
+public:
+    std::vector<LevelChunk> chunks;
+    std::vector<std::string> animationNames; // enemy animation names are stored as indices into this
+
+    int findAnimation(const std::string& name) {
+        for (int i = 0; i < animationNames.size(); i++) {
+            if (animationNames[i] == name) return i;
+        }
+        return 0;
+    }
+
+    bool compileScene(const std::string& filename) {
+        std::ifstream test(filename);
+        if (!test.good()) return false;
+        test.close();
+
+        GEMLoader::GEMScene scene;
+        scene.load(filename);
+
+        std::map<std::pair<int, int>, int> chunkIndices;
+        std::map<std::string, int> groupIndices; // "chunk|kind|mesh|texture|light|size" -> group
+        chunks.clear();
+
+        for (GEMLoader::GEMInstance& instance : scene.instances) {
+            Matrix world;
+            memcpy(world.m, instance.w.m, sizeof(world.m));
+
+            LevelInstanceGroup group;
+            group.meshFilename = instance.meshFilename;
+            std::string type = instance.material.find("type").value;
+            group.kind = type == "coin" ? LEVEL_COIN : (type == "enemy" ? LEVEL_ENEMY : LEVEL_OBJECT);
+            group.texture = instance.material.find("texture").value;
+            group.light = instance.material.find("light").value;
+            instance.material.find("size").getValuesAsVector3(group.size.x, group.size.y, group.size.z, ' ', group.size.x);
+
+            int cx = levelChunkCoord(world.m[3]);
+            int cz = levelChunkCoord(world.m[11]);
+            auto chunkIt = chunkIndices.find({cx, cz});
+            if (chunkIt == chunkIndices.end()) {
+                chunkIt = chunkIndices.insert({{cx, cz}, (int)chunks.size()}).first;
+                LevelChunk chunk;
+                chunk.cx = cx;
+                chunk.cz = cz;
+                chunks.push_back(chunk);
+            }
+            LevelChunk& chunk = chunks[chunkIt->second];
+
+            std::string key = std::to_string(cx) + " " + std::to_string(cz) + "|" + std::to_string(group.kind) + "|" + group.meshFilename + "|" + group.texture + "|" + group.light
+                + "|" + std::to_string(group.size.x) + " " + std::to_string(group.size.y) + " " + std::to_string(group.size.z);
+            auto groupIt = groupIndices.find(key);
+            if (groupIt == groupIndices.end()) {
+                groupIt = groupIndices.insert({key, (int)chunk.groups.size()}).first;
+                chunk.groups.push_back(group);
+            }
+            LevelInstanceGroup& target = chunk.groups[groupIt->second];
+            target.worldPositions.push_back(world);
+
+            if (group.kind == LEVEL_ENEMY) {
+                LevelEnemy enemy;
+                Vec3 start = Vec3(world.m[3], world.m[7], world.m[11]);
+                GEMLoader::GEMProperty end = instance.material.find("end");
+                end.getValuesAsVector3(enemy.endPosition.x, enemy.endPosition.y, enemy.endPosition.z);
+                if (end.value == "") enemy.endPosition = start;
+                std::string axis = instance.material.find("axis").value;
+                enemy.moveKind = axis == "chase" ? 2 : (axis == "z" ? 1 : 0); // MOVE_KIND
+                enemy.rotationAngle = instance.material.find("rotation").getValue(0.0f);
+                enemy.scale = instance.material.find("scale").getValue(1.0f);
+                enemy.animation = findAnimation(instance.material.find("animation").value);
+                enemy.walkVelocity = instance.material.find("speed").getValue(-1.0f); // < 0 keeps the enemy default
+                target.enemies.push_back(enemy);
+            }
+        }
+        return true;
+    }
+
+    static void writeChunk(std::ofstream& file, const LevelChunk& chunk) {
+        uint32_t numGroups = chunk.groups.size();
+        file.write((const char*)&numGroups, sizeof(numGroups));
+        for (const LevelInstanceGroup& group : chunk.groups) {
+            int32_t kind = group.kind;
+            uint32_t count = group.worldPositions.size();
+            file.write((const char*)&kind, sizeof(kind));
+            levelWriteString(file, group.meshFilename);
+            levelWriteString(file, group.texture);
+            levelWriteString(file, group.light);
+            file.write((const char*)&group.size, sizeof(float) * 3);
+            file.write((const char*)&count, sizeof(count));
+            file.write((const char*)group.worldPositions.data(), count * sizeof(Matrix));
+            if (group.kind == LEVEL_ENEMY) {
+                file.write((const char*)group.enemies.data(), count * sizeof(LevelEnemy));
+            }
+        }
+    }
+
+    static bool readChunk(std::ifstream& file, LevelChunk& chunk) {
+        uint32_t numGroups = 0;
+        file.read((char*)&numGroups, sizeof(numGroups));
+        if (!file) return false;
+
+        chunk.groups.resize(numGroups);
+        for (LevelInstanceGroup& group : chunk.groups) {
+            int32_t kind = 0;
+            uint32_t count = 0;
+            file.read((char*)&kind, sizeof(kind));
+            group.kind = kind;
+            if (!levelReadString(file, group.meshFilename)) return false;
+            if (!levelReadString(file, group.texture)) return false;
+            if (!levelReadString(file, group.light)) return false;
+            file.read((char*)&group.size, sizeof(float) * 3);
+            file.read((char*)&count, sizeof(count));
+            if (!file) return false;
+
+            group.worldPositions.resize(count);
+            file.read((char*)group.worldPositions.data(), count * sizeof(Matrix));
+            if (group.kind == LEVEL_ENEMY) {
+                group.enemies.resize(count);
+                file.read((char*)group.enemies.data(), count * sizeof(LevelEnemy));
+            }
+        }
+        return (bool)file;
+    }
+
+    // header: magic, version, chunk count, chunk table. Chunk data follows the table
+    bool saveBinary(const std::string& filename) {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file.good()) return false;
+
+        uint32_t header[3] = { LEVEL_FILE_MAGIC, LEVEL_FILE_VERSION, (uint32_t)chunks.size() };
+        file.write((const char*)header, sizeof(header));
+
+        std::vector<LevelChunkEntry> table(chunks.size());
+        std::streamoff tableStart = file.tellp();
+        file.write((const char*)table.data(), table.size() * sizeof(LevelChunkEntry)); // patched below
+
+        for (int i = 0; i < chunks.size(); i++) {
+            table[i].cx = chunks[i].cx;
+            table[i].cz = chunks[i].cz;
+            table[i].numCoins = 0;
+            table[i].reserved = 0;
+            for (const LevelInstanceGroup& group : chunks[i].groups) {
+                if (group.kind == LEVEL_COIN) table[i].numCoins += group.worldPositions.size();
+            }
+            table[i].offset = file.tellp();
+            writeChunk(file, chunks[i]);
+            table[i].size = (uint64_t)file.tellp() - table[i].offset;
+        }
+
+        file.seekp(tableStart);
+        file.write((const char*)table.data(), table.size() * sizeof(LevelChunkEntry));
+        return file.good();
+    }
+
+    static bool readTable(const std::string& filename, std::vector<LevelChunkEntry>& table) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.good()) return false;
+
+        uint32_t header[3] = {};
+        file.read((char*)header, sizeof(header));
+        if (!file || header[0] != LEVEL_FILE_MAGIC || header[1] != LEVEL_FILE_VERSION) return false;
+
+        table.resize(header[2]);
+        file.read((char*)table.data(), table.size() * sizeof(LevelChunkEntry));
+        return (bool)file;
+    }
+
+    static bool loadChunk(const std::string& filename, const LevelChunkEntry& entry, LevelChunk& chunk) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.good()) return false;
+        file.seekg(entry.offset);
+        chunk.cx = entry.cx;
+        chunk.cz = entry.cz;
+        return readChunk(file, chunk);
+    }
+};
+
+// Reads chunks of a binary level on the background pool. Chunks are handed back once
+// they are in memory, creating the GPU objects for them is up to the caller
+class LevelStreamer {
+public:
+    std::string filename;
+    std::vector<LevelChunkEntry> table;
+    std::map<int, std::future<LevelChunk*>> pending;
+
+    bool open(const std::string& _filename) {
+        filename = _filename;
+        pending.clear();
+        if (!LevelData::readTable(filename, table)) {
+            table.clear();
+            return false;
+        }
+        return true;
+    }
+
+    void request(int index) {
+        if (pending.find(index) != pending.end()) return;
+
+        std::string file = filename;
+        LevelChunkEntry entry = table[index];
+        pending[index] = backgroundJobs().async([file, entry, index]() -> LevelChunk* {
+            LevelChunk* chunk = new LevelChunk();
+            chunk->index = index;
+            if (!LevelData::loadChunk(file, entry, *chunk)) {
+                delete chunk;
+                return nullptr;
+            }
+            return chunk;
+        });
+    }
+
+    // Moves the chunks that finished loading into ready and the ones that could not be read
+    // into failed. Never blocks unless wait is set
+    void collect(std::vector<LevelChunk*>& ready, std::vector<int>& failed, bool wait = false) {
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (!wait && it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++it;
+                continue;
+            }
+            LevelChunk* chunk = it->second.get();
+            if (chunk != nullptr) {
+                ready.push_back(chunk);
+            }
+            else {
+                failed.push_back(it->first);
+            }
+            it = pending.erase(it);
+        }
+    }
+};
@@ -402,6 +402,15 @@ public:
         return v1;
     }
 
+    // rotates/scales a direction, ignoring the translation
+    Vec3 mulVec(const Vec3& v) const {
+        return Vec3(
+            v.x * m[0] + v.y * m[1] + v.z * m[2],
+            v.x * m[4] + v.y * m[5] + v.z * m[6],
+            v.x * m[8] + v.y * m[9] + v.z * m[10]
+        );
+    }
+
     void setRotationX(float angle) {
         setIdentity();
         float radians = (3.14159f / 180.0f) * angle;
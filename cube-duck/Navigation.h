@@ -0,0 +1,314 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <math.h>
+
+// Where enemies can walk, taken from the tops of the level blocks, and a flow field that
+// points every walkable cell one step closer to a goal. All the agents chasing the same goal
+// share the field, so a step costs an agent a lookup instead of a search. No D3D12 in here
+
+#define NAV_LAYERS 4 // walkable tops kept per column, the highest ones
+#define NAV_NO_NODE -1
+#define NAV_UNREACHED 0xFFFFFFFFu
+
+enum NAV_DIRECTION {
+    NAV_POS_X,
+    NAV_NEG_X,
+    NAV_POS_Z,
+    NAV_NEG_Z,
+    NAV_DIRECTIONS
+};
+
+const int NavDirectionOffsets[NAV_DIRECTIONS][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+
+// in cells of the block grid
+struct NavSettings {
+    int headroom = 1; // empty cells above a block for it to be walkable
+    int maxStepUp = 1;
+    int maxDrop = 2;
+};
+
+// Block cells the grid covers, inclusive
+struct NavBounds {
+    int minX = 0, minY = 0, minZ = 0;
+    int maxX = -1, maxY = -1, maxZ = -1;
+};
+
+// A column per (x, z) cell with up to NAV_LAYERS walkable tops, highest first. A node is a
+// column and a layer, column * NAV_LAYERS + layer. moves holds where a step from a node in each
+// direction lands: the highest top in the next column that is not above maxStepUp, as long as
+// it is not more than maxDrop below
+class NavGrid {
+public:
+    NavBounds bounds;
+    NavSettings settings;
+    float cellSize = 1.0f;
+    int sizeX = 0;
+    int sizeZ = 0;
+    std::vector<uint8_t> layerCounts; // by column
+    std::vector<int> heights; // by node, the y cell of the block walked on
+    std::vector<int> moves; // by node * NAV_DIRECTIONS, NAV_NO_NODE when blocked
+
+    int numNodes() const {
+        return sizeX * sizeZ * NAV_LAYERS;
+    }
+
+    int column(int x, int z) const {
+        if (x < bounds.minX || x > bounds.maxX || z < bounds.minZ || z > bounds.maxZ) return -1;
+        return ((z - bounds.minZ) * sizeX) + (x - bounds.minX);
+    }
+
+    int cellX(int node) const {
+        return ((node / NAV_LAYERS) % sizeX) + bounds.minX;
+    }
+
+    int cellZ(int node) const {
+        return ((node / NAV_LAYERS) / sizeX) + bounds.minZ;
+    }
+
+    // where an agent standing on node stands, in world units
+    float worldX(int node) const {
+        return cellX(node) * cellSize;
+    }
+
+    float worldY(int node) const {
+        return heights[node] * cellSize;
+    }
+
+    float worldZ(int node) const {
+        return cellZ(node) * cellSize;
+    }
+
+    // solid(x, y, z) tells whether the block cell is taken
+    template <typename F>
+    void build(const NavBounds& _bounds, const NavSettings& _settings, float _cellSize, F solid) {
+        bounds = _bounds;
+        settings = _settings;
+        cellSize = _cellSize;
+        sizeX = bounds.maxX - bounds.minX + 1;
+        sizeZ = bounds.maxZ - bounds.minZ + 1;
+        if (sizeX <= 0 || sizeZ <= 0) {
+            sizeX = sizeZ = 0;
+        }
+        layerCounts.assign(sizeX * sizeZ, 0);
+        heights.assign(numNodes(), 0);
+        moves.assign(numNodes() * NAV_DIRECTIONS, NAV_NO_NODE);
+
+        for (int z = bounds.minZ; z <= bounds.maxZ; z++) {
+            for (int x = bounds.minX; x <= bounds.maxX; x++) {
+                int c = column(x, z);
+                int free = settings.headroom; // empty cells seen right above y, over the top counts as empty
+                for (int y = bounds.maxY; y >= bounds.minY && layerCounts[c] < NAV_LAYERS; y--) {
+                    if (!solid(x, y, z)) {
+                        free++;
+                        continue;
+                    }
+                    if (free >= settings.headroom) {
+                        heights[(c * NAV_LAYERS) + layerCounts[c]] = y;
+                        layerCounts[c]++;
+                    }
+                    free = 0;
+                }
+            }
+        }
+
+        for (int c = 0; c < sizeX * sizeZ; c++) {
+            for (int layer = 0; layer < layerCounts[c]; layer++) {
+                int node = (c * NAV_LAYERS) + layer;
+                for (int d = 0; d < NAV_DIRECTIONS; d++) {
+                    moves[(node * NAV_DIRECTIONS) + d] = land(node, d);
+                }
+            }
+        }
+    }
+
+    int land(int node, int direction) const {
+        int next = column(cellX(node) + NavDirectionOffsets[direction][0], cellZ(node) + NavDirectionOffsets[direction][1]);
+        if (next == -1) return NAV_NO_NODE;
+        int from = heights[node];
+        for (int layer = 0; layer < layerCounts[next]; layer++) {
+            int to = (next * NAV_LAYERS) + layer;
+            if (heights[to] > from + settings.maxStepUp) continue;
+            return (from - heights[to] <= settings.maxDrop) ? to : NAV_NO_NODE;
+        }
+        return NAV_NO_NODE;
+    }
+
+    // The node under a point in world units: the highest top in its column at or below y
+    int nodeAt(float x, float y, float z) const {
+        int c = column((int)lroundf(x / cellSize), (int)lroundf(z / cellSize));
+        if (c == -1) return NAV_NO_NODE;
+        for (int layer = 0; layer < layerCounts[c]; layer++) {
+            int node = (c * NAV_LAYERS) + layer;
+            if (heights[node] * cellSize <= y) return node;
+        }
+        return NAV_NO_NODE;
+    }
+};
+
+// Per node the next node towards goal and how many steps away it is
+struct FlowField {
+    int goal = NAV_NO_NODE;
+    std::vector<int> next;
+    std::vector<uint32_t> distance;
+    std::vector<int> open; // the search frontier, kept to reuse its memory
+
+    // A breadth first search backwards from the goal over the moves of the grid. Every step
+    // costs the same, so the first time a node is reached is its shortest way there
+    void build(const NavGrid& grid, int _goal) {
+        goal = _goal;
+        next.assign(grid.numNodes(), NAV_NO_NODE);
+        distance.assign(grid.numNodes(), NAV_UNREACHED);
+        open.clear();
+        if (goal == NAV_NO_NODE) return;
+
+        distance[goal] = 0;
+        open.push_back(goal);
+        for (size_t i = 0; i < open.size(); i++) {
+            int node = open[i];
+            int x = grid.cellX(node);
+            int z = grid.cellZ(node);
+            for (int d = 0; d < NAV_DIRECTIONS; d++) {
+                // the nodes whose step in direction d lands on node
+                int from = grid.column(x - NavDirectionOffsets[d][0], z - NavDirectionOffsets[d][1]);
+                if (from == -1) continue;
+                for (int layer = 0; layer < grid.layerCounts[from]; layer++) {
+                    int source = (from * NAV_LAYERS) + layer;
+                    if (distance[source] != NAV_UNREACHED || grid.moves[(source * NAV_DIRECTIONS) + d] != node) continue;
+                    distance[source] = distance[node] + 1;
+                    next[source] = node;
+                    open.push_back(source);
+                }
+            }
+        }
+    }
+
+    bool reaches(int node) const {
+        return node != NAV_NO_NODE && node < (int)distance.size() && distance[node] != NAV_UNREACHED;
+    }
+};
+
+// Builds flow fields on its own thread. request() hands it a goal and returns at once, the game
+// keeps stepping agents along the last field until latest() picks up the new one. Goals asked
+// for while a field is being built collapse into the newest, and the three fields swap places
+// rather than being copied, so after the first few builds no memory is allocated
+class FlowFieldWorker {
+public:
+    const NavGrid* grid = nullptr;
+    FlowField fields[3];
+    FlowField* current = &fields[0]; // what the game reads
+    FlowField* ready = &fields[1]; // finished, not picked up yet
+    FlowField* building = &fields[2];
+    bool hasReady = false;
+    bool busy = false;
+    int requested = NAV_NO_NODE;
+    int pending = NAV_NO_NODE; // goal waiting for the thread
+    uint64_t builds = 0;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    bool quit = false;
+
+    void start(const NavGrid* _grid) {
+        grid = _grid;
+        thread = std::thread([this]() { worker(); });
+    }
+
+    // only builds when goal changed since the last request
+    void request(int goal) {
+        if (goal == NAV_NO_NODE || goal == requested) return;
+        requested = goal;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = goal;
+        }
+        wake.notify_one();
+    }
+
+    // the newest finished field, called once per frame before the agents step
+    const FlowField& latest() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (hasReady) {
+            FlowField* field = current;
+            current = ready;
+            ready = field;
+            hasReady = false;
+        }
+        return *current;
+    }
+
+    // Blocks until the thread is done with the grid, call before rebuilding it. The fields are
+    // dropped, the next request builds one for the new grid
+    void reset() {
+        std::unique_lock<std::mutex> lock(mutex);
+        pending = NAV_NO_NODE;
+        idle.wait(lock, [this]() { return !busy; });
+        for (FlowField& field : fields) {
+            field.goal = NAV_NO_NODE;
+            field.next.clear();
+            field.distance.clear();
+        }
+        hasReady = false;
+        requested = NAV_NO_NODE;
+    }
+
+    void worker() {
+        while (true) {
+            int goal;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return quit || pending != NAV_NO_NODE; });
+                if (quit) return;
+                goal = pending;
+                pending = NAV_NO_NODE;
+                busy = true;
+            }
+            building->build(*grid, goal);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                FlowField* field = ready;
+                ready = building;
+                building = field;
+                hasReady = true;
+                busy = false;
+                builds++;
+            }
+            idle.notify_all();
+        }
+    }
+
+    ~FlowFieldWorker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        if (thread.joinable()) thread.join();
+    }
+};
+
+// Walks an agent standing on node towards the next node of the field, speed world units per step.
+// Returns the node the agent stands on afterwards. x and z move, the caller sets the height
+int followField(const NavGrid& grid, const FlowField& field, int node, float speed, float& x, float& z) {
+    if (!field.reaches(node)) return node;
+    int target = field.next[node];
+    if (target == NAV_NO_NODE) return node; // at the goal
+
+    float dx = grid.worldX(target) - x;
+    float dz = grid.worldZ(target) - z;
+    float length = sqrtf((dx * dx) + (dz * dz));
+    if (length <= speed) {
+        x = grid.worldX(target);
+        z = grid.worldZ(target);
+        return target;
+    }
+    x += dx * (speed / length);
+    z += dz * (speed / length);
+    // past the middle of the two cells the agent stands on the next one
+    return (fabsf(x - grid.worldX(node)) + fabsf(z - grid.worldZ(node)) > grid.cellSize * 0.5f) ? target : node;
+}
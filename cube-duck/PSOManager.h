@@ -2,11 +2,247 @@
 
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
 #include "Core.h"
+#include "PipelineKey.h"
 
+#define PSO_LIBRARY_FILE "cache/pipelines.bin"
+
+// Everything that makes two pipelines different, in a fixed order. Structs are added field
+// by field because their padding is not guaranteed to be zero
+PipelineKey makePipelineKey(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) {
+    PipelineKey key;
+    key.addBlob(desc.VS.pShaderBytecode, desc.VS.BytecodeLength);
+    key.addBlob(desc.PS.pShaderBytecode, desc.PS.BytecodeLength);
+
+    key.addInt(desc.InputLayout.NumElements);
+    for (unsigned int i = 0; i < desc.InputLayout.NumElements; i++) {
+        const D3D12_INPUT_ELEMENT_DESC& element = desc.InputLayout.pInputElementDescs[i];
+        key.addString(element.SemanticName);
+        key.addInt(element.SemanticIndex);
+        key.addInt(element.Format);
+        key.addInt(element.InputSlot);
+        key.addInt(element.AlignedByteOffset);
+        key.addInt(element.InputSlotClass);
+        key.addInt(element.InstanceDataStepRate);
+    }
+
+    const D3D12_RASTERIZER_DESC& raster = desc.RasterizerState;
+    key.addInt(raster.FillMode);
+    key.addInt(raster.CullMode);
+    key.addInt(raster.FrontCounterClockwise);
+    key.addInt(raster.DepthBias);
+    key.addFloat(raster.DepthBiasClamp);
+    key.addFloat(raster.SlopeScaledDepthBias);
+    key.addInt(raster.DepthClipEnable);
+    key.addInt(raster.MultisampleEnable);
+    key.addInt(raster.AntialiasedLineEnable);
+    key.addInt(raster.ForcedSampleCount);
+    key.addInt(raster.ConservativeRaster);
+
+    const D3D12_DEPTH_STENCIL_DESC& depth = desc.DepthStencilState;
+    key.addInt(depth.DepthEnable);
+    key.addInt(depth.DepthWriteMask);
+    key.addInt(depth.DepthFunc);
+    key.addInt(depth.StencilEnable); // stencil ops are never used
+
+    key.addInt(desc.BlendState.AlphaToCoverageEnable);
+    key.addInt(desc.BlendState.IndependentBlendEnable);
+    for (int i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; i++) {
+        const D3D12_RENDER_TARGET_BLEND_DESC& blend = desc.BlendState.RenderTarget[i];
+        key.addInt(blend.BlendEnable);
+        key.addInt(blend.LogicOpEnable);
+        key.addInt(blend.SrcBlend);
+        key.addInt(blend.DestBlend);
+        key.addInt(blend.BlendOp);
+        key.addInt(blend.SrcBlendAlpha);
+        key.addInt(blend.DestBlendAlpha);
+        key.addInt(blend.BlendOpAlpha);
+        key.addInt(blend.LogicOp);
+        key.addInt(blend.RenderTargetWriteMask);
+    }
+
+    key.addInt(desc.SampleMask);
+    key.addInt(desc.PrimitiveTopologyType);
+    key.addInt(desc.NumRenderTargets);
+    for (unsigned int i = 0; i < desc.NumRenderTargets; i++) {
+        key.addInt(desc.RTVFormats[i]);
+    }
+    key.addInt(desc.DSVFormat);
+    key.addInt(desc.SampleDesc.Count);
+    key.addInt(desc.SampleDesc.Quality);
+    // the root signature is Core's and the same for every pipeline
+    return key;
+}
+
+// One pipeline per distinct description for the whole engine. Pipelines are kept in a D3D12
+// pipeline library that is written to PSO_LIBRARY_FILE by save(), so the next start loads
+// them instead of compiling
+class PSOCache {
+public:
+    struct State {
+        PipelineKeyTable table;
+        std::vector<ID3D12PipelineState*> pipelines; // by handle
+        std::vector<D3D12_GRAPHICS_PIPELINE_STATE_DESC> descriptions; // by handle, to rebuild pipelines when a shader changes
+        ID3D12PipelineLibrary* library = nullptr;
+        std::vector<char> libraryData; // the library reads from this, it has to outlive it
+        bool opened = false;
+        bool dirty = false;
+        std::string filename;
+    };
+
+    static State& state() {
+        static State s;
+        return s;
+    }
+
+    static void open(Core* core, const std::string& filename = PSO_LIBRARY_FILE) {
+        State& s = state();
+        if (s.opened) return;
+        s.opened = true;
+        s.filename = filename;
+
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (file.good()) {
+            s.libraryData.resize((size_t)file.tellg());
+            file.seekg(0);
+            file.read(s.libraryData.data(), s.libraryData.size());
+        }
+
+        HRESULT hr = E_FAIL;
+        if (!s.libraryData.empty()) {
+            hr = core->device->CreatePipelineLibrary(s.libraryData.data(), s.libraryData.size(), IID_PPV_ARGS(&s.library));
+        }
+        if (FAILED(hr)) {
+            // missing, or written by another driver or adapter: start empty
+            s.libraryData.clear();
+            s.library = nullptr;
+            hr = core->device->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&s.library));
+            if (FAILED(hr)) {
+                s.library = nullptr; // no library support, pipelines are still shared
+            }
+        }
+    }
+
+    static std::wstring libraryName(const PipelineKey& key) {
+        wchar_t name[32];
+        swprintf(name, 32, L"pso_%016llx", (unsigned long long)key.hash());
+        return name;
+    }
+
+    // -1 if the pipeline could not be created
+    static int acquire(Core* core, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, const std::string& debugName) {
+        State& s = state();
+        open(core);
+
+        PipelineKey key = makePipelineKey(desc);
+        bool created = false;
+        int handle = s.table.acquire(key, created);
+        if (!created) {
+            return handle;
+        }
+
+        ID3D12PipelineState* pso = nullptr;
+        std::wstring name = libraryName(key);
+        HRESULT hr = E_FAIL;
+        if (s.library != nullptr) {
+            hr = s.library->LoadGraphicsPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso));
+        }
+        if (FAILED(hr)) {
+            hr = core->device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso));
+            if (FAILED(hr)) {
+                MessageBoxA(NULL, ("Failed to create PSO: " + debugName + "\n").c_str(), "Error", MB_OK | MB_ICONERROR);
+                s.table.release(handle);
+                return -1;
+            }
+            store(name, pso);
+        }
+
+        if (handle >= s.pipelines.size()) {
+            s.pipelines.resize(handle + 1, nullptr);
+            s.descriptions.resize(handle + 1);
+        }
+        s.pipelines[handle] = pso;
+        s.descriptions[handle] = desc;
+        return handle;
+    }
+
+    static void store(const std::wstring& name, ID3D12PipelineState* pso) {
+        State& s = state();
+        if (s.library != nullptr && SUCCEEDED(s.library->StorePipeline(name.c_str(), pso))) {
+            s.dirty = true;
+        }
+    }
+
+    static ID3D12PipelineState* get(int handle) {
+        return state().pipelines[handle];
+    }
+
+    // live pipelines whose vertex or pixel shader is this bytecode, without taking a reference
+    static void usersOf(const void* bytecode, std::vector<int>& handles) {
+        State& s = state();
+        for (int i = 0; i < s.pipelines.size(); i++) {
+            if (s.pipelines[i] == nullptr) continue;
+            if (s.descriptions[i].VS.pShaderBytecode == bytecode || s.descriptions[i].PS.pShaderBytecode == bytecode) {
+                handles.push_back(i);
+            }
+        }
+    }
+
+    // keeps the handle and its pipeline alive while a reload builds a new version of it
+    static void addRef(int handle) {
+        state().table.addRef(handle);
+    }
+
+    // Points handle at a pipeline built from desc. Objects bind by handle, so they pick it up
+    // on their next draw. Returns the old pipeline, the caller releases it once the GPU is done
+    static ID3D12PipelineState* replace(int handle, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, ID3D12PipelineState* pso) {
+        State& s = state();
+        PipelineKey key = makePipelineKey(desc);
+        s.table.rekey(handle, key);
+        store(libraryName(key), pso);
+
+        ID3D12PipelineState* old = s.pipelines[handle];
+        s.pipelines[handle] = pso;
+        s.descriptions[handle] = desc;
+        return old;
+    }
+
+    // the caller makes sure the GPU is done with the pipeline
+    static void release(int handle) {
+        State& s = state();
+        if (s.table.release(handle)) {
+            s.pipelines[handle]->Release();
+            s.pipelines[handle] = nullptr;
+        }
+    }
+
+    // writes the library if pipelines were compiled since it was loaded
+    static void save() {
+        State& s = state();
+        if (s.library == nullptr || !s.dirty) return;
+
+        std::vector<char> data(s.library->GetSerializedSize());
+        if (FAILED(s.library->Serialize(data.data(), data.size()))) return;
+
+        std::filesystem::path path(s.filename);
+        if (path.has_parent_path()) {
+            std::error_code error;
+            std::filesystem::create_directories(path.parent_path(), error);
+        }
+        std::ofstream file(s.filename, std::ios::binary);
+        file.write(data.data(), data.size());
+        s.dirty = false;
+    }
+};
+
+// An object's pipelines by name. The pipelines themselves live in PSOCache and are
+// shared with every object that uses the same description
 class PSOManager {
 public:
-    std::unordered_map<std::string, ID3D12PipelineState*> psos;
+    std::unordered_map<std::string, int> psos; // PSOCache handles, they survive shader reloads
 
     void createPSO(Core* core, std::string name, ID3DBlob* vs, ID3DBlob* ps, D3D12_INPUT_LAYOUT_DESC layout, bool enableTransparency = false) {
         if (psos.find(name) != psos.end()) {
@@ -69,23 +305,38 @@ public:
         desc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
         desc.SampleDesc.Count = 1;
 
-        ID3D12PipelineState* pso;
-        HRESULT hr = core->device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso));
-        if (FAILED(hr)) {
-            MessageBoxA(NULL, ("Failed to create PSO: " + name + "\n").c_str(), "Error", MB_OK | MB_ICONERROR);
+        int handle = PSOCache::acquire(core, desc, name);
+        if (handle == -1) {
             return;
         }
+        psos.insert({ name, handle });
+    }
 
-        psos.insert({ name, pso });
+    void release() {
+        for (auto& pso : psos) {
+            PSOCache::release(pso.second);
+        }
+        psos.clear();
+    }
+
+    // the PSOCache handle, stable across shader reloads, -1 if there is no such pipeline
+    int handle(const std::string& name) const {
+        auto it = psos.find(name);
+        return it == psos.end() ? -1 : it->second;
     }
 
     void bind(Core* core, std::string name) {
         auto it = psos.find(name);
-        if (it == psos.end() || it->second == nullptr) {
+        if (it == psos.end()) {
             MessageBoxA(NULL, ("ERROR: PSO '" + name + "' not found or null!\n").c_str(), "Error", MB_OK | MB_ICONERROR);
             return;
         }
 
-        core->getCommandList()->SetPipelineState(psos[name]);
+        ID3D12PipelineState* pso = PSOCache::get(it->second);
+        if (threadListState.pipelineState == pso) {
+            return;
+        }
+        threadListState.pipelineState = pso;
+        core->getCommandList()->SetPipelineState(pso);
     }
 };
\ No newline at end of file
@@ -0,0 +1,176 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <future>
+#include <memory>
+#include <stdint.h>
+
+// Runs func(i) for every i in [0, count) on all hardware threads and waits for them.
+// Items are handed out one at a time, so uneven work still balances. Meant for load
+// time jobs, threads are created per call
+template <typename F>
+void parallelFor(int count, F func) {
+    int numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads > count) numThreads = count;
+
+    if (numThreads <= 1) {
+        for (int i = 0; i < count; i++) {
+            func(i);
+        }
+        return;
+    }
+
+    std::atomic<int> next{0};
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) {
+            func(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (int t = 1; t < numThreads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker(); // the calling thread works too
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// Threads that stay alive and wait for work, for jobs that run every frame where
+// creating threads per call would cost more than the job. run() blocks until done.
+// async() hands a single task to whichever thread is free and returns at once, a thread busy
+// with one holds up run(), so long tasks go to backgroundJobs() and not to a frame's pool
+class JobPool {
+public:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int)>* job = nullptr;
+    int jobCount = 0;
+    std::atomic<int> nextJob{0};
+    int finished = 0; // threads done with the current generation
+    uint64_t generation = 0;
+    std::deque<std::function<void()>> tasks; // from async, run in the order they came
+    bool quit = false;
+
+    // onThreadStart(i) runs once on worker thread i before it takes any job
+    void start(int numThreads, std::function<void(int)> onThreadStart = nullptr) {
+        threads.reserve(numThreads);
+        for (int i = 0; i < numThreads; i++) {
+            threads.emplace_back([this, i, onThreadStart]() {
+                if (onThreadStart) onThreadStart(i);
+                worker();
+            });
+        }
+    }
+
+    int numThreads() {
+        return (int)threads.size() + 1; // the calling thread works too
+    }
+
+    void run(int count, const std::function<void(int)>& func) {
+        if (threads.empty() || count <= 1) {
+            for (int i = 0; i < count; i++) {
+                func(i);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &func;
+            jobCount = count;
+            nextJob = 0;
+            finished = 0;
+            generation++;
+        }
+        wake.notify_all();
+        work();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return finished == (int)threads.size(); });
+        job = nullptr;
+    }
+
+    // func runs on a pool thread, the future holds its result. Without threads it runs right here
+    template <typename F>
+    auto async(F func) -> std::future<decltype(func())> {
+        typedef decltype(func()) Result;
+        std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(std::move(func));
+        std::future<Result> result = task->get_future();
+        if (threads.empty()) {
+            (*task)();
+            return result;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back([task]() { (*task)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+    void work() {
+        for (int i = nextJob++; i < jobCount; i = nextJob++) {
+            (*job)(i);
+        }
+    }
+
+    void worker() {
+        uint64_t seen = 0;
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen]() { return quit || generation != seen || !tasks.empty(); });
+                if (quit) return;
+                if (generation == seen) {
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+                seen = generation;
+            }
+            if (task) {
+                task();
+                continue;
+            }
+            work();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished++;
+            }
+            done.notify_one();
+        }
+    }
+
+    ~JobPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+// For loading and compiling in the background: texture decodes, streamed level chunks and
+// shader reloads. One pool for all of them, so they never run on more threads than the
+// machine has, however many are asked for at once
+JobPool& backgroundJobs() {
+    static JobPool pool;
+    static std::once_flag started;
+    std::call_once(started, []() {
+        int numThreads = (int)std::thread::hardware_concurrency() - 1;
+        pool.start(numThreads < 1 ? 1 : numThreads);
+    });
+    return pool;
+}
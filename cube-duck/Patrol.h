@@ -0,0 +1,210 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define PATROL_LANES 8
+typedef __m256 PatrolLanes;
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PATROL_LANES 4
+typedef __m128 PatrolLanes;
+#endif
+
+#define PATROL_EPSILON 0.001f // closer than this to the end counts as there
+
+enum PATROL_AXIS {
+    PATROL_ALONG_X,
+    PATROL_ALONG_Z
+};
+
+// Walks between start and end along one axis and turns around at the ends. position is the
+// coordinate along the axis, the patrol system owns it and copies it into the transform
+struct PatrolComponent {
+    float position = 0.0f;
+    float start = 0.0f;
+    float end = 0.0f;
+    float speed = 0.0f; // per step
+    int axis = PATROL_ALONG_X;
+    float waitFrames = 0.0f; // frames between steps
+    float frame = 0.0f; // frames waited, whole numbers kept as floats for the SIMD step
+};
+
+// One step: a move every waitFrames + 1 frames, and at the end start and end swap.
+// True when the patrol turned around
+bool patrolStep(PatrolComponent& patrol) {
+    if (patrol.frame < patrol.waitFrames) {
+        patrol.frame += 1.0f;
+        return false;
+    }
+    patrol.frame = 0.0f;
+    if (!(fabsf(patrol.position - patrol.end) > PATROL_EPSILON)) return false;
+
+    bool reached = false;
+    if (patrol.end - patrol.position < 0) {
+        patrol.position -= patrol.speed;
+        if (patrol.position <= patrol.end) reached = true;
+    }
+    if (patrol.end - patrol.position >= 0) {
+        patrol.position += patrol.speed;
+        if (patrol.position >= patrol.end) reached = true;
+    }
+
+    if (reached) {
+        float start = patrol.start;
+        patrol.start = patrol.end;
+        patrol.end = start;
+    }
+    return reached;
+}
+
+// The patrols of an archetype, a field per array so the step goes through PATROL_LANES
+// patrols per instruction. turned has a bit per row, set for the rows the last step turned around
+struct PatrolColumns {
+    std::vector<float> position;
+    std::vector<float> start;
+    std::vector<float> end;
+    std::vector<float> speed;
+    std::vector<int> axis;
+    std::vector<float> waitFrames;
+    std::vector<float> frame;
+    std::vector<uint8_t> turned; // row / 8, bit row % 8
+
+    int size() const {
+        return (int)position.size();
+    }
+
+    void push(const PatrolComponent& patrol) {
+        position.push_back(patrol.position);
+        start.push_back(patrol.start);
+        end.push_back(patrol.end);
+        speed.push_back(patrol.speed);
+        axis.push_back(patrol.axis);
+        waitFrames.push_back(patrol.waitFrames);
+        frame.push_back(patrol.frame);
+        turned.resize((size() + 7) / 8, 0);
+    }
+
+    PatrolComponent read(int row) const {
+        PatrolComponent patrol;
+        patrol.position = position[row];
+        patrol.start = start[row];
+        patrol.end = end[row];
+        patrol.speed = speed[row];
+        patrol.axis = axis[row];
+        patrol.waitFrames = waitFrames[row];
+        patrol.frame = frame[row];
+        return patrol;
+    }
+
+    void write(int row, const PatrolComponent& patrol) {
+        position[row] = patrol.position;
+        start[row] = patrol.start;
+        end[row] = patrol.end;
+        speed[row] = patrol.speed;
+        axis[row] = patrol.axis;
+        waitFrames[row] = patrol.waitFrames;
+        frame[row] = patrol.frame;
+    }
+
+    // the last row moves into row
+    void remove(int row) {
+        int last = size() - 1;
+        write(row, read(last));
+        position.pop_back();
+        start.pop_back();
+        end.pop_back();
+        speed.pop_back();
+        axis.pop_back();
+        waitFrames.pop_back();
+        frame.pop_back();
+        turned.resize((size() + 7) / 8);
+    }
+
+    bool hasTurned(int row) const {
+        return (turned[row >> 3] >> (row & 7)) & 1;
+    }
+};
+
+#if defined(PATROL_LANES)
+#if PATROL_LANES == 8
+inline PatrolLanes lanesLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline void lanesStore(float* p, PatrolLanes a) { _mm256_storeu_ps(p, a); }
+inline PatrolLanes lanesSet(float f) { return _mm256_set1_ps(f); }
+inline PatrolLanes lanesAdd(PatrolLanes a, PatrolLanes b) { return _mm256_add_ps(a, b); }
+inline PatrolLanes lanesSub(PatrolLanes a, PatrolLanes b) { return _mm256_sub_ps(a, b); }
+inline PatrolLanes lanesAnd(PatrolLanes a, PatrolLanes b) { return _mm256_and_ps(a, b); }
+inline PatrolLanes lanesOr(PatrolLanes a, PatrolLanes b) { return _mm256_or_ps(a, b); }
+inline PatrolLanes lanesAndNot(PatrolLanes a, PatrolLanes b) { return _mm256_andnot_ps(a, b); }
+inline PatrolLanes lanesLess(PatrolLanes a, PatrolLanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline PatrolLanes lanesLessEqual(PatrolLanes a, PatrolLanes b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline PatrolLanes lanesGreater(PatrolLanes a, PatrolLanes b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline PatrolLanes lanesGreaterEqual(PatrolLanes a, PatrolLanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline int lanesMask(PatrolLanes a) { return _mm256_movemask_ps(a); }
+#else
+inline PatrolLanes lanesLoad(const float* p) { return _mm_loadu_ps(p); }
+inline void lanesStore(float* p, PatrolLanes a) { _mm_storeu_ps(p, a); }
+inline PatrolLanes lanesSet(float f) { return _mm_set1_ps(f); }
+inline PatrolLanes lanesAdd(PatrolLanes a, PatrolLanes b) { return _mm_add_ps(a, b); }
+inline PatrolLanes lanesSub(PatrolLanes a, PatrolLanes b) { return _mm_sub_ps(a, b); }
+inline PatrolLanes lanesAnd(PatrolLanes a, PatrolLanes b) { return _mm_and_ps(a, b); }
+inline PatrolLanes lanesOr(PatrolLanes a, PatrolLanes b) { return _mm_or_ps(a, b); }
+inline PatrolLanes lanesAndNot(PatrolLanes a, PatrolLanes b) { return _mm_andnot_ps(a, b); }
+inline PatrolLanes lanesLess(PatrolLanes a, PatrolLanes b) { return _mm_cmplt_ps(a, b); }
+inline PatrolLanes lanesLessEqual(PatrolLanes a, PatrolLanes b) { return _mm_cmple_ps(a, b); }
+inline PatrolLanes lanesGreater(PatrolLanes a, PatrolLanes b) { return _mm_cmpgt_ps(a, b); }
+inline PatrolLanes lanesGreaterEqual(PatrolLanes a, PatrolLanes b) { return _mm_cmpge_ps(a, b); }
+inline int lanesMask(PatrolLanes a) { return _mm_movemask_ps(a); }
+#endif
+
+// mask ? a : b, lane by lane
+inline PatrolLanes lanesSelect(PatrolLanes mask, PatrolLanes a, PatrolLanes b) {
+    return lanesOr(lanesAnd(mask, a), lanesAndNot(mask, b));
+}
+#endif
+
+// Steps the rows first .. last, first a multiple of 8. The same arithmetic as patrolStep with
+// every branch turned into a lane mask, the rows that do not fill a step of lanes go one by one
+void stepPatrols(PatrolColumns& patrols, int first, int last) {
+    int row = first;
+    for (int byte = first >> 3; byte < ((last + 7) >> 3); byte++) {
+        patrols.turned[byte] = 0;
+    }
+#if defined(PATROL_LANES)
+    const PatrolLanes zero = lanesSet(0.0f);
+    const PatrolLanes one = lanesSet(1.0f);
+    const PatrolLanes epsilon = lanesSet(PATROL_EPSILON);
+    const PatrolLanes absMask = lanesSet(-0.0f);
+    for (; row + PATROL_LANES <= last; row += PATROL_LANES) {
+        PatrolLanes position = lanesLoad(&patrols.position[row]);
+        PatrolLanes start = lanesLoad(&patrols.start[row]);
+        PatrolLanes end = lanesLoad(&patrols.end[row]);
+        PatrolLanes speed = lanesLoad(&patrols.speed[row]);
+        PatrolLanes frame = lanesLoad(&patrols.frame[row]);
+
+        PatrolLanes active = lanesGreaterEqual(frame, lanesLoad(&patrols.waitFrames[row]));
+        lanesStore(&patrols.frame[row], lanesSelect(active, zero, lanesAdd(frame, one)));
+        PatrolLanes moving = lanesAnd(active, lanesGreater(lanesAndNot(absMask, lanesSub(position, end)), epsilon));
+
+        PatrolLanes back = lanesLess(lanesSub(end, position), zero);
+        PatrolLanes stepped = lanesSelect(back, lanesSub(position, speed), position);
+        PatrolLanes reachedBack = lanesAnd(back, lanesLessEqual(stepped, end));
+        PatrolLanes forward = lanesGreaterEqual(lanesSub(end, stepped), zero);
+        stepped = lanesSelect(forward, lanesAdd(stepped, speed), stepped);
+        PatrolLanes reachedForward = lanesAnd(forward, lanesGreaterEqual(stepped, end));
+        PatrolLanes reached = lanesAnd(moving, lanesOr(reachedBack, reachedForward));
+
+        lanesStore(&patrols.position[row], lanesSelect(moving, stepped, position));
+        lanesStore(&patrols.start[row], lanesSelect(reached, end, start));
+        lanesStore(&patrols.end[row], lanesSelect(reached, start, end));
+        patrols.turned[row >> 3] |= (uint8_t)(lanesMask(reached) << (row & 7));
+    }
+#endif
+    for (; row < last; row++) {
+        PatrolComponent patrol = patrols.read(row);
+        if (patrolStep(patrol)) patrols.turned[row >> 3] |= (uint8_t)(1 << (row & 7));
+        patrols.write(row, patrol);
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <string.h>
+
+// Pipeline descriptions flattened into bytes, hashed and deduplicated. No D3D12 in here,
+// so deduplication can be checked without a device
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// FNV-1a, 64 bit
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+class PipelineKey {
+public:
+    std::vector<unsigned char> bytes;
+
+    void addInt(uint32_t value) {
+        const unsigned char* p = (const unsigned char*)&value;
+        bytes.insert(bytes.end(), p, p + sizeof(value));
+    }
+
+    void addFloat(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        addInt(bits);
+    }
+
+    // length first, so two fields can never run into each other
+    void addBlob(const void* data, size_t size) {
+        addInt((uint32_t)size);
+        const unsigned char* p = (const unsigned char*)data;
+        bytes.insert(bytes.end(), p, p + size);
+    }
+
+    void addString(const char* s) {
+        addBlob(s, s == nullptr ? 0 : strlen(s));
+    }
+
+    uint64_t hash() const {
+        return hashBytes(bytes.data(), bytes.size());
+    }
+};
+
+// Hands out one handle per distinct key. A handle stays valid until its last reference is
+// released, then its slot is reused
+class PipelineKeyTable {
+public:
+    struct Slot {
+        std::vector<unsigned char> bytes;
+        uint64_t hash = 0;
+        int refCount = 0;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<int> freeSlots;
+    std::unordered_multimap<uint64_t, int> byHash;
+    int live = 0;
+
+    int find(const PipelineKey& key, uint64_t hash) {
+        auto range = byHash.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (slots[it->second].bytes == key.bytes) return it->second; // equal hash is not enough
+        }
+        return -1;
+    }
+
+    // created is set when the key was not in the table, the caller then creates the pipeline
+    int acquire(const PipelineKey& key, bool& created) {
+        uint64_t hash = key.hash();
+        int handle = find(key, hash);
+        if (handle != -1) {
+            slots[handle].refCount++;
+            created = false;
+            return handle;
+        }
+
+        if (!freeSlots.empty()) {
+            handle = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            handle = (int)slots.size();
+            slots.emplace_back();
+        }
+        slots[handle].bytes = key.bytes;
+        slots[handle].hash = hash;
+        slots[handle].refCount = 1;
+        byHash.insert({hash, handle});
+        live++;
+        created = true;
+        return handle;
+    }
+
+    // another reference to a live handle, dropped again with release
+    void addRef(int handle) {
+        slots[handle].refCount++;
+    }
+
+    // the pipeline behind handle now has another description, e.g. after a shader reload
+    void rekey(int handle, const PipelineKey& key) {
+        auto range = byHash.equal_range(slots[handle].hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == handle) {
+                byHash.erase(it);
+                break;
+            }
+        }
+        slots[handle].bytes = key.bytes;
+        slots[handle].hash = key.hash();
+        byHash.insert({slots[handle].hash, handle});
+    }
+
+    // true when that was the last reference and the caller should destroy the pipeline
+    bool release(int handle) {
+        if (handle < 0 || handle >= (int)slots.size() || slots[handle].refCount == 0) return false;
+        if (--slots[handle].refCount > 0) return false;
+
+        auto range = byHash.equal_range(slots[handle].hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == handle) {
+                byHash.erase(it);
+                break;
+            }
+        }
+        slots[handle].bytes.clear();
+        freeSlots.push_back(handle);
+        live--;
+        return true;
+    }
+};
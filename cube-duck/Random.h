@@ -1,18 +1,120 @@
 #pragma once
-#include <random>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
 
-float generateRandomFloat(float min, float max) {
-    std::random_device rd;
-    std::mt19937 mt(rd());
-    std::uniform_real_distribution<float> dist(min, max);
+#define RANDOM_DEFAULT_SEED 0x853c49e6748fea9bULL
+
+// PCG32 (XSH RR): 16 bytes of state, one multiply per number. Different streams
+// from the same seed never overlap, so each thread/job can own one
+class PCG32 {
+public:
+    uint64_t state = 0;
+    uint64_t inc = 1;
+
+    PCG32() {}
+    PCG32(uint64_t seed, uint64_t stream = 0) { setSeed(seed, stream); }
+
+    void setSeed(uint64_t seed, uint64_t stream = 0) {
+        state = 0;
+        inc = (stream << 1) | 1;
+        nextUInt();
+        state += seed;
+        nextUInt();
+    }
+
+    uint32_t nextUInt() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+        uint32_t rot = (uint32_t)(old >> 59);
+        return (xorShifted >> rot) | (xorShifted << ((32 - rot) & 31));
+    }
+
+    // [0, 1) with the full 24 bits of float precision
+    float nextFloat() {
+        return (nextUInt() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float nextFloat(float min, float max) {
+        return min + ((max - min) * nextFloat());
+    }
+
+    // [min, max] inclusive, unbiased (Lemire's multiply and reject)
+    int nextInt(int min, int max) {
+        uint32_t range = (uint32_t)(max - min) + 1;
+        if (range == 0) return (int)nextUInt(); // full 32 bit range
+
+        uint64_t m = (uint64_t)nextUInt() * range;
+        uint32_t low = (uint32_t)m;
+        if (low < range) {
+            uint32_t threshold = (0u - range) % range;
+            while (low < threshold) {
+                m = (uint64_t)nextUInt() * range;
+                low = (uint32_t)m;
+            }
+        }
+        return min + (int)(m >> 32);
+    }
+
+    void fillFloats(float* out, int count, float min, float max) {
+        float scale = (max - min) * (1.0f / 16777216.0f);
+        for (int i = 0; i < count; i++) {
+            out[i] = min + ((nextUInt() >> 8) * scale);
+        }
+    }
+
+    void fillInts(int* out, int count, int min, int max) {
+        for (int i = 0; i < count; i++) {
+            out[i] = nextInt(min, max);
+        }
+    }
+};
+
+inline uint64_t randomSeed = RANDOM_DEFAULT_SEED;
+inline std::atomic<uint64_t> randomNextStream{0};
+inline std::atomic<unsigned int> randomSeedEpoch{0};
 
-    return dist(mt);
+// Reseeds every thread's generator. The calling thread gets stream 0, so single threaded
+// generation right after this call is reproducible
+void setRandomSeed(uint64_t seed) {
+    randomSeed = seed;
+    randomNextStream = 0;
+    randomSeedEpoch++;
+}
+
+// Generator for a fixed stream of the current seed. Parallel jobs should use
+// randomStream(jobIndex) so the result does not depend on thread scheduling
+PCG32 randomStream(uint64_t stream) {
+    return PCG32(randomSeed, stream + 1); // stream 0 is reserved for the seeding thread
+}
+
+// The calling thread's generator, created on first use and reseeded after setRandomSeed
+PCG32& threadRandom() {
+    thread_local PCG32 rng;
+    thread_local unsigned int epoch = 0xFFFFFFFF;
+    if (epoch != randomSeedEpoch) {
+        uint64_t stream = randomNextStream++;
+        rng.setSeed(randomSeed, stream == 0 ? 0 : stream + 0x100000000ULL); // keep clear of randomStream ids
+        epoch = randomSeedEpoch;
+    }
+    return rng;
+}
+
+float generateRandomFloat(float min, float max) {
+    return threadRandom().nextFloat(min, max);
 }
 
 int generateRandomInt(int min, int max) {
-    std::random_device rd;
-    std::mt19937 mt(rd());
-    std::uniform_int_distribution<int> dist(min, max);
+    return threadRandom().nextInt(min, max);
+}
 
-    return dist(mt);
-}
\ No newline at end of file
+void generateRandomFloats(std::vector<float>& out, int count, float min, float max) {
+    out.resize(count);
+    threadRandom().fillFloats(out.data(), count, min, max);
+}
+
+void generateRandomInts(std::vector<int>& out, int count, int min, int max) {
+    out.resize(count);
+    threadRandom().fillInts(out.data(), count, min, max);
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include <string.h>
+
+// Draws are submitted as packets with a 64 bit key and drawn in key order, so objects that
+// share a pipeline and textures end up next to each other and their binds are skipped.
+//   bits 62-63 pass, 48-61 pipeline, 32-47 material, 0-31 depth
+// The pipeline is its PSOCache handle plus one, 0 for none. Handles are reused once a pipeline
+// is released, so they stay small
+
+enum RENDER_PASS {
+    RENDER_PASS_OPAQUE,
+    RENDER_PASS_TRANSPARENT // after every opaque draw, back to front
+};
+
+#define SORT_KEY_PASS_SHIFT 62
+#define SORT_KEY_PIPELINE_SHIFT 48
+#define SORT_KEY_MATERIAL_SHIFT 32
+#define SORT_KEY_PIPELINE_MASK 0x3FFFull
+#define SORT_KEY_MATERIAL_MASK 0xFFFFull
+
+uint64_t makeSortKey(int pass, unsigned int pipeline, unsigned int material, float depth) {
+    uint32_t depthBits = 0;
+    if (depth > 0.0f) {
+        memcpy(&depthBits, &depth, sizeof(depthBits)); // positive floats order like their bits
+    }
+    if (pass == RENDER_PASS_TRANSPARENT) {
+        depthBits = ~depthBits;
+    }
+    return ((uint64_t)pass << SORT_KEY_PASS_SHIFT)
+        | ((pipeline & SORT_KEY_PIPELINE_MASK) << SORT_KEY_PIPELINE_SHIFT)
+        | ((material & SORT_KEY_MATERIAL_MASK) << SORT_KEY_MATERIAL_SHIFT)
+        | depthBits;
+}
+
+struct RenderPacket {
+    uint64_t key;
+    int draw; // index into the queue's draws
+};
+
+// Stable LSD radix sort on the key, one byte per pass. Bytes that are the same in every
+// key are skipped, which is most of them when only a few pipelines and materials exist
+void radixSortPackets(std::vector<RenderPacket>& packets, std::vector<RenderPacket>& scratch) {
+    int count = packets.size();
+    if (count < 2) return;
+    scratch.resize(count);
+
+    uint64_t differing = 0;
+    for (int i = 1; i < count; i++) {
+        differing |= packets[i].key ^ packets[0].key;
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((differing >> shift) & 0xFF) == 0) continue;
+
+        int offsets[256] = {};
+        for (int i = 0; i < count; i++) {
+            offsets[(packets[i].key >> shift) & 0xFF]++;
+        }
+        int sum = 0;
+        for (int b = 0; b < 256; b++) {
+            int n = offsets[b];
+            offsets[b] = sum;
+            sum += n;
+        }
+        for (int i = 0; i < count; i++) {
+            scratch[offsets[(packets[i].key >> shift) & 0xFF]++] = packets[i];
+        }
+        packets.swap(scratch);
+    }
+}
+
+struct RenderQueueStats {
+    int pipelineChanges = 0;
+    int materialChanges = 0;
+};
+
+// binds a state tracking submitter has to issue for packets drawn in this order
+RenderQueueStats countStateChanges(const std::vector<RenderPacket>& packets) {
+    RenderQueueStats stats;
+    for (int i = 0; i < (int)packets.size(); i++) {
+        uint64_t key = packets[i].key;
+        uint64_t previous = i == 0 ? ~key : packets[i - 1].key;
+        if (((key ^ previous) >> SORT_KEY_PIPELINE_SHIFT) & SORT_KEY_PIPELINE_MASK) stats.pipelineChanges++;
+        if (((key ^ previous) >> SORT_KEY_MATERIAL_SHIFT) & SORT_KEY_MATERIAL_MASK) stats.materialChanges++;
+    }
+    return stats;
+}
+
+class RenderQueue {
+public:
+    std::vector<RenderPacket> packets;
+    std::vector<RenderPacket> scratch;
+    std::vector<std::function<void()>> draws; // in submission order
+    std::vector<std::function<void()>> sortedDraws;
+    RenderQueueStats unsortedStats; // of the last sort, debug builds only
+    RenderQueueStats sortedStats;
+
+    void clear() {
+        packets.clear();
+        draws.clear();
+    }
+
+    void submit(uint64_t key, std::function<void()> draw) {
+        packets.push_back({key, (int)draws.size()});
+        draws.push_back(std::move(draw));
+    }
+
+    // pipeline is a PSOCache handle, -1 when the object has none
+    void submit(int pass, int pipeline, unsigned int material, float depth, std::function<void()> draw) {
+        submit(makeSortKey(pass, (unsigned int)(pipeline + 1), material, depth), std::move(draw));
+    }
+
+    // draws in key order, valid until the next clear
+    const std::vector<std::function<void()>>& sort() {
+#ifdef _DEBUG
+        unsortedStats = countStateChanges(packets);
+#endif
+        radixSortPackets(packets, scratch);
+#ifdef _DEBUG
+        sortedStats = countStateChanges(packets);
+#endif
+
+        sortedDraws.clear();
+        sortedDraws.reserve(packets.size());
+        for (const RenderPacket& packet : packets) {
+            sortedDraws.push_back(std::move(draws[packet.draw]));
+        }
+        return sortedDraws;
+    }
+};
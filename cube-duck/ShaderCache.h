@@ -0,0 +1,131 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdint.h>
+#include "PipelineKey.h"
+
+// On-disk cache of compiled shaders, named by a hash of everything that goes into the
+// compile. Each entry is <hash>.cso with the bytecode and <hash>.reflect with the reflection
+// data as plain text, one item per line:
+//   gemshader <version>
+//   source <hlsl file>
+//   target <profile> <entry point>
+//   cbuffer <name>
+//   var <name> <offset> <size>
+//   texture <name> <bind point>
+// A changed source hashes differently, so stale entries are never read
+
+#define SHADER_CACHE_DIR "shaders/cache/"
+#define SHADER_CACHE_VERSION 2
+
+struct ShaderVariableInfo {
+    std::string name;
+    unsigned int offset;
+    unsigned int size;
+};
+
+struct ShaderTextureInfo {
+    std::string name;
+    unsigned int bindPoint;
+};
+
+struct ShaderReflectionData {
+    std::string source;
+    std::string target;
+    std::string entryPoint;
+    std::vector<std::string> constantBuffers;
+    std::vector<ShaderVariableInfo> variables; // of every constant buffer, in order
+    std::vector<ShaderTextureInfo> textures;
+};
+
+uint64_t shaderSourceHash(const std::string& source, const std::string& entryPoint, const std::string& target, unsigned int flags) {
+    PipelineKey key;
+    key.addBlob(source.data(), source.size());
+    key.addString(entryPoint.c_str());
+    key.addString(target.c_str());
+    key.addInt(flags);
+    key.addInt(SHADER_CACHE_VERSION);
+    return key.hash();
+}
+
+std::string shaderCachePath(uint64_t hash, const std::string& extension) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+    return SHADER_CACHE_DIR + std::string(name) + extension;
+}
+
+bool readBinaryFile(const std::string& filename, std::vector<char>& data) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.good()) return false;
+    data.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    return (bool)file;
+}
+
+bool writeBinaryFile(const std::string& filename, const void* data, size_t size) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.good()) return false;
+    file.write((const char*)data, size);
+    return file.good();
+}
+
+bool writeShaderReflection(const std::string& filename, const ShaderReflectionData& data) {
+    std::ofstream file(filename);
+    if (!file.good()) return false;
+    file << "gemshader " << SHADER_CACHE_VERSION << "\n";
+    file << "source " << data.source << "\n";
+    file << "target " << data.target << " " << data.entryPoint << "\n";
+    for (const std::string& name : data.constantBuffers) {
+        file << "cbuffer " << name << "\n";
+    }
+    for (const ShaderVariableInfo& variable : data.variables) {
+        file << "var " << variable.name << " " << variable.offset << " " << variable.size << "\n";
+    }
+    for (const ShaderTextureInfo& texture : data.textures) {
+        file << "texture " << texture.name << " " << texture.bindPoint << "\n";
+    }
+    return file.good();
+}
+
+bool readShaderReflection(const std::string& filename, ShaderReflectionData& data) {
+    std::ifstream file(filename);
+    if (!file.good()) return false;
+
+    std::string line;
+    int version = 0;
+    while (std::getline(file, line)) {
+        std::stringstream stream(line);
+        std::string tag;
+        stream >> tag;
+        if (tag == "gemshader") {
+            stream >> version;
+        }
+        else if (tag == "source") {
+            std::getline(stream >> std::ws, data.source); // paths may have spaces
+        }
+        else if (tag == "target") {
+            stream >> data.target >> data.entryPoint;
+        }
+        else if (tag == "cbuffer") {
+            std::string name;
+            stream >> name;
+            data.constantBuffers.push_back(name);
+        }
+        else if (tag == "var") {
+            ShaderVariableInfo variable;
+            stream >> variable.name >> variable.offset >> variable.size;
+            if (!stream) return false;
+            data.variables.push_back(variable);
+        }
+        else if (tag == "texture") {
+            ShaderTextureInfo texture;
+            stream >> texture.name >> texture.bindPoint;
+            if (!stream) return false;
+            data.textures.push_back(texture);
+        }
+    }
+    return version == SHADER_CACHE_VERSION;
+}
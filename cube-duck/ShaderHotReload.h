@@ -0,0 +1,247 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <future>
+#include "Core.h"
+#include "ShaderManager.h"
+#include "PSOManager.h"
+#include "FileWatcher.h"
+#include "Parallel.h"
+
+#define SHADER_RELOAD_RETIRE_FRAMES 3 // frames before a replaced pipeline or blob is freed
+
+// Recompiles shaders when their file changes and swaps them in together with every pipeline
+// built from them. Compiling and pipeline creation run on the background pool, update() only
+// swaps finished work at the frame boundary, so a reload never stalls a frame. A shader that
+// fails to compile keeps the old version running
+class ShaderHotReload {
+public:
+    struct CompiledShader {
+        ID3DBlob* blob = nullptr;
+        ShaderReflectionData reflection;
+        std::string error;
+    };
+
+    struct CompileJob {
+        std::string filename;
+        std::future<CompiledShader> result;
+    };
+
+    struct PipelineJob {
+        std::string filename;
+        CompiledShader shader;
+        std::vector<int> handles;
+        std::vector<D3D12_GRAPHICS_PIPELINE_STATE_DESC> descriptions;
+        std::future<std::vector<ID3D12PipelineState*>> result;
+    };
+
+    struct Retired {
+        ID3D12PipelineState* pso;
+        ID3DBlob* blob;
+        int framesLeft;
+    };
+
+    ShaderManager* shaderManager = nullptr; // set by start, the game only starts it in debug builds or with --hot-reload
+    FileWatcher watcher;
+    std::set<std::string> pending; // changed while an older version was still in flight
+    std::vector<CompileJob> compiling;
+    std::vector<PipelineJob> building;
+    std::vector<Retired> retired;
+    std::map<std::string, std::vector<ID3DBlob*>> staleBlobs; // replaced bytecode that pipelines built during a reload still use
+
+    void start(ShaderManager* _shaderManager, const std::string& directory) {
+        shaderManager = _shaderManager;
+        watcher.start(directory, ".hlsl");
+    }
+
+    bool inFlight(const std::string& filename) {
+        for (CompileJob& job : compiling) {
+            if (job.filename == filename) return true;
+        }
+        for (PipelineJob& job : building) {
+            if (job.filename == filename) return true;
+        }
+        return false;
+    }
+
+    void report(const std::string& filename, const std::string& error) {
+        OutputDebugStringA((filename + ": " + error + "\n").c_str()); // no message box, the game keeps running
+    }
+
+    template <typename T>
+    static bool isReady(std::future<T>& result) {
+        return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    void startCompiles() {
+        std::vector<std::string> changed;
+        watcher.poll(changed);
+        pending.insert(changed.begin(), changed.end());
+
+        for (auto it = pending.begin(); it != pending.end();) {
+            auto shader = shaderManager->shaders.find(*it);
+            if (shader == shaderManager->shaders.end()) {
+                it = pending.erase(it); // not used by the game
+                continue;
+            }
+            if (inFlight(*it)) {
+                ++it;
+                continue;
+            }
+
+            std::string filename = *it;
+            ShaderKind kind = shader->second.kind;
+            compiling.push_back({ filename, backgroundJobs().async([filename, kind]() {
+                CompiledShader compiled;
+                compiled.blob = loadShaderBytecode(filename, kind, compiled.reflection, compiled.error);
+                return compiled;
+            }) });
+            it = pending.erase(it);
+        }
+    }
+
+    // compiled shaders start building new versions of the pipelines that use them
+    void startPipelineBuilds(Core* core) {
+        for (auto it = compiling.begin(); it != compiling.end();) {
+            if (!isReady(it->result)) {
+                ++it;
+                continue;
+            }
+            CompiledShader compiled = it->result.get();
+            std::string filename = it->filename;
+            it = compiling.erase(it);
+            if (compiled.blob == nullptr) {
+                report(filename, compiled.error);
+                continue;
+            }
+
+            PipelineJob job;
+            job.filename = filename;
+            job.shader = compiled;
+            // the pipelines of the current version and of the ones still left from earlier reloads
+            std::vector<const void*> oldBytecodes = { shaderManager->shaders[filename].shaderBlob->GetBufferPointer() };
+            for (ID3DBlob* blob : staleBlobs[filename]) {
+                oldBytecodes.push_back(blob->GetBufferPointer());
+            }
+            for (const void* oldBytecode : oldBytecodes) {
+                PSOCache::usersOf(oldBytecode, job.handles);
+            }
+            // a chunk can release its pipelines while they build, the reload holds its own reference
+            // until the swap so the slot is not reused for another description in between
+            for (int handle : job.handles) {
+                PSOCache::addRef(handle);
+                D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = PSOCache::state().descriptions[handle];
+                D3D12_SHADER_BYTECODE bytecode = { compiled.blob->GetBufferPointer(), compiled.blob->GetBufferSize() };
+                for (const void* oldBytecode : oldBytecodes) {
+                    if (desc.VS.pShaderBytecode == oldBytecode) desc.VS = bytecode;
+                    if (desc.PS.pShaderBytecode == oldBytecode) desc.PS = bytecode;
+                }
+                job.descriptions.push_back(desc);
+            }
+
+            std::vector<D3D12_GRAPHICS_PIPELINE_STATE_DESC> descriptions = job.descriptions;
+            ID3D12Device5* device = core->device;
+            job.result = backgroundJobs().async([device, descriptions]() {
+                std::vector<ID3D12PipelineState*> psos(descriptions.size(), nullptr);
+                for (int i = 0; i < descriptions.size(); i++) {
+                    if (FAILED(device->CreateGraphicsPipelineState(&descriptions[i], IID_PPV_ARGS(&psos[i])))) {
+                        psos[i] = nullptr;
+                    }
+                }
+                return psos;
+            });
+            building.push_back(std::move(job));
+        }
+    }
+
+    // everything of a reload is swapped at once, or nothing
+    void swapFinished() {
+        for (auto it = building.begin(); it != building.end();) {
+            if (!isReady(it->result)) {
+                ++it;
+                continue;
+            }
+            PipelineJob job = std::move(*it);
+            it = building.erase(it);
+            std::vector<ID3D12PipelineState*> psos = job.result.get();
+
+            bool ok = true;
+            for (ID3D12PipelineState* pso : psos) {
+                if (pso == nullptr) ok = false;
+            }
+            ID3DBlob* oldBlob = nullptr;
+            if (ok && !shaderManager->replaceShader(job.filename, job.shader.blob, job.shader.reflection, oldBlob)) {
+                report(job.filename, "constant buffer is bigger than the one allocated at startup, restart to apply");
+                ok = false;
+            }
+            if (!ok) {
+                for (ID3D12PipelineState* pso : psos) {
+                    if (pso != nullptr) pso->Release();
+                }
+                job.shader.blob->Release();
+                releaseHandles(job);
+                continue;
+            }
+
+            for (int i = 0; i < job.handles.size(); i++) {
+                ID3D12PipelineState* old = PSOCache::replace(job.handles[i], job.descriptions[i], psos[i]);
+                retired.push_back({ old, nullptr, SHADER_RELOAD_RETIRE_FRAMES });
+            }
+            // a pipeline whose objects went away during the build is freed here, it never drew
+            releaseHandles(job);
+
+            // pipelines created while this reload was building still point at the old bytecode. It
+            // stays alive for them, and another reload of the file moves them to the new version
+            staleBlobs[job.filename].push_back(oldBlob);
+            if (!retireUnusedBlobs(job.filename)) {
+                pending.insert(job.filename);
+            }
+        }
+    }
+
+    void releaseHandles(PipelineJob& job) {
+        for (int handle : job.handles) {
+            PSOCache::release(handle);
+        }
+        job.handles.clear();
+    }
+
+    // Retires the stale blobs of a file no pipeline uses any more, false if some are still used
+    bool retireUnusedBlobs(const std::string& filename) {
+        std::vector<ID3DBlob*>& blobs = staleBlobs[filename];
+        for (auto it = blobs.begin(); it != blobs.end();) {
+            std::vector<int> stillUsing;
+            PSOCache::usersOf((*it)->GetBufferPointer(), stillUsing);
+            if (!stillUsing.empty()) {
+                ++it;
+                continue;
+            }
+            retired.push_back({ nullptr, *it, SHADER_RELOAD_RETIRE_FRAMES });
+            it = blobs.erase(it);
+        }
+        return blobs.empty();
+    }
+
+    void releaseRetired() {
+        for (auto it = retired.begin(); it != retired.end();) {
+            if (--it->framesLeft > 0) {
+                ++it;
+                continue;
+            }
+            if (it->pso != nullptr) it->pso->Release();
+            if (it->blob != nullptr) it->blob->Release();
+            it = retired.erase(it);
+        }
+    }
+
+    // call once per frame, outside of beginFrame/finishFrame
+    void update(Core* core) {
+        if (shaderManager == nullptr) return; // not started
+        releaseRetired();
+        swapFinished();
+        startPipelineBuilds(core);
+        startCompiles();
+    }
+};
@@ -5,8 +5,13 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <iostream>
+#include <filesystem>
 #include "Core.h"
 #include "ConstantBufferReflection.h"
+#include "ShaderCache.h"
+
+#define SHADER_COMPILE_FLAGS 0
 
 enum ShaderKind {
     VERTEX_SHADER,
@@ -20,6 +25,116 @@ std::string readFile(const std::string& filename) {
     return buffer.str();
 }
 
+// What the engine needs from D3DReflect, in the form the shader cache stores
+bool reflectShader(ID3DBlob* shaderBlob, ShaderReflectionData& data) {
+    ID3D12ShaderReflection* reflection;
+    HRESULT hr = D3DReflect(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), IID_PPV_ARGS(&reflection));
+    if (FAILED(hr)) {
+        return false;
+    }
+    D3D12_SHADER_DESC desc;
+    reflection->GetDesc(&desc);
+
+    for (int i = 0; i < desc.ConstantBuffers; i++) {
+        ID3D12ShaderReflectionConstantBuffer* constantBuffer = reflection->GetConstantBufferByIndex(i);
+        D3D12_SHADER_BUFFER_DESC cbDesc;
+        constantBuffer->GetDesc(&cbDesc);
+        D3D12_SHADER_INPUT_BIND_DESC cbBind;
+        if (SUCCEEDED(reflection->GetResourceBindingDescByName(cbDesc.Name, &cbBind)) && cbBind.BindPoint != 0) {
+            continue; // b1 and b2 are root constants, the texture indices and the mesh's vertex decode
+        }
+        data.constantBuffers.push_back(cbDesc.Name);
+
+        for (int j = 0; j < cbDesc.Variables; j++) {
+            ID3D12ShaderReflectionVariable* var = constantBuffer->GetVariableByIndex(j);
+            D3D12_SHADER_VARIABLE_DESC vDesc;
+            var->GetDesc(&vDesc);
+            data.variables.push_back({ vDesc.Name, vDesc.StartOffset, vDesc.Size });
+        }
+    }
+
+    for (int i = 0; i < desc.BoundResources; i++) {
+        D3D12_SHADER_INPUT_BIND_DESC bindDesc;
+        reflection->GetResourceBindingDesc(i, &bindDesc);
+        if (bindDesc.Type == D3D_SIT_TEXTURE) {
+            data.textures.push_back({ bindDesc.Name, bindDesc.BindPoint });
+        }
+    }
+
+    reflection->Release();
+    return true;
+}
+
+// Bytecode and reflection of a shader file. Comes from the shader cache when the source did not
+// change since it was compiled, otherwise the shader is compiled and added to the cache.
+// Returns nullptr and fills error if compiling fails
+ID3DBlob* loadShaderBytecode(const std::string& filename, ShaderKind kind, ShaderReflectionData& reflection, std::string& error) {
+    std::string entryPoint = (kind == VERTEX_SHADER) ? "VS" : "PS";
+    std::string target = (kind == VERTEX_SHADER) ? "vs_5_1" : "ps_5_1"; // 5.1 for unbounded texture arrays
+
+    std::string shaderStr = readFile(filename);
+    uint64_t hash = shaderSourceHash(shaderStr, entryPoint, target, SHADER_COMPILE_FLAGS);
+    std::string bytecodePath = shaderCachePath(hash, ".cso");
+    std::string reflectionPath = shaderCachePath(hash, ".reflect");
+
+    std::vector<char> bytecode;
+    if (readBinaryFile(bytecodePath, bytecode) && readShaderReflection(reflectionPath, reflection)) {
+        ID3DBlob* shader;
+        if (SUCCEEDED(D3DCreateBlob(bytecode.size(), &shader))) {
+            memcpy(shader->GetBufferPointer(), bytecode.data(), bytecode.size());
+            return shader;
+        }
+    }
+    reflection = ShaderReflectionData();
+
+    ID3DBlob* shader;
+    ID3DBlob* status;
+    HRESULT hr = D3DCompile(shaderStr.c_str(), strlen(shaderStr.c_str()), NULL, NULL, NULL, entryPoint.c_str(), target.c_str(), SHADER_COMPILE_FLAGS, 0, &shader, &status);
+    if (FAILED(hr)) {
+        error = status != nullptr ? (char*)status->GetBufferPointer() : "D3DCompile failed";
+        return nullptr;
+    }
+
+    reflection.source = filename;
+    reflection.target = target;
+    reflection.entryPoint = entryPoint;
+    if (!reflectShader(shader, reflection)) {
+        error = "Failed to reflect shader";
+        shader->Release();
+        return nullptr;
+    }
+
+    // a cache that cannot be written only costs the next start a compile
+    std::error_code dirError;
+    std::filesystem::create_directories(SHADER_CACHE_DIR, dirError);
+    if (writeBinaryFile(bytecodePath, shader->GetBufferPointer(), shader->GetBufferSize())) {
+        writeShaderReflection(reflectionPath, reflection);
+    }
+    return shader;
+}
+
+// Compiles every shader under directory into the shader cache. Shaders in a "vertex" folder
+// are vertex shaders, the rest pixel shaders. Run after each build with --build-shaders
+bool buildShaderCache(const std::string& directory) {
+    bool ok = true;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".hlsl") continue;
+
+        std::string filename = entry.path().generic_string();
+        ShaderKind kind = filename.find("/vertex/") != std::string::npos ? VERTEX_SHADER : PIXEL_SHADER;
+        ShaderReflectionData reflection;
+        std::string error;
+        ID3DBlob* shader = loadShaderBytecode(filename, kind, reflection, error);
+        if (shader == nullptr) {
+            std::cerr << filename << ": " << error << std::endl;
+            ok = false;
+            continue;
+        }
+        shader->Release();
+    }
+    return ok;
+}
+
 class Shader {
 public:
     ID3DBlob* shaderBlob;
@@ -39,87 +154,75 @@ public:
 class ShaderManager {
 public:
     std::unordered_map<std::string, Shader> shaders;
-    std::map<std::string, int> textureBindPoints;
     Core* core;
 
     ShaderManager(Core* _core) : core(_core) {}
 
-    void loadConstantBufferReflection(ID3DBlob* shaderBlob, ConstantBufferReflection* reflectionBuffer) {
-        ID3D12ShaderReflection* reflection;
-        HRESULT hr = D3DReflect(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), IID_PPV_ARGS(&reflection));
-        if (FAILED(hr)) {
-            MessageBoxA(NULL, "Failed to reflect shader", "Shader Reflection Error", MB_OK | MB_ICONERROR);
-            return;
+    void loadConstantBufferReflection(const ShaderReflectionData& data, ConstantBufferReflection* reflectionBuffer) {
+        for (const std::string& name : data.constantBuffers) {
+            reflectionBuffer->name = name;
         }
-        D3D12_SHADER_DESC desc;
-        reflection->GetDesc(&desc);
-
-        for (int i = 0; i < desc.ConstantBuffers; i++) {
-            ID3D12ShaderReflectionConstantBuffer* constantBuffer = reflection->GetConstantBufferByIndex(i);
-            D3D12_SHADER_BUFFER_DESC cbDesc;
-            constantBuffer->GetDesc(&cbDesc);
-            reflectionBuffer->name = cbDesc.Name;
-            unsigned int totalSize = 0;
-
-            for (int j = 0; j < cbDesc.Variables; j++) {
-                ID3D12ShaderReflectionVariable* var = constantBuffer->GetVariableByIndex(j);
-                D3D12_SHADER_VARIABLE_DESC vDesc;
-                var->GetDesc(&vDesc);
-                ConstantBufferVariable bufferVariable;
-                bufferVariable.offset = vDesc.StartOffset;
-                bufferVariable.size = vDesc.Size;
-                reflectionBuffer->constantBufferData.insert({ vDesc.Name, bufferVariable });
-                totalSize += bufferVariable.size;
-            }
+        for (const ShaderVariableInfo& variable : data.variables) {
+            ConstantBufferVariable bufferVariable;
+            bufferVariable.offset = variable.offset;
+            bufferVariable.size = variable.size;
+            reflectionBuffer->constantBufferData.insert({ variable.name, bufferVariable });
         }
+    }
 
-        for (int i = 0; i < desc.BoundResources; i++) {
-            D3D12_SHADER_INPUT_BIND_DESC bindDesc;
-            reflection->GetResourceBindingDesc(i, &bindDesc);
-            if (bindDesc.Type == D3D_SIT_TEXTURE) {
-                textureBindPoints.insert({ bindDesc.Name, bindDesc.BindPoint });
+    // Swaps in recompiled bytecode and its reflection. Fails if the constant buffer grew past
+    // what was allocated for it. old gets the previous blob, which pipelines may still use
+    bool replaceShader(const std::string& filename, ID3DBlob* blob, const ShaderReflectionData& reflection, ID3DBlob*& old) {
+        auto it = shaders.find(filename);
+        if (it == shaders.end()) {
+            return false;
+        }
+        Shader& shader = it->second;
+        if (shader.constantBufferReflection != nullptr) {
+            for (const ShaderVariableInfo& variable : reflection.variables) {
+                if (variable.offset + variable.size > shader.constantBufferReflection->cbSizeInBytes) {
+                    return false;
+                }
             }
+            shader.constantBufferReflection->constantBufferData.clear();
+            loadConstantBufferReflection(reflection, shader.constantBufferReflection);
         }
-
-        reflection->Release();
+        old = shader.shaderBlob;
+        shader.shaderBlob = blob;
+        return true;
     }
 
-    void updateTexturePS(Core* core, std::string name, int heapOffset) {
-        UINT bindPoint = textureBindPoints[name];
-        D3D12_GPU_DESCRIPTOR_HANDLE handle = core->srvHeap.gpuHandle;
-        handle.ptr = handle.ptr + (UINT64)(heapOffset - bindPoint) * (UINT64)core->srvHeap.incrementSize;
-        core->getCommandList()->SetGraphicsRootDescriptorTable(2, handle);
+    // Textures are read straight from the SRV heap, a draw only passes the heap indices
+    void updateTexturesPS(Core* core, int diffuseIndex, int normalIndex) {
+        unsigned int indices[TEXTURE_INDEX_COUNT] = { (unsigned int)diffuseIndex, (unsigned int)normalIndex };
+        if (threadListState.textureIndicesSet && memcmp(threadListState.textureIndices, indices, sizeof(indices)) == 0) {
+            return;
+        }
+        memcpy(threadListState.textureIndices, indices, sizeof(indices));
+        threadListState.textureIndicesSet = true;
+        core->getCommandList()->SetGraphicsRoot32BitConstants(ROOT_TEXTURE_INDICES, TEXTURE_INDEX_COUNT, indices, 0);
     }
 
-    void updateTexturesPSWithNormalMap(Core* core, std::string diffuseName, int diffuseOffset, std::string normalName, int normalOffset) {
-        UINT bindPoint0 = textureBindPoints[diffuseName];
-        UINT bindPoint1 = textureBindPoints[normalName];
-
-        D3D12_GPU_DESCRIPTOR_HANDLE handle = core->srvHeap.gpuHandle;
-        handle.ptr = handle.ptr + (UINT64)(diffuseOffset - bindPoint0) * (UINT64)core->srvHeap.incrementSize;
-        core->getCommandList()->SetGraphicsRootDescriptorTable(2, handle);
+    void updateTexturePS(Core* core, int heapOffset) {
+        updateTexturesPS(core, heapOffset, 0);
+    }
 
-        handle = core->srvHeap.gpuHandle;
-        handle.ptr = handle.ptr + (UINT64)(normalOffset - bindPoint1) * (UINT64)core->srvHeap.incrementSize;
-        core->getCommandList()->SetGraphicsRootDescriptorTable(3, handle);
+    void updateTexturesPSWithNormalMap(Core* core, int diffuseOffset, int normalOffset) {
+        updateTexturesPS(core, diffuseOffset, normalOffset);
     }
 
     template <typename T>
     Shader* getShader(std::string filename, ShaderKind kind, T* cpuConstantBufferStruct) {
         auto it = shaders.find(filename);
         if (it != shaders.end()) {
-            return &shaders[filename];
+            return &it->second;
         }
 
-        ID3DBlob* shader;
-        ID3DBlob* status;
-        std::string entryPoint = (kind == VERTEX_SHADER) ? "VS" : "PS";
-        std::string target = (kind == VERTEX_SHADER) ? "vs_5_0" : "ps_5_0";
-
-        std::string shaderStr = readFile(filename);
-        HRESULT hr = D3DCompile(shaderStr.c_str(), strlen(shaderStr.c_str()), NULL, NULL, NULL, entryPoint.c_str(), target.c_str(), 0, 0, &shader, &status);
-        if (FAILED(hr)) {
-            MessageBoxA(NULL, (char*)status->GetBufferPointer(), (filename + " Shader Compilation Error").c_str(), MB_OK | MB_ICONERROR);
+        ShaderReflectionData reflection;
+        std::string error;
+        ID3DBlob* shader = loadShaderBytecode(filename, kind, reflection, error);
+        if (shader == nullptr) {
+            MessageBoxA(NULL, error.c_str(), (filename + " Shader Compilation Error").c_str(), MB_OK | MB_ICONERROR);
             return nullptr;
         }
 
@@ -127,7 +230,7 @@ public:
         if (cpuConstantBufferStruct != nullptr) {
             constantBufferReflection = new ConstantBufferReflection();
             constantBufferReflection->init(core, sizeof(*cpuConstantBufferStruct));
-            loadConstantBufferReflection(shader, constantBufferReflection);
+            loadConstantBufferReflection(reflection, constantBufferReflection);
             //MessageBoxA(NULL, ("GPU ADRESS 1: " + std::to_string(constantBufferReflection->getGPUAddress())).c_str(), "Info", MB_OK | MB_ICONINFORMATION);
         }
 
@@ -138,18 +241,14 @@ public:
     Shader* getShader(std::string filename, ShaderKind kind) {
         auto it = shaders.find(filename);
         if (it != shaders.end()) {
-            return &shaders[filename];
+            return &it->second;
         }
 
-        ID3DBlob* shader;
-        ID3DBlob* status;
-        std::string entryPoint = (kind == VERTEX_SHADER) ? "VS" : "PS";
-        std::string target = (kind == VERTEX_SHADER) ? "vs_5_0" : "ps_5_0";
-
-        std::string shaderStr = readFile(filename);
-        HRESULT hr = D3DCompile(shaderStr.c_str(), strlen(shaderStr.c_str()), NULL, NULL, NULL, entryPoint.c_str(), target.c_str(), 0, 0, &shader, &status);
-        if (FAILED(hr)) {
-            MessageBoxA(NULL, (char*)status->GetBufferPointer(), (filename + " Shader Compilation Error").c_str(), MB_OK | MB_ICONERROR);
+        ShaderReflectionData reflection;
+        std::string error;
+        ID3DBlob* shader = loadShaderBytecode(filename, kind, reflection, error);
+        if (shader == nullptr) {
+            MessageBoxA(NULL, error.c_str(), (filename + " Shader Compilation Error").c_str(), MB_OK | MB_ICONERROR);
             return nullptr;
         }
 
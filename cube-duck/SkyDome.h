@@ -9,6 +9,7 @@
 #include "Texture.h"
 
 #define ROTATION_INCREMENT 2.0f
+#define SKY_TEXTURE "models/textures/sky_2.png"
 
 class SkyDome {
 public:
@@ -71,7 +72,7 @@ public:
 
         // load texture
         texture = new Texture();
-        texture->load(core, "models/textures/sky_2.png");
+        texture->load(core, SKY_TEXTURE);
 
         std::vector<Matrix> worldMatrices;
         Matrix identity;
@@ -111,7 +112,7 @@ public:
         vertexShaderCB->W.setRotationY(skyRotationAngle);
         updateConstantsVertexShader(core);
 
-        shaderManager->updateTexturePS(core, "SkyDome", texture->heapOffset);
+        shaderManager->updateTexturePS(core, texture->heapOffset);
 
         mesh.draw(core);
     }
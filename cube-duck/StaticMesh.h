@@ -10,24 +10,43 @@ public:
 
     StaticMesh(Core* core) : core(core) {}
 
-    void load(const std::string& filename, std::vector<Matrix> worldMatrices) {
+    void load(const std::string& filename, const std::vector<Matrix>& worldMatrices) {
         GEMLoader::GEMModelLoader loader;
         std::vector<GEMLoader::GEMMesh> gemmeshes;
         loader.load(filename, gemmeshes);
         for (int i = 0; i < gemmeshes.size(); i++) {
             Mesh* mesh = new Mesh();
-            std::vector<STATIC_VERTEX> vertices;
-            for (int j = 0; j < gemmeshes[i].verticesStatic.size(); j++) {
-                STATIC_VERTEX v;
-                memcpy(&v, &gemmeshes[i].verticesStatic[j], sizeof(STATIC_VERTEX));
-                vertices.push_back(v);
-            }
+            std::vector<STATIC_VERTEX> vertices(gemmeshes[i].verticesStatic.size());
+            memcpy(vertices.data(), gemmeshes[i].verticesStatic.data(), vertices.size() * sizeof(STATIC_VERTEX));
             mesh->initFromVec(core, vertices, gemmeshes[i].indices, worldMatrices);
             meshes.push_back(mesh);
         }
     }
 
+    unsigned long long sizeInBytes() {
+        unsigned long long size = 0;
+        for (Mesh* mesh : meshes) {
+            size += mesh->sizeInBytes;
+        }
+        return size;
+    }
+
+    void updateInstances(const std::vector<Matrix>& worldMatrices) {
+        for (Mesh* mesh : meshes) {
+            mesh->updateInstances(core, worldMatrices);
+        }
+    }
+
+    void release() {
+        for (Mesh* mesh : meshes) {
+            mesh->release();
+            delete mesh;
+        }
+        meshes.clear();
+    }
+
     void draw() {
+        if (!meshes.empty() && meshes[0]->numInstances == 0) return;
         for (int i = 0; i < meshes.size(); i++) {
             meshes[i]->draw(core);
         }
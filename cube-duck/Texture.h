@@ -1,16 +1,16 @@
 #pragma once
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <d3d12.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "Core.h"
-
-// Makes sure textures are loaded only once
-class TextureManager {
-public:
-    // Methods to manage multiple textures can be added here
-};
+#include "GpuMemory.h"
+#include "CookedTexture.h"
+#include "TextureFile.h"
+#include "ImageConvert.h"
 
 // Texture class to handle loading and uploading textures to GPU
 // It works by uploading the texture data to a default heap resource
@@ -18,14 +18,14 @@ public:
 // The SRV can then be bound to the pipeline for use in shaders
 class Texture {
 public:
-    ID3D12Resource* tex;
-    int heapOffset;
+    ID3D12Resource* tex = nullptr;
+    GpuAllocation memory; // where tex is placed
+    int heapOffset = 0; // slot 0 until uploaded, so a texture that failed to load still draws
+    DescriptorHeap* srvHeap = nullptr; // owner of the SRV slot, freed with the texture
+    unsigned long long sizeInBytes = 0;
 
+    // data is 1 to 4 channels of 8 bits, the texture is always RGBA8
     void upload(Core* core, const void* data, int width, int height, int channels = 4, DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB) {
-        D3D12_HEAP_PROPERTIES heapDesc;
-        memset(&heapDesc, 0, sizeof(D3D12_HEAP_PROPERTIES));
-        heapDesc.Type = D3D12_HEAP_TYPE_DEFAULT;
-
         D3D12_RESOURCE_DESC textureDesc;
         memset(&textureDesc, 0, sizeof(D3D12_RESOURCE_DESC));
         textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
@@ -39,53 +39,162 @@ public:
         textureDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
         textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
-        core->device->CreateCommittedResource(&heapDesc, D3D12_HEAP_FLAG_NONE, &textureDesc,
-            D3D12_RESOURCE_STATE_COPY_DEST, NULL, IID_PPV_ARGS(&tex));
+        if (FAILED(GpuMemory::createTexture(core, textureDesc, D3D12_RESOURCE_STATE_COPY_DEST, &tex, memory))) {
+            MessageBoxA(NULL, "Failed to create texture", "Texture Error", MB_OK | MB_ICONERROR);
+            return;
+        }
 
+        // rows are converted straight into the upload buffer at the pitch D3D12 copies with
         D3D12_RESOURCE_DESC desc = tex->GetDesc();
         unsigned long long size;
         D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
         core->device->GetCopyableFootprints(&desc, 0, 1, 0, &footprint, NULL, NULL, &size);
-        unsigned int alignedWidth = ((width * channels) + 255) & ~255;
-        core->uploadResource(tex, data, alignedWidth * height,
-            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &footprint);
+        sizeInBytes = size;
+        unsigned char* mapped = nullptr;
+        ID3D12Resource* uploadBuffer = core->createUploadBuffer(size, (void**)&mapped);
+        const unsigned char* texels = (const unsigned char*)data;
+        for (int row = 0; row < height; row++) {
+            convertRowToRGBA(&texels[(size_t)row * width * channels], channels, &mapped[footprint.Offset + ((size_t)row * footprint.Footprint.RowPitch)], width);
+        }
+        uploadBuffer->Unmap(0, NULL);
+        core->copyFromUploadBuffer(tex, uploadBuffer, size, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &footprint);
+
+        createSRV(core, format, 1);
+    }
 
-        D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = core->srvHeap.getNextCPUHandle();
+    void createSRV(Core* core, DXGI_FORMAT format, int mipLevels) {
+        srvHeap = &core->srvHeap;
+        heapOffset = srvHeap->allocate();
+        D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = srvHeap->getCPUHandle(heapOffset);
 
         D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
         srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
         srvDesc.Format = format;
         srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-        srvDesc.Texture2D.MipLevels = 1;
+        srvDesc.Texture2D.MipLevels = mipLevels;
         core->device->CreateShaderResourceView(tex, &srvDesc, srvHandle);
+    }
+
+    // A cooked texture is already in its GPU format with all its mips, the rows only have to be
+    // spaced out to the pitch D3D12 copies with. state is how shaders read it afterwards
+    void uploadCooked(Core* core, const CookedTexture& cooked, D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE) {
+        unsigned int numMips = cooked.mips.size();
+        DXGI_FORMAT format = (DXGI_FORMAT)cooked.format;
 
-        heapOffset = core->srvHeap.used - 1;
+        D3D12_RESOURCE_DESC textureDesc = {};
+        textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+        textureDesc.Width = cooked.width;
+        textureDesc.Height = cooked.height;
+        textureDesc.DepthOrArraySize = 1;
+        textureDesc.MipLevels = numMips;
+        textureDesc.Format = format;
+        textureDesc.SampleDesc.Count = 1;
+        textureDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+        textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+        if (FAILED(GpuMemory::createTexture(core, textureDesc, D3D12_RESOURCE_STATE_COPY_DEST, &tex, memory))) {
+            MessageBoxA(NULL, "Failed to create texture", "Texture Error", MB_OK | MB_ICONERROR);
+            return;
+        }
+
+        std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(numMips);
+        std::vector<UINT> numRows(numMips);
+        std::vector<UINT64> rowSizes(numMips);
+        UINT64 size = 0;
+        core->device->GetCopyableFootprints(&textureDesc, 0, numMips, 0, footprints.data(), numRows.data(), rowSizes.data(), &size);
+
+        unsigned char* mapped = nullptr;
+        ID3D12Resource* uploadBuffer = core->createUploadBuffer(size, (void**)&mapped);
+        for (unsigned int i = 0; i < numMips; i++) {
+            const CookedMip& mip = cooked.mips[i];
+            unsigned int rows = numRows[i] < mip.rows ? numRows[i] : mip.rows;
+            for (unsigned int row = 0; row < rows; row++) {
+                memcpy(&mapped[footprints[i].Offset + ((size_t)row * footprints[i].Footprint.RowPitch)], &mip.data[(size_t)row * mip.rowBytes], mip.rowBytes);
+            }
+        }
+        uploadBuffer->Unmap(0, NULL);
+        sizeInBytes = size;
+        core->copyFromUploadBuffer(tex, uploadBuffer, size, state, footprints.data(), numMips);
+        createSRV(core, format, numMips);
     }
 
+    // the cooked texture if there is an up to date one, otherwise the image decoded without mips
     void load(Core* core, std::string filename) {
-        int width = 0;
-        int height = 0;
-        int channels = 0;
-        unsigned char* texels = stbi_load(filename.c_str(), &width, &height, &channels, 0);
-
-        if (channels == 3) {
-            channels = 4;
-            unsigned char* texelsWithAlpha = new unsigned char[width * height * channels];
-            for (int i = 0; i < (width * height); i++) {
-                texelsWithAlpha[i * 4] = texels[i * 3];
-                texelsWithAlpha[(i * 4) + 1] = texels[(i * 3) + 1];
-                texelsWithAlpha[(i * 4) + 2] = texels[(i * 3) + 2];
-                texelsWithAlpha[(i * 4) + 3] = 255;
-            }
-            // Initialize texture using width, height, channels, and texelsWithAlpha
-            upload(core, texelsWithAlpha, width, height, channels);
-            delete[] texelsWithAlpha;
+        TextureFileData file;
+        if (!TexturePrefetch::take(filename, file)) {
+            file = readTextureFile(filename);
+        }
+        if (!file.loaded) {
+            MessageBoxA(NULL, ("Failed to load texture " + filename).c_str(), "Texture Error", MB_OK | MB_ICONERROR);
+            return;
+        }
+
+        if (file.cooked) {
+            uploadCooked(core, file.cookedTexture);
         }
         else {
-            // Initialize texture using width, height, channels, and texels
-            upload(core, texels, width, height, channels);
+            DXGI_FORMAT format = textureRoleFromFilename(filename) == TEXTURE_ROLE_COLOUR ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+            upload(core, file.texels, file.width, file.height, file.channels, format);
+        }
+        file.release();
+    }
+
+    void release() {
+        if (tex != nullptr) tex->Release();
+        tex = nullptr;
+        GpuMemory::freeTexture(memory);
+        if (srvHeap != nullptr) {
+            srvHeap->free(heapOffset); // bindless indices are reused, the slot may hold another texture next
+            srvHeap = nullptr;
+        }
+    }
+};
+
+// Makes sure textures are loaded only once. Objects acquire a texture by filename and
+// release it when they unload, the GPU copy goes away with the last user
+class TextureManager {
+public:
+    struct Entry {
+        Texture* texture;
+        int refCount;
+    };
+
+    static std::unordered_map<std::string, Entry>& entries() {
+        static std::unordered_map<std::string, Entry> textures;
+        return textures;
+    }
+
+    static Texture* acquire(Core* core, const std::string& filename) {
+        auto it = entries().find(filename);
+        if (it != entries().end()) {
+            it->second.refCount++;
+            return it->second.texture;
         }
-        stbi_image_free(texels);
+
+        Texture* texture = new Texture();
+        texture->load(core, filename);
+        entries()[filename] = Entry{ texture, 1 };
+        return texture;
+    }
+
+    // starts reading the textures that are not loaded yet on worker threads, acquire picks them up
+    static void prefetch(const std::vector<std::string>& filenames) {
+        std::vector<std::string> missing;
+        for (const std::string& filename : filenames) {
+            if (!filename.empty() && entries().find(filename) == entries().end()) missing.push_back(filename);
+        }
+        TexturePrefetch::prefetch(missing);
+    }
+
+    // the caller makes sure the GPU is done with the texture
+    static void release(const std::string& filename) {
+        auto it = entries().find(filename);
+        if (it == entries().end()) return;
+        if (--it->second.refCount > 0) return;
+
+        it->second.texture->release();
+        delete it->second.texture;
+        entries().erase(it);
     }
 };
 
@@ -0,0 +1,559 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+#include "CookedTexture.h"
+#include "Parallel.h"
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h" // declarations only, Texture.h or the cooker tool holds the implementation
+#endif
+
+// Offline texture cooking: mip chain, block compression and the cooked file. No D3D12 in
+// here, the engine runs it with --cook-textures and tools/cook-textures.cpp on any platform.
+// Formats picked per texture:
+//   colour: BC1 (sRGB) when opaque, BC3 (sRGB) with alpha, BC7 (sRGB) for both in high quality
+//   normal maps: BC5, two channels, z is rebuilt in the shader
+//   data: like colour, but linear
+// A top level that is not a multiple of 4 stays RGBA8, D3D12 cannot create BC textures of it
+
+struct TextureLevel {
+    int width = 0;
+    int height = 0;
+    std::vector<float> texels; // RGBA. Colour is linear light, normals are in [-1, 1]
+};
+
+float srgbToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : (1.055f * powf(c, 1.0f / 2.4f)) - 0.055f;
+}
+
+void textureLevelFromRGBA8(const unsigned char* rgba, int width, int height, int role, TextureLevel& level) {
+    float decode[256];
+    for (int i = 0; i < 256; i++) {
+        float v = i / 255.0f;
+        decode[i] = role == TEXTURE_ROLE_COLOUR ? srgbToLinear(v) : (role == TEXTURE_ROLE_NORMAL ? (v * 2.0f) - 1.0f : v);
+    }
+    level.width = width;
+    level.height = height;
+    level.texels.resize((size_t)width * height * 4);
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        level.texels[(i * 4) + 0] = decode[rgba[(i * 4) + 0]];
+        level.texels[(i * 4) + 1] = decode[rgba[(i * 4) + 1]];
+        level.texels[(i * 4) + 2] = decode[rgba[(i * 4) + 2]];
+        level.texels[(i * 4) + 3] = rgba[(i * 4) + 3] / 255.0f;
+    }
+}
+
+void textureLevelToRGBA8(const TextureLevel& level, int role, std::vector<unsigned char>& rgba) {
+    rgba.resize(level.texels.size());
+    for (size_t i = 0; i < level.texels.size(); i++) {
+        float v = level.texels[i];
+        if ((i & 3) != 3) {
+            if (role == TEXTURE_ROLE_COLOUR) v = linearToSrgb(fmaxf(v, 0.0f));
+            else if (role == TEXTURE_ROLE_NORMAL) v = (v * 0.5f) + 0.5f;
+        }
+        v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+        rgba[i] = (unsigned char)((v * 255.0f) + 0.5f);
+    }
+}
+
+// Source texels making up each destination texel along one axis: a tent as wide as two
+// destination texels, which is smoother than a 2x2 box and handles odd sizes. Textures
+// here tile, so sources wrap around
+struct MipTap {
+    int source;
+    float weight;
+};
+
+void mipFilterTaps(int sourceSize, int destinationSize, std::vector<std::vector<MipTap>>& taps) {
+    taps.assign(destinationSize, {});
+    float scale = (float)sourceSize / destinationSize;
+    for (int i = 0; i < destinationSize; i++) {
+        if (sourceSize == destinationSize) {
+            taps[i].push_back({ i, 1.0f });
+            continue;
+        }
+        float centre = ((i + 0.5f) * scale) - 0.5f;
+        float total = 0.0f;
+        for (int s = (int)floorf(centre - scale) + 1; s <= (int)ceilf(centre + scale) - 1; s++) {
+            float weight = 1.0f - (fabsf(s - centre) / scale);
+            if (weight <= 0.0f) continue;
+            int wrapped = ((s % sourceSize) + sourceSize) % sourceSize;
+            taps[i].push_back({ wrapped, weight });
+            total += weight;
+        }
+        for (MipTap& tap : taps[i]) tap.weight /= total;
+    }
+}
+
+void downsampleTextureLevel(const TextureLevel& source, int role, TextureLevel& destination) {
+    destination.width = source.width > 1 ? source.width / 2 : 1;
+    destination.height = source.height > 1 ? source.height / 2 : 1;
+    std::vector<std::vector<MipTap>> tapsX;
+    std::vector<std::vector<MipTap>> tapsY;
+    mipFilterTaps(source.width, destination.width, tapsX);
+    mipFilterTaps(source.height, destination.height, tapsY);
+
+    std::vector<float> horizontal((size_t)destination.width * source.height * 4, 0.0f);
+    for (int y = 0; y < source.height; y++) {
+        for (int x = 0; x < destination.width; x++) {
+            float* out = &horizontal[(((size_t)y * destination.width) + x) * 4];
+            for (const MipTap& tap : tapsX[x]) {
+                const float* in = &source.texels[(((size_t)y * source.width) + tap.source) * 4];
+                for (int c = 0; c < 4; c++) out[c] += in[c] * tap.weight;
+            }
+        }
+    }
+
+    destination.texels.assign((size_t)destination.width * destination.height * 4, 0.0f);
+    for (int y = 0; y < destination.height; y++) {
+        for (int x = 0; x < destination.width; x++) {
+            float* out = &destination.texels[(((size_t)y * destination.width) + x) * 4];
+            for (const MipTap& tap : tapsY[y]) {
+                const float* in = &horizontal[(((size_t)tap.source * destination.width) + x) * 4];
+                for (int c = 0; c < 4; c++) out[c] += in[c] * tap.weight;
+            }
+            if (role == TEXTURE_ROLE_NORMAL) {
+                float length = sqrtf((out[0] * out[0]) + (out[1] * out[1]) + (out[2] * out[2]));
+                if (length > 0.0f) {
+                    out[0] /= length;
+                    out[1] /= length;
+                    out[2] /= length;
+                }
+            }
+        }
+    }
+}
+
+// Block compression. Blocks are 16 texels of RGBA8 in row order
+
+// Endpoints at the extremes of the block along the main axis of its colours
+void fitBlockEndpoints(const unsigned char* block, int channels, float low[4], float high[4]) {
+    float mean[4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < channels; c++) mean[c] += block[(i * 4) + c] / 16.0f;
+    }
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        float d[4];
+        for (int c = 0; c < channels; c++) d[c] = block[(i * 4) + c] - mean[c];
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++) covariance[a][b] += d[a] * d[b];
+        }
+    }
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++) { // power iteration
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++) next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length < 1e-12f) break;
+        length = 1.0f / sqrtf(length);
+        for (int a = 0; a < channels; a++) axis[a] = next[a] * length;
+    }
+
+    float minT = 0.0f;
+    float maxT = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++) t += (block[(i * 4) + c] - mean[c]) * axis[c];
+        minT = fminf(minT, t);
+        maxT = fmaxf(maxT, t);
+    }
+    for (int c = 0; c < channels; c++) {
+        low[c] = fmaxf(0.0f, fminf(255.0f, mean[c] + (axis[c] * minT)));
+        high[c] = fmaxf(0.0f, fminf(255.0f, mean[c] + (axis[c] * maxT)));
+    }
+}
+
+uint16_t packRGB565(const float colour[3]) {
+    int r = (int)((colour[0] * 31.0f / 255.0f) + 0.5f);
+    int g = (int)((colour[1] * 63.0f / 255.0f) + 0.5f);
+    int b = (int)((colour[2] * 31.0f / 255.0f) + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, int colour[3]) {
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    colour[0] = (r << 3) | (r >> 2);
+    colour[1] = (g << 2) | (g >> 4);
+    colour[2] = (b << 3) | (b >> 2);
+}
+
+// indices of the closest palette entries, returns the squared error
+int chooseBC1Indices(const unsigned char* block, uint16_t c0, uint16_t c1, uint32_t& indices) {
+    int palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = ((2 * palette[0][c]) + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + (2 * palette[1][c])) / 3;
+    }
+    indices = 0;
+    int error = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        int bestError = 0x7FFFFFFF;
+        for (int p = 0; p < 4; p++) {
+            int e = 0;
+            for (int c = 0; c < 3; c++) {
+                int d = block[(i * 4) + c] - palette[p][c];
+                e += d * d;
+            }
+            if (e < bestError) {
+                bestError = e;
+                best = p;
+            }
+        }
+        indices |= (uint32_t)best << (i * 2);
+        error += bestError;
+    }
+    return error;
+}
+
+// Four colour mode only, alpha is ignored
+void encodeBC1Block(const unsigned char* block, unsigned char* out) {
+    float low[4];
+    float high[4];
+    fitBlockEndpoints(block, 3, low, high);
+    uint16_t c0 = packRGB565(high);
+    uint16_t c1 = packRGB565(low);
+    if (c0 < c1) std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int error = chooseBC1Indices(block, c0, c1, indices);
+
+        // least squares refit of the endpoints to the chosen indices, kept if it is better
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+        float ax[3] = {}, bx[3] = {};
+        for (int i = 0; i < 16; i++) {
+            float a = weights[(indices >> (i * 2)) & 3];
+            float b = 1.0f - a;
+            aa += a * a;
+            bb += b * b;
+            ab += a * b;
+            for (int c = 0; c < 3; c++) {
+                ax[c] += a * block[(i * 4) + c];
+                bx[c] += b * block[(i * 4) + c];
+            }
+        }
+        float determinant = (aa * bb) - (ab * ab);
+        if (fabsf(determinant) > 1e-6f) {
+            float refit0[3], refit1[3];
+            for (int c = 0; c < 3; c++) {
+                refit0[c] = fmaxf(0.0f, fminf(255.0f, ((ax[c] * bb) - (bx[c] * ab)) / determinant));
+                refit1[c] = fmaxf(0.0f, fminf(255.0f, ((bx[c] * aa) - (ax[c] * ab)) / determinant));
+            }
+            uint16_t r0 = packRGB565(refit0);
+            uint16_t r1 = packRGB565(refit1);
+            if (r0 < r1) std::swap(r0, r1);
+            uint32_t refitIndices = 0;
+            if (r0 != r1 && chooseBC1Indices(block, r0, r1, refitIndices) < error) {
+                c0 = r0;
+                c1 = r1;
+                indices = refitIndices;
+            }
+        }
+    }
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    memcpy(out + 4, &indices, 4);
+}
+
+// one channel, 16 values. Always the 8 value mode
+void encodeBC4Block(const unsigned char* values, unsigned char* out) {
+    int low = 255;
+    int high = 0;
+    for (int i = 0; i < 16; i++) {
+        if (values[i] < low) low = values[i];
+        if (values[i] > high) high = values[i];
+    }
+    out[0] = (unsigned char)high;
+    out[1] = (unsigned char)low;
+
+    int palette[8] = { high, low };
+    for (int p = 1; p < 7; p++) {
+        palette[p + 1] = (((7 - p) * high) + (p * low)) / 7;
+    }
+    uint64_t indices = 0;
+    for (int i = 0; i < 16 && high != low; i++) {
+        int best = 0;
+        int bestError = 0x7FFFFFFF;
+        for (int p = 0; p < 8; p++) {
+            int e = abs(values[i] - palette[p]);
+            if (e < bestError) {
+                bestError = e;
+                best = p;
+            }
+        }
+        indices |= (uint64_t)best << (i * 3);
+    }
+    for (int b = 0; b < 6; b++) {
+        out[2 + b] = (unsigned char)(indices >> (b * 8));
+    }
+}
+
+void encodeBC3Block(const unsigned char* block, unsigned char* out) {
+    unsigned char alpha[16];
+    for (int i = 0; i < 16; i++) alpha[i] = block[(i * 4) + 3];
+    encodeBC4Block(alpha, out);
+    encodeBC1Block(block, out + 8);
+}
+
+void encodeBC5Block(const unsigned char* block, unsigned char* out) {
+    unsigned char red[16];
+    unsigned char green[16];
+    for (int i = 0; i < 16; i++) {
+        red[i] = block[i * 4];
+        green[i] = block[(i * 4) + 1];
+    }
+    encodeBC4Block(red, out);
+    encodeBC4Block(green, out + 8);
+}
+
+class BlockBitWriter {
+public:
+    unsigned char* out;
+    int position = 0;
+
+    BlockBitWriter(unsigned char* _out) : out(_out) {
+        memset(out, 0, 16);
+    }
+
+    void write(uint32_t value, int bits) {
+        for (int b = 0; b < bits; b++, position++) {
+            out[position >> 3] |= ((value >> b) & 1) << (position & 7);
+        }
+    }
+};
+
+static const int bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// BC7 mode 6 only: one subset, RGBA endpoints of 7 bits plus a shared low bit each, 16 levels.
+// Fine for smooth colour and alpha, blocks with two distinct colour groups look better in the
+// partitioned modes, which this does not search
+void encodeBC7Block(const unsigned char* block, unsigned char* out) {
+    float ends[2][4];
+    fitBlockEndpoints(block, 4, ends[0], ends[1]);
+
+    int quantized[2][4];
+    int pbits[2];
+    int values[2][4];
+    for (int e = 0; e < 2; e++) {
+        float bestError = 1e30f;
+        for (int p = 0; p < 2; p++) {
+            int q[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++) {
+                q[c] = (int)((ends[e][c] - p) / 2.0f + 0.5f);
+                q[c] = q[c] < 0 ? 0 : (q[c] > 127 ? 127 : q[c]);
+                float d = ((q[c] << 1) | p) - ends[e][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                pbits[e] = p;
+                for (int c = 0; c < 4; c++) {
+                    quantized[e][c] = q[c];
+                    values[e][c] = (q[c] << 1) | p;
+                }
+            }
+        }
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        int bestError = 0x7FFFFFFF;
+        for (int k = 0; k < 16; k++) {
+            int e = 0;
+            for (int c = 0; c < 4; c++) {
+                int v = (((64 - bc7Weights4[k]) * values[0][c]) + (bc7Weights4[k] * values[1][c]) + 32) >> 6;
+                int d = block[(i * 4) + c] - v;
+                e += d * d;
+            }
+            if (e < bestError) {
+                bestError = e;
+                best = k;
+            }
+        }
+        indices[i] = best;
+    }
+    if (indices[0] & 8) { // the first index is stored without its top bit
+        for (int c = 0; c < 4; c++) std::swap(quantized[0][c], quantized[1][c]);
+        std::swap(pbits[0], pbits[1]);
+        for (int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+    }
+
+    BlockBitWriter writer(out);
+    writer.write(1 << 6, 7); // mode 6
+    for (int c = 0; c < 4; c++) {
+        writer.write(quantized[0][c], 7);
+        writer.write(quantized[1][c], 7);
+    }
+    writer.write(pbits[0], 1);
+    writer.write(pbits[1], 1);
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; i++) {
+        writer.write(indices[i], 4);
+    }
+}
+
+void compressTextureLevel(const std::vector<unsigned char>& rgba, int width, int height, uint32_t format, CookedMip& mip) {
+    mip.width = width;
+    mip.height = height;
+    if (!cookedFormatIsBlockCompressed(format)) {
+        mip.rowBytes = width * 4;
+        mip.rows = height;
+        mip.data = rgba;
+        return;
+    }
+
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    uint32_t blockBytes = cookedFormatBlockBytes(format);
+    mip.rowBytes = blocksX * blockBytes;
+    mip.rows = blocksY;
+    mip.data.resize((size_t)mip.rowBytes * mip.rows);
+
+    parallelFor(blocksY, [&](int by) {
+        unsigned char block[64];
+        for (int bx = 0; bx < blocksX; bx++) {
+            for (int i = 0; i < 16; i++) { // levels smaller than a block repeat their edge
+                int x = (bx * 4) + (i & 3);
+                int y = (by * 4) + (i >> 2);
+                x = x < width ? x : width - 1;
+                y = y < height ? y : height - 1;
+                memcpy(&block[i * 4], &rgba[(((size_t)y * width) + x) * 4], 4);
+            }
+            unsigned char* out = &mip.data[((size_t)by * mip.rowBytes) + (bx * blockBytes)];
+            switch (format) {
+            case COOKED_FORMAT_BC1:
+            case COOKED_FORMAT_BC1_SRGB:
+                encodeBC1Block(block, out);
+                break;
+            case COOKED_FORMAT_BC3:
+            case COOKED_FORMAT_BC3_SRGB:
+                encodeBC3Block(block, out);
+                break;
+            case COOKED_FORMAT_BC5:
+                encodeBC5Block(block, out);
+                break;
+            default:
+                encodeBC7Block(block, out);
+                break;
+            }
+        }
+    });
+}
+
+uint32_t chooseCookedFormat(int role, bool hasAlpha, int width, int height, bool highQuality) {
+    bool srgb = role == TEXTURE_ROLE_COLOUR;
+    if ((width % 4) != 0 || (height % 4) != 0) {
+        return srgb ? COOKED_FORMAT_RGBA8_SRGB : COOKED_FORMAT_RGBA8;
+    }
+    if (role == TEXTURE_ROLE_NORMAL) {
+        return COOKED_FORMAT_BC5;
+    }
+    if (highQuality) {
+        return srgb ? COOKED_FORMAT_BC7_SRGB : COOKED_FORMAT_BC7;
+    }
+    if (hasAlpha) {
+        return srgb ? COOKED_FORMAT_BC3_SRGB : COOKED_FORMAT_BC3;
+    }
+    return srgb ? COOKED_FORMAT_BC1_SRGB : COOKED_FORMAT_BC1;
+}
+
+// full mip chain of an RGBA8 image, down to 1x1
+void cookTexture(const unsigned char* rgba, int width, int height, int role, bool highQuality, CookedTexture& cooked) {
+    bool hasAlpha = false;
+    for (size_t i = 0; i < (size_t)width * height && !hasAlpha; i++) {
+        hasAlpha = rgba[(i * 4) + 3] != 255;
+    }
+    cooked.format = chooseCookedFormat(role, hasAlpha, width, height, highQuality);
+    cooked.width = width;
+    cooked.height = height;
+    cooked.mips.clear();
+
+    std::vector<unsigned char> levelRGBA(rgba, rgba + ((size_t)width * height * 4));
+    TextureLevel level;
+    textureLevelFromRGBA8(rgba, width, height, role, level);
+    while (true) {
+        cooked.mips.emplace_back();
+        compressTextureLevel(levelRGBA, level.width, level.height, cooked.format, cooked.mips.back());
+        if (level.width == 1 && level.height == 1) break;
+
+        TextureLevel next;
+        downsampleTextureLevel(level, role, next); // from the float level, rounding does not add up over the chain
+        level = std::move(next);
+        textureLevelToRGBA8(level, role, levelRGBA);
+    }
+}
+
+bool cookedFormatMatchesQuality(uint32_t format, bool highQuality) {
+    bool bc7 = format == COOKED_FORMAT_BC7 || format == COOKED_FORMAT_BC7_SRGB;
+    bool bc1or3 = format == COOKED_FORMAT_BC1 || format == COOKED_FORMAT_BC1_SRGB || format == COOKED_FORMAT_BC3 || format == COOKED_FORMAT_BC3_SRGB;
+    return highQuality ? !bc1or3 : !bc7;
+}
+
+// Cooks one image unless its cooked file is up to date. The cache folder must exist
+bool cookTextureFile(const std::string& source, bool highQuality) {
+    std::string destination = cookedTexturePath(source);
+    CookedTexture existing;
+    if (readCookedTexture(destination, existing) && cookedTextureIsCurrent(source, existing) && cookedFormatMatchesQuality(existing.format, highQuality)) {
+        return true;
+    }
+
+    std::vector<char> contents;
+    CookedTexture cooked;
+    if (!textureSourceHash(source, cooked.sourceSize, cooked.sourceHash, &contents)) {
+        std::cerr << source << ": cannot read" << std::endl;
+        return false;
+    }
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char* texels = stbi_load_from_memory((const stbi_uc*)contents.data(), (int)contents.size(), &width, &height, &channels, 4);
+    if (texels == nullptr) {
+        std::cerr << source << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    cookTexture(texels, width, height, textureRoleFromFilename(source), highQuality, cooked);
+    stbi_image_free(texels);
+
+    if (!writeCookedTexture(destination, cooked)) {
+        std::cerr << destination << ": cannot write" << std::endl;
+        return false;
+    }
+    std::cout << source << ": " << width << "x" << height << ", " << cooked.mips.size() << " mips, format " << cooked.format
+        << ", " << (cooked.sizeInBytes() / 1024) << " KB (RGBA8 without mips " << (((unsigned long long)width * height * 4) / 1024) << " KB)" << std::endl;
+    return true;
+}
+
+bool cookTextures(const std::string& directory, bool highQuality = false) {
+    std::filesystem::create_directories(std::filesystem::path(directory) / COOKED_TEXTURE_DIR);
+    bool ok = true;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+        if (!entry.is_regular_file() || (extension != ".png" && extension != ".jpg" && extension != ".jpeg" && extension != ".tga")) continue;
+        ok = cookTextureFile(entry.path().generic_string(), highQuality) && ok;
+    }
+    return ok;
+}
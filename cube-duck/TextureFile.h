@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <map>
+#include <vector>
+#include <future>
+#include "CookedTexture.h"
+#include "Parallel.h"
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h" // declarations only, Texture.h holds the implementation
+#endif
+
+// A texture file in memory, ready to upload: the cooked texture if there is an up to date
+// one, otherwise the decoded image. No D3D12 in here, reading can run on any thread
+struct TextureFileData {
+    bool loaded = false;
+    bool cooked = false;
+    CookedTexture cookedTexture;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char* texels = nullptr; // as decoded, RGB stays RGB. Expanding it is left to the upload
+
+    void release() {
+        if (texels != nullptr) stbi_image_free(texels);
+        texels = nullptr;
+    }
+};
+
+TextureFileData readTextureFile(const std::string& filename) {
+    TextureFileData data;
+    if (readCookedTexture(cookedTexturePath(filename), data.cookedTexture) && cookedTextureIsCurrent(filename, data.cookedTexture)) {
+        data.cooked = true;
+        data.loaded = true;
+        return data;
+    }
+    data.cookedTexture = CookedTexture();
+    data.texels = stbi_load(filename.c_str(), &data.width, &data.height, &data.channels, 0);
+    data.loaded = data.texels != nullptr;
+    return data;
+}
+
+// Reads textures on the background pool ahead of the objects that need them, so the decodes run in
+// parallel with each other and with whatever the main thread does meanwhile. Texture::load
+// takes a prefetched file if there is one and reads it itself otherwise
+class TexturePrefetch {
+public:
+    static std::map<std::string, std::future<TextureFileData>>& pending() {
+        static std::map<std::string, std::future<TextureFileData>> files;
+        return files;
+    }
+
+    static void prefetch(const std::vector<std::string>& filenames) {
+        for (const std::string& filename : filenames) {
+            if (pending().find(filename) != pending().end()) continue;
+            pending()[filename] = backgroundJobs().async([filename]() {
+                return readTextureFile(filename);
+            });
+        }
+    }
+
+    // waits for the file if it is still being read, false if it was never prefetched
+    static bool take(const std::string& filename, TextureFileData& data) {
+        auto it = pending().find(filename);
+        if (it == pending().end()) return false;
+        data = it->second.get();
+        pending().erase(it);
+        return true;
+    }
+
+    // drops prefetched files nothing took
+    static void clear() {
+        for (auto& file : pending()) {
+            TextureFileData data = file.second.get();
+            data.release();
+        }
+        pending().clear();
+    }
+};
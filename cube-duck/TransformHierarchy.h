@@ -0,0 +1,236 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+#include "Math.h"
+#include "Animation.h"
+
+// Transforms hanging off each other. A node has a local translation, rotation and scale and
+// maybe a parent, its world matrix is the parent's world times its local one. The nodes live in
+// flat arrays sorted by depth, so one pass from the front sees every parent before its children,
+// and the pass starts at the first node that changed. A node whose local and parents did not
+// change is skipped, static scenery costs nothing after its first update.
+// A node can also hang off a socket of an animated model, between its parent and its local
+
+#define TRANSFORM_NO_PARENT -1
+#define TRANSFORM_NO_SLOT -1
+
+typedef int TransformId; // stays the same while the arrays are sorted, reused after remove
+
+struct TransformLocal {
+    Vec3 position;
+    Quaternion rotation;
+    Vec3 scale = Vec3(1.0f, 1.0f, 1.0f);
+
+    // translation, rotation then scale, as the objects composed them by hand
+    Matrix toMatrix() const {
+        Quaternion r = rotation;
+        return (Matrix::setTranslation(position).mul(r.toMatrix())).mul(Matrix::setScaling(scale));
+    }
+
+    // a turn around y in degrees, the same matrix as Matrix::setRotationY
+    static TransformLocal fromRotationY(const Vec3& position, float degrees, const Vec3& scale) {
+        TransformLocal local;
+        local.position = position;
+        float halfRadians = (3.14159f / 180.0f) * degrees * 0.5f;
+        local.rotation = Quaternion(0.0f, sinf(halfRadians), 0.0f, cosf(halfRadians));
+        local.scale = scale;
+        return local;
+    }
+
+    bool operator==(const TransformLocal& other) const {
+        return memcmp(this, &other, sizeof(TransformLocal)) == 0;
+    }
+};
+
+struct TransformSocket {
+    const AnimationInstance* instance = nullptr; // owned by whatever draws the model
+    int socket = -1; // in the instance's Animation::sockets
+};
+
+class TransformHierarchy {
+public:
+    // by slot, parents before children and shallower before deeper
+    std::vector<TransformId> ids;
+    std::vector<int> parents; // slots, TRANSFORM_NO_PARENT for roots
+    std::vector<int> depths;
+    std::vector<TransformLocal> locals;
+    std::vector<TransformSocket> sockets; // no instance when the node does not hang off a socket
+    std::vector<Matrix> worlds;
+    std::vector<uint8_t> dirty; // the local changed since the last update
+    std::vector<uint8_t> removed;
+    std::vector<uint32_t> updatedAt; // the update the world matrix was last computed in
+
+    std::vector<int> slots; // by id, TRANSFORM_NO_SLOT when free
+    std::vector<TransformId> freeIds;
+    std::vector<TransformId> socketIds; // nodes hanging off sockets, their pose moves every update
+    int firstDirty = INT_MAX; // slot the next update starts at
+    bool unsorted = false; // nodes were added or removed since the last update
+    uint32_t updateCount = 0;
+
+    int size() const {
+        return (int)ids.size();
+    }
+
+    // The world matrix of the new node is there after the next update
+    TransformId add(const TransformLocal& local, TransformId parent = TRANSFORM_NO_PARENT) {
+        TransformId id;
+        if (!freeIds.empty()) {
+            id = freeIds.back();
+            freeIds.pop_back();
+        }
+        else {
+            id = (TransformId)slots.size();
+            slots.push_back(TRANSFORM_NO_SLOT);
+        }
+
+        // appending keeps the parent in front, the depth order comes back in the next update
+        int parentSlot = parent == TRANSFORM_NO_PARENT ? TRANSFORM_NO_PARENT : slots[parent];
+        int slot = size();
+        slots[id] = slot;
+        ids.push_back(id);
+        parents.push_back(parentSlot);
+        depths.push_back(parentSlot == TRANSFORM_NO_PARENT ? 0 : depths[parentSlot] + 1);
+        locals.push_back(local);
+        sockets.push_back(TransformSocket());
+        worlds.push_back(Matrix());
+        dirty.push_back(1);
+        removed.push_back(0);
+        updatedAt.push_back(0);
+        firstDirty = min(firstDirty, slot);
+        unsorted = true;
+        return id;
+    }
+
+    // Takes the node and everything hanging off it out in the next update
+    void remove(TransformId id) {
+        if (id < 0 || id >= (TransformId)slots.size() || slots[id] == TRANSFORM_NO_SLOT) return;
+        removed[slots[id]] = 1;
+        unsorted = true;
+    }
+
+    // Only a local that really changed marks the node, an idle enemy stays clean
+    void setLocal(TransformId id, const TransformLocal& local) {
+        int slot = slots[id];
+        if (locals[slot] == local) return;
+        locals[slot] = local;
+        markDirty(slot);
+    }
+
+    const TransformLocal& local(TransformId id) const {
+        return locals[slots[id]];
+    }
+
+    // The node goes between its parent and the socket's matrix, see AnimationInstance::socketMatrix.
+    // The parent is the model's node, the instance has to outlive the node. A socket of -1, as
+    // Animation::findSocket gives for a model without it, detaches the node
+    void attachToSocket(TransformId id, const AnimationInstance* instance, int socket) {
+        int slot = slots[id];
+        bool wasAttached = sockets[slot].instance != nullptr;
+        bool attached = instance != nullptr && socket != -1;
+        sockets[slot].instance = attached ? instance : nullptr;
+        sockets[slot].socket = attached ? socket : -1;
+        if (!wasAttached && attached) socketIds.push_back(id);
+        if (wasAttached && !attached) socketIds.erase(std::remove(socketIds.begin(), socketIds.end(), id), socketIds.end());
+        markDirty(slot);
+    }
+
+    const Matrix& world(TransformId id) const {
+        return worlds[slots[id]];
+    }
+
+    // the world matrix was computed again in the last update
+    bool moved(TransformId id) const {
+        return updatedAt[slots[id]] == updateCount;
+    }
+
+    void markDirty(int slot) {
+        dirty[slot] = 1;
+        firstDirty = min(firstDirty, slot);
+    }
+
+    // World matrices of the nodes that changed and of everything below them, in one pass
+    void update() {
+        if (unsorted) sort();
+        for (TransformId id : socketIds) {
+            markDirty(slots[id]);
+        }
+
+        updateCount++;
+        for (int i = firstDirty; i < size(); i++) {
+            int parent = parents[i];
+            bool parentMoved = parent != TRANSFORM_NO_PARENT && updatedAt[parent] == updateCount;
+            if (!dirty[i] && !parentMoved) continue;
+
+            Matrix local = locals[i].toMatrix();
+            if (sockets[i].instance != nullptr) {
+                local = sockets[i].instance->socketMatrix(sockets[i].socket).mul(local);
+            }
+            worlds[i] = parent == TRANSFORM_NO_PARENT ? local : worlds[parent].mul(local);
+            dirty[i] = 0;
+            updatedAt[i] = updateCount;
+        }
+        firstDirty = INT_MAX;
+    }
+
+    // Drops removed nodes and the ones below them, then sorts by depth. A stable sort keeps
+    // siblings in the order they were added
+    void sort() {
+        std::vector<int> order;
+        order.reserve(size());
+        for (int i = 0; i < size(); i++) {
+            // parents come first, a removed parent already marked its children
+            if (parents[i] != TRANSFORM_NO_PARENT && removed[parents[i]]) removed[i] = 1;
+            if (removed[i]) {
+                slots[ids[i]] = TRANSFORM_NO_SLOT;
+                freeIds.push_back(ids[i]);
+                continue;
+            }
+            order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+            return depths[a] < depths[b];
+        });
+
+        std::vector<int> newSlots(size(), TRANSFORM_NO_SLOT);
+        for (int i = 0; i < (int)order.size(); i++) {
+            newSlots[order[i]] = i;
+        }
+        reorder(ids, order);
+        reorder(depths, order);
+        reorder(locals, order);
+        reorder(sockets, order);
+        reorder(worlds, order);
+        reorder(dirty, order);
+        reorder(updatedAt, order);
+        std::vector<int> oldParents = parents;
+        parents.resize(order.size());
+        for (int i = 0; i < (int)order.size(); i++) {
+            int parent = oldParents[order[i]];
+            parents[i] = parent == TRANSFORM_NO_PARENT ? TRANSFORM_NO_PARENT : newSlots[parent];
+        }
+        removed.assign(order.size(), 0);
+
+        socketIds.clear();
+        firstDirty = INT_MAX;
+        for (int i = 0; i < size(); i++) {
+            slots[ids[i]] = i;
+            if (sockets[i].instance != nullptr) socketIds.push_back(ids[i]);
+            if (dirty[i] && firstDirty == INT_MAX) firstDirty = i;
+        }
+        unsorted = false;
+    }
+
+    template <typename T>
+    static void reorder(std::vector<T>& values, const std::vector<int>& order) {
+        std::vector<T> sorted;
+        sorted.reserve(order.size());
+        for (int from : order) {
+            sorted.push_back(std::move(values[from]));
+        }
+        values.swap(sorted);
+    }
+};
@@ -0,0 +1,353 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <cmath>
+#include <stdint.h>
+#include <string.h>
+#include "GEMLoader.h"
+#include "CookedTexture.h"
+#include "VertexCompression.h"
+
+// Vertex animation textures: every clip of an animated model skinned offline, frame by frame,
+// into a texture the vertex shader reads, so crowds play their animation with no bones on the
+// CPU. No D3D12 in here, the engine bakes a missing file itself and tools/bake-vat.cpp does it
+// on any platform. A baked model sits in a cache folder next to its source:
+//   models/Bull-white.gem -> models/cache/Bull-white.vat
+// and holds, little endian:
+//   header: magic, version, vertex count, texture width and height, rows per frame, clip count,
+//           position bounds (min xyz, max xyz), source size, source hash
+//   per clip: name length and name, first frame, frame count, frames per second
+//   the texels, rows of width RGBA16 unorm, rowsPerFrame rows per frame, the clips one after another
+// A texel is a vertex in one frame: xyz the position inside the bounds, w its normal folded onto
+// an octahedron, 8 bits per axis. The vertices of all the meshes of the model are numbered in order
+
+#define VAT_MAGIC 0x54415643 // "CVAT"
+#define VAT_VERSION 1
+#define VAT_DIR "cache/"
+#define VAT_EXTENSION ".vat"
+#define VAT_FORMAT 11 // DXGI_FORMAT_R16G16B16A16_UNORM
+#define VAT_TEXEL_BYTES 8
+#define VAT_MAX_WIDTH 4096
+#define VAT_MAX_HEIGHT 16384 // D3D12 texture limit
+#define VAT_MAX_CLIPS 64 // what the vertex shader's clip table holds
+
+struct VertexAnimationClip {
+    std::string name;
+    uint32_t firstFrame = 0; // row / rowsPerFrame of its first frame
+    uint32_t frameCount = 0;
+    float framesPerSecond = 0.0f;
+};
+
+struct VertexAnimation {
+    uint32_t numVertices = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t rowsPerFrame = 0;
+    float boundsMin[3] = {};
+    float boundsMax[3] = {};
+    uint64_t sourceSize = 0;
+    uint64_t sourceHash = 0;
+    std::vector<VertexAnimationClip> clips;
+    std::vector<uint16_t> texels; // width * height * 4
+
+    int findClip(const std::string& name) const {
+        for (int i = 0; i < (int)clips.size(); i++) {
+            if (clips[i].name == name) return i;
+        }
+        return -1;
+    }
+
+    // the single mip the runtime uploads, through the path of cooked textures
+    void toCookedTexture(CookedTexture& texture) const {
+        texture.format = VAT_FORMAT;
+        texture.width = width;
+        texture.height = height;
+        texture.mips.resize(1);
+        CookedMip& mip = texture.mips[0];
+        mip.width = width;
+        mip.height = height;
+        mip.rowBytes = width * VAT_TEXEL_BYTES;
+        mip.rows = height;
+        mip.data.resize(texels.size() * sizeof(uint16_t));
+        memcpy(mip.data.data(), texels.data(), mip.data.size());
+    }
+
+    // position and normal of vertex in frame of the baked clip, as the shader decodes them
+    void decode(int clip, int frame, int vertex, float position[3], float normal[3]) const {
+        size_t row = ((size_t)(clips[clip].firstFrame + frame) * rowsPerFrame) + (vertex / width);
+        const uint16_t* texel = &texels[((row * width) + (vertex % width)) * 4];
+        for (int axis = 0; axis < 3; axis++) {
+            position[axis] = boundsMin[axis] + ((texel[axis] / 65535.0f) * (boundsMax[axis] - boundsMin[axis]));
+        }
+        float x = ((texel[3] & 255) / 255.0f * 2.0f) - 1.0f;
+        float y = ((texel[3] >> 8) / 255.0f * 2.0f) - 1.0f;
+        octahedralUnfold(x, y, normal);
+    }
+};
+
+std::string vertexAnimationPath(const std::string& source) {
+    size_t slash = source.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : source.substr(0, slash + 1);
+    std::string name = source.substr(slash == std::string::npos ? 0 : slash + 1);
+    return directory + VAT_DIR + name.substr(0, name.find_last_of('.')) + VAT_EXTENSION;
+}
+
+// Row major with the translation in the last column, as Matrix in Math.h, which the baker
+// cannot include on every platform. A bone's pose is computed the way Animation.h does
+struct VatMatrix {
+    float m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    VatMatrix mul(const VatMatrix& other) const {
+        VatMatrix result;
+        for (int row = 0; row < 4; row++) {
+            for (int column = 0; column < 4; column++) {
+                result.m[(row * 4) + column] = (m[row * 4] * other.m[column]) + (m[(row * 4) + 1] * other.m[4 + column]) +
+                    (m[(row * 4) + 2] * other.m[8 + column]) + (m[(row * 4) + 3] * other.m[12 + column]);
+            }
+        }
+        return result;
+    }
+
+    // translation * rotation * scale of a key, the rotation quaternion normalised as slerp leaves it
+    static VatMatrix fromKey(const GEMLoader::GEMVec3& position, const GEMLoader::GEMQuaternion& rotation, const GEMLoader::GEMVec3& scale) {
+        float length = sqrtf((rotation.q[0] * rotation.q[0]) + (rotation.q[1] * rotation.q[1]) + (rotation.q[2] * rotation.q[2]) + (rotation.q[3] * rotation.q[3]));
+        float a = rotation.q[0] / length, b = rotation.q[1] / length, c = rotation.q[2] / length, d = rotation.q[3] / length;
+        VatMatrix r;
+        r.m[0] = 1 - 2 * ((b * b) + (c * c));
+        r.m[1] = 2 * ((a * b) - (d * c));
+        r.m[2] = 2 * ((a * c) + (d * b));
+        r.m[4] = 2 * ((a * b) + (d * c));
+        r.m[5] = 1 - 2 * ((a * a) + (c * c));
+        r.m[6] = 2 * ((b * c) - (d * a));
+        r.m[8] = 2 * ((a * c) - (d * b));
+        r.m[9] = 2 * ((b * c) + (d * a));
+        r.m[10] = 1 - 2 * ((a * a) + (b * b));
+        VatMatrix t;
+        t.m[3] = position.x;
+        t.m[7] = position.y;
+        t.m[11] = position.z;
+        VatMatrix s;
+        s.m[0] = scale.x;
+        s.m[5] = scale.y;
+        s.m[10] = scale.z;
+        return (t.mul(r)).mul(s);
+    }
+};
+
+// The bone palette of one key frame, what AnimationInstance::update leaves in matrices at that frame
+void vertexAnimationPalette(const GEMLoader::GEMAnimation& animation, const GEMLoader::GEMAnimationFrame& frame, std::vector<VatMatrix>& palette) {
+    VatMatrix globalInverse;
+    memcpy(globalInverse.m, animation.globalInverse.m, sizeof(globalInverse.m));
+    std::vector<VatMatrix> globals(animation.bones.size());
+    palette.resize(animation.bones.size());
+    for (size_t i = 0; i < animation.bones.size(); i++) {
+        VatMatrix local = VatMatrix::fromKey(frame.positions[i], frame.rotations[i], frame.scales[i]);
+        int parent = animation.bones[i].parentIndex;
+        globals[i] = parent > -1 ? globals[parent].mul(local) : local;
+        VatMatrix offset;
+        memcpy(offset.m, animation.bones[i].offset.m, sizeof(offset.m));
+        palette[i] = (globalInverse.mul(globals[i])).mul(offset);
+    }
+}
+
+// The skinned vertex, as the animated vertex shader blends the palette
+void skinVertex(const GEMLoader::GEMAnimatedVertex& vertex, const std::vector<VatMatrix>& palette, float position[3], float normal[3]) {
+    float blended[12] = {};
+    for (int influence = 0; influence < 4; influence++) {
+        float weight = vertex.boneWeights[influence];
+        if (weight == 0.0f) continue;
+        const VatMatrix& bone = palette[vertex.bonesIDs[influence]];
+        for (int e = 0; e < 12; e++) {
+            blended[e] += bone.m[e] * weight;
+        }
+    }
+    const float p[3] = { vertex.position.x, vertex.position.y, vertex.position.z };
+    const float n[3] = { vertex.normal.x, vertex.normal.y, vertex.normal.z };
+    for (int row = 0; row < 3; row++) {
+        position[row] = (blended[row * 4] * p[0]) + (blended[(row * 4) + 1] * p[1]) + (blended[(row * 4) + 2] * p[2]) + blended[(row * 4) + 3];
+        normal[row] = (blended[row * 4] * n[0]) + (blended[(row * 4) + 1] * n[1]) + (blended[(row * 4) + 2] * n[2]);
+    }
+    float length = sqrtf((normal[0] * normal[0]) + (normal[1] * normal[1]) + (normal[2] * normal[2]));
+    for (int axis = 0; axis < 3; axis++) {
+        normal[axis] = length > 0.0f ? normal[axis] / length : (axis == 1 ? 1.0f : 0.0f);
+    }
+}
+
+uint16_t encodeOctahedralNormal(const float normal[3]) {
+    float x, y;
+    octahedralFold(normal, x, y);
+    uint16_t ex = (uint16_t)lroundf(((x * 0.5f) + 0.5f) * 255.0f);
+    uint16_t ey = (uint16_t)lroundf(((y * 0.5f) + 0.5f) * 255.0f);
+    return (uint16_t)(ex | (ey << 8));
+}
+
+// Skins every key frame of every clip of the model. False with error set when the model has
+// no animation or does not fit the texture
+bool bakeVertexAnimation(const std::string& modelFilename, VertexAnimation& baked, std::string& error) {
+    GEMLoader::GEMModelLoader loader;
+    std::vector<GEMLoader::GEMMesh> meshes;
+    GEMLoader::GEMAnimation animation;
+    loader.load(modelFilename, meshes, animation);
+
+    std::vector<const GEMLoader::GEMAnimatedVertex*> vertices;
+    for (const GEMLoader::GEMMesh& mesh : meshes) {
+        for (const GEMLoader::GEMAnimatedVertex& vertex : mesh.verticesAnimated) vertices.push_back(&vertex);
+    }
+    if (vertices.empty() || animation.animations.empty()) {
+        error = modelFilename + " has no animated meshes or clips";
+        return false;
+    }
+    if (animation.animations.size() > VAT_MAX_CLIPS) {
+        error = modelFilename + " has more than " + std::to_string(VAT_MAX_CLIPS) + " clips";
+        return false;
+    }
+
+    baked = VertexAnimation();
+    baked.numVertices = (uint32_t)vertices.size();
+    baked.width = baked.numVertices < VAT_MAX_WIDTH ? baked.numVertices : VAT_MAX_WIDTH;
+    baked.rowsPerFrame = (baked.numVertices + baked.width - 1) / baked.width;
+    uint32_t numFrames = 0;
+    for (const GEMLoader::GEMAnimationSequence& sequence : animation.animations) {
+        VertexAnimationClip clip;
+        clip.name = sequence.name;
+        clip.firstFrame = numFrames;
+        clip.frameCount = (uint32_t)sequence.frames.size();
+        clip.framesPerSecond = sequence.ticksPerSecond;
+        baked.clips.push_back(clip);
+        numFrames += clip.frameCount;
+    }
+    if ((uint64_t)numFrames * baked.rowsPerFrame > VAT_MAX_HEIGHT) {
+        error = modelFilename + ": " + std::to_string(numFrames) + " frames of " + std::to_string(baked.numVertices) + " vertices do not fit a texture";
+        return false;
+    }
+    baked.height = numFrames * baked.rowsPerFrame;
+
+    // skinned once into floats, quantised after the bounds of every frame are known
+    std::vector<float> positions((size_t)numFrames * baked.numVertices * 3);
+    std::vector<uint16_t> normals((size_t)numFrames * baked.numVertices);
+    for (int axis = 0; axis < 3; axis++) {
+        baked.boundsMin[axis] = 1e30f;
+        baked.boundsMax[axis] = -1e30f;
+    }
+    std::vector<VatMatrix> palette;
+    for (size_t c = 0; c < animation.animations.size(); c++) {
+        for (uint32_t f = 0; f < baked.clips[c].frameCount; f++) {
+            vertexAnimationPalette(animation, animation.animations[c].frames[f], palette);
+            size_t frame = baked.clips[c].firstFrame + f;
+            for (uint32_t v = 0; v < baked.numVertices; v++) {
+                float* position = &positions[((frame * baked.numVertices) + v) * 3];
+                float normal[3];
+                skinVertex(*vertices[v], palette, position, normal);
+                normals[(frame * baked.numVertices) + v] = encodeOctahedralNormal(normal);
+                for (int axis = 0; axis < 3; axis++) {
+                    if (position[axis] < baked.boundsMin[axis]) baked.boundsMin[axis] = position[axis];
+                    if (position[axis] > baked.boundsMax[axis]) baked.boundsMax[axis] = position[axis];
+                }
+            }
+        }
+    }
+
+    baked.texels.assign((size_t)baked.width * baked.height * 4, 0);
+    for (size_t frame = 0; frame < numFrames; frame++) {
+        for (uint32_t v = 0; v < baked.numVertices; v++) {
+            size_t row = (frame * baked.rowsPerFrame) + (v / baked.width);
+            uint16_t* texel = &baked.texels[((row * baked.width) + (v % baked.width)) * 4];
+            const float* position = &positions[((frame * baked.numVertices) + v) * 3];
+            for (int axis = 0; axis < 3; axis++) {
+                float extent = baked.boundsMax[axis] - baked.boundsMin[axis];
+                float unit = extent > 0.0f ? (position[axis] - baked.boundsMin[axis]) / extent : 0.0f;
+                texel[axis] = (uint16_t)lroundf(unit * 65535.0f);
+            }
+            texel[3] = normals[(frame * baked.numVertices) + v];
+        }
+    }
+
+    if (!textureSourceHash(modelFilename, baked.sourceSize, baked.sourceHash)) {
+        baked.sourceSize = 0;
+        baked.sourceHash = 0;
+    }
+    return true;
+}
+
+bool writeVertexAnimation(const std::string& filename, const VertexAnimation& baked) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.good()) return false;
+
+    uint32_t header[7] = { VAT_MAGIC, VAT_VERSION, baked.numVertices, baked.width, baked.height, baked.rowsPerFrame, (uint32_t)baked.clips.size() };
+    uint64_t source[2] = { baked.sourceSize, baked.sourceHash };
+    file.write((const char*)header, sizeof(header));
+    file.write((const char*)baked.boundsMin, sizeof(baked.boundsMin));
+    file.write((const char*)baked.boundsMax, sizeof(baked.boundsMax));
+    file.write((const char*)source, sizeof(source));
+    for (const VertexAnimationClip& clip : baked.clips) {
+        uint32_t length = (uint32_t)clip.name.size();
+        file.write((const char*)&length, sizeof(length));
+        file.write(clip.name.data(), length);
+        uint32_t frames[2] = { clip.firstFrame, clip.frameCount };
+        file.write((const char*)frames, sizeof(frames));
+        file.write((const char*)&clip.framesPerSecond, sizeof(clip.framesPerSecond));
+    }
+    file.write((const char*)baked.texels.data(), baked.texels.size() * sizeof(uint16_t));
+    return file.good();
+}
+
+bool readVertexAnimation(const std::string& filename, VertexAnimation& baked) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.good()) return false;
+
+    uint32_t header[7] = {};
+    uint64_t source[2] = {};
+    file.read((char*)header, sizeof(header));
+    file.read((char*)baked.boundsMin, sizeof(baked.boundsMin));
+    file.read((char*)baked.boundsMax, sizeof(baked.boundsMax));
+    file.read((char*)source, sizeof(source));
+    if (!file || header[0] != VAT_MAGIC || header[1] != VAT_VERSION || header[3] > VAT_MAX_WIDTH || header[4] > VAT_MAX_HEIGHT || header[6] > VAT_MAX_CLIPS) return false;
+
+    baked.numVertices = header[2];
+    baked.width = header[3];
+    baked.height = header[4];
+    baked.rowsPerFrame = header[5];
+    baked.sourceSize = source[0];
+    baked.sourceHash = source[1];
+    baked.clips.resize(header[6]);
+    for (VertexAnimationClip& clip : baked.clips) {
+        uint32_t length = 0;
+        file.read((char*)&length, sizeof(length));
+        if (!file || length > 256) return false;
+        clip.name.resize(length);
+        file.read(&clip.name[0], length);
+        uint32_t frames[2] = {};
+        file.read((char*)frames, sizeof(frames));
+        file.read((char*)&clip.framesPerSecond, sizeof(clip.framesPerSecond));
+        clip.firstFrame = frames[0];
+        clip.frameCount = frames[1];
+    }
+    baked.texels.resize((size_t)baked.width * baked.height * 4);
+    file.read((char*)baked.texels.data(), baked.texels.size() * sizeof(uint16_t));
+    return (bool)file;
+}
+
+// false if the model changed since it was baked. A missing model is fine, as for textures
+bool vertexAnimationIsCurrent(const std::string& modelFilename, const VertexAnimation& baked) {
+    std::ifstream file(modelFilename, std::ios::binary | std::ios::ate);
+    if (!file.good()) return true;
+    if ((uint64_t)file.tellg() != baked.sourceSize) return false;
+    file.close();
+
+    uint64_t size = 0;
+    uint64_t hash = 0;
+    return textureSourceHash(modelFilename, size, hash) && hash == baked.sourceHash;
+}
+
+// The baked file of a model, baked and written again when it is missing or out of date
+bool loadVertexAnimation(const std::string& modelFilename, VertexAnimation& baked, std::string& error) {
+    std::string path = vertexAnimationPath(modelFilename);
+    if (readVertexAnimation(path, baked) && vertexAnimationIsCurrent(modelFilename, baked)) return true;
+    if (!bakeVertexAnimation(modelFilename, baked, error)) return false;
+    std::error_code ignored;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ignored);
+    writeVertexAnimation(path, baked); // still usable if the folder is read only
+    return true;
+}
@@ -0,0 +1,216 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// Vertices as the GPU reads them, packed from the float vertices meshes are built with:
+//   position  unorm16 x4, inside the box of the mesh, w is always 1
+//   normal    snorm16 x2, folded onto an octahedron
+//   tangent   snorm16 x2, the same
+//   uv        half x2
+//   bones     uint8 x4 and their weights unorm8 x4, adding up to 255
+// The vertex shaders unfold the normals and take the box from root constants (b2), the input
+// assembler does the rest. A static vertex takes 20 bytes instead of 44, an animated one 28
+// instead of 76. No D3D12 in here, tools/vertex-pack.cpp checks what the packing loses
+
+struct PACKED_STATIC_VERTEX {
+    uint16_t position[4];
+    int16_t normal[2];
+    int16_t tangent[2];
+    uint16_t uv[2];
+};
+
+struct PACKED_ANIMATED_VERTEX {
+    uint16_t position[4];
+    int16_t normal[2];
+    int16_t tangent[2];
+    uint16_t uv[2];
+    uint8_t bonesIDs[4];
+    uint8_t boneWeights[4];
+};
+
+// The box of a mesh's positions, laid out as the shaders read it: min xyz and extent xyz, each
+// padded to a float4
+struct VertexDecode {
+    float positionMin[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float positionExtent[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+
+    // V has pos.x, pos.y and pos.z, as STATIC_VERTEX and ANIMATED_VERTEX
+    template <typename V>
+    void fit(const V* vertices, size_t count) {
+        if (count == 0) return;
+        float low[3] = { vertices[0].pos.x, vertices[0].pos.y, vertices[0].pos.z };
+        float high[3] = { low[0], low[1], low[2] };
+        for (size_t i = 1; i < count; i++) {
+            const float p[3] = { vertices[i].pos.x, vertices[i].pos.y, vertices[i].pos.z };
+            for (int axis = 0; axis < 3; axis++) {
+                low[axis] = fminf(low[axis], p[axis]);
+                high[axis] = fmaxf(high[axis], p[axis]);
+            }
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            positionMin[axis] = low[axis];
+            positionExtent[axis] = high[axis] - low[axis];
+        }
+    }
+
+    uint16_t quantize(float value, int axis) const {
+        if (positionExtent[axis] <= 0.0f) return 0;
+        float unit = (value - positionMin[axis]) / positionExtent[axis];
+        return (uint16_t)lroundf(fminf(fmaxf(unit, 0.0f), 1.0f) * 65535.0f);
+    }
+
+    float dequantize(uint16_t value, int axis) const {
+        return positionMin[axis] + ((value / 65535.0f) * positionExtent[axis]);
+    }
+};
+
+// x and y of a unit vector folded onto the octahedron |x| + |y| + |z| = 1, the lower half
+// folded over the upper one. Both end up in [-1, 1]
+void octahedralFold(const float v[3], float& x, float& y) {
+    float sum = fabsf(v[0]) + fabsf(v[1]) + fabsf(v[2]);
+    if (sum == 0.0f) { // the zero tangents of generated meshes
+        x = 0.0f;
+        y = 0.0f;
+        return;
+    }
+    x = v[0] / sum;
+    y = v[1] / sum;
+    if (v[2] < 0.0f) {
+        float foldX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldX;
+        y = foldY;
+    }
+}
+
+void octahedralUnfold(float x, float y, float v[3]) {
+    v[0] = x;
+    v[1] = y;
+    v[2] = 1.0f - fabsf(x) - fabsf(y);
+    if (v[2] < 0.0f) {
+        v[0] = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        v[1] = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+    float length = sqrtf((v[0] * v[0]) + (v[1] * v[1]) + (v[2] * v[2]));
+    for (int axis = 0; axis < 3; axis++) v[axis] /= length;
+}
+
+void packOctahedral(const float v[3], int16_t packed[2]) {
+    float x, y;
+    octahedralFold(v, x, y);
+    packed[0] = (int16_t)lroundf(x * 32767.0f);
+    packed[1] = (int16_t)lroundf(y * 32767.0f);
+}
+
+// as the input assembler reads snorm16: -32768 is -1 as well
+void unpackOctahedral(const int16_t packed[2], float v[3]) {
+    octahedralUnfold(fmaxf(packed[0] / 32767.0f, -1.0f), fmaxf(packed[1] / 32767.0f, -1.0f), v);
+}
+
+// Round to nearest even. Out of range values become infinity, values too small for a half
+// flush to zero
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    if (magnitude >= 0x7F800000) return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0); // inf, nan
+    if (magnitude >= 0x477FF000) return sign | 0x7C00; // rounds past the largest half
+    if (magnitude < 0x33000001) return sign; // below half the smallest subnormal
+    int exponent = (int)(magnitude >> 23) - 127;
+    uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+    int shift = exponent < -14 ? 13 + (-14 - exponent) : 13; // subnormals lose more bits
+    uint32_t kept = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (kept & 1))) kept++;
+    if (exponent < -14) return sign | (uint16_t)kept; // a carry into the exponent field is still right
+    return sign | (uint16_t)((((exponent + 15) << 10) + (kept - 0x400)));
+}
+
+float halfToFloat(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    int exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent != 0) {
+        bits = sign | ((uint32_t)(exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    else if (mantissa == 0) {
+        bits = sign;
+    }
+    else { // subnormal, normalised for the float
+        exponent = -14;
+        while ((mantissa & 0x400) == 0) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | ((uint32_t)(exponent + 127) << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Weights to 8 bits that still add up to 1: the rounding error goes to the largest weight
+void packBoneWeights(const float weights[4], uint8_t packed[4]) {
+    float sum = weights[0] + weights[1] + weights[2] + weights[3];
+    if (sum <= 0.0f) {
+        packed[0] = 255;
+        packed[1] = packed[2] = packed[3] = 0;
+        return;
+    }
+    int total = 0;
+    int largest = 0;
+    for (int i = 0; i < 4; i++) {
+        packed[i] = (uint8_t)lroundf(fmaxf(weights[i] / sum, 0.0f) * 255.0f);
+        total += packed[i];
+        if (weights[i] > weights[largest]) largest = i;
+    }
+    packed[largest] = (uint8_t)(packed[largest] + (255 - total));
+}
+
+// V as STATIC_VERTEX: pos, normal and tangent with x, y and z, then tu and tv
+template <typename V>
+void packVertexAttributes(const V& vertex, const VertexDecode& decode, uint16_t position[4], int16_t normal[2], int16_t tangent[2], uint16_t uv[2]) {
+    position[0] = decode.quantize(vertex.pos.x, 0);
+    position[1] = decode.quantize(vertex.pos.y, 1);
+    position[2] = decode.quantize(vertex.pos.z, 2);
+    position[3] = 65535;
+    const float n[3] = { vertex.normal.x, vertex.normal.y, vertex.normal.z };
+    const float t[3] = { vertex.tangent.x, vertex.tangent.y, vertex.tangent.z };
+    packOctahedral(n, normal);
+    packOctahedral(t, tangent);
+    uv[0] = floatToHalf(vertex.tu);
+    uv[1] = floatToHalf(vertex.tv);
+}
+
+template <typename V>
+void packStaticVertices(const std::vector<V>& vertices, VertexDecode& decode, std::vector<PACKED_STATIC_VERTEX>& packed) {
+    decode.fit(vertices.data(), vertices.size());
+    packed.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        PACKED_STATIC_VERTEX& out = packed[i];
+        packVertexAttributes(vertices[i], decode, out.position, out.normal, out.tangent, out.uv);
+    }
+}
+
+// V as ANIMATED_VERTEX, the bone indices below 256 as the shaders' palette is
+template <typename V>
+void packAnimatedVertices(const std::vector<V>& vertices, VertexDecode& decode, std::vector<PACKED_ANIMATED_VERTEX>& packed) {
+    decode.fit(vertices.data(), vertices.size());
+    packed.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        PACKED_ANIMATED_VERTEX& out = packed[i];
+        packVertexAttributes(vertices[i], decode, out.position, out.normal, out.tangent, out.uv);
+        for (int j = 0; j < 4; j++) {
+            out.bonesIDs[j] = (uint8_t)(vertices[i].bonesIDs[j] < 256 ? vertices[i].bonesIDs[j] : 0);
+        }
+        packBoneWeights(vertices[i].boneWeights, out.boneWeights);
+    }
+}
@@ -93,7 +93,7 @@ public:
         // 2. Update constant buffer values
         updateConstantsVertexShader(core);
         updateConstantsPixelShader(core);
-        shaderManager->updateTexturePS(core, textureName, texture->heapOffset);
+        shaderManager->updateTexturePS(core, texture->heapOffset);
         
         // 4. Draw
         staticMesh.draw();
@@ -0,0 +1,137 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "Math.h"
+
+// Residency bookkeeping for a world split into square cells on x/z. It only decides what to
+// load and evict, loading and creating GPU objects is left to the caller, so it runs headless
+
+enum CELL_STATE {
+    CELL_UNLOADED,
+    CELL_LOADING,
+    CELL_RESIDENT,
+    CELL_FAILED // not retried
+};
+
+struct StreamingSettings {
+    float loadRadius = 40.0f;
+    float unloadRadius = 56.0f; // bigger than loadRadius so cells on the border do not load and evict every frame
+    unsigned long long memoryBudget = 256ull * 1024 * 1024;
+    int maxLoadsInFlight = 4;
+};
+
+struct StreamingCell {
+    float minX;
+    float minZ;
+    float size;
+    int state = CELL_UNLOADED;
+    unsigned long long cost; // bytes, an estimate until the cell is loaded
+    uint64_t lastUsedFrame = 0;
+};
+
+class ChunkResidency {
+public:
+    StreamingSettings settings;
+    std::vector<StreamingCell> cells;
+    unsigned long long usedBytes = 0; // resident and loading cells
+    int loadsInFlight = 0;
+    uint64_t currentFrame = 0;
+
+    int addCell(float minX, float minZ, float size, unsigned long long estimatedCost) {
+        StreamingCell cell;
+        cell.minX = minX;
+        cell.minZ = minZ;
+        cell.size = size;
+        cell.cost = estimatedCost;
+        cells.push_back(cell);
+        return cells.size() - 1;
+    }
+
+    // distance on x/z from position to the closest point of the cell
+    static float distance(const StreamingCell& cell, const Vec3& position) {
+        float dx = max(cell.minX - position.x, max(0.0f, position.x - (cell.minX + cell.size)));
+        float dz = max(cell.minZ - position.z, max(0.0f, position.z - (cell.minZ + cell.size)));
+        return sqrtf((dx * dx) + (dz * dz));
+    }
+
+    void evict(int index, std::vector<int>& toEvict) {
+        cells[index].state = CELL_UNLOADED;
+        usedBytes -= cells[index].cost;
+        toEvict.push_back(index);
+    }
+
+    // least recently used resident cell that the position does not need, -1 if there is none
+    int findEvictable(const Vec3& position) {
+        int best = -1;
+        for (int i = 0; i < cells.size(); i++) {
+            if (cells[i].state != CELL_RESIDENT || distance(cells[i], position) <= settings.loadRadius) continue;
+            if (best == -1 || cells[i].lastUsedFrame < cells[best].lastUsedFrame) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    // Decides which cells to start loading and which to drop this frame. Cells in
+    // toEvict must be unloaded by the caller, cells in toLoad reported back with onLoaded
+    void update(const Vec3& position, uint64_t frame, std::vector<int>& toLoad, std::vector<int>& toEvict) {
+        currentFrame = frame;
+        std::vector<std::pair<float, int>> wanted;
+
+        for (int i = 0; i < cells.size(); i++) {
+            float d = distance(cells[i], position);
+            if (cells[i].state == CELL_RESIDENT) {
+                if (d <= settings.loadRadius) {
+                    cells[i].lastUsedFrame = frame;
+                }
+                else if (d > settings.unloadRadius) {
+                    evict(i, toEvict);
+                }
+            }
+            else if (cells[i].state == CELL_UNLOADED && d <= settings.loadRadius) {
+                wanted.push_back({d, i});
+            }
+        }
+
+        // the real cost of a cell is only known once loaded, so the budget can be overshot
+        while (usedBytes > settings.memoryBudget) {
+            int victim = findEvictable(position);
+            if (victim == -1) break;
+            evict(victim, toEvict);
+        }
+
+        std::sort(wanted.begin(), wanted.end()); // closest first
+        for (const std::pair<float, int>& candidate : wanted) {
+            if (loadsInFlight >= settings.maxLoadsInFlight) break;
+
+            StreamingCell& cell = cells[candidate.second];
+            while (usedBytes + cell.cost > settings.memoryBudget) {
+                int victim = findEvictable(position);
+                if (victim == -1) break;
+                evict(victim, toEvict);
+            }
+            if (usedBytes + cell.cost > settings.memoryBudget) break; // everything resident is needed
+
+            cell.state = CELL_LOADING;
+            usedBytes += cell.cost;
+            loadsInFlight++;
+            toLoad.push_back(candidate.second);
+        }
+    }
+
+    void onLoaded(int index, unsigned long long actualCost) {
+        StreamingCell& cell = cells[index];
+        usedBytes = usedBytes - cell.cost + actualCost;
+        cell.cost = actualCost;
+        cell.state = CELL_RESIDENT;
+        cell.lastUsedFrame = currentFrame;
+        loadsInFlight--;
+    }
+
+    void onLoadFailed(int index) {
+        usedBytes -= cells[index].cost;
+        cells[index].state = CELL_FAILED;
+        loadsInFlight--;
+    }
+};
@@ -5,6 +5,8 @@
 #include "Camera.h"
 #include "SkyDome.h"
 #include "Level1.h"
+#include "ShaderHotReload.h"
+#include "TextureCooker.h"
 
 void reactToCameraMovement(Window *win, Camera *camera, Duck *duck) {
     float mouseOffsetY = win->lastmousey - win->mousey;
@@ -31,14 +33,23 @@ void reactToCameraMovement(Window *win, Camera *camera, Duck *duck) {
     win->lastmousey = win->mousey;
 }
 
-void mainLoop() {
+// hotReloadShaders: recompile shaders when their files change, for working on them
+void mainLoop(bool hotReloadShaders) {
     Window win;
     win.init(WINDOW_HEIGHT, WINDOW_WIDTH, 0, 0, "My Window");
 
     Core core;
     core.init(win.hwnd, win.windowWidth, win.windowHeight);
+
+    std::vector<std::string> startupTextures = Level1::startupTextures();
+    startupTextures.push_back(SKY_TEXTURE);
+    TextureManager::prefetch(startupTextures);
     
     ShaderManager* shaderManager = new ShaderManager(&core);
+    ShaderHotReload shaderHotReload;
+    if (hotReloadShaders) {
+        shaderHotReload.start(shaderManager, "shaders");
+    }
     Camera camera;
 
     SkyDome sky(shaderManager);
@@ -46,10 +57,14 @@ void mainLoop() {
 
     Level1 level1(&win, shaderManager, &core, &camera);
     level1.init();
+    TexturePrefetch::clear(); // whatever init did not take
 
     GamesEngineeringBase::Timer tim = GamesEngineeringBase::Timer();
 
     while (true) {
+        level1.rebuildDirtyChunks();
+        level1.streamLevel();
+        shaderHotReload.update(&core);
         core.beginFrame();
         win.processMessages();
         if (win.keys[VK_ESCAPE] == 1) {
@@ -70,14 +85,31 @@ void mainLoop() {
     }
 
     core.flushGraphicsQueue();
+    PSOCache::save();
+    GpuMemory::release();
 }
 
 int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nCmdShow) {
-    mainLoop();
+    // post build steps: compile the shaders into the shader cache and cook the textures,
+    // so startup does not have to
+    bool buildShaders = lpCmdLine != nullptr && strstr(lpCmdLine, "--build-shaders") != nullptr;
+    bool cook = lpCmdLine != nullptr && strstr(lpCmdLine, "--cook-textures") != nullptr;
+    if (buildShaders || cook) {
+        bool ok = true;
+        if (buildShaders) ok = buildShaderCache("shaders") && ok;
+        if (cook) ok = cookTextures("models/textures", strstr(lpCmdLine, "--bc7") != nullptr) && ok;
+        return ok ? 0 : 1;
+    }
+#ifdef _DEBUG
+    bool hotReloadShaders = true;
+#else
+    bool hotReloadShaders = lpCmdLine != nullptr && strstr(lpCmdLine, "--hot-reload") != nullptr;
+#endif
+    mainLoop(hotReloadShaders);
     return 0;
 }
 
 // int main() {
-//     mainLoop();
+//     mainLoop(false);
 //     return 0;
 // }
\ No newline at end of file
@@ -1,7 +1,11 @@
-Texture2D tex : register(t0);
-Texture2D normalsTexture : register(t8);
+Texture2D textures[] : register(t0, space1); // the whole SRV heap
 SamplerState samplerLinear : register(s0);
 
+cbuffer TextureIndices : register(b1) { // root constants
+    uint diffuseIndex;
+    uint normalIndex;
+}
+
 cbuffer BRDFLightCB : register(b0) {
     float3 LightDirection;
     float3 LightColor;
@@ -17,7 +21,7 @@ struct PS_INPUT {
 };
 
 float4 PS(PS_INPUT input) : SV_Target0 {
-    float4 colour = tex.Sample(samplerLinear, input.TexCoord);
+    float4 colour = textures[diffuseIndex].Sample(samplerLinear, input.TexCoord);
 
     float3 normal = normalize(input.Normal);
     float3 tangent = normalize(input.Tangent);
@@ -25,8 +29,9 @@ float4 PS(PS_INPUT input) : SV_Target0 {
     float3x3 TBN = float3x3(tangent, binormal, normal);
 
     // Sample and unpack normal map (stays in tangent space)
-    float3 normalMapSample = normalsTexture.Sample(samplerLinear, input.TexCoord).rgb;
-    float3 mapNormal = normalize(normalMapSample * 2.0 - 1.0);
+    // only x and y are read, cooked normal maps are BC5 and have no z
+    float2 normalMapSample = textures[normalIndex].Sample(samplerLinear, input.TexCoord).rg * 2.0 - 1.0;
+    float3 mapNormal = float3(normalMapSample, sqrt(saturate(1.0 - dot(normalMapSample, normalMapSample))));
 
     // Rotate lighting into tangent space using transpose(TBN)
     float3 lightDir = normalize(LightDirection);
@@ -1,6 +1,11 @@
-Texture2D tex : register(t0);
+Texture2D textures[] : register(t0, space1); // the whole SRV heap
 SamplerState samplerLinear : register(s0);
 
+cbuffer TextureIndices : register(b1) { // root constants
+    uint diffuseIndex;
+    uint normalIndex;
+}
+
 struct PS_INPUT {
     float4 Pos : SV_POSITION;
     float3 Normal : NORMAL;
@@ -9,6 +14,6 @@ struct PS_INPUT {
 };
 
 float4 PS(PS_INPUT input) : SV_Target0 {
-    float4 colour = tex.Sample(samplerLinear, input.TexCoord);
+    float4 colour = textures[diffuseIndex].Sample(samplerLinear, input.TexCoord);
     return float4(colour.rgb, 1.0);
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
-Texture2D tex : register(t0);
+Texture2D textures[] : register(t0, space1); // the whole SRV heap
 SamplerState samplerLinear : register(s0);
 
+cbuffer TextureIndices : register(b1) { // root constants
+    uint diffuseIndex;
+    uint normalIndex;
+}
+
 cbuffer BRDFLightCB : register(b0) {
     float3 LightDirection;
     float3 LightColor;
@@ -16,7 +21,7 @@ struct PS_INPUT {
 };
 
 float4 PS(PS_INPUT input) : SV_Target0 {
-    float4 colour = tex.Sample(samplerLinear, input.TexCoord);
+    float4 colour = textures[diffuseIndex].Sample(samplerLinear, input.TexCoord);
     float3 normal = normalize(input.Normal);
 
     float3 albedo = colour.rgb;
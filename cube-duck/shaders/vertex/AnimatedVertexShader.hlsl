@@ -5,10 +5,15 @@ cbuffer animatedMeshBuffer : register(b0) {
     float4x4 bones[256];
 };
 
+cbuffer MeshDecode : register(b2) { // root constants, the box the mesh's positions are packed in
+    float4 positionMin;
+    float4 positionExtent;
+};
+
 struct VS_INPUT {
-    float4 Pos : POSITION;
-    float3 Normal : NORMAL;
-    float3 Tangent : TANGENT;
+    float4 Pos : POSITION; // unorm16 inside the box
+    float2 Normal : NORMAL; // snorm16 folded onto an octahedron
+    float2 Tangent : TANGENT;
     float2 TexCoord : TEXCOORD;
     uint4 BoneIDs : BONEIDS;
     float4 BoneWeights : BONEWEIGHTS;
@@ -21,23 +26,34 @@ struct PS_INPUT {
     float2 TexCoord : TEXCOORD;
 };
 
+float3 decodeOctahedral(float2 folded) {
+    float3 v = float3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(folded.yx)) * (folded >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 PS_INPUT VS(VS_INPUT input) {
     PS_INPUT output;
-    
+    float4 pos = float4(positionMin.xyz + (input.Pos.xyz * positionExtent.xyz), 1.0);
+    float3 normal = decodeOctahedral(input.Normal);
+    float3 tangent = decodeOctahedral(input.Tangent);
+
     float4x4 transform = bones[input.BoneIDs[0]] * input.BoneWeights[0];
     transform += bones[input.BoneIDs[1]] * input.BoneWeights[1];
     transform += bones[input.BoneIDs[2]] * input.BoneWeights[2];
     transform += bones[input.BoneIDs[3]] * input.BoneWeights[3];
 
-    output.Pos = mul(input.Pos, transform);
+    output.Pos = mul(pos, transform);
     output.Pos = mul(output.Pos, W);
     output.Pos = mul(output.Pos, VP);
 
-    output.Normal = mul(input.Normal, (float3x3)transform);
+    output.Normal = mul(normal, (float3x3)transform);
     output.Normal = mul(output.Normal, (float3x3)W);
     output.Normal = normalize(output.Normal);
 
-    output.Tangent = mul(input.Tangent, (float3x3)transform);
+    output.Tangent = mul(tangent, (float3x3)transform);
     output.Tangent = mul(output.Tangent, (float3x3)W);
     output.Tangent = normalize(output.Tangent);
 
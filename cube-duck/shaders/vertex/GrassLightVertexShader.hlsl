@@ -5,10 +5,15 @@ cbuffer staticMeshBuffer {
     float4x4 PLAYER_POS;
 };
 
+cbuffer MeshDecode : register(b2) { // root constants, the box the mesh's positions are packed in
+    float4 positionMin;
+    float4 positionExtent;
+};
+
 struct VS_INPUT {
-    float4 Pos : POSITION;
-    float3 Normal : NORMAL;
-    float3 Tangent : TANGENT;
+    float4 Pos : POSITION; // unorm16 inside the box
+    float2 Normal : NORMAL; // snorm16 folded onto an octahedron
+    float2 Tangent : TANGENT;
     float2 TexCoord : TEXCOORD;
     float4x4 World : WORLD;
 };
@@ -21,10 +26,21 @@ struct PS_INPUT {
     float3 LocalPos  : LOCAL_POS;
 };
 
+float3 decodeOctahedral(float2 folded) {
+    float3 v = float3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(folded.yx)) * (folded >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 PS_INPUT VS(VS_INPUT input) {
     PS_INPUT output;
+    float4 pos = float4(positionMin.xyz + (input.Pos.xyz * positionExtent.xyz), 1.0);
+    float3 normal = decodeOctahedral(input.Normal);
+    float3 tangent = decodeOctahedral(input.Tangent);
 
-    float4 worldPos = mul(input.Pos, input.World);
+    float4 worldPos = mul(pos, input.World);
     float3 playerPos = float3(PLAYER_POS[3][0], PLAYER_POS[3][1], PLAYER_POS[3][2]);
 
     float3 grassToPlayer = worldPos.xyz - playerPos.xyz;
@@ -37,7 +53,7 @@ PS_INPUT VS(VS_INPUT input) {
         float bendFactor = 1.0 - (dist / bendRadius);
         bendFactor = smoothstep(0.0, 1.0, bendFactor);
         
-        float heightFactor = input.Pos.y;
+        float heightFactor = pos.y;
         float3 bendDir = normalize(grassToPlayer);
         
         float displacement = bendFactor * bendStrength * heightFactor;
@@ -45,10 +61,10 @@ PS_INPUT VS(VS_INPUT input) {
     }
 
     output.Pos = mul(worldPos, VP);
-    output.Normal = mul(input.Normal, (float3x3)input.World);
-    output.Tangent = mul(input.Tangent, (float3x3)input.World);
+    output.Normal = mul(normal, (float3x3)input.World);
+    output.Tangent = mul(tangent, (float3x3)input.World);
     output.TexCoord = input.TexCoord;
 
-    output.LocalPos = input.Pos.xyz;
+    output.LocalPos = pos.xyz;
     return output;
 }
\ No newline at end of file
@@ -3,10 +3,15 @@ cbuffer staticMeshBuffer {
     float4x4 VP;
 };
 
+cbuffer MeshDecode : register(b2) { // root constants, the box the mesh's positions are packed in
+    float4 positionMin;
+    float4 positionExtent;
+};
+
 struct VS_INPUT {
-    float4 Pos : POSITION;
-    float3 Normal : NORMAL;
-    float3 Tangent : TANGENT;
+    float4 Pos : POSITION; // unorm16 inside the box
+    float2 Normal : NORMAL; // snorm16 folded onto an octahedron
+    float2 Tangent : TANGENT;
     float2 TexCoord : TEXCOORD;
     float4x4 World : WORLD;
 };
@@ -18,16 +23,27 @@ struct PS_INPUT {
     float3 LocalPos : TEXCOORD2;
 };
 
+float3 decodeOctahedral(float2 folded) {
+    float3 v = float3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(folded.yx)) * (folded >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 PS_INPUT VS(VS_INPUT input) {
     PS_INPUT output;
+    float4 pos = float4(positionMin.xyz + (input.Pos.xyz * positionExtent.xyz), 1.0);
+    float3 normal = decodeOctahedral(input.Normal);
+    float3 tangent = decodeOctahedral(input.Tangent);
 
-    float4 world = mul(input.Pos, input.World);
+    float4 world = mul(pos, input.World);
     output.Pos      = mul(world, VP);
     output.WorldPos = world.xyz;
-    output.LocalPos = input.Pos.xyz;
+    output.LocalPos = pos.xyz;
 
     // normal transform
-    output.Normal = normalize(mul(input.Normal, (float3x3)input.World));
+    output.Normal = normalize(mul(normal, (float3x3)input.World));
 
     return output;
 }
@@ -0,0 +1,67 @@
+Texture2D textures[] : register(t0, space1); // the whole SRV heap, the baked animation is one of them
+
+// VertexAnimation.h bakes the texture: a row block per frame, a texel per vertex with the
+// position inside the bounds in xyz and the normal folded onto an octahedron in w
+cbuffer crowdBuffer : register(b0) {
+    float4x4 VP;
+    float4 boundsMin; // w is the time in seconds
+    float4 boundsExtent;
+    uint4 vat; // texture index, width, rows per frame
+    float4 clips[64]; // first frame, frame count, frames per second
+};
+
+struct VS_INPUT {
+    float2 TexCoord : TEXCOORD;
+    uint Vertex : VAT_VERTEX;
+    float4x4 World : WORLD;
+    uint Clip : CLIP;
+    float2 Playback : PLAYBACK; // seconds into the clip at time 0, and the playback rate
+};
+
+struct PS_INPUT {
+    float4 Pos      : SV_POSITION;
+    float3 Normal   : NORMAL;
+    float3 Tangent  : TANGENT;
+    float2 TexCoord : TEXCOORD;
+};
+
+float3 decodeNormal(float packed) {
+    uint bits = (uint)round(packed * 65535.0);
+    float2 folded = (float2(bits & 255, bits >> 8) / 255.0) * 2.0 - 1.0;
+    float3 normal = float3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+    if (normal.z < 0.0) {
+        normal.xy = (1.0 - abs(folded.yx)) * (folded.xy >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(normal);
+}
+
+float4 fetch(uint vertex, uint frame) {
+    uint row = (frame * vat.z) + (vertex / vat.y);
+    return textures[vat.x].Load(int3(vertex % vat.y, row, 0));
+}
+
+PS_INPUT VS(VS_INPUT input) {
+    PS_INPUT output;
+
+    // the clip loops, the last frame blends back into the first
+    float4 clip = clips[input.Clip];
+    float frames = ((boundsMin.w * input.Playback.y) + input.Playback.x) * clip.z;
+    frames = frames - (floor(frames / clip.y) * clip.y);
+    uint frame = (uint)frames;
+    uint nextFrame = (frame + 1) % (uint)clip.y;
+    float blend = frames - frame;
+
+    float4 texel = fetch(input.Vertex, (uint)clip.x + frame);
+    float4 nextTexel = fetch(input.Vertex, (uint)clip.x + nextFrame);
+    float3 position = boundsMin.xyz + (lerp(texel.xyz, nextTexel.xyz, blend) * boundsExtent.xyz);
+    float3 normal = lerp(decodeNormal(texel.w), decodeNormal(nextTexel.w), blend);
+
+    output.Pos = mul(float4(position, 1.0), input.World);
+    output.Pos = mul(output.Pos, VP);
+
+    output.Normal = normalize(mul(normal, (float3x3)input.World));
+    output.Tangent = float3(0.0, 0.0, 0.0);
+    output.TexCoord = input.TexCoord;
+
+    return output;
+}
@@ -5,10 +5,15 @@ cbuffer staticMeshBuffer {
     float time;
 };
 
+cbuffer MeshDecode : register(b2) { // root constants, the box the mesh's positions are packed in
+    float4 positionMin;
+    float4 positionExtent;
+};
+
 struct VS_INPUT {
-    float4 Pos : POSITION;
-    float3 Normal : NORMAL;
-    float3 Tangent : TANGENT;
+    float4 Pos : POSITION; // unorm16 inside the box
+    float2 Normal : NORMAL; // snorm16 folded onto an octahedron
+    float2 Tangent : TANGENT;
     float2 TexCoord : TEXCOORD;
     float4x4 World : WORLD;
 };
@@ -21,8 +26,20 @@ struct PS_INPUT {
     float3 LocalPos  : LOCAL_POS;
 };
 
+float3 decodeOctahedral(float2 folded) {
+    float3 v = float3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(folded.yx)) * (folded >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 PS_INPUT VS(VS_INPUT input) {
     PS_INPUT output;
+    float4 pos = float4(positionMin.xyz + (input.Pos.xyz * positionExtent.xyz), 1.0);
+    float3 normal = decodeOctahedral(input.Normal);
+    float3 tangent = decodeOctahedral(input.Tangent);
+
     float a1 = 0.1;
     float a2 = 0.15;
 
@@ -32,17 +49,17 @@ PS_INPUT VS(VS_INPUT input) {
     float s1 = 1.0;
     float s2 = 1.5;
 
-    float newY = input.Pos.y + a1 * sin(f1 * input.Pos.x + s1 * time) + a2 * cos(f2 * input.Pos.z + s2 * time);
-    input.Pos.y = newY;
+    float newY = pos.y + a1 * sin(f1 * pos.x + s1 * time) + a2 * cos(f2 * pos.z + s2 * time);
+    pos.y = newY;
     
-    output.Pos = mul(input.Pos, input.World);
+    output.Pos = mul(pos, input.World);
     output.Pos = mul(output.Pos, VP);
 
-    output.Normal = mul(input.Normal, (float3x3)input.World);
-    output.Tangent = mul(input.Tangent, (float3x3)input.World);
+    output.Normal = mul(normal, (float3x3)input.World);
+    output.Tangent = mul(tangent, (float3x3)input.World);
     output.TexCoord = input.TexCoord;
 
-    output.LocalPos = input.Pos.xyz;
+    output.LocalPos = pos.xyz;
 
     return output;
 }
\ No newline at end of file
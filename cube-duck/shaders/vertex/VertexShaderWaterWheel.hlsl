@@ -5,10 +5,15 @@ cbuffer staticMeshBuffer {
     float time;
 };
 
+cbuffer MeshDecode : register(b2) { // root constants, the box the mesh's positions are packed in
+    float4 positionMin;
+    float4 positionExtent;
+};
+
 struct VS_INPUT {
-    float4 Pos : POSITION;
-    float3 Normal : NORMAL;
-    float3 Tangent : TANGENT;
+    float4 Pos : POSITION; // unorm16 inside the box
+    float2 Normal : NORMAL; // snorm16 folded onto an octahedron
+    float2 Tangent : TANGENT;
     float2 TexCoord : TEXCOORD;
     float4x4 World : WORLD;
 };
@@ -21,9 +26,20 @@ struct PS_INPUT {
     float3 LocalPos  : LOCAL_POS;
 };
 
+float3 decodeOctahedral(float2 folded) {
+    float3 v = float3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(folded.yx)) * (folded >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 PS_INPUT VS(VS_INPUT input) {
     PS_INPUT output;
-    
+    float4 pos = float4(positionMin.xyz + (input.Pos.xyz * positionExtent.xyz), 1.0);
+    float3 normal = decodeOctahedral(input.Normal);
+    float3 tangent = decodeOctahedral(input.Tangent);
+
     float cosT = cos(time);
     float sinT = sin(time);
     float4x4 rotationX = float4x4(
@@ -33,7 +49,7 @@ PS_INPUT VS(VS_INPUT input) {
         0,     0,     0, 1
     );
 
-    float4 centeredPos = float4(input.Pos.xyz - float3(0, 2.0, 0), 1.0);
+    float4 centeredPos = float4(pos.xyz - float3(0, 2.0, 0), 1.0);
     float4 rotatedPos = mul(centeredPos, rotationX);
     rotatedPos = float4(rotatedPos.xyz + float3(0, 2.0, 0), 1.0);
     
@@ -43,9 +59,9 @@ PS_INPUT VS(VS_INPUT input) {
     output.Pos = mul(rotatedPos, input.World);
     output.Pos = mul(output.Pos, VP);
 
-    output.Normal = mul(input.Normal, (float3x3)rotationX);
+    output.Normal = mul(normal, (float3x3)rotationX);
     output.Normal = mul(output.Normal, (float3x3)input.World);
-    output.Tangent = mul(input.Tangent, (float3x3)rotationX);
+    output.Tangent = mul(tangent, (float3x3)rotationX);
     output.Tangent = mul(output.Tangent, (float3x3)input.World);
 
     return output;
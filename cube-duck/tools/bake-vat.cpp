@@ -0,0 +1,86 @@
+// Vertex animation baker as a program of its own. Bakes every clip of the animated models it
+// is given into models/cache/<model>.vat, then reads the file back and checks every texel
+// against the skinned floats it came from. Run it from the cube-duck folder:
+//   g++ -std=c++17 -O2 tools/bake-vat.cpp -o bake-vat
+//   ./bake-vat [models, models/Bull-white.gem by default]
+#include <stdio.h>
+#include <chrono>
+#include "../VertexAnimation.h"
+
+// largest distance between a baked position and its float one, and the largest angle in
+// degrees between the normals
+bool checkBaked(const std::string& modelFilename, const VertexAnimation& baked, float& positionError, float& normalError) {
+    GEMLoader::GEMModelLoader loader;
+    std::vector<GEMLoader::GEMMesh> meshes;
+    GEMLoader::GEMAnimation animation;
+    loader.load(modelFilename, meshes, animation);
+    std::vector<const GEMLoader::GEMAnimatedVertex*> vertices;
+    for (const GEMLoader::GEMMesh& mesh : meshes) {
+        for (const GEMLoader::GEMAnimatedVertex& vertex : mesh.verticesAnimated) vertices.push_back(&vertex);
+    }
+    if (vertices.size() != baked.numVertices || animation.animations.size() != baked.clips.size()) return false;
+
+    positionError = 0.0f;
+    float minDot = 1.0f;
+    std::vector<VatMatrix> palette;
+    for (int c = 0; c < (int)baked.clips.size(); c++) {
+        for (int f = 0; f < (int)baked.clips[c].frameCount; f++) {
+            vertexAnimationPalette(animation, animation.animations[c].frames[f], palette);
+            for (int v = 0; v < (int)baked.numVertices; v++) {
+                float position[3], normal[3], bakedPosition[3], bakedNormal[3];
+                skinVertex(*vertices[v], palette, position, normal);
+                baked.decode(c, f, v, bakedPosition, bakedNormal);
+                float dx = position[0] - bakedPosition[0];
+                float dy = position[1] - bakedPosition[1];
+                float dz = position[2] - bakedPosition[2];
+                positionError = fmaxf(positionError, sqrtf((dx * dx) + (dy * dy) + (dz * dz)));
+                minDot = fminf(minDot, (normal[0] * bakedNormal[0]) + (normal[1] * bakedNormal[1]) + (normal[2] * bakedNormal[2]));
+            }
+        }
+    }
+    normalError = acosf(fmaxf(-1.0f, fminf(1.0f, minDot))) * 57.29578f;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> models;
+    for (int i = 1; i < argc; i++) models.push_back(argv[i]);
+    if (models.empty()) models.push_back("models/Bull-white.gem");
+
+    bool ok = true;
+    for (const std::string& model : models) {
+        VertexAnimation baked;
+        std::string error;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!bakeVertexAnimation(model, baked, error)) {
+            printf("%s\n", error.c_str());
+            ok = false;
+            continue;
+        }
+        double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::string path = vertexAnimationPath(model);
+        std::error_code ignored;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ignored);
+        VertexAnimation loaded;
+        float positionError = 0.0f;
+        float normalError = 0.0f;
+        if (!writeVertexAnimation(path, baked) || !readVertexAnimation(path, loaded) || !checkBaked(model, loaded, positionError, normalError)) {
+            printf("%s: could not write and read back %s\n", model.c_str(), path.c_str());
+            ok = false;
+            continue;
+        }
+
+        uint32_t numFrames = loaded.height / loaded.rowsPerFrame;
+        float extent = fmaxf(loaded.boundsMax[0] - loaded.boundsMin[0], fmaxf(loaded.boundsMax[1] - loaded.boundsMin[1], loaded.boundsMax[2] - loaded.boundsMin[2]));
+        printf("%s: %u vertices, %zu clips, %u frames, %ux%u texels (%.1f KB), baked in %.1f ms\n", model.c_str(), loaded.numVertices,
+            loaded.clips.size(), numFrames, loaded.width, loaded.height, loaded.texels.size() * sizeof(uint16_t) / 1024.0f, bakeMs);
+        printf("    position error %.5f (%.4f%% of the bounds), normal error %.2f degrees\n", positionError, 100.0f * positionError / extent, normalError);
+        for (const VertexAnimationClip& clip : loaded.clips) {
+            printf("    %-24s frames %4u..%-4u at %.0f fps\n", clip.name.c_str(), clip.firstFrame, clip.firstFrame + clip.frameCount - 1, clip.framesPerSecond);
+        }
+        // a quantisation step is extent / 65535, so half of one per axis at most
+        ok = ok && positionError <= extent * 1.5e-5f && normalError < 2.0f;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// Times the player's narrow phase against the static boxes: the per instance loop over world
+// matrices Level1 used to run, against the packed batches of Colliders.h. Checks both block the
+// same axes first. Run it from anywhere:
+//   g++ -std=c++17 -O2 tools/collision-bench.cpp -o collision-bench        (SSE, 2 x 4 boxes)
+//   g++ -std=c++17 -O2 -mavx tools/collision-bench.cpp -o collision-bench  (AVX, 8 boxes)
+//   ./collision-bench [boxes, 20000 by default]
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include "../Colliders.h"
+
+struct BenchVec3 {
+    float x, y, z;
+};
+
+struct BenchMatrix {
+    float m[16];
+};
+
+// Duck::checkBoxCollision and checkCollisionX/Y/Z as they are
+struct BenchDuck {
+    BenchVec3 position;
+    BenchVec3 lastPosition;
+
+    bool checkBoxCollision(BenchVec3 axisPosition, BenchVec3 point, BenchVec3 size) {
+        bool overlapX = std::abs(axisPosition.x - point.x) < (0.5f + size.x / 2);
+        bool overlapY = std::abs(axisPosition.y - point.y) < (1.0f + size.y / 2);
+        bool overlapZ = std::abs(axisPosition.z - point.z) < (0.5f + size.z / 2);
+        return overlapX && overlapY && overlapZ;
+    }
+
+    bool checkCollisionX(BenchMatrix* worldMatrix, BenchVec3 size) {
+        return checkBoxCollision(BenchVec3{ position.x, lastPosition.y, lastPosition.z }, BenchVec3{ worldMatrix->m[3], worldMatrix->m[7], worldMatrix->m[11] }, size);
+    }
+
+    bool checkCollisionY(BenchMatrix* worldMatrix, BenchVec3 size) {
+        return checkBoxCollision(BenchVec3{ lastPosition.x, position.y, lastPosition.z }, BenchVec3{ worldMatrix->m[3], worldMatrix->m[7], worldMatrix->m[11] }, size);
+    }
+
+    bool checkCollisionZ(BenchMatrix* worldMatrix, BenchVec3 size) {
+        return checkBoxCollision(BenchVec3{ lastPosition.x, lastPosition.y, position.z }, BenchVec3{ worldMatrix->m[3], worldMatrix->m[7], worldMatrix->m[11] }, size);
+    }
+};
+
+// the old Level1::checkRigidBodyCollision, with the blocks recorded instead of applied
+ColliderHits loopOverMatrices(BenchDuck duck, const std::vector<BenchMatrix>& worldPositions, BenchVec3 size) {
+    ColliderHits hits;
+    for (BenchMatrix objectWorldMatrix : worldPositions) {
+        if (duck.checkCollisionX(&objectWorldMatrix, size)) {
+            duck.position.x = duck.lastPosition.x;
+            hits.x = 1;
+        }
+        if (duck.checkCollisionY(&objectWorldMatrix, size)) {
+            duck.position.y = duck.lastPosition.y;
+            hits.y = 1;
+        }
+        if (duck.checkCollisionZ(&objectWorldMatrix, size)) {
+            duck.position.z = duck.lastPosition.z;
+            hits.z = 1;
+        }
+    }
+    return hits;
+}
+
+float randomFloat(float low, float high) {
+    return low + ((high - low) * (rand() / (float)RAND_MAX));
+}
+
+int main(int argc, char** argv) {
+    int numBoxes = argc > 1 ? atoi(argv[1]) : 20000;
+    const int numQueries = 2000;
+    const BenchVec3 size = { 2.0f, 2.0f, 2.0f };
+    srand(1);
+
+    // a field of blocks on the 1.95 grid of the level, a few layers deep
+    std::vector<BenchMatrix> worldPositions(numBoxes);
+    StaticColliders colliders;
+    int side = (int)std::sqrt(numBoxes / 4.0f) + 1;
+    for (int i = 0; i < numBoxes; i++) {
+        BenchMatrix& world = worldPositions[i];
+        for (int e = 0; e < 16; e++) world.m[e] = (e % 5 == 0) ? 1.0f : 0.0f;
+        world.m[3] = ((i % side) - (side / 2)) * 1.95f;
+        world.m[7] = ((i / (side * side)) * 1.95f) - 0.15f;
+        world.m[11] = (((i / side) % side) - (side / 2)) * 1.95f;
+        colliders.add(world.m[3], world.m[7], world.m[11], size.x, size.y, size.z);
+    }
+    colliders.pad();
+
+    std::vector<BenchDuck> ducks(numQueries);
+    float extent = side * 1.95f / 2;
+    for (BenchDuck& duck : ducks) {
+        duck.lastPosition = BenchVec3{ randomFloat(-extent, extent), randomFloat(0.0f, 8.0f), randomFloat(-extent, extent) };
+        duck.position = BenchVec3{ duck.lastPosition.x + randomFloat(-0.1f, 0.1f), duck.lastPosition.y + randomFloat(-0.1f, 0.1f), duck.lastPosition.z + randomFloat(-0.1f, 0.1f) };
+    }
+
+    int mismatches = 0;
+    int blocked = 0;
+    for (const BenchDuck& duck : ducks) {
+        ColliderHits loop = loopOverMatrices(duck, worldPositions, size);
+        ColliderHits packed = testColliders(colliders, ColliderQuery{ duck.lastPosition.x, duck.lastPosition.y, duck.lastPosition.z,
+            duck.position.x, duck.position.y, duck.position.z, 0.5f, 1.0f, 0.5f });
+        if ((loop.x != 0) != (packed.x != 0) || (loop.y != 0) != (packed.y != 0) || (loop.z != 0) != (packed.z != 0)) mismatches++;
+        if (loop.x || loop.y || loop.z) blocked++;
+    }
+
+    // full sweeps, the early out would only measure where the first hits are
+    unsigned int sink = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const BenchDuck& duck : ducks) {
+        ColliderHits hits = loopOverMatrices(duck, worldPositions, size);
+        sink += hits.x + hits.y + hits.z;
+    }
+    auto middle = std::chrono::high_resolution_clock::now();
+    for (const BenchDuck& duck : ducks) {
+        ColliderQuery query = { duck.lastPosition.x, duck.lastPosition.y, duck.lastPosition.z, duck.position.x, duck.position.y, duck.position.z, 0.5f, 1.0f, 0.5f };
+        for (int b = 0; b < colliders.batches(); b++) {
+            ColliderHits hits = testColliderBatch(colliders, b * COLLIDERS_BATCH, query);
+            sink += hits.x | hits.y | hits.z;
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double loopNs = std::chrono::duration<double, std::nano>(middle - start).count() / numQueries;
+    double packedNs = std::chrono::duration<double, std::nano>(end - middle).count() / numQueries;
+    printf("%d boxes, %d queries, %d blocked, %d mismatches\n", numBoxes, numQueries, blocked, mismatches);
+    printf("matrix loop  %10.0f ns per query\n", loopNs);
+    printf("packed boxes %10.0f ns per query (%.1fx)\n", packedNs, loopNs / packedNs);
+    return (mismatches == 0 && sink != 0xFFFFFFFF) ? 0 : 1;
+}
@@ -0,0 +1,18 @@
+// Texture cooker as a program of its own, for machines without the engine build. Run it from
+// the cube-duck folder, it does the same as cube-duck.exe --cook-textures:
+//   g++ -std=c++17 -O2 -pthread tools/cook-textures.cpp -o cook-textures
+//   ./cook-textures [--bc7] [directory, models/textures by default]
+#include <string.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#include "../TextureCooker.h"
+
+int main(int argc, char** argv) {
+    bool highQuality = false;
+    std::string directory = "models/textures";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bc7") == 0) highQuality = true;
+        else directory = argv[i];
+    }
+    return cookTextures(directory, highQuality) ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+// Checks DescriptorAllocator.h without a device: free ranges merging with their neighbours,
+// bad frees and leak reporting of the free list, wrapping and fence reclaim of the ring, and a
+// random run of the free list against a slot map. Prints each failed check, exits with 1 if
+// any failed. Run it from anywhere:
+//   g++ -std=c++17 -O2 tools/descriptor-test.cpp -o descriptor-test
+//   ./descriptor-test [random steps, 100000 by default]
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "../DescriptorAllocator.h"
+#include "../Random.h"
+
+int failures = 0;
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+void check(bool condition, const char* text, int line) {
+    if (condition) return;
+    printf("line %d: %s\n", line, text);
+    failures++;
+}
+
+void testCoalescing() {
+    DescriptorFreeList list;
+    list.init(10, 32);
+    int a = list.allocate(4);
+    int b = list.allocate(4);
+    int c = list.allocate(4);
+    CHECK(a == 10 && b == 14 && c == 18);
+    CHECK(list.getStats().freeRanges == 1);
+
+    CHECK(list.free(b));
+    CHECK(list.getStats().freeRanges == 2); // the hole at b and the tail
+    CHECK(list.freeRanges.count(b) == 1 && list.freeRanges[b] == 4);
+
+    CHECK(list.free(a)); // merges with b after it
+    CHECK(list.getStats().freeRanges == 2);
+    CHECK(list.freeRanges.count(a) == 1 && list.freeRanges[a] == 8);
+
+    CHECK(list.free(c)); // merges with a before it and the tail after it
+    DescriptorAllocatorStats stats = list.getStats();
+    CHECK(stats.freeRanges == 1 && stats.largestFreeRange == 32);
+    CHECK(stats.used == 0 && stats.peak == 12);
+
+    // a range freed between two free ones joins both
+    int d = list.allocate(8);
+    int e = list.allocate(8);
+    int f = list.allocate(8);
+    list.free(d);
+    list.free(f);
+    CHECK(list.getStats().freeRanges == 2);
+    list.free(e);
+    CHECK(list.getStats().freeRanges == 1 && list.getStats().largestFreeRange == 32);
+
+    // first fit takes the lowest hole that is big enough
+    int g = list.allocate(2);
+    int h = list.allocate(6);
+    list.allocate(2);
+    list.free(g);
+    list.free(h);
+    CHECK(list.allocate(7) == g);
+}
+
+void testBadFreesAndLeaks() {
+    DescriptorFreeList list;
+    list.init(0, 16);
+    int a = list.allocate(3);
+    int b = list.allocate(1);
+    int c = list.allocate(5);
+    CHECK(list.free(b));
+    CHECK(!list.free(b)); // double free
+    CHECK(!list.free(a + 1)); // inside an allocation, not its start
+    CHECK(!list.free(15)); // never allocated
+    CHECK(list.getStats().badFrees == 3);
+    CHECK(list.getStats().used == 8);
+
+    std::vector<std::pair<int, int>> leaked;
+    list.leaks(leaked);
+    CHECK(leaked.size() == 2);
+    CHECK(leaked.size() == 2 && leaked[0] == std::make_pair(a, 3) && leaked[1] == std::make_pair(c, 5));
+
+    list.free(a);
+    list.free(c);
+    list.leaks(leaked);
+    CHECK(leaked.empty());
+
+    CHECK(list.allocate(17) == -1);
+    CHECK(list.getStats().failed == 1);
+    CHECK(list.allocate(16) == 0);
+    CHECK(list.allocate(1) == -1);
+}
+
+void testRing() {
+    DescriptorRing ring;
+    ring.init(100, 16);
+    CHECK(ring.allocate(6) == 100);
+    ring.endFrame(1);
+    CHECK(ring.allocate(6) == 106);
+    ring.endFrame(2);
+
+    // 4 slots left before the end, a range of 6 skips them and wraps, but frame 1 still holds the front
+    CHECK(ring.allocate(6) == -1);
+    CHECK(ring.getStats().failed == 1);
+
+    ring.reclaim(0); // nothing completed yet
+    CHECK(ring.allocate(6) == -1);
+
+    ring.reclaim(1);
+    CHECK(ring.allocate(6) == 100); // wrapped to the start
+    CHECK(ring.getStats().used == 16); // the skipped end counts until its frame is reclaimed
+    ring.endFrame(3);
+    CHECK(ring.allocate(1) == -1);
+
+    ring.reclaim(3); // frames complete in order, 2 and 3 come back together
+    CHECK(ring.getStats().used == 0);
+    CHECK(ring.frames.empty());
+    CHECK(ring.allocate(10) == 106); // the rest of the ring up to its end
+    CHECK(ring.allocate(17) == -1);
+
+    // many frames of a few slots each keep going around the ring
+    DescriptorRing small;
+    small.init(0, 8);
+    bool ok = true;
+    for (uint64_t frame = 1; frame <= 1000; frame++) {
+        int first = small.allocate(3);
+        if (first == -1 || first + 3 > 8) ok = false;
+        small.endFrame(frame);
+        if (frame >= 2) small.reclaim(frame - 1); // one frame in flight
+    }
+    CHECK(ok);
+    CHECK(small.getStats().peak <= 8);
+}
+
+// random allocations and frees, every live range checked against a map of the slots
+void testRandom(int steps) {
+    const int capacity = 4096;
+    DescriptorFreeList list;
+    list.init(0, capacity);
+    std::vector<int> owner(capacity, -1);
+    std::vector<std::pair<int, int>> live;
+    PCG32 rng(7);
+    bool overlaps = false;
+    bool leaksMatch = true;
+
+    for (int step = 0; step < steps; step++) {
+        if (live.empty() || rng.nextInt(0, 2) != 0) {
+            int count = rng.nextInt(1, 24);
+            int offset = list.allocate(count);
+            if (offset == -1) continue;
+            for (int i = offset; i < offset + count; i++) {
+                if (owner[i] != -1) overlaps = true;
+                owner[i] = offset;
+            }
+            live.push_back({ offset, count });
+        }
+        else {
+            int which = rng.nextInt(0, (int)live.size() - 1);
+            std::pair<int, int> range = live[which];
+            live[which] = live.back();
+            live.pop_back();
+            list.free(range.first);
+            for (int i = range.first; i < range.first + range.second; i++) {
+                owner[i] = -1;
+            }
+        }
+    }
+
+    std::vector<std::pair<int, int>> leaked;
+    list.leaks(leaked);
+    std::sort(live.begin(), live.end());
+    if (leaked != live) leaksMatch = false;
+
+    // free ranges never touch each other, they would have been merged
+    bool merged = true;
+    int freeSlots = 0;
+    for (auto it = list.freeRanges.begin(); it != list.freeRanges.end(); ++it) {
+        auto next = std::next(it);
+        if (next != list.freeRanges.end() && it->first + it->second == next->first) merged = false;
+        freeSlots += it->second;
+    }
+
+    CHECK(!overlaps);
+    CHECK(leaksMatch);
+    CHECK(merged);
+    CHECK(freeSlots + list.getStats().used == capacity);
+    for (const std::pair<int, int>& range : live) {
+        list.free(range.first);
+    }
+    CHECK(list.getStats().freeRanges == 1 && list.getStats().largestFreeRange == capacity);
+    CHECK(list.getStats().badFrees == 0);
+}
+
+int main(int argc, char** argv) {
+    int steps = argc > 1 ? atoi(argv[1]) : 100000;
+    testCoalescing();
+    testBadFreesAndLeaks();
+    testRing();
+    testRandom(steps);
+    printf("%s, %d failed checks\n", failures == 0 ? "ok" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+// Times a gameplay tick (patrol step and the player's overlap test) for many enemies: once as
+// heap objects carrying an enemy's inline state, as Level1 kept them, once as ECS.h entities,
+// on one thread and on a JobPool. Checks both end in the same place first. Run it from anywhere:
+//   g++ -std=c++17 -O2 -pthread tools/entity-bench.cpp -o entity-bench
+//   ./entity-bench [enemies, 20000 by default] [ticks, 100 by default]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "../ECS.h"
+
+// roughly what an Enemy carries besides its patrol: two 256 bone palettes and the
+// constant buffer copy of one
+#define BENCH_ENEMY_STATE (2 * 256 * 64 + 16 * 1024)
+
+struct BenchEnemy {
+    TransformComponent transform;
+    PatrolComponent patrol;
+    ColliderComponent collider;
+    unsigned char state[BENCH_ENEMY_STATE];
+};
+
+float randomFloat(float low, float high) {
+    return low + ((high - low) * (rand() / (float)RAND_MAX));
+}
+
+int main(int argc, char** argv) {
+    int numEnemies = argc > 1 ? atoi(argv[1]) : 20000;
+    int numTicks = argc > 2 ? atoi(argv[2]) : 100;
+    srand(1);
+
+    std::vector<BenchEnemy*> objects(numEnemies);
+    EntityWorld world;
+    EntityWorld pooledWorld;
+    ComponentMask mask = COMPONENT_BIT(COMPONENT_TRANSFORM) | COMPONENT_BIT(COMPONENT_PATROL) | COMPONENT_BIT(COMPONENT_COLLIDER);
+    for (int i = 0; i < numEnemies; i++) {
+        BenchEnemy* enemy = new BenchEnemy();
+        memset(enemy->state, 0, sizeof(enemy->state));
+        enemy->transform.x = randomFloat(-500.0f, 500.0f);
+        enemy->transform.y = randomFloat(0.0f, 10.0f);
+        enemy->transform.z = randomFloat(-500.0f, 500.0f);
+        enemy->patrol.axis = (i & 1) ? PATROL_ALONG_Z : PATROL_ALONG_X;
+        enemy->patrol.position = enemy->patrol.axis == PATROL_ALONG_X ? enemy->transform.x : enemy->transform.z;
+        enemy->patrol.start = enemy->patrol.position;
+        enemy->patrol.end = enemy->patrol.position + randomFloat(-8.0f, 8.0f);
+        enemy->patrol.speed = 0.09f;
+        enemy->patrol.waitFrames = (float)(i % 4); // some step every tick
+        enemy->collider.halfX = enemy->collider.halfY = enemy->collider.halfZ = 1.0f;
+        objects[i] = enemy;
+
+        for (EntityWorld* target : { &world, &pooledWorld }) {
+            Entity entity = target->create(mask);
+            target->get<TransformComponent>(entity) = enemy->transform;
+            target->setPatrol(entity, enemy->patrol);
+            target->get<ColliderComponent>(entity) = enemy->collider;
+        }
+    }
+    ColliderQuery query = { 1000.0f, 1000.0f, 1000.0f, 1000.1f, 1000.0f, 1000.0f, 0.5f, 1.0f, 0.5f }; // away from everything, a full sweep
+
+    JobPool pool;
+    int numThreads = (int)std::thread::hardware_concurrency();
+    pool.start(numThreads > 1 ? numThreads - 1 : 0);
+
+    int hits = 0;
+    std::vector<Entity> turnarounds;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int tick = 0; tick < numTicks; tick++) {
+        for (BenchEnemy* enemy : objects) {
+            if (patrolStep(enemy->patrol)) {
+                enemy->transform.rotationY = fmodf(enemy->transform.rotationY + 180.0f, 360.0f);
+            }
+            (&enemy->transform.x)[enemy->patrol.axis * 2] = enemy->patrol.position;
+        }
+        for (BenchEnemy* enemy : objects) {
+            bool lastX = fabsf(query.lastX - enemy->transform.x) < (query.halfX + enemy->collider.halfX);
+            bool lastY = fabsf(query.lastY - enemy->transform.y) < (query.halfY + enemy->collider.halfY);
+            bool lastZ = fabsf(query.lastZ - enemy->transform.z) < (query.halfZ + enemy->collider.halfZ);
+            bool nextX = fabsf(query.nextX - enemy->transform.x) < (query.halfX + enemy->collider.halfX);
+            bool nextY = fabsf(query.nextY - enemy->transform.y) < (query.halfY + enemy->collider.halfY);
+            bool nextZ = fabsf(query.nextZ - enemy->transform.z) < (query.halfZ + enemy->collider.halfZ);
+            if ((nextX && lastY && lastZ) || (lastX && nextY && lastZ) || (lastX && lastY && nextZ)) {
+                hits++;
+                break;
+            }
+        }
+    }
+    auto objectsEnd = std::chrono::high_resolution_clock::now();
+    for (int tick = 0; tick < numTicks; tick++) {
+        turnarounds.clear();
+        patrolSystem(world, nullptr, &turnarounds);
+        turnAround(world, turnarounds);
+        hits += firstOverlap(world, query).valid();
+    }
+    auto serialEnd = std::chrono::high_resolution_clock::now();
+
+    auto pooledStart = std::chrono::high_resolution_clock::now();
+    for (int tick = 0; tick < numTicks; tick++) {
+        turnarounds.clear();
+        patrolSystem(pooledWorld, &pool, &turnarounds);
+        turnAround(pooledWorld, turnarounds);
+        hits += firstOverlap(pooledWorld, query).valid();
+    }
+    auto pooledEnd = std::chrono::high_resolution_clock::now();
+
+    int mismatches = 0;
+    for (int i = 0; i < numEnemies; i++) {
+        const TransformComponent& entity = world.archetypes[0]->transforms[i];
+        const TransformComponent& pooled = pooledWorld.archetypes[0]->transforms[i];
+        if (entity.x != objects[i]->transform.x || entity.z != objects[i]->transform.z || entity.rotationY != objects[i]->transform.rotationY) mismatches++;
+        if (pooled.x != entity.x || pooled.z != entity.z || pooled.rotationY != entity.rotationY) mismatches++;
+    }
+
+    double objectsMs = std::chrono::duration<double, std::milli>(objectsEnd - start).count() / numTicks;
+    double serialMs = std::chrono::duration<double, std::milli>(serialEnd - objectsEnd).count() / numTicks;
+    double pooledMs = std::chrono::duration<double, std::milli>(pooledEnd - pooledStart).count() / numTicks;
+    printf("%d enemies, %d ticks, %d threads, %d hits, %d mismatches\n", numEnemies, numTicks, pool.numThreads(), hits, mismatches);
+    printf("heap objects    %8.3f ms per tick\n", objectsMs);
+    printf("entities        %8.3f ms per tick (%.1fx)\n", serialMs, objectsMs / serialMs);
+    printf("entities, pool  %8.3f ms per tick (%.1fx)\n", pooledMs, objectsMs / pooledMs);
+
+    for (BenchEnemy* enemy : objects) {
+        delete enemy;
+    }
+    return mismatches == 0 ? 0 : 1;
+}
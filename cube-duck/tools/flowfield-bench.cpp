@@ -0,0 +1,165 @@
+// Chasing agents on a block terrain with steps and bridges: a search per agent (A*, as each
+// enemy planning its own way) against one flow field shared by all of them, built on the
+// FlowFieldWorker thread while the agents keep walking. Checks the field's distances match A*
+// first. Run it from anywhere:
+//   g++ -std=c++17 -O2 -pthread tools/flowfield-bench.cpp -o flowfield-bench
+//   ./flowfield-bench [agents, 5000 by default] [terrain side in cells, 160 by default]
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <queue>
+#include <thread>
+#include "../ECS.h"
+
+#define BENCH_TICKS 600
+#define BENCH_GOAL_TICKS 10 // the goal moves to the next cell every this many ticks
+#define BENCH_ASTAR_SAMPLE 200
+
+// hills up to 5 blocks high, and every 16th row of cells a bridge 3 blocks over the hills
+struct BenchTerrain {
+    int side;
+
+    int ground(int x, int z) const {
+        return (int)(2.5f + 1.5f * sinf(x * 0.21f) + 1.2f * cosf(z * 0.17f) + 0.6f * sinf((x + z) * 0.5f));
+    }
+
+    bool solid(int x, int y, int z) const {
+        if (y <= ground(x, z)) return true;
+        return (z % 16 == 8) && y == 9 && x > 4 && x < side - 4;
+    }
+};
+
+struct BenchSearch {
+    std::vector<uint32_t> cost;
+    std::vector<uint32_t> stamp;
+    uint32_t generation = 0;
+
+    // steps of the shortest way from start to goal over the moves of the grid, NAV_UNREACHED when there is none
+    uint32_t astar(const NavGrid& grid, int start, int goal) {
+        cost.resize(grid.numNodes());
+        stamp.resize(grid.numNodes(), 0);
+        generation++;
+        typedef std::pair<uint32_t, int> Open; // estimate, node
+        std::priority_queue<Open, std::vector<Open>, std::greater<Open>> open;
+        auto estimate = [&](int node) {
+            return (uint32_t)(abs(grid.cellX(node) - grid.cellX(goal)) + abs(grid.cellZ(node) - grid.cellZ(goal)));
+        };
+        cost[start] = 0;
+        stamp[start] = generation;
+        open.push(Open(estimate(start), start));
+        while (!open.empty()) {
+            Open top = open.top();
+            open.pop();
+            int node = top.second;
+            if (node == goal) return cost[node];
+            if (top.first > cost[node] + estimate(node)) continue; // already reached cheaper
+            for (int d = 0; d < NAV_DIRECTIONS; d++) {
+                int next = grid.moves[(node * NAV_DIRECTIONS) + d];
+                if (next == NAV_NO_NODE) continue;
+                uint32_t nextCost = cost[node] + 1;
+                if (stamp[next] == generation && cost[next] <= nextCost) continue;
+                stamp[next] = generation;
+                cost[next] = nextCost;
+                open.push(Open(nextCost + estimate(next), next));
+            }
+        }
+        return NAV_UNREACHED;
+    }
+};
+
+int main(int argc, char** argv) {
+    int numAgents = argc > 1 ? atoi(argv[1]) : 5000;
+    int side = argc > 2 ? atoi(argv[2]) : 160;
+    srand(1);
+
+    BenchTerrain terrain = { side };
+    NavBounds bounds;
+    bounds.maxX = bounds.maxZ = side - 1;
+    bounds.maxY = 10;
+    NavGrid grid;
+    auto buildStart = std::chrono::high_resolution_clock::now();
+    grid.build(bounds, NavSettings(), 2.0f, [&terrain](int x, int y, int z) { return terrain.solid(x, y, z); });
+    double gridMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+
+    // the goal walks along a row of cells, one cell per BENCH_GOAL_TICKS
+    std::vector<int> goals;
+    for (int x = 8; x < side - 8; x++) {
+        int goal = grid.nodeAt(x * 2.0f, 100.0f, (side / 2) * 2.0f);
+        if (goal != NAV_NO_NODE && (goals.empty() || goals.back() != goal)) goals.push_back(goal);
+    }
+
+    // agents where the first goal can be reached from
+    FlowField field;
+    field.build(grid, goals[0]);
+    std::vector<int> starts;
+    while ((int)starts.size() < numAgents) {
+        int node = (rand() % (grid.sizeX * grid.sizeZ)) * NAV_LAYERS;
+        if (grid.layerCounts[node / NAV_LAYERS] > 0 && field.reaches(node)) starts.push_back(node);
+    }
+
+    // the field's distances are the shortest ways, every next is a move one step closer
+    int mismatches = 0;
+    BenchSearch search;
+    for (int i = 0; i < BENCH_ASTAR_SAMPLE; i++) {
+        if (search.astar(grid, starts[i], goals[0]) != field.distance[starts[i]]) mismatches++;
+    }
+    int reachable = 0;
+    for (int node = 0; node < grid.numNodes(); node++) {
+        if (!field.reaches(node) || node == field.goal) continue;
+        reachable++;
+        int next = field.next[node];
+        bool isMove = false;
+        for (int d = 0; d < NAV_DIRECTIONS; d++) isMove |= grid.moves[(node * NAV_DIRECTIONS) + d] == next;
+        if (!isMove || field.distance[next] + 1 != field.distance[node]) mismatches++;
+    }
+
+    // what replanning costs when the goal changes cell: a search per agent or one field
+    auto searchStart = std::chrono::high_resolution_clock::now();
+    uint32_t sink = 0;
+    for (int i = 0; i < BENCH_ASTAR_SAMPLE; i++) {
+        sink += search.astar(grid, starts[i], goals[1]);
+    }
+    double searchMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - searchStart).count() * numAgents / BENCH_ASTAR_SAMPLE;
+    auto fieldStart = std::chrono::high_resolution_clock::now();
+    for (int i = 1; i <= 10; i++) {
+        field.build(grid, goals[i]);
+    }
+    double fieldMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - fieldStart).count() / 10;
+
+    // the game side: entities stepping along whatever field the worker thread last finished
+    EntityWorld world;
+    for (int node : starts) {
+        Entity entity = world.create(COMPONENT_BIT(COMPONENT_TRANSFORM) | COMPONENT_BIT(COMPONENT_CHASE));
+        TransformComponent& transform = world.get<TransformComponent>(entity);
+        transform.x = grid.worldX(node);
+        transform.y = grid.worldY(node) + 1.0f;
+        transform.z = grid.worldZ(node);
+        world.get<ChaseComponent>(entity).speed = 0.15f;
+    }
+    FlowFieldWorker worker;
+    worker.start(&grid);
+    double stepMs = 0.0;
+    double worstStepMs = 0.0;
+    for (int tick = 0; tick < BENCH_TICKS; tick++) {
+        auto tickStart = std::chrono::high_resolution_clock::now();
+        worker.request(goals[(tick / BENCH_GOAL_TICKS) % goals.size()]);
+        chaseSystem(world, nullptr, grid, worker.latest());
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tickStart).count();
+        stepMs += ms;
+        if (ms > worstStepMs) worstStepMs = ms;
+        std::this_thread::sleep_for(std::chrono::microseconds(500)); // the rest of a frame
+    }
+    worker.reset();
+    int atGoal = 0;
+    int lastGoal = goals[((BENCH_TICKS - 1) / BENCH_GOAL_TICKS) % goals.size()];
+    for (const ChaseComponent& chase : world.archetypes[0]->chases) {
+        atGoal += grid.cellX(chase.node) == grid.cellX(lastGoal) && grid.cellZ(chase.node) == grid.cellZ(lastGoal);
+    }
+
+    printf("%d x %d cells, %d nodes reach the goal, grid built in %.2f ms, %d mismatches\n", side, side, reachable + 1, gridMs, mismatches);
+    printf("goal changes cell: A* per agent %9.2f ms for %d agents\n", searchMs, numAgents);
+    printf("                   one field    %9.2f ms (%.0fx), on the worker thread\n", fieldMs, searchMs / fieldMs);
+    printf("agents stepping    %9.3f ms per tick, worst %.3f ms, %.1f ns per agent\n", stepMs / BENCH_TICKS, worstStepMs, stepMs * 1e6 / ((double)BENCH_TICKS * numAgents));
+    printf("%llu fields built over %d ticks, %d agents at the goal\n", (unsigned long long)worker.builds, BENCH_TICKS, atGoal);
+    return (mismatches == 0 && sink != 0) ? 0 : 1;
+}
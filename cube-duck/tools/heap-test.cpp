@@ -0,0 +1,231 @@
+// Checks GpuHeapAllocator.h without a device: best fit and aligned splits of one heap, free
+// ranges merging with their neighbours, pages growing up to a shared budget, the
+// fragmentation stat, and a random run against a map of the live ranges. Prints each failed
+// check, exits with 1 if any failed. Run it from anywhere:
+//   g++ -std=c++17 -O2 tools/heap-test.cpp -o heap-test
+//   ./heap-test [random steps, 100000 by default]
+#include <stdio.h>
+#include <stdlib.h>
+#include "../GpuHeapAllocator.h"
+#include "../Random.h"
+
+#define KB 1024ull
+#define MB (1024ull * 1024ull)
+
+int failures = 0;
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+void check(bool condition, const char* text, int line) {
+    if (condition) return;
+    printf("line %d: %s\n", line, text);
+    failures++;
+}
+
+// the two free indexes describe the same ranges, and no two free ranges touch
+bool consistent(const HeapRangeAllocator& heap) {
+    if (heap.freeByOffset.size() != heap.freeBySize.size()) return false;
+    for (auto& range : heap.freeBySize) {
+        auto it = heap.freeByOffset.find(range.second);
+        if (it == heap.freeByOffset.end() || it->second != range.first) return false;
+    }
+    for (auto it = heap.freeByOffset.begin(); it != heap.freeByOffset.end(); ++it) {
+        auto next = std::next(it);
+        if (next != heap.freeByOffset.end() && it->first + it->second >= next->first) return false;
+    }
+    return true;
+}
+
+void testSplitsAndCoalescing() {
+    HeapRangeAllocator heap;
+    heap.init(1024);
+    uint64_t a = heap.allocate(100, 1);
+    uint64_t b = heap.allocate(100, 256); // skips to 256, the padding stays free in front
+    CHECK(a == 0 && b == 256);
+    CHECK(heap.freeByOffset.size() == 2);
+    CHECK(heap.freeByOffset.count(100) == 1 && heap.freeByOffset[100] == 156);
+    CHECK(heap.freeByOffset.count(356) == 1 && heap.freeByOffset[356] == 668);
+
+    // best fit takes the small hole in front, not the big range after b
+    uint64_t c = heap.allocate(50, 4);
+    CHECK(c == 100);
+    CHECK(heap.freeByOffset.count(150) == 1 && heap.freeByOffset[150] == 106);
+
+    // the hole at 150 is big enough but aligning to 128 leaves only 62 of it, it goes after b
+    uint64_t d = heap.allocate(100, 128);
+    CHECK(d == 384);
+    CHECK(d % 128 == 0);
+    CHECK(consistent(heap));
+    CHECK(heap.usedBytes() == 350);
+
+    CHECK(!heap.free(101)); // inside an allocation, not its start
+    CHECK(heap.free(c));
+    CHECK(!heap.free(c)); // double free
+    CHECK(heap.freeByOffset.count(100) == 1 && heap.freeByOffset[100] == 156); // merged with the hole after it
+
+    CHECK(heap.free(b)); // joins the hole before it and the padding of d after it
+    CHECK(heap.freeByOffset.count(100) == 1 && heap.freeByOffset[100] == 284);
+    CHECK(heap.free(a));
+    CHECK(heap.free(d));
+    CHECK(heap.freeByOffset.size() == 1 && heap.largestFree() == 1024);
+    CHECK(heap.live.empty() && consistent(heap));
+
+    CHECK(heap.allocate(1025, 1) == GPU_INVALID_OFFSET);
+    CHECK(heap.allocate(1024, 1024) == 0);
+    CHECK(heap.allocate(1, 1) == GPU_INVALID_OFFSET);
+}
+
+void testPagesAndBudget() {
+    GpuMemoryBudget budget;
+    budget.budget = 4 * MB;
+    GpuHeapAllocator buffers;
+    GpuHeapAllocator textures;
+    buffers.init(1 * MB, &budget);
+    textures.init(1 * MB, &budget);
+
+    GpuAllocation a = buffers.allocate(600 * KB, 256);
+    GpuAllocation b = buffers.allocate(600 * KB, 256); // does not fit next to a, a second page
+    CHECK(a.valid() && b.valid());
+    CHECK(a.page == 0 && b.page == 1 && b.offset == 0);
+    GpuAllocation c = buffers.allocate(300 * KB, 256); // back on the first page
+    CHECK(c.page == 0 && c.offset % 256 == 0);
+    CHECK(budget.reserved == 2 * MB);
+
+    // bigger than a page, a page of its own rounded to the heap alignment
+    GpuAllocation big = textures.allocate(1 * MB + 1, 65536);
+    CHECK(big.valid() && big.offset == 0);
+    CHECK(textures.pages.size() == 1 && textures.pages[0].capacity == 1 * MB + 65536);
+    CHECK(budget.reserved == 3 * MB + 65536);
+
+    // both pools draw from the same budget, what is left is less than a page
+    GpuAllocation over = buffers.allocate(900 * KB, 256);
+    CHECK(!over.valid());
+    CHECK(buffers.getStats().failed == 1);
+    CHECK(textures.getStats().failed == 0);
+    CHECK(budget.reserved == 3 * MB + 65536); // a failed allocation reserves nothing
+
+    GpuMemoryStats stats = buffers.getStats();
+    CHECK(stats.pages == 2 && stats.allocations == 3);
+    CHECK(stats.used == 1500 * KB && stats.peak == 1500 * KB);
+    CHECK(stats.reserved == 2 * MB && stats.freeBytes == 2 * MB - 1500 * KB);
+
+    CHECK(buffers.free(b));
+    CHECK(!buffers.free(b));
+    CHECK(!buffers.free(over));
+    GpuAllocation wrongPage = a;
+    wrongPage.page = 7;
+    CHECK(!buffers.free(wrongPage));
+    stats = buffers.getStats();
+    CHECK(stats.used == 900 * KB && stats.peak == 1500 * KB && stats.allocations == 2);
+
+    // pages are kept once created, the freed one takes the next allocation that fits there
+    GpuAllocation again = buffers.allocate(900 * KB, 256);
+    CHECK(again.page == 1);
+    CHECK(budget.reserved == 3 * MB + 65536);
+}
+
+void testFragmentation() {
+    GpuHeapAllocator heap;
+    heap.init(1024, nullptr);
+    CHECK(heap.getStats().fragmentation() == 0.0f); // no pages, nothing free
+
+    GpuAllocation ranges[4];
+    for (int i = 0; i < 4; i++) {
+        ranges[i] = heap.allocate(256, 1);
+    }
+    CHECK(heap.getStats().freeBytes == 0 && heap.getStats().fragmentation() == 0.0f);
+
+    heap.free(ranges[0]);
+    heap.free(ranges[2]);
+    GpuMemoryStats stats = heap.getStats();
+    CHECK(stats.freeBytes == 512 && stats.largestFree == 256);
+    CHECK(stats.fragmentation() == 0.5f); // two holes of the same size
+
+    heap.free(ranges[1]); // the holes merge into one
+    stats = heap.getStats();
+    CHECK(stats.largestFree == 768 && stats.fragmentation() == 0.0f);
+
+    heap.free(ranges[3]);
+    CHECK(heap.getStats().largestFree == 1024 && heap.getStats().used == 0);
+}
+
+// random allocations and frees over a few pages, every live range checked against the others
+void testRandom(int steps) {
+    GpuMemoryBudget budget;
+    budget.budget = 4 * MB;
+    GpuHeapAllocator heap;
+    heap.init(1 * MB, &budget);
+    std::vector<GpuAllocation> live;
+    std::vector<std::map<uint64_t, uint64_t>> owned; // by page, offset -> size
+    PCG32 rng(11);
+    bool overlaps = false;
+    bool misaligned = false;
+    bool outside = false;
+    int failed = 0;
+
+    for (int step = 0; step < steps; step++) {
+        if (live.empty() || rng.nextInt(0, 2) != 0) {
+            uint64_t size = (uint64_t)rng.nextInt(1, 96) * KB - (uint64_t)rng.nextInt(0, 255);
+            uint64_t alignment = 1ull << rng.nextInt(0, 16);
+            GpuAllocation allocation = heap.allocate(size, alignment);
+            if (!allocation.valid()) {
+                failed++;
+                continue;
+            }
+            if (allocation.offset % alignment != 0) misaligned = true;
+            if (allocation.offset + size > heap.pages[allocation.page].capacity) outside = true;
+            if (allocation.page >= (int)owned.size()) owned.resize(allocation.page + 1);
+
+            std::map<uint64_t, uint64_t>& ranges = owned[allocation.page];
+            auto next = ranges.lower_bound(allocation.offset);
+            if (next != ranges.end() && next->first < allocation.offset + size) overlaps = true;
+            if (next != ranges.begin() && std::prev(next)->first + std::prev(next)->second > allocation.offset) overlaps = true;
+            ranges[allocation.offset] = size;
+            live.push_back(allocation);
+        }
+        else {
+            int which = rng.nextInt(0, (int)live.size() - 1);
+            GpuAllocation allocation = live[which];
+            live[which] = live.back();
+            live.pop_back();
+            heap.free(allocation);
+            owned[allocation.page].erase(allocation.offset);
+        }
+    }
+
+    uint64_t liveBytes = 0;
+    for (const GpuAllocation& allocation : live) liveBytes += allocation.size;
+    bool indexes = true;
+    for (const HeapRangeAllocator& page : heap.pages) {
+        if (!consistent(page)) indexes = false;
+    }
+
+    CHECK(!overlaps);
+    CHECK(!misaligned);
+    CHECK(!outside);
+    CHECK(indexes);
+    CHECK(heap.getStats().used == liveBytes);
+    CHECK(heap.getStats().failed == failed);
+    CHECK(heap.getStats().allocations == (int)live.size());
+    CHECK(budget.reserved <= budget.budget);
+
+    for (const GpuAllocation& allocation : live) {
+        heap.free(allocation);
+    }
+    bool empty = true;
+    for (const HeapRangeAllocator& page : heap.pages) {
+        if (page.freeByOffset.size() != 1 || page.largestFree() != page.capacity) empty = false;
+    }
+    CHECK(empty);
+    CHECK(heap.getStats().used == 0 && heap.getStats().largestFree == 1 * MB); // pages stay, each one free as a whole
+}
+
+int main(int argc, char** argv) {
+    int steps = argc > 1 ? atoi(argv[1]) : 100000;
+    testSplitsAndCoalescing();
+    testPagesAndBudget();
+    testFragmentation();
+    testRandom(steps);
+    printf("%s, %d failed checks\n", failures == 0 ? "ok" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
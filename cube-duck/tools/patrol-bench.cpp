@@ -0,0 +1,80 @@
+// Stress test of the patrol step: many agents stepped one by one with patrolStep, as the
+// branchy Enemy::move did, and in lanes with stepPatrols. Checks both leave every agent in the
+// same place with the same turnarounds, then times them. Run it from anywhere:
+//   g++ -std=c++17 -O2 tools/patrol-bench.cpp -o patrol-bench        (SSE, 4 lanes)
+//   g++ -std=c++17 -O2 -mavx tools/patrol-bench.cpp -o patrol-bench  (AVX, 8 lanes)
+//   ./patrol-bench [agents, 10000 by default] [ticks, 1000 by default]
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "../Patrol.h"
+
+float randomFloat(float low, float high) {
+    return low + ((high - low) * (rand() / (float)RAND_MAX));
+}
+
+int main(int argc, char** argv) {
+    int numAgents = argc > 1 ? atoi(argv[1]) : 10000;
+    int numTicks = argc > 2 ? atoi(argv[2]) : 1000;
+    srand(1);
+
+    std::vector<PatrolComponent> agents(numAgents);
+    PatrolColumns columns;
+    for (int i = 0; i < numAgents; i++) {
+        PatrolComponent& agent = agents[i];
+        agent.axis = (i & 1) ? PATROL_ALONG_Z : PATROL_ALONG_X;
+        agent.position = randomFloat(-100.0f, 100.0f);
+        agent.start = agent.position;
+        agent.end = agent.position + randomFloat(-8.0f, 8.0f);
+        agent.speed = randomFloat(0.02f, 0.2f);
+        agent.waitFrames = (float)(rand() % 4);
+        if (i % 97 == 0) agent.end = agent.position; // already there, never moves
+        columns.push(agent);
+    }
+
+    // same results first
+    std::vector<PatrolComponent> reference = agents;
+    PatrolColumns lanes = columns;
+    long long referenceTurns = 0;
+    long long laneTurns = 0;
+    int mismatches = 0;
+    for (int tick = 0; tick < numTicks; tick++) {
+        stepPatrols(lanes, 0, numAgents);
+        for (int i = 0; i < numAgents; i++) {
+            bool turned = patrolStep(reference[i]);
+            referenceTurns += turned;
+            laneTurns += lanes.hasTurned(i);
+            if (turned != lanes.hasTurned(i)) mismatches++;
+        }
+    }
+    for (int i = 0; i < numAgents; i++) {
+        PatrolComponent agent = lanes.read(i);
+        if (agent.position != reference[i].position || agent.start != reference[i].start || agent.end != reference[i].end || agent.frame != reference[i].frame) mismatches++;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    long long sink = 0;
+    for (int tick = 0; tick < numTicks; tick++) {
+        for (PatrolComponent& agent : agents) {
+            sink += patrolStep(agent);
+        }
+    }
+    auto middle = std::chrono::high_resolution_clock::now();
+    for (int tick = 0; tick < numTicks; tick++) {
+        stepPatrols(columns, 0, numAgents);
+        sink += columns.turned[0];
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double scalarNs = std::chrono::duration<double, std::nano>(middle - start).count() / ((double)numTicks * numAgents);
+    double lanesNs = std::chrono::duration<double, std::nano>(end - middle).count() / ((double)numTicks * numAgents);
+#if defined(PATROL_LANES)
+    int numLanes = PATROL_LANES;
+#else
+    int numLanes = 1;
+#endif
+    printf("%d agents, %d ticks, %d lanes, %lld turnarounds (%lld in lanes), %d mismatches\n", numAgents, numTicks, numLanes, referenceTurns, laneTurns, mismatches);
+    printf("one by one %6.2f ns per agent step\n", scalarNs);
+    printf("in lanes   %6.2f ns per agent step (%.1fx)\n", lanesNs, scalarNs / lanesNs);
+    return (mismatches == 0 && referenceTurns == laneTurns && sink != -1) ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+// Packs the vertices of every model as Mesh and AnimatedMesh upload them, then unpacks them as
+// the vertex shaders do and reports what was lost and what was saved. Run it from the cube-duck
+// folder:
+//   g++ -std=c++17 -O2 tools/vertex-pack.cpp -o vertex-pack
+//   ./vertex-pack [directory, models by default]
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <filesystem>
+#include <algorithm>
+#include "../GEMLoader.h"
+#include "../VertexCompression.h"
+
+// the float vertices of Mesh.h and AnimatedMesh.h, without Math.h
+struct PackVec3 {
+    float x, y, z;
+};
+
+struct PackStaticVertex {
+    PackVec3 pos;
+    PackVec3 normal;
+    PackVec3 tangent;
+    float tu;
+    float tv;
+};
+
+struct PackAnimatedVertex {
+    PackVec3 pos;
+    PackVec3 normal;
+    PackVec3 tangent;
+    float tu;
+    float tv;
+    unsigned int bonesIDs[4];
+    float boneWeights[4];
+};
+
+struct PackErrors {
+    float position = 0.0f; // world units
+    float positionOfBox = 0.0f; // as a fraction of the largest side of the box
+    float normalDegrees = 0.0f;
+    float tangentDegrees = 0.0f;
+    float uv = 0.0f;
+    float weight = 0.0f;
+    int wrongBones = 0;
+
+    void merge(const PackErrors& other) {
+        position = fmaxf(position, other.position);
+        positionOfBox = fmaxf(positionOfBox, other.positionOfBox);
+        normalDegrees = fmaxf(normalDegrees, other.normalDegrees);
+        tangentDegrees = fmaxf(tangentDegrees, other.tangentDegrees);
+        uv = fmaxf(uv, other.uv);
+        weight = fmaxf(weight, other.weight);
+        wrongBones += other.wrongBones;
+    }
+};
+
+float angleDegrees(const PackVec3& a, const float b[3]) {
+    float length = sqrtf((a.x * a.x) + (a.y * a.y) + (a.z * a.z));
+    if (length == 0.0f) return 0.0f; // a zero tangent has no direction to keep
+    float cosine = ((a.x * b[0]) + (a.y * b[1]) + (a.z * b[2])) / length;
+    return acosf(fmaxf(-1.0f, fminf(1.0f, cosine))) * 57.29578f;
+}
+
+template <typename V, typename P>
+void checkAttributes(const V& vertex, const P& packed, const VertexDecode& decode, PackErrors& errors) {
+    const float p[3] = { vertex.pos.x, vertex.pos.y, vertex.pos.z };
+    float largest = fmaxf(decode.positionExtent[0], fmaxf(decode.positionExtent[1], decode.positionExtent[2]));
+    for (int axis = 0; axis < 3; axis++) {
+        float error = fabsf(decode.dequantize(packed.position[axis], axis) - p[axis]);
+        errors.position = fmaxf(errors.position, error);
+        if (largest > 0.0f) errors.positionOfBox = fmaxf(errors.positionOfBox, error / largest);
+    }
+    float normal[3], tangent[3];
+    unpackOctahedral(packed.normal, normal);
+    unpackOctahedral(packed.tangent, tangent);
+    errors.normalDegrees = fmaxf(errors.normalDegrees, angleDegrees(vertex.normal, normal));
+    errors.tangentDegrees = fmaxf(errors.tangentDegrees, angleDegrees(vertex.tangent, tangent));
+    errors.uv = fmaxf(errors.uv, fmaxf(fabsf(halfToFloat(packed.uv[0]) - vertex.tu), fabsf(halfToFloat(packed.uv[1]) - vertex.tv)));
+}
+
+int main(int argc, char** argv) {
+    std::string directory = argc > 1 ? argv[1] : "models";
+    std::vector<std::string> models;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() == ".gem") models.push_back(entry.path().string());
+    }
+    std::sort(models.begin(), models.end());
+
+    unsigned long long staticBytes = 0, packedStaticBytes = 0, animatedBytes = 0, packedAnimatedBytes = 0;
+    PackErrors staticErrors, animatedErrors;
+    for (const std::string& model : models) {
+        GEMLoader::GEMModelLoader loader;
+        std::vector<GEMLoader::GEMMesh> meshes;
+        GEMLoader::GEMAnimation animation;
+        loader.load(model, meshes, animation);
+
+        PackErrors errors;
+        unsigned long long before = 0, after = 0;
+        for (const GEMLoader::GEMMesh& mesh : meshes) {
+            VertexDecode decode;
+            if (!mesh.verticesAnimated.empty()) {
+                std::vector<PackAnimatedVertex> vertices(mesh.verticesAnimated.size());
+                memcpy(vertices.data(), mesh.verticesAnimated.data(), vertices.size() * sizeof(PackAnimatedVertex));
+                std::vector<PACKED_ANIMATED_VERTEX> packed;
+                packAnimatedVertices(vertices, decode, packed);
+                for (size_t i = 0; i < vertices.size(); i++) {
+                    checkAttributes(vertices[i], packed[i], decode, errors);
+                    float sum = vertices[i].boneWeights[0] + vertices[i].boneWeights[1] + vertices[i].boneWeights[2] + vertices[i].boneWeights[3];
+                    for (int j = 0; j < 4; j++) {
+                        float weight = sum > 0.0f ? vertices[i].boneWeights[j] / sum : 0.0f;
+                        errors.weight = fmaxf(errors.weight, fabsf((packed[i].boneWeights[j] / 255.0f) - weight));
+                        if (weight > 0.0f && packed[i].bonesIDs[j] != vertices[i].bonesIDs[j]) errors.wrongBones++;
+                    }
+                }
+                before += vertices.size() * sizeof(PackAnimatedVertex);
+                after += packed.size() * sizeof(PACKED_ANIMATED_VERTEX);
+            }
+            else {
+                std::vector<PackStaticVertex> vertices(mesh.verticesStatic.size());
+                memcpy(vertices.data(), mesh.verticesStatic.data(), vertices.size() * sizeof(PackStaticVertex));
+                std::vector<PACKED_STATIC_VERTEX> packed;
+                packStaticVertices(vertices, decode, packed);
+                for (size_t i = 0; i < vertices.size(); i++) {
+                    checkAttributes(vertices[i], packed[i], decode, errors);
+                }
+                before += vertices.size() * sizeof(PackStaticVertex);
+                after += packed.size() * sizeof(PACKED_STATIC_VERTEX);
+            }
+        }
+        bool animated = !meshes.empty() && !meshes[0].verticesAnimated.empty();
+        printf("%-28s %-8s %8.1f KB -> %7.1f KB   position %.5f (%.6f of the box)  normal %.3f  tangent %.3f degrees  uv %.5f\n",
+            model.c_str(), animated ? "animated" : "static", before / 1024.0, after / 1024.0, errors.position, errors.positionOfBox, errors.normalDegrees, errors.tangentDegrees, errors.uv);
+        (animated ? animatedErrors : staticErrors).merge(errors);
+        (animated ? animatedBytes : staticBytes) += before;
+        (animated ? packedAnimatedBytes : packedStaticBytes) += after;
+    }
+
+    printf("static   %zu -> %zu bytes a vertex, %.1f KB -> %.1f KB (%.2fx)\n", sizeof(PackStaticVertex), sizeof(PACKED_STATIC_VERTEX),
+        staticBytes / 1024.0, packedStaticBytes / 1024.0, (double)staticBytes / packedStaticBytes);
+    printf("animated %zu -> %zu bytes a vertex, %.1f KB -> %.1f KB (%.2fx), weights within %.4f, %d wrong bones\n", sizeof(PackAnimatedVertex), sizeof(PACKED_ANIMATED_VERTEX),
+        animatedBytes / 1024.0, packedAnimatedBytes / 1024.0, (double)animatedBytes / packedAnimatedBytes, animatedErrors.weight, animatedErrors.wrongBones);
+
+    // half a step of the box, with some room for measuring it in floats, a tenth of a degree for
+    // directions. Rounding four weights can leave two steps of 255 on the largest one. Half floats
+    // keep uvs in [0, 1] within half a texel of a 2048 texture, larger tiling uvs lose more
+    PackErrors all = staticErrors;
+    all.merge(animatedErrors);
+    bool ok = all.positionOfBox <= 0.6f / 65535.0f && all.normalDegrees < 0.1f && all.tangentDegrees < 0.1f && all.weight <= 2.0f / 255.0f && all.wrongBones == 0;
+    return ok ? 0 : 1;
+}